@@ -0,0 +1,125 @@
+#include "bench_util.h"
+#include <dukglue/dukglue.h>
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+// Heap startup with 500 classes and 5000 methods: repeating the dukglue_register_* calls for every
+// heap, against applying a BindingSet recorded once, right away or lazily. Timed until a first script
+// (which uses two of the classes) has run.
+
+namespace {
+	const int NUM_CLASSES = 500;
+	const int METHODS_PER_CLASS = 10;
+
+	template<int N>
+	class Widget {
+	public:
+		template<int M>
+		int get() const {
+			return N * METHODS_PER_CLASS + M;
+		}
+	};
+
+	const char* method_names[METHODS_PER_CLASS] = { "m0", "m1", "m2", "m3", "m4", "m5", "m6", "m7", "m8", "m9" };
+
+	// registers the methods of Widget<N> in a heap, or records them in a BindingSet
+	template<int N, int M>
+	struct RegisterMethods {
+		static void run(duk_context* ctx) {
+			RegisterMethods<N, M - 1>::run(ctx);
+			dukglue_register_method(ctx, &Widget<N>::template get<M>, method_names[M]);
+		}
+
+		static void run(dukglue::BindingSet& bindings) {
+			RegisterMethods<N, M - 1>::run(bindings);
+			bindings.register_method(&Widget<N>::template get<M>, method_names[M]);
+		}
+	};
+
+	template<int N>
+	struct RegisterMethods<N, -1> {
+		static void run(duk_context*) {}
+		static void run(dukglue::BindingSet&) {}
+	};
+
+	std::string class_names[NUM_CLASSES];
+
+	// registers Widget<From> .. Widget<To - 1> (split in halves, to keep template recursion shallow)
+	template<int From, int To>
+	struct RegisterClasses {
+		template<typename Target>
+		static void run(Target& target) {
+			RegisterClasses<From, (From + To) / 2>::run(target);
+			RegisterClasses<(From + To) / 2, To>::run(target);
+		}
+	};
+
+	template<int N>
+	struct RegisterClasses<N, N + 1> {
+		static void run(duk_context*& ctx) {
+			dukglue_register_constructor<Widget<N> >(ctx, class_names[N].c_str());
+			RegisterMethods<N, METHODS_PER_CLASS - 1>::run(ctx);
+		}
+
+		static void run(dukglue::BindingSet& bindings) {
+			bindings.register_constructor<Widget<N> >(class_names[N].c_str());
+			RegisterMethods<N, METHODS_PER_CLASS - 1>::run(bindings);
+		}
+	};
+
+	template<typename Setup>
+	void time_startup(const char* name, int heaps, Setup setup, double& ns, long& bytes) {
+		double total_ns = 0;
+		for (int i = 0; i < heaps; i++) {
+			auto start = std::chrono::steady_clock::now();
+			duk_context* ctx = bench_create_counted_heap();
+			setup(ctx);
+			const bool ok = duk_peval_string(ctx, "new Widget499().m9() + new Widget0().m1()") == 0 && duk_get_int(ctx, -1) == 5000;
+			duk_pop(ctx);
+			auto end = std::chrono::steady_clock::now();
+			total_ns += std::chrono::duration<double, std::nano>(end - start).count();
+
+			if (!ok)
+				std::printf("%s: bindings are broken!\n", name);
+
+			bytes = bench_heap_bytes(ctx);
+			bench_destroy_counted_heap(ctx);
+		}
+		ns = total_ns / heaps;
+	}
+}
+
+void bench_binding_set()
+{
+	for (int i = 0; i < NUM_CLASSES; i++)
+		class_names[i] = "Widget" + std::to_string(i);
+
+	const int heaps = 20;
+
+	double register_ns = 0, apply_ns = 0, lazy_ns = 0;
+	long register_bytes = 0, apply_bytes = 0, lazy_bytes = 0;
+
+	time_startup("register", heaps, [](duk_context* ctx) {
+		RegisterClasses<0, NUM_CLASSES>::run(ctx);
+	}, register_ns, register_bytes);
+
+	// recording the set is a one-time cost, outside the timing
+	dukglue::BindingSet bindings;
+	RegisterClasses<0, NUM_CLASSES>::run(bindings);
+
+	time_startup("apply", heaps, [&bindings](duk_context* ctx) {
+		bindings.apply(ctx);
+	}, apply_ns, apply_bytes);
+
+	time_startup("apply_lazy", heaps, [&bindings](duk_context* ctx) {
+		bindings.apply_lazy(ctx);
+	}, lazy_ns, lazy_bytes);
+
+	bench_report("binding set", "heap startup, 500 classes (register)", register_ns);
+	bench_report("binding set", "heap startup, 500 classes (BindingSet)", apply_ns, register_ns);
+	bench_report("binding set", "heap startup, 500 classes (lazy BindingSet)", lazy_ns, register_ns);
+	bench_report_bytes("binding set", "heap size, 500 classes (BindingSet)", static_cast<double>(apply_bytes), static_cast<double>(register_bytes));
+	bench_report_bytes("binding set", "heap size, 500 classes (lazy BindingSet)", static_cast<double>(lazy_bytes), static_cast<double>(register_bytes));
+}
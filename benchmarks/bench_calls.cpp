@@ -0,0 +1,435 @@
+#include "bench_util.h"
+#include <dukglue/dukglue.h>
+
+#include <functional>
+#include <string>
+
+// Per-call cost of methods, free functions and property accessors.
+// Each binding is compared against a hand-written equivalent that looks up its
+// hidden properties with string keys on every call (the way dukglue used to),
+// which shows the saving from interned keys and magic-indexed bindings.
+
+namespace {
+	class Counter {
+	public:
+		Counter() : value_(0) {}
+
+		void add(int v) {
+			value_ += v;
+		}
+
+		int getValue() const {
+			return value_;
+		}
+
+		void setValue(int v) {
+			value_ = v;
+		}
+
+	private:
+		int value_;
+	};
+
+	int addOne(int v) {
+		return v + 1;
+	}
+
+	typedef void (Counter::*AddMethod)(int);
+	typedef int (Counter::*GetMethod)() const;
+	typedef void (Counter::*SetMethod)(int);
+
+	Counter* string_key_this(duk_context* ctx) {
+		duk_push_this(ctx);
+		duk_get_prop_string(ctx, -1, "\xFF" "obj_ptr");
+		Counter* obj = static_cast<Counter*>(duk_require_pointer(ctx, -1));
+		duk_pop_2(ctx);
+		return obj;
+	}
+
+	void* string_key_holder(duk_context* ctx, const char* key) {
+		duk_push_current_function(ctx);
+		duk_get_prop_string(ctx, -1, key);
+		void* holder = duk_require_pointer(ctx, -1);
+		duk_pop_2(ctx);
+		return holder;
+	}
+
+	int string_key_read_int(duk_context* ctx, duk_idx_t idx) {
+		if (!duk_is_number(ctx, idx))
+			duk_error(ctx, DUK_RET_TYPE_ERROR, "Argument %d: expected int", idx);
+		return duk_get_int(ctx, idx);
+	}
+
+	duk_ret_t string_key_add(duk_context* ctx) {
+		Counter* obj = string_key_this(ctx);
+		AddMethod method = *static_cast<AddMethod*>(string_key_holder(ctx, "\xFF" "method_holder"));
+		(obj->*method)(string_key_read_int(ctx, 0));
+		return 0;
+	}
+
+	duk_ret_t string_key_get(duk_context* ctx) {
+		Counter* obj = string_key_this(ctx);
+		GetMethod method = *static_cast<GetMethod*>(string_key_holder(ctx, "\xFF" "method_holder"));
+		duk_push_int(ctx, (obj->*method)());
+		return 1;
+	}
+
+	duk_ret_t string_key_set(duk_context* ctx) {
+		Counter* obj = string_key_this(ctx);
+		SetMethod method = *static_cast<SetMethod*>(string_key_holder(ctx, "\xFF" "method_holder"));
+		(obj->*method)(string_key_read_int(ctx, 0));
+		return 0;
+	}
+
+	duk_ret_t string_key_add_one(duk_context* ctx) {
+		void* fp_void = string_key_holder(ctx, "\xFF" "func_ptr");
+		int(*func)(int) = reinterpret_cast<int(*)(int)>(fp_void);
+		duk_push_int(ctx, func(string_key_read_int(ctx, 0)));
+		return 1;
+	}
+
+	AddMethod add_holder = &Counter::add;
+	GetMethod get_holder = &Counter::getValue;
+	SetMethod set_holder = &Counter::setValue;
+
+	void push_string_key_function(duk_context* ctx, duk_c_function func, duk_idx_t nargs, const char* key, void* holder) {
+		duk_push_c_function(ctx, func, nargs);
+		duk_push_pointer(ctx, holder);
+		duk_put_prop_string(ctx, -2, key);
+	}
+
+	void register_string_key_bindings(duk_context* ctx) {
+		push_string_key_function(ctx, string_key_add_one, 1, "\xFF" "func_ptr", reinterpret_cast<void*>(&addOne));
+		duk_put_global_string(ctx, "stringKeyAddOne");
+
+		dukglue::detail::ProtoManager::push_prototype<Counter>(ctx);
+
+		push_string_key_function(ctx, string_key_add, 1, "\xFF" "method_holder", &add_holder);
+		duk_put_prop_string(ctx, -2, "stringKeyAdd");
+
+		duk_push_string(ctx, "stringKeyValue");
+		push_string_key_function(ctx, string_key_get, 0, "\xFF" "method_holder", &get_holder);
+		push_string_key_function(ctx, string_key_set, 1, "\xFF" "method_holder", &set_holder);
+		duk_def_prop(ctx, -4, DUK_DEFPROP_HAVE_GETTER | DUK_DEFPROP_HAVE_SETTER | DUK_DEFPROP_FORCE);
+
+		duk_pop(ctx);  // pop prototype
+	}
+}
+
+// loop body runs N times, with the benchmark Counter in c
+#define LOOP(body) "var c = counter, n = N, x; for (var i = 0; i < n; i++) { " body " }"
+
+void bench_calls()
+{
+	const long iterations = 2000000;
+
+	duk_context* ctx = duk_create_heap_default();
+
+	dukglue_register_constructor<Counter>(ctx, "Counter");
+	dukglue_register_method(ctx, &Counter::add, "add");
+	dukglue_register_property(ctx, &Counter::getValue, &Counter::setValue, "value");
+	dukglue_register_function(ctx, &addOne, "addOne");
+	register_string_key_bindings(ctx);
+
+	bench_eval(ctx, "counter = new Counter();", 1);
+
+	double loop = bench_eval(ctx, LOOP("x = i;"), iterations);
+	bench_report("calls", "empty loop", loop);
+
+	double string_key = bench_eval(ctx, LOOP("c.stringKeyAdd(1);"), iterations);
+	double bound = bench_eval(ctx, LOOP("c.add(1);"), iterations);
+	bench_report("calls", "method (string keys)", string_key);
+	bench_report("calls", "method (dukglue)", bound, string_key);
+
+	string_key = bench_eval(ctx, LOOP("x = stringKeyAddOne(i);"), iterations);
+	bound = bench_eval(ctx, LOOP("x = addOne(i);"), iterations);
+	bench_report("calls", "function (string keys)", string_key);
+	bench_report("calls", "function (dukglue)", bound, string_key);
+
+	string_key = bench_eval(ctx, LOOP("x = c.stringKeyValue;"), iterations);
+	bound = bench_eval(ctx, LOOP("x = c.value;"), iterations);
+	bench_report("calls", "property get (string keys)", string_key);
+	bench_report("calls", "property get (dukglue)", bound, string_key);
+
+	string_key = bench_eval(ctx, LOOP("c.stringKeyValue = i;"), iterations);
+	bound = bench_eval(ctx, LOOP("c.value = i;"), iterations);
+	bench_report("calls", "property set (string keys)", string_key);
+	bench_report("calls", "property set (dukglue)", bound, string_key);
+
+	duk_destroy_heap(ctx);
+}
+
+// Capturing lambdas against the equivalent free function + global lookup trampoline.
+namespace {
+	Counter* trampoline_counter = nullptr;
+
+	int counterPlus(int v) {
+		return trampoline_counter->getValue() + v;
+	}
+}
+
+void bench_callables()
+{
+	const long iterations = 2000000;
+
+	duk_context* ctx = duk_create_heap_default();
+
+	Counter counter;
+	trampoline_counter = &counter;
+	dukglue_register_function(ctx, &counterPlus, "counterPlus");
+	dukglue_register_function(ctx, [&counter](int v) { return counter.getValue() + v; }, "counterPlusLambda");
+
+	std::function<int(int)> func = [&counter](int v) { return counter.getValue() + v; };
+	dukglue_register_function(ctx, func, "counterPlusStdFunction");
+
+	bench_eval(ctx, "counter = null;", 1);  // not used from script
+
+	double trampoline = bench_eval(ctx, LOOP("x = counterPlus(i);"), iterations);
+	double lambda = bench_eval(ctx, LOOP("x = counterPlusLambda(i);"), iterations);
+	double std_function = bench_eval(ctx, LOOP("x = counterPlusStdFunction(i);"), iterations);
+	bench_report("callables", "trampoline function", trampoline);
+	bench_report("callables", "lambda", lambda, trampoline);
+	bench_report("callables", "std::function", std_function, trampoline);
+
+	duk_destroy_heap(ctx);
+}
+
+// Native overload dispatch against a script shim that picks the overload
+// with arguments.length and typeof, the usual workaround without overloads.
+namespace {
+	int scale(int v) {
+		return v * 2;
+	}
+
+	int scaleBy(int v, int factor) {
+		return v * factor;
+	}
+
+	int scaleString(std::string s) {
+		return static_cast<int>(s.size()) * 2;
+	}
+}
+
+void bench_overloads()
+{
+	const long iterations = 2000000;
+
+	duk_context* ctx = duk_create_heap_default();
+
+	dukglue_register_function(ctx, &scale, "scaleInt");
+	dukglue_register_function(ctx, &scaleBy, "scaleBy");
+	dukglue_register_function(ctx, &scaleString, "scaleString");
+	dukglue_register_function_overloads(ctx, "scale", &scale, &scaleBy, &scaleString);
+
+	bench_eval(ctx, "counter = null;"
+		"scaleShim = function(v, factor) {"
+		"  if (arguments.length >= 2) return scaleBy(v, factor);"
+		"  if (typeof v === 'string') return scaleString(v);"
+		"  return scaleInt(v);"
+		"};", 1);
+
+	double direct = bench_eval(ctx, LOOP("x = scaleInt(i);"), iterations);
+	bench_report("overloads", "direct call", direct);
+
+	double shim = bench_eval(ctx, LOOP("x = scaleShim(i);"), iterations);
+	double native = bench_eval(ctx, LOOP("x = scale(i);"), iterations);
+	bench_report("overloads", "by type (script shim)", shim);
+	bench_report("overloads", "by type (dukglue)", native, shim);
+
+	shim = bench_eval(ctx, LOOP("x = scaleShim(i, 3);"), iterations);
+	native = bench_eval(ctx, LOOP("x = scale(i, 3);"), iterations);
+	bench_report("overloads", "by arity (script shim)", shim);
+	bench_report("overloads", "by arity (dukglue)", native, shim);
+
+	duk_destroy_heap(ctx);
+}
+
+// Registration-time default arguments against a script shim that fills them in.
+void bench_defaults()
+{
+	const long iterations = 2000000;
+
+	duk_context* ctx = duk_create_heap_default();
+
+	dukglue_register_function(ctx, &scaleBy, "scaleBy");
+	dukglue_register_function(ctx, &scaleBy, "scaleDefault", dukglue_defaults(2));
+
+	bench_eval(ctx, "counter = null;"
+		"scaleShim = function(v, factor) {"
+		"  return scaleBy(v, factor === undefined ? 2 : factor);"
+		"};", 1);
+
+	double direct = bench_eval(ctx, LOOP("x = scaleBy(i, 2);"), iterations);
+	double shim = bench_eval(ctx, LOOP("x = scaleShim(i);"), iterations);
+	double native = bench_eval(ctx, LOOP("x = scaleDefault(i);"), iterations);
+	bench_report("defaults", "all arguments passed", direct);
+	bench_report("defaults", "omitted (script shim)", shim);
+	bench_report("defaults", "omitted (dukglue)", native, shim);
+
+	duk_destroy_heap(ctx);
+}
+
+// Trusted bindings (no argument type checks) against checked bindings,
+// for signatures taking several native objects.
+namespace {
+	class Body {
+	public:
+		Body() : mass_(1) {}
+
+		int mass() const {
+			return mass_;
+		}
+
+		int pull(const Body& a, const Body& b, const Body& c) const {
+			return mass_ + a.mass_ + b.mass_ + c.mass_;
+		}
+
+	protected:
+		int mass_;
+	};
+
+	// a few levels of inheritance, so checked reads have to walk the base chain
+	class Planet : public Body {};
+	class Moon : public Planet {};
+	class Asteroid : public Moon {};
+
+	int weigh(const Body* a, const Body* b, int scale) {
+		return (a->mass() + b->mass()) * scale;
+	}
+}
+
+void bench_trusted()
+{
+	const long iterations = 2000000;
+
+	duk_context* ctx = duk_create_heap_default();
+
+	dukglue_register_constructor<Body>(ctx, "Body");
+	dukglue_register_constructor<Asteroid>(ctx, "Asteroid");
+	dukglue_set_base_class<Body, Planet>(ctx);
+	dukglue_set_base_class<Planet, Moon>(ctx);
+	dukglue_set_base_class<Moon, Asteroid>(ctx);
+
+	dukglue_register_method(ctx, &Body::pull, "pull");
+	dukglue_register_function(ctx, &weigh, "weigh");
+
+	dukglue_set_trusted(ctx, true);
+	dukglue_register_method(ctx, &Body::pull, "pullTrusted");
+	dukglue_register_function(ctx, &weigh, "weighTrusted");
+	dukglue_set_trusted(ctx, false);
+
+	bench_eval(ctx, "counter = new Body(); a = new Body(); b = new Asteroid();", 1);
+
+	double checked = bench_eval(ctx, LOOP("x = c.pull(a, b, c);"), iterations);
+	double trusted = bench_eval(ctx, LOOP("x = c.pullTrusted(a, b, c);"), iterations);
+	bench_report("trusted", "3 objects (checked)", checked);
+	bench_report("trusted", "3 objects (trusted)", trusted, checked);
+
+	checked = bench_eval(ctx, LOOP("x = weigh(b, b, i);"), iterations);
+	trusted = bench_eval(ctx, LOOP("x = weighTrusted(b, b, i);"), iterations);
+	bench_report("trusted", "2 derived objects + int (checked)", checked);
+	bench_report("trusted", "2 derived objects + int (trusted)", trusted, checked);
+
+	duk_destroy_heap(ctx);
+}
+
+// Lightfuncs against normal function objects: memory per binding and call cost.
+namespace {
+	template<int N>
+	int offset(int v) {
+		return v + N;
+	}
+
+	// registers offset<Begin>() ... offset<End - 1>() as "offset<N>", as lightfuncs or normal functions
+	template<int Begin, int End>
+	struct RegisterOffsets {
+		static void apply(duk_context* ctx, bool lightfunc) {
+			std::string name = "offset" + std::to_string(Begin);
+			if (lightfunc)
+				dukglue_register_lightfunc(ctx, &offset<Begin>, name.c_str());
+			else
+				dukglue_register_function(ctx, &offset<Begin>, name.c_str());
+			RegisterOffsets<Begin + 1, End>::apply(ctx, lightfunc);
+		}
+	};
+
+	template<int End>
+	struct RegisterOffsets<End, End> {
+		static void apply(duk_context*, bool) {}
+	};
+}
+
+void bench_lightfunc()
+{
+	const long iterations = 2000000;
+	const int bindings = 200;
+
+	double bytes[2];
+	for (int lightfunc = 0; lightfunc < 2; lightfunc++) {
+		duk_context* ctx = bench_create_counted_heap();
+		dukglue_register_function(ctx, &addOne, "addOne");  // create dukglue's heap state up front
+
+		long before = bench_heap_bytes(ctx);
+		RegisterOffsets<0, bindings>::apply(ctx, lightfunc != 0);
+		bytes[lightfunc] = static_cast<double>(bench_heap_bytes(ctx) - before) / bindings;
+
+		bench_destroy_counted_heap(ctx);
+	}
+	bench_report_bytes("lightfunc", "heap bytes per function (object)", bytes[0], bytes[0]);
+	bench_report_bytes("lightfunc", "heap bytes per function (lightfunc)", bytes[1], bytes[0]);
+
+	duk_context* ctx = duk_create_heap_default();
+
+	dukglue_register_function(ctx, &addOne, "addOne");
+	dukglue_register_lightfunc(ctx, &addOne, "addOneLight");
+	bench_eval(ctx, "counter = null;", 1);
+
+	double object = bench_eval(ctx, LOOP("x = addOne(i);"), iterations);
+	double light = bench_eval(ctx, LOOP("x = addOneLight(i);"), iterations);
+	bench_report("lightfunc", "call (object)", object);
+	bench_report("lightfunc", "call (lightfunc)", light, object);
+
+	duk_destroy_heap(ctx);
+}
+
+#ifdef DUKGLUE_HAS_CPP17
+// Compile-time (template<auto>) bindings against the same bindings registered at run time.
+void bench_compiletime()
+{
+	const long iterations = 2000000;
+
+	duk_context* ctx = duk_create_heap_default();
+
+	dukglue_register_constructor<Counter>(ctx, "Counter");
+	dukglue_register_method(ctx, &Counter::add, "add");
+	dukglue_register_method<&Counter::add>(ctx, "addCompiletime");
+	dukglue_register_property(ctx, &Counter::getValue, &Counter::setValue, "value");
+	dukglue_register_property<&Counter::getValue, &Counter::setValue>(ctx, "valueCompiletime");
+	dukglue_register_function(ctx, &addOne, "addOne");
+	dukglue_register_function<&addOne>(ctx, "addOneCompiletime");
+
+	bench_eval(ctx, "counter = new Counter();", 1);
+
+	double runtime = bench_eval(ctx, LOOP("c.add(1);"), iterations);
+	double compiletime = bench_eval(ctx, LOOP("c.addCompiletime(1);"), iterations);
+	bench_report("compiletime", "method (MethodRuntime)", runtime);
+	bench_report("compiletime", "method (MethodCompiletime)", compiletime, runtime);
+
+	runtime = bench_eval(ctx, LOOP("x = addOne(i);"), iterations);
+	compiletime = bench_eval(ctx, LOOP("x = addOneCompiletime(i);"), iterations);
+	bench_report("compiletime", "function (FuncRuntime)", runtime);
+	bench_report("compiletime", "function (FuncCompiletime)", compiletime, runtime);
+
+	runtime = bench_eval(ctx, LOOP("x = c.value;"), iterations);
+	compiletime = bench_eval(ctx, LOOP("x = c.valueCompiletime;"), iterations);
+	bench_report("compiletime", "property get (runtime)", runtime);
+	bench_report("compiletime", "property get (compile time)", compiletime, runtime);
+
+	runtime = bench_eval(ctx, LOOP("c.value = i;"), iterations);
+	compiletime = bench_eval(ctx, LOOP("c.valueCompiletime = i;"), iterations);
+	bench_report("compiletime", "property set (runtime)", runtime);
+	bench_report("compiletime", "property set (compile time)", compiletime, runtime);
+
+	duk_destroy_heap(ctx);
+}
+#endif
@@ -0,0 +1,108 @@
+#include "bench_util.h"
+#include <dukglue/dukglue.h>
+
+#include <chrono>
+#include <cstdio>
+
+// Duktape's memory functions: the system malloc (duk_create_heap_default) against dukglue_create_heap
+// with size-class pools, and with pools plus an arena, on the kinds of script work the other benchmarks do.
+
+namespace {
+	class Point {
+	public:
+		Point(double x, double y) : x_(x), y_(y) {}
+
+		double x() const {
+			return x_;
+		}
+
+	private:
+		double x_, y_;
+	};
+
+	enum HeapKind {
+		SYSTEM_MALLOC,
+		POOLS,
+		POOLS_AND_ARENA,
+		NUM_HEAP_KINDS
+	};
+
+	const char* heap_kind_names[NUM_HEAP_KINDS] = { "malloc", "pools", "pools + arena" };
+
+	duk_context* create_heap(HeapKind kind) {
+		if (kind == SYSTEM_MALLOC)
+			return duk_create_heap_default();
+
+		DukglueHeapOptions options;
+		options.size_class_pools = true;
+		options.arena = (kind == POOLS_AND_ARENA);
+		return dukglue_create_heap(options);
+	}
+
+	struct Workload {
+		const char* name;
+		const char* code;
+		long iterations;
+	};
+
+	const Workload workloads[] = {
+		{ "method calls", "var p = new Point(1, 2), x = 0; for (var i = 0; i < N; i++) x += p.x();", 2000000 },
+		{ "managed objects", "var x = 0; for (var i = 0; i < N; i++) x += new Point(i, 1).x();", 1000000 },
+		{ "object literals", "var o; for (var i = 0; i < N; i++) o = { a: i, b: i + 1 };", 1000000 },
+		{ "string concat", "var s; for (var i = 0; i < N; i++) s = 'item' + i;", 1000000 },
+		{ "array growth", "var a; for (var i = 0; i < N; i++) { a = []; for (var j = 0; j < 100; j++) a.push(j); }", 20000 },
+		{ "JSON round trip", "var t = { a: [1, 2, 3], b: 'text', c: { d: true } }; for (var i = 0; i < N; i++) t = JSON.parse(JSON.stringify(t));", 200000 },
+	};
+}
+
+void bench_heap()
+{
+	for (const Workload& workload : workloads) {
+		double reference = 0;
+		for (int kind = 0; kind < NUM_HEAP_KINDS; kind++) {
+			duk_context* ctx = create_heap(static_cast<HeapKind>(kind));
+			dukglue_register_constructor_managed<Point, double, double>(ctx, "Point");
+			dukglue_register_method(ctx, &Point::x, "x");
+
+			double ns = bench_eval(ctx, workload.code, workload.iterations);
+
+			char name[64];
+			std::snprintf(name, sizeof(name), "%s (%s)", workload.name, heap_kind_names[kind]);
+			if (kind == SYSTEM_MALLOC) {
+				reference = ns;
+				bench_report("heap", name, ns);
+			}
+			else {
+				bench_report("heap", name, ns, reference);
+			}
+
+			dukglue_destroy_heap(ctx);
+		}
+	}
+
+	// tearing down a heap holding 200k objects
+	double reference = 0;
+	for (int kind = 0; kind < NUM_HEAP_KINDS; kind++) {
+		duk_context* ctx = create_heap(static_cast<HeapKind>(kind));
+		duk_peval_string_noresult(ctx, "var keep = []; for (var i = 0; i < 200000; i++) keep.push({ v: i, s: 'k' + i });");
+
+		const dukglue::detail::HeapAllocStats stats = dukglue_get_heap_alloc_stats(ctx);
+
+		auto start = std::chrono::steady_clock::now();
+		dukglue_destroy_heap(ctx);
+		auto end = std::chrono::steady_clock::now();
+		double ns = std::chrono::duration<double, std::nano>(end - start).count() / 200000;
+
+		char name[64];
+		std::snprintf(name, sizeof(name), "destroy, per object (%s)", heap_kind_names[kind]);
+		if (kind == SYSTEM_MALLOC) {
+			reference = ns;
+			bench_report("heap", name, ns);
+		}
+		else {
+			bench_report("heap", name, ns, reference);
+			std::printf("%-12s %-40s %9.1f MB (%.1f MB reserved)\n", "heap", "  peak Duktape bytes",
+				stats.peak_bytes / 1048576.0, stats.reserved / 1048576.0);
+		}
+	}
+}
@@ -0,0 +1,173 @@
+#include "bench_util.h"
+#include <dukglue/dukglue.h>
+
+#include <chrono>
+#include <cstdio>
+#include <typeindex>
+
+// Passing objects of deep class hierarchies as base class arguments: TypeInfo's flattened ancestor sets
+// against walking the base class chain (what TypeInfo did before), and calls through a base class
+// at another address than the object (multiple inheritance) against calls through the first one.
+
+namespace {
+	// Level<N> derives from Level<N - 1>
+	template<int N>
+	struct Level;
+
+	template<>
+	struct Level<0> {
+		int value;
+		Level() : value(1) {}
+		virtual ~Level() {}
+
+		int get() const {
+			return value;
+		}
+	};
+
+	template<int N>
+	struct Level : Level<N - 1> {};
+
+	template<int N>
+	struct SetBases {
+		static void run(duk_context* ctx) {
+			SetBases<N - 1>::run(ctx);
+			dukglue_set_base_class<Level<N - 1>, Level<N> >(ctx);
+		}
+	};
+
+	template<>
+	struct SetBases<0> {
+		static void run(duk_context*) {}
+	};
+
+	Level<0> flat;
+	Level<16> deep;
+
+	Level<0>* getFlat() {
+		return &flat;
+	}
+
+	Level<16>* getDeep() {
+		return &deep;
+	}
+
+	int readLevel(Level<0>* obj) {
+		return obj->value;
+	}
+
+	// the old TypeInfo: a linked list of base classes, compared with typeid level by level
+	struct ChainedTypeInfo {
+		std::type_index index;
+		const ChainedTypeInfo* base;
+
+		template<typename T>
+		bool can_cast() const {
+			for (const ChainedTypeInfo* info = this; info != nullptr; info = info->base) {
+				if (info->index == typeid(T))
+					return true;
+			}
+			return false;
+		}
+	};
+
+	template<int N>
+	struct Chain {
+		static const ChainedTypeInfo* get() {
+			static const ChainedTypeInfo info = { typeid(Level<N>), Chain<N - 1>::get() };
+			return &info;
+		}
+	};
+
+	template<>
+	struct Chain<-1> {
+		static const ChainedTypeInfo* get() {
+			return nullptr;
+		}
+	};
+
+	template<typename Info>
+	double can_cast_ns(const Info* info, long iterations) {
+		volatile long hits = 0;
+		auto start = std::chrono::steady_clock::now();
+		for (long i = 0; i < iterations; i++)
+			hits = hits + info->template can_cast<Level<0> >();
+		auto end = std::chrono::steady_clock::now();
+		return std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+	}
+
+	class First {
+	public:
+		virtual ~First() {}
+
+		int first() const {
+			return 1;
+		}
+
+	private:
+		double data_[2];
+	};
+
+	class Second {
+	public:
+		virtual ~Second() {}
+
+		int second() const {
+			return 2;
+		}
+	};
+
+	class Both : public First, public Second {};
+}
+
+void bench_inheritance()
+{
+	// the type check alone
+	{
+		const long iterations = 20000000;
+		dukglue::detail::TypeInfo info(dukglue_class_id<Level<16> >());
+		dukglue::detail::TypeInfo base(dukglue_class_id<Level<0> >());
+		info.add_base(&base, dukglue::detail::make_base_cast<Level<0>, Level<16> >());
+
+		double chained = can_cast_ns(Chain<16>::get(), iterations);
+		double flattened = can_cast_ns(&info, iterations);
+		bench_report("inheritance", "can_cast, 16 levels (chain)", chained);
+		bench_report("inheritance", "can_cast, 16 levels (flattened)", flattened, chained);
+	}
+
+	// passing objects as base class arguments from scripts
+	{
+		duk_context* ctx = duk_create_heap_default();
+		SetBases<16>::run(ctx);
+		dukglue_register_function(ctx, &getFlat, "getFlat");
+		dukglue_register_function(ctx, &getDeep, "getDeep");
+		dukglue_register_function(ctx, &readLevel, "readLevel");
+
+		double flat_ns = bench_eval(ctx, "var o = getFlat(), x = 0; for (var i = 0; i < N; i++) x += readLevel(o);", 2000000);
+		double deep_ns = bench_eval(ctx, "var o = getDeep(), x = 0; for (var i = 0; i < N; i++) x += readLevel(o);", 2000000);
+		bench_report("inheritance", "base class argument (flat)", flat_ns);
+		bench_report("inheritance", "base class argument (16 levels)", deep_ns, flat_ns);
+		duk_destroy_heap(ctx);
+	}
+
+	// methods of the first and second base class of a class
+	{
+		duk_context* ctx = duk_create_heap_default();
+		dukglue_register_method(ctx, &First::first, "first");
+		dukglue_register_method(ctx, &Second::second, "second");
+		dukglue_set_base_class<First, Both>(ctx);
+		dukglue_set_base_class<Second, Both>(ctx);
+
+		Both both;
+		dukglue_push(ctx, &both);
+		duk_put_global_string(ctx, "both");
+
+		double first_ns = bench_eval(ctx, "var o = both, x = 0; for (var i = 0; i < N; i++) x += o.first();", 2000000);
+		double second_ns = bench_eval(ctx, "var o = both, x = 0; for (var i = 0; i < N; i++) x += o.second();", 2000000);
+		bench_report("inheritance", "method of first base class", first_ns);
+		bench_report("inheritance", "method of second base class", second_ns, first_ns);
+
+		dukglue_invalidate_object(ctx, &both);
+		duk_destroy_heap(ctx);
+	}
+}
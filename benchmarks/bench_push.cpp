@@ -0,0 +1,449 @@
+#include "bench_util.h"
+#include <dukglue/dukglue.h>
+
+#include <chrono>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// Cost of pushing registered native objects and DukValues.
+// Each is compared against a hand-written equivalent that finds its ref map and
+// ref array through the heap stash on every push (the way dukglue used to),
+// which shows the saving from keeping them in the per-heap state.
+
+namespace {
+	class Widget {
+	public:
+		int id() const {
+			return 1;
+		}
+	};
+
+	Widget widget;
+
+	Widget* getWidget() {
+		return &widget;
+	}
+
+	DukValue identity(DukValue v) {
+		return v;
+	}
+
+	typedef std::unordered_map<void*, duk_uarridx_t> StashRefMap;
+
+	// mirrors the old RefManager::get_ref_map() / push_ref_array()
+	StashRefMap* stash_ref_map(duk_context* ctx) {
+		duk_push_heap_stash(ctx);
+		if (!duk_has_prop_string(ctx, -1, "bench_ref_map"))
+			duk_error(ctx, DUK_ERR_ERROR, "bench_ref_map missing");
+		duk_get_prop_string(ctx, -1, "bench_ref_map");
+		duk_get_prop_string(ctx, -1, "ptr");
+		StashRefMap* map = static_cast<StashRefMap*>(duk_require_pointer(ctx, -1));
+		duk_pop_3(ctx);
+		return map;
+	}
+
+	void stash_push_ref_array(duk_context* ctx) {
+		duk_push_heap_stash(ctx);
+		if (!duk_has_prop_string(ctx, -1, "bench_ref_array"))
+			duk_error(ctx, DUK_ERR_ERROR, "bench_ref_array missing");
+		duk_get_prop_string(ctx, -1, "bench_ref_array");
+		duk_remove(ctx, -2);
+	}
+
+	duk_ret_t stash_get_widget(duk_context* ctx) {
+		StashRefMap* map = stash_ref_map(ctx);
+		auto it = map->find(getWidget());
+		if (it == map->end())
+			duk_error(ctx, DUK_ERR_ERROR, "widget not registered");
+
+		stash_push_ref_array(ctx);
+		duk_get_prop_index(ctx, -1, it->second);
+		duk_remove(ctx, -2);
+		return 1;
+	}
+
+	duk_ret_t stash_identity(duk_context* ctx) {
+		// stash_ref + push + free_ref each found the ref array through the heap stash
+		stash_push_ref_array(ctx);
+		duk_dup(ctx, 0);
+		duk_put_prop_index(ctx, -2, 1);
+		duk_pop(ctx);
+
+		stash_push_ref_array(ctx);
+		duk_get_prop_index(ctx, -1, 1);
+		duk_remove(ctx, -2);
+
+		stash_push_ref_array(ctx);
+		duk_push_undefined(ctx);
+		duk_put_prop_index(ctx, -2, 1);
+		duk_pop(ctx);
+		return 1;
+	}
+
+	StashRefMap stash_map;
+
+	void register_stash_bindings(duk_context* ctx) {
+		duk_push_heap_stash(ctx);
+
+		duk_push_object(ctx);
+		duk_push_pointer(ctx, &stash_map);
+		duk_put_prop_string(ctx, -2, "ptr");
+		duk_put_prop_string(ctx, -2, "bench_ref_map");
+
+		// bench_ref_array[1] = widget's script object
+		duk_push_array(ctx);
+		duk_get_global_string(ctx, "widget");
+		duk_put_prop_index(ctx, -2, 1);
+		duk_put_prop_string(ctx, -2, "bench_ref_array");
+
+		duk_pop(ctx);  // pop heap stash
+
+		stash_map[getWidget()] = 1;
+
+		duk_push_c_function(ctx, stash_get_widget, 0);
+		duk_put_global_string(ctx, "stashGetWidget");
+
+		duk_push_c_function(ctx, stash_identity, 1);
+		duk_put_global_string(ctx, "stashIdentity");
+	}
+}
+
+// loop body runs N times
+#define LOOP(body) "var n = N, x, o = {}; for (var i = 0; i < n; i++) { " body " }"
+
+void bench_push()
+{
+	const long iterations = 2000000;
+
+	duk_context* ctx = duk_create_heap_default();
+
+	dukglue_register_method(ctx, &Widget::id, "id");
+	dukglue_register_function(ctx, &getWidget, "getWidget");
+	dukglue_register_function(ctx, &identity, "identity");
+
+	bench_eval(ctx, "widget = getWidget();", 1);
+	register_stash_bindings(ctx);
+
+	double stash = bench_eval(ctx, LOOP("x = stashGetWidget();"), iterations);
+	double state = bench_eval(ctx, LOOP("x = getWidget();"), iterations);
+	bench_report("push", "native object (heap stash)", stash);
+	bench_report("push", "native object (heap state)", state, stash);
+
+	stash = bench_eval(ctx, LOOP("x = stashIdentity(o);"), iterations);
+	state = bench_eval(ctx, LOOP("x = identity(o);"), iterations);
+	bench_report("push", "DukValue round trip (heap stash)", stash);
+	bench_report("push", "DukValue round trip (heap state)", state, stash);
+
+	duk_destroy_heap(ctx);
+}
+
+// Heap growth when scripts touch many distinct native objects once each (a getter returning
+// a different object every call), with the registry keeping every script object alive (default)
+// or holding weak refs.
+namespace {
+	std::vector<Widget> churn_widgets;
+
+	Widget* getChurnWidget(int i) {
+		return &churn_widgets[i];
+	}
+}
+
+void bench_weak_refs()
+{
+	const int objects = 100000;
+	churn_widgets.resize(objects);
+
+	double bytes[2];
+	double times[2];
+	for (int weak = 0; weak < 2; weak++) {
+		duk_context* ctx = bench_create_counted_heap();
+		dukglue_register_method(ctx, &Widget::id, "id");
+		dukglue_register_function(ctx, &getChurnWidget, "getChurnWidget");
+		dukglue_set_weak_refs(ctx, weak != 0);
+
+		long before = bench_heap_bytes(ctx);
+		times[weak] = bench_eval(ctx, LOOP("x = getChurnWidget(i).id();"), objects);
+		bytes[weak] = static_cast<double>(bench_heap_bytes(ctx) - before) / objects;
+
+		bench_destroy_counted_heap(ctx);
+	}
+
+	bench_report_bytes("weak refs", "heap bytes per object touched (strong)", bytes[0], bytes[0]);
+	bench_report_bytes("weak refs", "heap bytes per object touched (weak)", bytes[1], bytes[0]);
+	bench_report("weak refs", "push new object + call (strong)", times[0]);
+	bench_report("weak refs", "push new object + call (weak)", times[1], times[0]);
+
+	// pushing an object whose script object is alive
+	duk_context* ctx = duk_create_heap_default();
+	dukglue_register_function(ctx, &getChurnWidget, "getChurnWidget");
+	dukglue_set_weak_refs(ctx, true);
+	bench_eval(ctx, "kept = getChurnWidget(0);", 1);
+
+	double live = bench_eval(ctx, LOOP("x = getChurnWidget(0);"), 2000000);
+	bench_report("weak refs", "push live object (weak)", live);
+
+	duk_destroy_heap(ctx);
+	churn_widgets.clear();
+}
+
+// Pushing an object held by a std::shared_ptr: one wrapper per object (dukglue) against a new
+// wrapper on every push, each owning its own heap-allocated shared_ptr and finalizer function
+// (the way dukglue used to push them, written out by hand).
+namespace {
+	std::shared_ptr<Widget> shared_widget;
+
+	std::shared_ptr<Widget> getSharedWidget() {
+		return shared_widget;
+	}
+
+	duk_ret_t old_shared_ptr_finalizer(duk_context* ctx) {
+		dukglue::detail::get_hidden_prop(ctx, 0, dukglue::detail::KEY_SHARED_PTR);
+		std::shared_ptr<Widget>* ptr = static_cast<std::shared_ptr<Widget>*>(duk_get_pointer(ctx, -1));
+		duk_pop(ctx);
+		delete ptr;
+
+		duk_push_undefined(ctx);
+		dukglue::detail::put_hidden_prop(ctx, 0, dukglue::detail::KEY_SHARED_PTR);
+		return 0;
+	}
+
+	duk_ret_t old_get_shared_widget(duk_context* ctx) {
+		std::shared_ptr<Widget> value = getSharedWidget();
+		dukglue::detail::ProtoManager::make_script_object(ctx, value.get());
+
+		duk_push_pointer(ctx, new std::shared_ptr<Widget>(value));
+		dukglue::detail::put_hidden_prop(ctx, -2, dukglue::detail::KEY_SHARED_PTR);
+
+		duk_push_c_function(ctx, old_shared_ptr_finalizer, 1);
+		duk_set_finalizer(ctx, -2);
+		return 1;
+	}
+}
+
+void bench_shared_ptrs()
+{
+	const long iterations = 1000000;
+	shared_widget = std::make_shared<Widget>();
+
+	duk_context* ctx = bench_create_counted_heap();
+	dukglue_register_method(ctx, &Widget::id, "id");
+	dukglue_register_function(ctx, &getSharedWidget, "getSharedWidget");
+	duk_push_c_function(ctx, old_get_shared_widget, 0);
+	duk_put_global_string(ctx, "oldGetSharedWidget");
+
+	// the script keeps one wrapper alive, and pushes the object again and again
+	bench_eval(ctx, "kept = oldGetSharedWidget();", 1);
+	double old_push = bench_eval(ctx, LOOP("x = oldGetSharedWidget().id();"), iterations);
+	bench_eval(ctx, "kept = getSharedWidget();", 1);
+	double new_push = bench_eval(ctx, LOOP("x = getSharedWidget().id();"), iterations);
+	bench_report("shared_ptr", "push + call (wrapper per push)", old_push);
+	bench_report("shared_ptr", "push + call (wrapper per object)", new_push, old_push);
+
+	// heap held by 1000 pushes of the object kept in a script array
+	long before = bench_heap_bytes(ctx);
+	bench_eval(ctx, "var a = []; for (var i = 0; i < N; i++) a.push(oldGetSharedWidget()); keptOld = a;", 1000);
+	double old_bytes = static_cast<double>(bench_heap_bytes(ctx) - before) / 1000;
+	before = bench_heap_bytes(ctx);
+	bench_eval(ctx, "var a = []; for (var i = 0; i < N; i++) a.push(getSharedWidget()); keptNew = a;", 1000);
+	double new_bytes = static_cast<double>(bench_heap_bytes(ctx) - before) / 1000;
+	bench_report_bytes("shared_ptr", "heap bytes per push kept (wrapper per push)", old_bytes, old_bytes);
+	bench_report_bytes("shared_ptr", "heap bytes per push kept (wrapper per object)", new_bytes, old_bytes);
+
+	bench_destroy_counted_heap(ctx);
+	shared_widget.reset();
+}
+
+// Factories handing a new object to the script: as a std::shared_ptr (an extra control block,
+// atomic refcounts and a registry slot) or as a std::unique_ptr (owned by the script object).
+// Each object is dropped right away, so this includes deleting it.
+namespace {
+	std::shared_ptr<Widget> makeSharedWidget() {
+		return std::make_shared<Widget>();
+	}
+
+	std::unique_ptr<Widget> makeUniqueWidget() {
+		return std::unique_ptr<Widget>(new Widget());
+	}
+}
+
+void bench_unique_ptrs()
+{
+	const long iterations = 500000;
+
+	duk_context* ctx = duk_create_heap_default();
+	dukglue_register_method(ctx, &Widget::id, "id");
+	dukglue_register_function(ctx, &makeSharedWidget, "makeSharedWidget");
+	dukglue_register_function(ctx, &makeUniqueWidget, "makeUniqueWidget");
+
+	double shared = bench_eval(ctx, LOOP("x = makeSharedWidget().id();"), iterations);
+	double unique = bench_eval(ctx, LOOP("x = makeUniqueWidget().id();"), iterations);
+	bench_report("unique_ptr", "new object + call (shared_ptr)", shared);
+	bench_report("unique_ptr", "new object + call (unique_ptr)", unique, shared);
+
+	duk_destroy_heap(ctx);
+}
+
+// Factories handing a new object with its own reference count to the script: through a
+// std::shared_ptr (a control block next to the object's own count) or through
+// intrusive_ptr_traits (the script object holds one intrusive reference).
+namespace {
+	class RefWidget {
+	public:
+		RefWidget() : refs(0) {}
+
+		int id() const {
+			return 1;
+		}
+
+		int refs;
+	};
+
+	std::shared_ptr<RefWidget> makeSharedRefWidget() {
+		return std::make_shared<RefWidget>();
+	}
+
+	RefWidget* makeRefWidget() {
+		return new RefWidget();
+	}
+}
+
+namespace dukglue {
+	template<>
+	struct intrusive_ptr_traits<RefWidget> {
+		static void add_ref(RefWidget* obj) {
+			obj->refs++;
+		}
+
+		static void release(RefWidget* obj) {
+			if (--obj->refs == 0)
+				delete obj;
+		}
+	};
+}
+
+void bench_intrusive_ptrs()
+{
+	const long iterations = 500000;
+
+	duk_context* ctx = bench_create_counted_heap();
+	dukglue_register_method(ctx, &RefWidget::id, "id");
+	dukglue_register_function(ctx, &makeSharedRefWidget, "makeSharedRefWidget");
+	dukglue_register_function(ctx, &makeRefWidget, "makeRefWidget");
+
+	double shared = bench_eval(ctx, LOOP("x = makeSharedRefWidget().id();"), iterations);
+	double intrusive = bench_eval(ctx, LOOP("x = makeRefWidget().id();"), iterations);
+	bench_report("intrusive", "new object + call (shared_ptr)", shared);
+	bench_report("intrusive", "new object + call (intrusive_ptr_traits)", intrusive, shared);
+
+	// heap held by script objects kept alive
+	long before = bench_heap_bytes(ctx);
+	bench_eval(ctx, "var a = []; for (var i = 0; i < N; i++) a.push(makeSharedRefWidget()); keptShared = a;", 1000);
+	double shared_bytes = static_cast<double>(bench_heap_bytes(ctx) - before) / 1000;
+	before = bench_heap_bytes(ctx);
+	bench_eval(ctx, "var a = []; for (var i = 0; i < N; i++) a.push(makeRefWidget()); keptIntrusive = a;", 1000);
+	double intrusive_bytes = static_cast<double>(bench_heap_bytes(ctx) - before) / 1000;
+	bench_report_bytes("intrusive", "heap bytes per object kept (shared_ptr)", shared_bytes, shared_bytes);
+	bench_report_bytes("intrusive", "heap bytes per object kept (intrusive_ptr_traits)", intrusive_bytes, shared_bytes);
+
+	bench_destroy_counted_heap(ctx);
+}
+
+// Mark-and-sweep time and heap size after a spike of 1M DukValues, of which 1% are kept:
+// a ref array that never shrinks (the way dukglue used to keep it, emulated with a plain array)
+// against dukglue's, which is compacted once it is mostly free.
+namespace {
+	const int spike = 1000000;
+	const int keep_every = 100;
+
+	double time_gc(duk_context* ctx) {
+		const int runs = 20;
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < runs; i++)
+			duk_gc(ctx, 0);
+		auto end = std::chrono::steady_clock::now();
+		return std::chrono::duration<double, std::nano>(end - start).count() / runs;
+	}
+}
+
+void bench_compaction()
+{
+	// never shrinks
+	duk_context* ctx = bench_create_counted_heap();
+	long before = bench_heap_bytes(ctx);
+	bench_eval(ctx, "var refs = [0]; for (var i = 1; i <= N; i++) refs[i] = {};"
+		"for (var i = 1; i <= N; i++) if (i % 100 != 0) refs[i] = undefined; stash = refs;", spike);
+	double fixed_gc = time_gc(ctx);
+	double fixed_bytes = static_cast<double>(bench_heap_bytes(ctx) - before);
+	bench_destroy_counted_heap(ctx);
+
+	// compacted
+	ctx = bench_create_counted_heap();
+	before = bench_heap_bytes(ctx);
+	{
+		std::vector<DukValue> values;
+		values.reserve(spike);
+		for (int i = 1; i <= spike; i++) {
+			duk_push_object(ctx);
+			values.push_back(DukValue::take_from_stack(ctx));
+		}
+
+		std::vector<DukValue> kept;
+		for (int i = 1; i <= spike; i++) {
+			if (i % keep_every == 0)
+				kept.push_back(std::move(values[i - 1]));
+		}
+		values.clear();
+		values.shrink_to_fit();
+
+		double compacted_gc = time_gc(ctx);
+		double compacted_bytes = static_cast<double>(bench_heap_bytes(ctx) - before);
+
+		bench_report("compaction", "gc after 1M ref spike (array kept)", fixed_gc);
+		bench_report("compaction", "gc after 1M ref spike (compacted)", compacted_gc, fixed_gc);
+		bench_report_bytes("compaction", "heap after 1M ref spike (array kept)", fixed_bytes, fixed_bytes);
+		bench_report_bytes("compaction", "heap after 1M ref spike (compacted)", compacted_bytes, fixed_bytes);
+	}
+	bench_destroy_counted_heap(ctx);
+}
+
+// Scripts creating and dropping small value-like objects with a managed constructor: allocated
+// with new (as before dukglue_class_allocator), or from the default slab pool.
+namespace {
+	template<int Tag>
+	class Vec {
+	public:
+		Vec(double x, double y) : x_(x), y_(y) {}
+
+		double x() const {
+			return x_;
+		}
+
+	private:
+		double x_, y_;
+	};
+
+	typedef Vec<0> HeapVec;
+	typedef Vec<1> SlabVec;
+}
+
+template<>
+struct dukglue_class_allocator<HeapVec> : dukglue::new_delete_allocator<HeapVec> {};
+
+void bench_class_allocator()
+{
+	const long iterations = 1000000;
+
+	duk_context* ctx = duk_create_heap_default();
+	dukglue_register_constructor_managed<HeapVec, double, double>(ctx, "HeapVec");
+	dukglue_register_method(ctx, &HeapVec::x, "x");
+	dukglue_register_constructor_managed<SlabVec, double, double>(ctx, "SlabVec");
+	dukglue_register_method(ctx, &SlabVec::x, "x");
+
+	double heap = bench_eval(ctx, LOOP("x = new HeapVec(i, 1).x();"), iterations);
+	double slab = bench_eval(ctx, LOOP("x = new SlabVec(i, 1).x();"), iterations);
+	bench_report("allocator", "new + call + finalize (new/delete)", heap);
+	bench_report("allocator", "new + call + finalize (slab pool)", slab, heap);
+
+	duk_destroy_heap(ctx);
+}
@@ -0,0 +1,299 @@
+#include "bench_util.h"
+#include <dukglue/dukglue.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+// Native object registry (pointer -> ref array index) at scale:
+// PtrMap, the flat table RefManager uses, against std::unordered_map (what it used before).
+// Keys are spread like heap-allocated objects (48-byte stride, shuffled).
+
+namespace {
+	typedef dukglue::detail::PtrMap<duk_uarridx_t> FlatMap;
+	typedef std::unordered_map<void*, duk_uarridx_t> NodeMap;
+
+	template<typename F>
+	double time_per_op(size_t ops, F f) {
+		auto start = std::chrono::steady_clock::now();
+		f();
+		auto end = std::chrono::steady_clock::now();
+		return std::chrono::duration<double, std::nano>(end - start).count() / ops;
+	}
+
+	volatile duk_uarridx_t sink;
+
+	void flat_insert(FlatMap& map, const std::vector<void*>& keys) {
+		for (size_t i = 0; i < keys.size(); i++)
+			map.set(keys[i], static_cast<duk_uarridx_t>(i));
+	}
+
+	void node_insert(NodeMap& map, const std::vector<void*>& keys) {
+		for (size_t i = 0; i < keys.size(); i++)
+			map[keys[i]] = static_cast<duk_uarridx_t>(i);
+	}
+
+	void flat_find(FlatMap& map, const std::vector<void*>& keys) {
+		duk_uarridx_t sum = 0;
+		for (void* key : keys) {
+			const duk_uarridx_t* value = map.find(key);
+			if (value != nullptr)
+				sum += *value;
+		}
+		sink = sum;
+	}
+
+	void node_find(NodeMap& map, const std::vector<void*>& keys) {
+		duk_uarridx_t sum = 0;
+		for (void* key : keys) {
+			auto it = map.find(key);
+			if (it != map.end())
+				sum += it->second;
+		}
+		sink = sum;
+	}
+
+	void flat_erase(FlatMap& map, const std::vector<void*>& keys) {
+		for (void* key : keys)
+			map.erase(key);
+	}
+
+	void node_erase(NodeMap& map, const std::vector<void*>& keys) {
+		for (void* key : keys)
+			map.erase(key);
+	}
+
+	void report(const char* what, size_t count, double flat, double node) {
+		char name[64];
+		std::snprintf(name, sizeof(name), "%s %zu (unordered_map)", what, count);
+		bench_report("registry", name, node);
+		std::snprintf(name, sizeof(name), "%s %zu (PtrMap)", what, count);
+		bench_report("registry", name, flat, node);
+	}
+}
+
+void bench_registry()
+{
+	std::mt19937 rng(42);
+
+	for (size_t count = 1000; count <= 10000000; count *= 10) {
+		const size_t stride = 48;
+		const char* base = reinterpret_cast<const char*>(static_cast<uintptr_t>(0x7f0000000000ull));
+
+		std::vector<void*> keys(count);
+		std::vector<void*> missing(count);
+		for (size_t i = 0; i < count; i++) {
+			keys[i] = const_cast<char*>(base + i * stride);
+			missing[i] = const_cast<char*>(base + (count + i) * stride);
+		}
+		std::shuffle(keys.begin(), keys.end(), rng);
+
+		std::vector<void*> lookups = keys;
+		std::shuffle(lookups.begin(), lookups.end(), rng);
+
+		// repeat small sizes so the timings are long enough to be stable
+		const size_t repeat = std::max<size_t>(1, 1000000 / count);
+
+		double flat_insert_ns = 0, node_insert_ns = 0;
+		double flat_hit_ns = 0, node_hit_ns = 0;
+		double flat_miss_ns = 0, node_miss_ns = 0;
+		double flat_erase_ns = 0, node_erase_ns = 0;
+
+		for (size_t r = 0; r < repeat; r++) {
+			{
+				FlatMap map;
+				flat_insert_ns += time_per_op(count, [&] { flat_insert(map, keys); });
+				flat_hit_ns += time_per_op(count, [&] { flat_find(map, lookups); });
+				flat_miss_ns += time_per_op(count, [&] { flat_find(map, missing); });
+				flat_erase_ns += time_per_op(count, [&] { flat_erase(map, lookups); });
+			}
+			{
+				NodeMap map;
+				node_insert_ns += time_per_op(count, [&] { node_insert(map, keys); });
+				node_hit_ns += time_per_op(count, [&] { node_find(map, lookups); });
+				node_miss_ns += time_per_op(count, [&] { node_find(map, missing); });
+				node_erase_ns += time_per_op(count, [&] { node_erase(map, lookups); });
+			}
+		}
+
+		report("insert", count, flat_insert_ns / repeat, node_insert_ns / repeat);
+		report("find hit", count, flat_hit_ns / repeat, node_hit_ns / repeat);
+		report("find miss", count, flat_miss_ns / repeat, node_miss_ns / repeat);
+		report("erase", count, flat_erase_ns / repeat, node_erase_ns / repeat);
+	}
+}
+
+// Invalidating every object of a subsystem: one dukglue_invalidate_object call per pointer,
+// against one dukglue_invalidate_scope or dukglue_invalidate_all call.
+namespace {
+	struct Entity {
+		int value;
+	};
+
+	std::vector<Entity> entities;
+
+	Entity* getEntity(int i) {
+		return &entities[i];
+	}
+
+	duk_context* make_entity_heap(duk_uint_t* scope) {
+		duk_context* ctx = duk_create_heap_default();
+		dukglue_register_function(ctx, &getEntity, "getEntity");
+
+		// the script objects are kept alive by the registry
+		*scope = dukglue_open_scope(ctx);
+		bench_eval(ctx, "for (var i = 0; i < N; i++) getEntity(i);", static_cast<long>(entities.size()));
+		dukglue_close_scope(ctx, *scope);
+		return ctx;
+	}
+}
+
+void bench_invalidate()
+{
+	const size_t count = 100000;
+	entities.resize(count);
+
+	duk_uint_t scope;
+	duk_context* ctx = make_entity_heap(&scope);
+	double per_pointer = time_per_op(count, [&] {
+		for (Entity& entity : entities)
+			dukglue_invalidate_object(ctx, &entity);
+	});
+	duk_destroy_heap(ctx);
+
+	ctx = make_entity_heap(&scope);
+	double by_scope = time_per_op(count, [&] { dukglue_invalidate_scope(ctx, scope); });
+	duk_destroy_heap(ctx);
+
+	ctx = make_entity_heap(&scope);
+	double by_type = time_per_op(count, [&] { dukglue_invalidate_all<Entity>(ctx); });
+	duk_destroy_heap(ctx);
+
+	bench_report("invalidate", "100000 objects, per pointer", per_pointer);
+	bench_report("invalidate", "100000 objects, by scope", by_scope, per_pointer);
+	bench_report("invalidate", "100000 objects, by type", by_type, per_pointer);
+
+	entities.clear();
+}
+
+// Class prototypes for 512 classes: the native class id -> prototype table ProtoManager uses,
+// against the sorted script array it used before (a binary search reading each probe's
+// array element and its hidden type_info property, and inserts shifting elements up one at a time).
+namespace {
+	template<int N>
+	struct Tagged {};
+
+	template<int N>
+	struct CollectTypes {
+		static void add(std::vector<dukglue::class_id_t>& types) {
+			CollectTypes<N - 1>::add(types);
+			types.push_back(dukglue_class_id<Tagged<N> >());
+		}
+	};
+
+	template<>
+	struct CollectTypes<0> {
+		static void add(std::vector<dukglue::class_id_t>& types) {
+			types.push_back(dukglue_class_id<Tagged<0> >());
+		}
+	};
+
+	using dukglue::detail::TypeInfo;
+
+	// the old registry, in a script array at the top of the stack
+	bool sorted_find(duk_context* ctx, const TypeInfo& search_info) {
+		int min = 0;
+		int max = static_cast<int>(duk_get_length(ctx, -1)) - 1;
+		while (min <= max) {
+			int mid = (max - min) / 2 + min;
+			duk_get_prop_index(ctx, -1, mid);
+			dukglue::detail::get_hidden_prop(ctx, -1, dukglue::detail::KEY_TYPE_INFO);
+			const TypeInfo* mid_info = static_cast<TypeInfo*>(duk_get_pointer(ctx, -1));
+			duk_pop_2(ctx);
+
+			if (*mid_info == search_info)
+				return true;
+			else if (*mid_info < search_info)
+				min = mid + 1;
+			else
+				max = mid - 1;
+		}
+		return false;
+	}
+
+	void sorted_insert(duk_context* ctx, const TypeInfo* info) {
+		duk_push_object(ctx);  // [array] [proto]
+		duk_push_pointer(ctx, const_cast<TypeInfo*>(info));
+		dukglue::detail::put_hidden_prop(ctx, -2, dukglue::detail::KEY_TYPE_INFO);
+
+		duk_size_t i = duk_get_length(ctx, -2);
+		while (i > 0) {
+			duk_get_prop_index(ctx, -2, static_cast<duk_uarridx_t>(i - 1));
+			dukglue::detail::get_hidden_prop(ctx, -1, dukglue::detail::KEY_TYPE_INFO);
+			const TypeInfo* chk_info = static_cast<TypeInfo*>(duk_get_pointer(ctx, -1));
+			duk_pop(ctx);
+
+			if (*chk_info > *info) {
+				duk_put_prop_index(ctx, -3, static_cast<duk_uarridx_t>(i));
+				i--;
+			}
+			else {
+				duk_pop(ctx);
+				break;
+			}
+		}
+		duk_put_prop_index(ctx, -2, static_cast<duk_uarridx_t>(i));
+	}
+}
+
+void bench_prototypes()
+{
+	std::vector<dukglue::class_id_t> types;
+	CollectTypes<511>::add(types);
+	std::vector<TypeInfo> infos;
+	for (dukglue::class_id_t type : types)
+		infos.push_back(TypeInfo(type));
+
+	// (registered in any order, as type_index order was)
+	std::shuffle(infos.begin(), infos.end(), std::mt19937(42));
+
+	const size_t lookups = 1000000;
+
+	duk_context* ctx = duk_create_heap_default();
+	duk_push_array(ctx);
+	double sorted_register = time_per_op(infos.size(), [&] {
+		for (const TypeInfo& info : infos)
+			sorted_insert(ctx, &info);
+	});
+	double sorted_lookup = time_per_op(lookups, [&] {
+		size_t found = 0;
+		for (size_t i = 0; i < lookups; i++)
+			found += sorted_find(ctx, infos[(i * 7919) % infos.size()]);
+		sink = static_cast<duk_uarridx_t>(found);
+	});
+	duk_pop(ctx);
+	duk_destroy_heap(ctx);
+
+	ctx = duk_create_heap_default();
+	double table_register = time_per_op(infos.size(), [&] {
+		for (const TypeInfo& info : infos) {
+			dukglue::detail::ProtoManager::push_prototype(ctx, info.id());
+			duk_pop(ctx);
+		}
+	});
+	double table_lookup = time_per_op(lookups, [&] {
+		for (size_t i = 0; i < lookups; i++) {
+			dukglue::detail::ProtoManager::push_prototype(ctx, infos[(i * 7919) % infos.size()].id());
+			duk_pop(ctx);
+		}
+	});
+	duk_destroy_heap(ctx);
+
+	bench_report("prototypes", "register 512 classes, per class (sorted)", sorted_register);
+	bench_report("prototypes", "register 512 classes, per class (table)", table_register, sorted_register);
+	bench_report("prototypes", "find among 512 (sorted array)", sorted_lookup);
+	bench_report("prototypes", "find among 512 (id table)", table_lookup, sorted_lookup);
+}
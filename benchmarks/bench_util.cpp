@@ -0,0 +1,129 @@
+#include "bench_util.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+double bench_eval(duk_context* ctx, const char* code, long iterations)
+{
+	duk_push_number(ctx, static_cast<double>(iterations));
+	duk_put_global_string(ctx, "N");
+
+	// run the code inside a function, so local variables are register-bound
+	std::string wrapped = std::string("(function () {") + code + "\n})();";
+
+	duk_push_lstring(ctx, wrapped.data(), wrapped.size());
+	duk_push_string(ctx, "bench");
+	if (duk_pcompile(ctx, 0) != 0) {
+		std::fprintf(stderr, "Error compiling '%s': %s\n", code, duk_safe_to_string(ctx, -1));
+		std::exit(1);
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	if (duk_pcall(ctx, 0) != 0) {
+		duk_get_prop_string(ctx, -1, "stack");
+		std::fprintf(stderr, "Error running '%s': %s\n", code, duk_safe_to_string(ctx, -1));
+		std::exit(1);
+	}
+	auto end = std::chrono::steady_clock::now();
+	duk_pop(ctx);
+
+	return std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+}
+
+void bench_report(const char* group, const char* name, double ns_per_iteration)
+{
+	std::printf("%-12s %-40s %9.1f ns\n", group, name, ns_per_iteration);
+}
+
+void bench_report(const char* group, const char* name, double ns_per_iteration, double reference_ns)
+{
+	std::printf("%-12s %-40s %9.1f ns  (%+.1f ns)\n", group, name, ns_per_iteration, ns_per_iteration - reference_ns);
+}
+
+namespace {
+	struct HeapCounter {
+		long bytes;
+	};
+
+	// each allocation is prefixed with its size
+	union AllocHeader {
+		std::size_t size;
+		std::max_align_t align;
+	};
+
+	void* counted_alloc(void* udata, duk_size_t size) {
+		if (size == 0)
+			return nullptr;
+
+		AllocHeader* header = static_cast<AllocHeader*>(std::malloc(sizeof(AllocHeader) + size));
+		if (header == nullptr)
+			return nullptr;
+
+		header->size = size;
+		static_cast<HeapCounter*>(udata)->bytes += static_cast<long>(size);
+		return header + 1;
+	}
+
+	void counted_free(void* udata, void* ptr) {
+		if (ptr == nullptr)
+			return;
+
+		AllocHeader* header = static_cast<AllocHeader*>(ptr) - 1;
+		static_cast<HeapCounter*>(udata)->bytes -= static_cast<long>(header->size);
+		std::free(header);
+	}
+
+	void* counted_realloc(void* udata, void* ptr, duk_size_t size) {
+		if (ptr == nullptr)
+			return counted_alloc(udata, size);
+
+		if (size == 0) {
+			counted_free(udata, ptr);
+			return nullptr;
+		}
+
+		void* new_ptr = counted_alloc(udata, size);
+		if (new_ptr == nullptr)
+			return nullptr;
+
+		AllocHeader* header = static_cast<AllocHeader*>(ptr) - 1;
+		std::memcpy(new_ptr, ptr, header->size < size ? header->size : size);
+		counted_free(udata, ptr);
+		return new_ptr;
+	}
+
+	HeapCounter* get_counter(duk_context* ctx) {
+		duk_memory_functions funcs;
+		duk_get_memory_functions(ctx, &funcs);
+		return static_cast<HeapCounter*>(funcs.udata);
+	}
+}
+
+duk_context* bench_create_counted_heap()
+{
+	HeapCounter* counter = new HeapCounter();
+	counter->bytes = 0;
+	return duk_create_heap(counted_alloc, counted_realloc, counted_free, counter, nullptr);
+}
+
+void bench_destroy_counted_heap(duk_context* ctx)
+{
+	HeapCounter* counter = get_counter(ctx);
+	duk_destroy_heap(ctx);
+	delete counter;
+}
+
+long bench_heap_bytes(duk_context* ctx)
+{
+	duk_gc(ctx, 0);
+	return get_counter(ctx)->bytes;
+}
+
+void bench_report_bytes(const char* group, const char* name, double bytes, double reference_bytes)
+{
+	std::printf("%-12s %-40s %9.1f B   (%+.1f B)\n", group, name, bytes, bytes - reference_bytes);
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "duktape.h"
+
+// Compiles code, then runs it and returns the average run time per iteration in nanoseconds.
+// The code is run as the body of a function, so its local variables are fast.
+// The script can read the iteration count from the global variable N.
+double bench_eval(duk_context* ctx, const char* code, long iterations);
+
+// Prints one result line.
+void bench_report(const char* group, const char* name, double ns_per_iteration);
+
+// Prints a result line, along with the saving compared to a reference time.
+void bench_report(const char* group, const char* name, double ns_per_iteration, double reference_ns);
+
+// Creates a heap that counts the bytes it has allocated (see bench_heap_bytes).
+// Destroy it with bench_destroy_counted_heap.
+duk_context* bench_create_counted_heap();
+void bench_destroy_counted_heap(duk_context* ctx);
+
+// Bytes currently allocated by a heap created with bench_create_counted_heap.
+long bench_heap_bytes(duk_context* ctx);
+
+// Prints a memory result line, along with the saving compared to a reference size.
+void bench_report_bytes(const char* group, const char* name, double bytes, double reference_bytes);
@@ -0,0 +1,51 @@
+#include <dukglue/detail_traits.h>  // for DUKGLUE_HAS_CPP17
+
+void bench_calls();
+void bench_push();
+void bench_weak_refs();
+void bench_shared_ptrs();
+void bench_unique_ptrs();
+void bench_intrusive_ptrs();
+void bench_compaction();
+void bench_callables();
+void bench_overloads();
+void bench_defaults();
+void bench_trusted();
+void bench_lightfunc();
+void bench_registry();
+void bench_invalidate();
+void bench_class_allocator();
+void bench_heap();
+void bench_prototypes();
+void bench_inheritance();
+void bench_binding_set();
+#ifdef DUKGLUE_HAS_CPP17
+void bench_compiletime();
+#endif
+
+int main() {
+	bench_calls();
+	bench_push();
+	bench_weak_refs();
+	bench_shared_ptrs();
+	bench_unique_ptrs();
+	bench_intrusive_ptrs();
+	bench_compaction();
+	bench_callables();
+	bench_overloads();
+	bench_defaults();
+	bench_trusted();
+	bench_lightfunc();
+	bench_registry();
+	bench_invalidate();
+	bench_class_allocator();
+	bench_heap();
+	bench_prototypes();
+	bench_inheritance();
+	bench_binding_set();
+#ifdef DUKGLUE_HAS_CPP17
+	bench_compiletime();
+#endif
+
+	return 0;
+}
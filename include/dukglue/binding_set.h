@@ -0,0 +1,580 @@
+#ifndef _BINDING_SET_20240506_H
+#define _BINDING_SET_20240506_H 1
+
+#include "register_class.h"
+#include "register_property.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace dukglue
+{
+   namespace detail
+   {
+      // One registration recorded by a BindingSet.
+      struct BindingEntry
+      {
+         enum Kind { FUNCTION, METHOD, PROPERTY, CONSTRUCTOR, BASE_CLASS };
+
+         Kind kind;
+         std::string name;
+         class_id_t cls;  // the class of a member or constructor; the derived class for BASE_CLASS
+         class_id_t base;  // BASE_CLASS only
+
+         // The Duktape/C function (the getter of a PROPERTY), its argument count, and the magic value of its binding
+         // (see DukglueHeapState::shared_binding_magic), or 0 if it has no binding.
+         duk_c_function func;
+         duk_idx_t nargs;
+         duk_int_t magic;
+
+         // PROPERTY only
+         duk_c_function setter;
+         duk_int_t setter_magic;
+
+         // CONSTRUCTOR only: pushes the object for the constructor's prototype property
+         // (null for the class prototype)
+         void(*push_prototype)(duk_context*);
+      };
+
+      // The native data of a BindingSet. Heaps the set has been applied to share it, and keep it alive.
+      struct BindingSetData
+      {
+         std::vector<std::unique_ptr<TypeInfo>> types;
+         std::vector<std::size_t> type_index;  // class id -> index in types + 1 (or 0), while recording
+         std::vector<BindingSlot> slots;
+         std::vector<BindingEntry> entries;
+
+         // Indices in entries, made when the set is first applied: the global ones (functions and
+         // constructors) sorted by name, and the others grouped by class, with class id c's at
+         // [member_begin[c], member_begin[c + 1]) (for BindingSet::apply_lazy).
+         std::vector<std::size_t> global_entries;
+         std::vector<std::size_t> member_entries;
+         std::vector<std::size_t> member_begin;
+
+         bool adjusted_casts;
+         bool trusted;
+
+         // set when the set is first applied; nothing can be recorded after that
+         std::once_flag seal_once;
+         std::atomic<bool> sealed;
+
+         BindingSetData() : adjusted_casts(false), trusted(false), sealed(false) {}
+      };
+   }
+
+   // Registrations recorded once, for applying to many heaps.
+   // Registering the usual way (dukglue_register_*) creates native data per heap: a binding slot per
+   // function, a TypeInfo per class... A BindingSet keeps that data itself, so applying it to a heap
+   // only creates the script side (prototypes, functions and properties), and every heap the set is
+   // applied to shares the same native data:
+   //   dukglue::BindingSet bindings;
+   //   bindings.register_constructor<Dog, std::string>("Dog");
+   //   bindings.register_method(&Dog::bark, "bark");
+   //   ...
+   //   bindings.apply(ctx);  // for every heap
+   // Registrations are applied in the order they were recorded, so base classes work the same as
+   // with dukglue_set_base_class.
+   // The set becomes immutable once it has been applied: recording after that throws a DukException.
+   // Its classes get their base classes from the set only (dukglue_set_base_class throws for them).
+   // A heap can have one BindingSet applied, before anything else touches the set's classes in that
+   // heap; everything else (lambdas, overloads, ...) is registered per heap as usual.
+   // The set can be destroyed while heaps it was applied to are alive.
+   class BindingSet
+   {
+   public:
+      BindingSet() : data_(new detail::BindingSetData()) {}
+
+      BindingSet(const BindingSet&) = delete;
+      BindingSet& operator=(const BindingSet&) = delete;
+
+      // Functions and methods recorded from now on skip argument type checks (see dukglue_set_trusted).
+      void set_trusted(bool trusted)
+      {
+         check_open();
+         data_->trusted = trusted;
+      }
+
+      template<typename RetType, typename... Ts>
+      void register_function(RetType(*funcToCall)(Ts...), const char* name)
+      {
+         typedef typename detail::FuncInfoHolder<RetType, Ts...>::FuncRuntime FuncRuntime;
+
+         check_open();
+         detail::BindingEntry entry = make_entry(detail::BindingEntry::FUNCTION, name, 0);
+         entry.func = data_->trusted ? FuncRuntime::call_native_function_trusted : FuncRuntime::call_native_function;
+         entry.nargs = sizeof...(Ts);
+         entry.magic = add_slot(funcToCall);
+         data_->entries.push_back(std::move(entry));
+      }
+
+      template<class Cls, typename RetType, typename... Ts>
+      void register_method(RetType(Cls::*method)(Ts...), const char* name)
+      {
+         add_method<false, Cls, RetType, Ts...>(method, name);
+      }
+
+      template<class Cls, typename RetType, typename... Ts>
+      void register_method(RetType(Cls::*method)(Ts...) const, const char* name)
+      {
+         add_method<true, Cls, RetType, Ts...>(method, name);
+      }
+
+      // const getter, setter
+      template<typename Cls, typename RetT, typename ArgT>
+      void register_property(RetT(Cls::*getter)() const, void(Cls::*setter)(ArgT), const char* name)
+      {
+         add_property<true, Cls, RetT, ArgT>(getter, setter, name);
+      }
+
+      // const getter, no setter
+      template<typename Cls, typename RetT>
+      void register_property(RetT(Cls::*getter)() const, std::nullptr_t, const char* name)
+      {
+         add_property<true, Cls, RetT, RetT>(getter, nullptr, name);
+      }
+
+      // non-const getter, setter
+      template<typename Cls, typename RetT, typename ArgT>
+      void register_property(RetT(Cls::*getter)(), void(Cls::*setter)(ArgT), const char* name)
+      {
+         add_property<false, Cls, RetT, ArgT>(getter, setter, name);
+      }
+
+      // non-const getter, no setter
+      template<typename Cls, typename RetT>
+      void register_property(RetT(Cls::*getter)(), std::nullptr_t, const char* name)
+      {
+         add_property<false, Cls, RetT, RetT>(getter, nullptr, name);
+      }
+
+      // no getter, setter
+      template<typename Cls, typename ArgT>
+      void register_property(std::nullptr_t, void(Cls::*setter)(ArgT), const char* name)
+      {
+         add_property<false, Cls, ArgT, ArgT>(nullptr, setter, name);
+      }
+
+      template<class Cls, typename... Ts>
+      void register_constructor(const char* name)
+      {
+         add_constructor(detail::call_native_constructor<false, Cls, Ts...>, sizeof...(Ts), nullptr, detail::class_id<Cls>(), name);
+      }
+
+      template<class Cls, typename... Ts>
+      void register_constructor_managed(const char* name)
+      {
+         add_constructor(detail::call_native_constructor<true, Cls, Ts...>, sizeof...(Ts), detail::push_managed_prototype<Cls>,
+            detail::class_id<Cls>(), name);
+      }
+
+      template<typename Cls>
+      void register_delete()
+      {
+         check_open();
+         detail::BindingEntry entry = make_entry(detail::BindingEntry::METHOD, "delete", type(detail::class_id<Cls>())->id());
+         entry.func = detail::call_native_deleter<Cls>;
+         entry.nargs = 0;
+         data_->entries.push_back(std::move(entry));
+      }
+
+      template<class Base, class Derived>
+      void set_base_class()
+      {
+         static_assert(!std::is_pointer<Base>::value && !std::is_pointer<Derived>::value
+            && !std::is_const<Base>::value && !std::is_const<Derived>::value, "Use bare class names.");
+         static_assert(std::is_base_of<Base, Derived>::value, "Invalid class hierarchy!");
+
+         check_open();
+         detail::TypeInfo* derived = type(detail::class_id<Derived>());
+         detail::TypeInfo* base = type(detail::class_id<Base>());
+
+         const detail::BaseCast cast = detail::make_base_cast<Base, Derived>();
+         derived->add_base(base, cast);
+         if (!cast.is_identity())
+            data_->adjusted_casts = true;
+
+         detail::BindingEntry entry = make_entry(detail::BindingEntry::BASE_CLASS, "", derived->id());
+         entry.base = base->id();
+         data_->entries.push_back(std::move(entry));
+      }
+
+      // Registers everything recorded in ctx's heap.
+      // Throws a DukException if the heap already has a BindingSet, has run out of binding slots,
+      // or already has a prototype for one of the set's classes; the heap is left unchanged then.
+      // Can be called from several threads at once (for different heaps).
+      void apply(duk_context* ctx) const
+      {
+         apply(ctx, false);
+      }
+
+      // Same as apply, but creates script functions as scripts get to them, so a heap only pays for
+      // the part of the bindings its scripts use:
+      // - a class prototype gets its members the first time an object of the class (or of a derived
+      //   class) is created, or its constructor is read
+      // - global functions and constructors are getter stubs on the global object, which replace
+      //   themselves with the function when first read (or with the value a script assigns).
+      //   That needs Duktape to give getters and setters the property key (the default,
+      //   DUK_USE_NONSTD_GETTER_KEY_ARGUMENT and DUK_USE_NONSTD_SETTER_KEY_ARGUMENT); without it,
+      //   globals are created right away.
+      void apply_lazy(duk_context* ctx) const
+      {
+         apply(ctx, true);
+      }
+
+   private:
+      void apply(duk_context* ctx, bool lazy) const
+      {
+         using namespace detail;
+         BindingSetData& data = *data_;
+         std::call_once(data.seal_once, [&data]() { seal(data); });
+
+         for (const std::unique_ptr<TypeInfo>& info : data.types) {
+            if (ProtoManager::has_prototype(ctx, info->id()))
+               throw DukException() << "Can't apply BindingSet: a class of the set already has a prototype in this heap";
+         }
+
+         DukglueHeapState* state = DukglueHeapState::require(ctx);
+         state->share_bindings(data_, data.slots.data(), data.slots.size());
+         if (data.adjusted_casts)
+            state->adjusted_casts = true;
+
+         for (const std::unique_ptr<TypeInfo>& info : data.types) {
+            ProtoManager::push_shared_prototype(ctx, info.get());
+            duk_pop(ctx);
+         }
+
+         if (!lazy) {
+            for (const BindingEntry& entry : data.entries)
+               apply_entry(ctx, entry);
+            return;
+         }
+
+         if (!data.types.empty()) {
+            state->lazy_prototypes.assign(data.types.front()->id() + 1, false);
+            for (const std::unique_ptr<TypeInfo>& info : data.types)
+               state->lazy_prototypes[info->id()] = true;
+            state->num_lazy_prototypes = data.types.size();
+            state->materialize_prototype = materialize_prototype;
+         }
+
+#if defined(DUK_USE_NONSTD_GETTER_KEY_ARGUMENT) && defined(DUK_USE_NONSTD_SETTER_KEY_ARGUMENT)
+         // one getter and one setter for every stub
+         duk_push_global_object(ctx);
+         duk_push_c_function(ctx, lazy_global_getter, 1);
+         duk_push_c_function(ctx, lazy_global_setter, 2);
+
+         const std::string* last_name = nullptr;
+         for (std::size_t idx : data.global_entries) {
+            const std::string& name = data.entries[idx].name;
+            if (last_name != nullptr && *last_name == name)
+               continue;
+            last_name = &name;
+
+            duk_push_lstring(ctx, name.data(), name.size());
+            duk_dup(ctx, -3);
+            duk_dup(ctx, -3);
+            duk_def_prop(ctx, -6, DUK_DEFPROP_HAVE_GETTER | DUK_DEFPROP_HAVE_SETTER
+               | DUK_DEFPROP_HAVE_ENUMERABLE | DUK_DEFPROP_ENUMERABLE
+               | DUK_DEFPROP_HAVE_CONFIGURABLE | DUK_DEFPROP_CONFIGURABLE);
+         }
+
+         duk_pop_3(ctx);  // pop setter, getter and global object
+#else
+         for (std::size_t idx : data.global_entries) {
+            push_global(ctx, data.entries[idx]);
+            duk_put_global_string(ctx, data.entries[idx].name.c_str());
+         }
+#endif
+      }
+
+      static void seal(detail::BindingSetData& data)
+      {
+         using namespace detail;
+
+         for (const std::unique_ptr<TypeInfo>& info : data.types)
+            info->freeze();
+
+         // highest class id first, so the heap's prototype table is sized once
+         std::sort(data.types.begin(), data.types.end(),
+            [](const std::unique_ptr<TypeInfo>& a, const std::unique_ptr<TypeInfo>& b) { return a->id() > b->id(); });
+         data.type_index.clear();
+
+         const class_id_t max_id = data.types.empty() ? 0 : data.types.front()->id();
+         data.member_begin.assign(max_id + 2, 0);
+         for (std::size_t i = 0; i < data.entries.size(); i++) {
+            const BindingEntry& entry = data.entries[i];
+            if (entry.kind == BindingEntry::FUNCTION || entry.kind == BindingEntry::CONSTRUCTOR) {
+               data.global_entries.push_back(i);
+            }
+            else {
+               data.member_entries.push_back(i);
+               data.member_begin[entry.cls + 1]++;
+            }
+         }
+
+         for (std::size_t id = 1; id < data.member_begin.size(); id++)
+            data.member_begin[id] += data.member_begin[id - 1];
+
+         // (stable sorts keep the order entries were recorded in)
+         const std::vector<BindingEntry>& entries = data.entries;
+         std::stable_sort(data.global_entries.begin(), data.global_entries.end(),
+            [&entries](std::size_t a, std::size_t b) { return entries[a].name < entries[b].name; });
+         std::stable_sort(data.member_entries.begin(), data.member_entries.end(),
+            [&entries](std::size_t a, std::size_t b) { return entries[a].cls < entries[b].cls; });
+
+         data.sealed = true;
+      }
+
+      static const detail::BindingSetData* applied_set(duk_context* ctx)
+      {
+         const detail::DukglueHeapState* state = detail::DukglueHeapState::get(ctx);
+         return state != nullptr ? static_cast<const detail::BindingSetData*>(state->binding_set.get()) : nullptr;
+      }
+
+      // Puts the members of the class with ID id into its prototype (see DukglueHeapState::materialize_prototype).
+      // Stack: unchanged
+      static void materialize_prototype(duk_context* ctx, class_id_t id)
+      {
+         using namespace detail;
+         DukglueHeapState* state = DukglueHeapState::require(ctx);
+         state->lazy_prototypes[id] = false;
+         state->num_lazy_prototypes--;
+
+         // (base classes are filled in when their prototypes are pushed to set them up)
+         const BindingSetData* data = applied_set(ctx);
+         for (std::size_t i = data->member_begin[id]; i < data->member_begin[id + 1]; i++)
+            apply_entry(ctx, data->entries[data->member_entries[i]]);
+      }
+
+      // Finds the last global entry recorded with the name at idx, or returns null.
+      static const detail::BindingEntry* find_global(duk_context* ctx, duk_idx_t idx)
+      {
+         const detail::BindingSetData* data = applied_set(ctx);
+         const char* name = duk_get_string(ctx, idx);
+         if (data == nullptr || name == nullptr)
+            return nullptr;
+
+         const std::vector<detail::BindingEntry>& entries = data->entries;
+         auto found = std::upper_bound(data->global_entries.begin(), data->global_entries.end(), name,
+            [&entries](const char* key, std::size_t entry) { return entries[entry].name.compare(key) > 0; });
+         if (found == data->global_entries.begin() || entries[*(found - 1)].name.compare(name) != 0)
+            return nullptr;
+
+         return &entries[*(found - 1)];
+      }
+
+      // Replaces the global at key with value (a normal global, as duk_put_global_string makes).
+      // Stack: ... [value]  ->  ... [value]
+      static void define_global(duk_context* ctx, duk_idx_t key_idx)
+      {
+         duk_push_global_object(ctx);
+         duk_dup(ctx, key_idx);
+         duk_dup(ctx, -3);
+         duk_def_prop(ctx, -3, DUK_DEFPROP_HAVE_VALUE
+            | DUK_DEFPROP_HAVE_WRITABLE | DUK_DEFPROP_WRITABLE
+            | DUK_DEFPROP_HAVE_ENUMERABLE | DUK_DEFPROP_ENUMERABLE
+            | DUK_DEFPROP_HAVE_CONFIGURABLE | DUK_DEFPROP_CONFIGURABLE);
+         duk_pop(ctx);  // pop global object
+      }
+
+      // Getter of a global stub (see apply_lazy): creates the function, and puts it in the stub's place.
+      // Arguments: [key]
+      static duk_ret_t lazy_global_getter(duk_context* ctx)
+      {
+         const detail::BindingEntry* entry = find_global(ctx, 0);
+         if (entry == nullptr)
+            return 0;
+
+         push_global(ctx, *entry);
+         define_global(ctx, 0);
+         return 1;
+      }
+
+      // Setter of a global stub: puts the value assigned in the stub's place.
+      // Arguments: [value] [key]
+      static duk_ret_t lazy_global_setter(duk_context* ctx)
+      {
+         duk_dup(ctx, 0);
+         define_global(ctx, 1);
+         return 0;
+      }
+
+      void check_open() const
+      {
+         if (data_->sealed)
+            throw DukException() << "BindingSet can't be changed after it has been applied";
+      }
+
+      static detail::BindingEntry make_entry(detail::BindingEntry::Kind kind, const char* name, class_id_t cls)
+      {
+         detail::BindingEntry entry;
+         entry.kind = kind;
+         entry.name = name;
+         entry.cls = cls;
+         entry.base = 0;
+         entry.func = nullptr;
+         entry.nargs = 0;
+         entry.magic = 0;
+         entry.setter = nullptr;
+         entry.setter_magic = 0;
+         entry.push_prototype = nullptr;
+         return entry;
+      }
+
+      // Returns the type info for class id, creating it if necessary.
+      detail::TypeInfo* type(class_id_t id)
+      {
+         std::vector<std::size_t>& index = data_->type_index;
+         if (id >= index.size())
+            index.resize(id + 1, 0);
+
+         if (index[id] == 0) {
+            data_->types.emplace_back(new detail::TypeInfo(id));
+            index[id] = data_->types.size();
+         }
+
+         return data_->types[index[id] - 1].get();
+      }
+
+      // Stores value in a new shared binding slot, and returns the magic value for it.
+      template<typename T>
+      duk_int_t add_slot(const T& value)
+      {
+         if (data_->slots.size() >= detail::DukglueHeapState::MAX_BINDINGS - 1)
+            throw DukException() << "Too many bindings in BindingSet (the limit is " << (detail::DukglueHeapState::MAX_BINDINGS - 1) << ")";
+
+         data_->slots.push_back(detail::BindingSlot::make(value));
+         return detail::DukglueHeapState::shared_binding_magic(data_->slots.size() - 1);
+      }
+
+      template<bool isConst, typename Cls, typename RetType, typename... Ts>
+      void add_method(typename std::conditional<isConst, RetType(Cls::*)(Ts...) const, RetType(Cls::*)(Ts...)>::type method, const char* name)
+      {
+         typedef typename detail::MethodInfo<isConst, Cls, RetType, Ts...>::MethodRuntime MethodRuntime;
+
+         check_open();
+         detail::BindingEntry entry = make_entry(detail::BindingEntry::METHOD, name, type(detail::class_id<Cls>())->id());
+         entry.func = data_->trusted ? MethodRuntime::call_native_method_trusted : MethodRuntime::call_native_method;
+         entry.nargs = sizeof...(Ts);
+         entry.magic = add_slot(method);
+         data_->entries.push_back(std::move(entry));
+      }
+
+      template<bool isConstGetter, typename Cls, typename RetT, typename ArgT>
+      void add_property(typename std::conditional<isConstGetter, RetT(Cls::*)() const, RetT(Cls::*)()>::type getter,
+         void(Cls::*setter)(ArgT), const char* name)
+      {
+         typedef typename detail::MethodInfo<isConstGetter, Cls, RetT>::MethodRuntime GetterRuntime;
+         typedef typename detail::MethodInfo<false, Cls, void, ArgT>::MethodRuntime SetterRuntime;
+
+         check_open();
+         detail::BindingEntry entry = make_entry(detail::BindingEntry::PROPERTY, name, type(detail::class_id<Cls>())->id());
+
+         if (getter != nullptr) {
+            entry.func = GetterRuntime::call_native_method;
+            entry.magic = add_slot(getter);
+         }
+         else {
+            entry.func = dukglue_throw_error;
+            entry.nargs = 1;
+         }
+
+         if (setter != nullptr) {
+            entry.setter = SetterRuntime::call_native_method;
+            entry.setter_magic = add_slot(setter);
+         }
+         else {
+            entry.setter = dukglue_throw_error;
+         }
+
+         data_->entries.push_back(std::move(entry));
+      }
+
+      void add_constructor(duk_c_function func, duk_idx_t nargs, void(*push_prototype)(duk_context*), class_id_t cls, const char* name)
+      {
+         check_open();
+         detail::BindingEntry entry = make_entry(detail::BindingEntry::CONSTRUCTOR, name, type(cls)->id());
+         entry.func = func;
+         entry.nargs = nargs;
+         entry.push_prototype = push_prototype;
+         data_->entries.push_back(std::move(entry));
+      }
+
+      static void apply_entry(duk_context* ctx, const detail::BindingEntry& entry)
+      {
+         using namespace detail;
+
+         switch (entry.kind) {
+         case BindingEntry::FUNCTION:
+         case BindingEntry::CONSTRUCTOR:
+            push_global(ctx, entry);
+            duk_put_global_string(ctx, entry.name.c_str());
+            break;
+
+         case BindingEntry::METHOD:
+            ProtoManager::push_prototype(ctx, entry.cls);
+            push_function(ctx, entry.func, entry.nargs, entry.magic);
+            duk_put_prop_string(ctx, -2, entry.name.c_str());
+            ProtoManager::member_added(ctx, -1, entry.cls, entry.name.c_str());
+            duk_pop(ctx);  // pop prototype
+            break;
+
+         case BindingEntry::PROPERTY: {
+            ProtoManager::push_prototype(ctx, entry.cls);
+            duk_push_string(ctx, entry.name.c_str());
+            push_function(ctx, entry.func, entry.nargs, entry.magic);
+            push_function(ctx, entry.setter, 1, entry.setter_magic);
+
+            // (the same flags as dukglue_register_property)
+            duk_uint_t flags = DUK_DEFPROP_HAVE_GETTER
+               | DUK_DEFPROP_HAVE_SETTER
+               | DUK_DEFPROP_HAVE_CONFIGURABLE
+               | DUK_DEFPROP_FORCE;
+
+            duk_def_prop(ctx, -4, flags);
+            ProtoManager::member_added(ctx, -1, entry.cls, entry.name.c_str());
+            duk_pop(ctx);  // pop prototype
+            break;
+         }
+
+         case BindingEntry::BASE_CLASS:
+            // (type infos already know their base classes)
+            ProtoManager::push_prototype(ctx, entry.cls);
+            ProtoManager::push_prototype(ctx, entry.base);
+            ProtoManager::inherit_prototype(ctx, -2, -1);
+            duk_pop_2(ctx);
+            break;
+         }
+      }
+
+      // Pushes the function for a FUNCTION or CONSTRUCTOR entry.
+      // Stack: ... -> ... [func]
+      static void push_global(duk_context* ctx, const detail::BindingEntry& entry)
+      {
+         push_function(ctx, entry.func, entry.nargs, entry.magic);
+
+         if (entry.kind == detail::BindingEntry::CONSTRUCTOR) {
+            if (entry.push_prototype != nullptr)
+               entry.push_prototype(ctx);
+            else
+               detail::ProtoManager::push_prototype(ctx, entry.cls);
+            duk_put_prop_string(ctx, -2, "prototype");
+         }
+      }
+
+      static void push_function(duk_context* ctx, duk_c_function func, duk_idx_t nargs, duk_int_t magic)
+      {
+         duk_push_c_function(ctx, func, nargs);
+         if (magic != 0)
+            duk_set_magic(ctx, -1, magic);
+      }
+
+      std::shared_ptr<detail::BindingSetData> data_;
+   };
+}
+
+#endif
@@ -0,0 +1,155 @@
+#ifndef _CLASS_ALLOCATOR_20240506_H
+#define _CLASS_ALLOCATOR_20240506_H 1
+
+#include "detail_slab_pool.h"
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+
+namespace dukglue
+{
+   // Allocates Cls objects from SlabPool: thread-local free lists per size class (see SlabPool for
+   // how memory moves between threads, and why it is kept for the life of the process).
+   // Types too large or too aligned for it get operator new.
+   template<typename Cls>
+   struct slab_allocator
+   {
+      static const bool uses_new = false;
+
+      static void* allocate()
+      {
+         return detail::SlabPool::allocate(sizeof(Cls));
+      }
+
+      static void deallocate(void* ptr)
+      {
+         detail::SlabPool::deallocate(ptr, sizeof(Cls));
+      }
+   };
+
+   // Allocates Cls objects with operator new, like new Cls(...) does.
+   template<typename Cls>
+   struct new_delete_allocator
+   {
+      // objects can be deleted with delete (so scripts can give them up as a std::unique_ptr)
+      static const bool uses_new = true;
+
+      static void* allocate()
+      {
+         return ::operator new(sizeof(Cls));
+      }
+
+      static void deallocate(void* ptr)
+      {
+         ::operator delete(ptr);
+      }
+   };
+
+   namespace detail
+   {
+      template<typename Cls>
+      struct DefaultClassAllocator
+      {
+         typedef typename std::conditional<
+            alignof(Cls) <= alignof(std::max_align_t) && sizeof(Cls) <= SlabPool::MAX_SIZE,
+            slab_allocator<Cls>,
+            new_delete_allocator<Cls>
+         >::type type;
+      };
+   }
+}
+
+// The allocator for objects constructed by managed constructors (dukglue_register_constructor_managed
+// and friends), which are freed by their script object's finalizer. Specialize it to change how a class
+// is allocated:
+//
+//   template<>
+//   struct dukglue_class_allocator<Vec2> : dukglue::new_delete_allocator<Vec2> {};
+//
+// An allocator has static void* allocate() and void deallocate(void*) for one Cls-sized block, and a
+// static const bool uses_new, true if the block can be freed by delete. Objects from an allocator that
+// doesn't use new can't be read as a std::unique_ptr (scripts can't give them up to native code).
+// The specialization must be visible wherever the constructor is registered.
+//
+// By default, small classes are allocated from a thread-local size-class pool (dukglue::slab_allocator).
+// Objects created with a non-managed constructor are always allocated with new, since native code
+// deletes them.
+template<typename Cls>
+struct dukglue_class_allocator : dukglue::detail::DefaultClassAllocator<Cls>::type {};
+
+namespace dukglue
+{
+   namespace detail
+   {
+      // Allocation counters for a class, over all threads (see dukglue_get_class_alloc_stats).
+      struct ClassAllocStats
+      {
+         std::size_t allocations;
+         std::size_t deallocations;
+
+         std::size_t live() const
+         {
+            return allocations - deallocations;
+         }
+      };
+
+      // Constructs and destroys managed objects through dukglue_class_allocator<Cls>, counting them.
+      template<typename Cls>
+      struct ClassAllocation
+      {
+         typedef dukglue_class_allocator<Cls> Allocator;
+
+         static ClassAllocStats stats()
+         {
+            // (the counts are read one after the other, so live() can be off while other threads allocate)
+            const std::size_t deallocations = counters().deallocations.load(std::memory_order_relaxed);
+            ClassAllocStats stats = { counters().allocations.load(std::memory_order_relaxed), deallocations };
+            return stats;
+         }
+
+         // Constructs a Cls in allocator memory with make(memory), which must return the
+         // new object (a placement new). If it throws, the memory is given back.
+         template<typename Make>
+         static Cls* create(Make make)
+         {
+            void* memory = Allocator::allocate();
+            Cls* obj;
+            try {
+               obj = make(memory);
+            }
+            catch (...) {
+               Allocator::deallocate(memory);
+               throw;
+            }
+
+            counters().allocations.fetch_add(1, std::memory_order_relaxed);
+            return obj;
+         }
+
+         static void destroy(Cls* obj)
+         {
+            obj->~Cls();
+            Allocator::deallocate(obj);
+            counters().deallocations.fetch_add(1, std::memory_order_relaxed);
+         }
+
+      private:
+         // global, since objects can be destroyed on another thread than the one that created them
+         struct Counters
+         {
+            std::atomic<std::size_t> allocations;
+            std::atomic<std::size_t> deallocations;
+         };
+
+         static Counters& counters()
+         {
+            static Counters counters = { {0}, {0} };
+            return counters;
+         }
+      };
+   }
+}
+
+#endif
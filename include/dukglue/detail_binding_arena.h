@@ -0,0 +1,118 @@
+#ifndef _DETAIL_BINDING_ARENA_20240506_H
+#define _DETAIL_BINDING_ARENA_20240506_H 1
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace dukglue
+{
+   namespace detail
+   {
+      // Bump allocator for native data that lives as long as a heap does
+      // (like the captures of lambdas bound with dukglue_register_function).
+      // Objects are carved out of large chunks instead of getting one allocation each,
+      // and are destroyed (in reverse order of creation) when the arena is destroyed.
+      // Objects never move, so pointers to them stay valid for the arena's lifetime.
+      class BindingArena
+      {
+      public:
+         BindingArena() {}
+
+         ~BindingArena()
+         {
+            for (auto it = destructors_.rbegin(); it != destructors_.rend(); ++it)
+               it->destroy(it->obj);
+
+            for (auto& chunk : chunks_)
+               std::free(chunk.data);
+         }
+
+         // Move or copy value into the arena and return a pointer to the arena's copy.
+         template<typename T>
+         typename std::decay<T>::type* create(T&& value)
+         {
+            typedef typename std::decay<T>::type Stored;
+            static_assert(alignof(Stored) <= alignof(std::max_align_t), "Over-aligned types can't be stored in a BindingArena");
+
+            // make room first, so recording the destructor can't fail once the object is constructed
+            if (!std::is_trivially_destructible<Stored>::value && destructors_.size() == destructors_.capacity())
+               destructors_.reserve(destructors_.empty() ? 16 : destructors_.size() * 2);
+
+            void* mem = allocate(sizeof(Stored), alignof(Stored));
+            Stored* obj = new (mem) Stored(std::forward<T>(value));
+
+            if (!std::is_trivially_destructible<Stored>::value) {
+               Destructor d = { &destroy<Stored>, obj };
+               destructors_.push_back(d);
+            }
+
+            return obj;
+         }
+
+      private:
+         BindingArena(const BindingArena&) = delete;
+         BindingArena& operator=(const BindingArena&) = delete;
+
+         static const std::size_t CHUNK_SIZE = 4096;
+
+         struct Chunk
+         {
+            char* data;
+            std::size_t used;
+            std::size_t size;
+         };
+
+         struct Destructor
+         {
+            void(*destroy)(void*);
+            void* obj;
+         };
+
+         template<typename T>
+         static void destroy(void* obj)
+         {
+            static_cast<T*>(obj)->~T();
+         }
+
+         void* allocate(std::size_t size, std::size_t align)
+         {
+            if (!chunks_.empty()) {
+               Chunk& chunk = chunks_.back();
+               std::size_t offset = (chunk.used + align - 1) & ~(align - 1);
+               if (offset + size <= chunk.size) {
+                  chunk.used = offset + size;
+                  return chunk.data + offset;
+               }
+            }
+
+            // need a new chunk (malloc'd memory is suitably aligned for any fundamental type)
+            static_assert(CHUNK_SIZE % alignof(std::max_align_t) == 0, "CHUNK_SIZE must be a multiple of max_align_t");
+            const std::size_t chunk_size = (size > CHUNK_SIZE ? size : CHUNK_SIZE);
+            char* data = static_cast<char*>(std::malloc(chunk_size));
+            if (data == nullptr)
+               throw std::bad_alloc();
+
+            Chunk chunk = { data, size, chunk_size };
+
+            // keep bump allocating from the chunk with the most space left
+            if (chunks_.empty() || chunk_size - size >= chunks_.back().size - chunks_.back().used) {
+               chunks_.push_back(chunk);
+            }
+            else {
+               chunks_.insert(chunks_.end() - 1, chunk);
+            }
+
+            return data;
+         }
+
+         std::vector<Chunk> chunks_;
+         std::vector<Destructor> destructors_;
+      };
+   }
+}
+
+#endif
@@ -0,0 +1,135 @@
+#ifndef _DETAIL_CALLABLE_20240506_H
+#define _DETAIL_CALLABLE_20240506_H 1
+
+#include "detail_stack.h"
+
+namespace dukglue
+{
+   namespace detail
+   {
+      // Generates a Duktape C function that calls a callable object (lambda, functor, std::function...).
+      // The callable is moved into the heap's binding arena when it is registered,
+      // and found at run time through the function's magic value.
+      // Callable is known at compile time, so operator() is called directly (and can be inlined).
+      template<typename Callable, typename RetType, typename... Ts>
+      struct CallableInfo
+      {
+         static duk_ret_t call_native_function(duk_context* ctx)
+         {
+            Callable* callable = DukglueHeapState::current_binding<Callable*>(ctx);
+
+            actually_call(ctx, *callable, dukglue::detail::get_stack_values<Ts...>(ctx));
+            return std::is_void<RetType>::value ? 0 : 1;
+         }
+
+         // Same as call_native_function, without argument type checks (see dukglue_set_trusted).
+         static duk_ret_t call_native_function_trusted(duk_context* ctx)
+         {
+            Callable* callable = DukglueHeapState::current_binding<Callable*>(ctx);
+
+            actually_call(ctx, *callable, dukglue::detail::get_stack_values_trusted<Ts...>(ctx));
+            return std::is_void<RetType>::value ? 0 : 1;
+         }
+
+         // Moves callable into the heap's binding arena and pushes a Duktape function that calls it.
+         template<typename T>
+         static void push(duk_context* ctx, T&& callable)
+         {
+            DukglueHeapState* state = DukglueHeapState::require(ctx);
+
+            duk_push_c_function(ctx, state->trusted ? call_native_function_trusted : call_native_function, sizeof...(Ts));
+            DukglueHeapState::set_binding(ctx, -1, state->arena.create(std::forward<T>(callable)));
+         }
+
+         // Callable along with default values for its trailing arguments.
+         template<typename... Ds>
+         struct WithDefaults
+         {
+            Callable callable;
+            std::tuple<Ds...> defaults;
+         };
+
+         template<typename... Ds>
+         static duk_ret_t call_native_function_defaults(duk_context* ctx)
+         {
+            WithDefaults<Ds...>* binding = DukglueHeapState::current_binding<WithDefaults<Ds...>*>(ctx);
+
+            actually_call(ctx, binding->callable, dukglue::detail::get_stack_values<Ts...>(ctx, binding->defaults));
+            return std::is_void<RetType>::value ? 0 : 1;
+         }
+
+         template<typename T, typename... Ds>
+         static void push(duk_context* ctx, T&& callable, Defaults<Ds...>&& defaults)
+         {
+            DukglueHeapState* state = DukglueHeapState::require(ctx);
+            WithDefaults<Ds...> binding = { std::forward<T>(callable), std::move(defaults.values) };
+
+            duk_push_c_function(ctx, call_native_function_defaults<Ds...>, sizeof...(Ts));
+            DukglueHeapState::set_binding(ctx, -1, state->arena.create(std::move(binding)));
+         }
+
+      private:
+         // this mess is to support functions with void return values
+         template<typename Dummy = RetType, typename... BakedTs>
+         static typename std::enable_if<!std::is_void<Dummy>::value>::type actually_call(duk_context* ctx, Callable& callable, std::tuple<BakedTs...>&& args)
+         {
+            // ArgStorage has some static_asserts in it that validate value types,
+            // so we typedef it to force ArgStorage<RetType> to compile and run the asserts
+            typedef typename dukglue::types::ArgStorage<RetType>::type ValidateReturnType;
+            (void) sizeof(ValidateReturnType);
+
+            RetType return_val = dukglue::detail::apply_callable<RetType, Ts...>(callable, std::move(args));
+
+            using namespace dukglue::types;
+            DukType<typename Bare<RetType>::type>::template push<RetType>(ctx, std::move(return_val));
+         }
+
+         template<typename Dummy = RetType, typename... BakedTs>
+         static typename std::enable_if<std::is_void<Dummy>::value>::type actually_call(duk_context*, Callable& callable, std::tuple<BakedTs...>&& args)
+         {
+            dukglue::detail::apply_callable<RetType, Ts...>(callable, std::move(args));
+         }
+      };
+
+      // Deduces the signature of a callable object from its operator().
+      // (Generic lambdas and functors with overloaded operator() can't be deduced.)
+      template<typename Callable, typename CallOperator>
+      struct CallableInfoFromOperator;
+
+      template<typename Callable, typename Cls, typename RetType, typename... Ts>
+      struct CallableInfoFromOperator<Callable, RetType(Cls::*)(Ts...)> : CallableInfo<Callable, RetType, Ts...> {};
+
+      template<typename Callable, typename Cls, typename RetType, typename... Ts>
+      struct CallableInfoFromOperator<Callable, RetType(Cls::*)(Ts...) const> : CallableInfo<Callable, RetType, Ts...> {};
+
+#if defined(__cpp_noexcept_function_type) && __cpp_noexcept_function_type >= 201510L
+      template<typename Callable, typename Cls, typename RetType, typename... Ts>
+      struct CallableInfoFromOperator<Callable, RetType(Cls::*)(Ts...) noexcept> : CallableInfo<Callable, RetType, Ts...> {};
+
+      template<typename Callable, typename Cls, typename RetType, typename... Ts>
+      struct CallableInfoFromOperator<Callable, RetType(Cls::*)(Ts...) const noexcept> : CallableInfo<Callable, RetType, Ts...> {};
+#endif
+
+      template<typename Callable>
+      struct CallableInfoOf : CallableInfoFromOperator<Callable, decltype(&Callable::operator())> {};
+
+      // True for callable objects (as opposed to function pointers).
+      template<typename T>
+      struct IsCallableObject : std::is_class<typename std::decay<T>::type> {};
+
+      // Stack: ... -> ... [func]
+      template<typename Callable>
+      void push_callable(duk_context* ctx, Callable&& callable)
+      {
+         CallableInfoOf<typename std::decay<Callable>::type>::push(ctx, std::forward<Callable>(callable));
+      }
+
+      template<typename Callable, typename... Ds>
+      void push_callable(duk_context* ctx, Callable&& callable, Defaults<Ds...>&& defaults)
+      {
+         CallableInfoOf<typename std::decay<Callable>::type>::push(ctx, std::forward<Callable>(callable), std::move(defaults));
+      }
+   }
+}
+
+#endif
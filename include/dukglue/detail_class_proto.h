@@ -2,6 +2,8 @@
 #ifndef _DETAIL_CLASS_PROTO_H_20240506_H
 #define _DETAIL_CLASS_PROTO_H_20240506_H 1
 
+#include "detail_heap_state.h"
+#include "detail_refs.h"
 #include "detail_typeinfo.h"
 
 #include <assert.h>
@@ -15,22 +17,23 @@ namespace dukglue {
          template <typename Cls>
          static void push_prototype(duk_context* ctx)
          {
-            push_prototype(ctx, TypeInfo(typeid(Cls)));
+            push_prototype(ctx, class_id<Cls>());
          }
 
-         static void push_prototype(duk_context* ctx, const TypeInfo& check_info)
+         // Pushes the prototype of the class with ID id.
+         static void push_prototype(duk_context* ctx, class_id_t id)
          {
-            if (!find_and_push_prototype(ctx, check_info)) {
+            if (!find_and_push_prototype(ctx, id)) {
                // nope, need to create our prototype object
                duk_push_object(ctx);
 
                // add reference to this class' info object so we can do type checking
                // when trying to pass this object into method calls
                typedef dukglue::detail::TypeInfo TypeInfo;
-               TypeInfo* info = new TypeInfo(check_info);
+               TypeInfo* info = new TypeInfo(id);
 
                duk_push_pointer(ctx, info);
-               duk_put_prop_string(ctx, -2, "\xFF" "type_info");
+               put_hidden_prop(ctx, -2, KEY_TYPE_INFO);
 
                // Clean up the TypeInfo object when this prototype is destroyed.
                // We can't put a finalizer directly on this prototype, because it
@@ -42,7 +45,7 @@ namespace dukglue {
                // during shutdown, you can probably comment out this part.
                duk_push_object(ctx);
                duk_push_pointer(ctx, info);
-               duk_put_prop_string(ctx, -2, "\xFF" "type_info");
+               put_hidden_prop(ctx, -2, KEY_TYPE_INFO);
                duk_push_c_function(ctx, type_info_finalizer, 1);
                duk_set_finalizer(ctx, -2);
                duk_put_prop_string(ctx, -2, "\xFF" "type_info_finalizer");
@@ -52,16 +55,152 @@ namespace dukglue {
             }
          }
 
+         // Creates the prototype of info's class, with info shared between heaps instead of owned by
+         // this one (see BindingSet). Returns false, pushing nothing, if the class already has a prototype.
+         // Stack: ... -> ... [proto]
+         static bool push_shared_prototype(duk_context* ctx, TypeInfo* info)
+         {
+            if (has_prototype(ctx, info->id()))
+               return false;
+
+            duk_push_object(ctx);
+            duk_push_pointer(ctx, info);
+            put_hidden_prop(ctx, -2, KEY_TYPE_INFO);
+
+            register_prototype(ctx, info);
+            return true;
+         }
+
+         // True if the class with ID id has a prototype in ctx's heap.
+         static bool has_prototype(duk_context* ctx, class_id_t id)
+         {
+            const DukglueHeapState* state = DukglueHeapState::require(ctx);
+            return id < state->prototypes.size() && state->prototypes[id] != nullptr;
+         }
+
+         // Makes the prototype at derived_idx inherit the members of the prototype at base_idx.
+         // A prototype has a single prototype chain, so it goes to the first base class; the members of
+         // further base classes (and of their own base classes) are copied over instead, skipping any
+         // the derived prototype already has. Members registered on those later are copied when they
+         // are registered (see member_added).
+         // Stack: unchanged
+         static void inherit_prototype(duk_context* ctx, duk_idx_t derived_idx, duk_idx_t base_idx)
+         {
+            derived_idx = duk_normalize_index(ctx, derived_idx);
+            base_idx = duk_normalize_index(ctx, base_idx);
+
+            duk_get_prototype(ctx, derived_idx);
+            const bool has_base = is_class_prototype(ctx, -1);
+            duk_pop(ctx);
+
+            if (!has_base) {
+               duk_dup(ctx, base_idx);
+               duk_set_prototype(ctx, derived_idx);
+               return;
+            }
+
+            // remember the copy, so members registered on base later get copied too
+            DukglueHeapState* state = DukglueHeapState::require(ctx);
+            const CopiedBase copied = { prototype_class(ctx, base_idx), prototype_class(ctx, derived_idx) };
+            state->copied_bases.push_back(copied);
+
+            duk_dup(ctx, base_idx);  // ... [proto]
+            while (is_class_prototype(ctx, -1)) {
+               const duk_idx_t proto_idx = duk_get_top_index(ctx);
+
+               duk_enum(ctx, proto_idx, DUK_ENUM_OWN_PROPERTIES_ONLY | DUK_ENUM_INCLUDE_NONENUMERABLE);
+               while (duk_next(ctx, -1, 0)) {  // ... [proto] [enum] [key]
+                  copy_member(ctx, derived_idx, proto_idx);
+                  duk_pop(ctx);  // pop key
+               }
+               duk_pop(ctx);  // pop enum
+
+               duk_get_prototype(ctx, proto_idx);
+               duk_remove(ctx, proto_idx);
+            }
+            duk_pop(ctx);
+         }
+
+         // To be called after a member is put into the prototype at proto_idx, of the class with ID id:
+         // copies it into the prototypes it has been copied into by inherit_prototype (those of classes
+         // with id, or a class inheriting from it, as a further base class), and on to theirs.
+         // Stack: unchanged
+         static void member_added(duk_context* ctx, duk_idx_t proto_idx, class_id_t id, const char* name)
+         {
+            const DukglueHeapState* state = DukglueHeapState::require(ctx);
+            if (state->copied_bases.empty())
+               return;
+
+            proto_idx = duk_normalize_index(ctx, proto_idx);
+            duk_push_string(ctx, name);  // ... [key]
+
+            for (const CopiedBase& copied : state->copied_bases) {
+               const TypeInfo* base_info = copied.base < state->type_infos.size() ? state->type_infos[copied.base] : nullptr;
+               if (base_info == nullptr || !base_info->is_a(id))
+                  continue;
+
+               duk_push_heapptr(ctx, state->prototypes[copied.derived]);  // ... [key] [derived]
+               duk_swap_top(ctx, -2);  // ... [derived] [key]
+               if (copy_member(ctx, -2, proto_idx))
+                  member_added(ctx, -2, copied.derived, name);
+               duk_remove(ctx, -2);  // pop derived
+            }
+            duk_pop(ctx);  // pop key
+         }
+
+         // Returns the ID of the class whose prototype the script object got.
          template<typename Cls>
-         static void make_script_object(duk_context* ctx, Cls* obj)
+         static class_id_t make_script_object(duk_context* ctx, Cls* obj)
          {
             assert(obj != nullptr);
 
             duk_push_object(ctx);
-            duk_push_pointer(ctx, obj);
-            duk_put_prop_string(ctx, -2, "\xFF" "obj_ptr");
+            class_id_t proto_id;
+            void* stored_ptr = push_object_prototype(ctx, obj, proto_id);
+            duk_set_prototype(ctx, -2);
+
+            put_object_ptr(ctx, stored_ptr, obj);
+            return proto_id;
+         }
+
+      private:
+         // Sets the native object pointer of a new script object: the object as the class of its prototype
+         // (see push_object_prototype). If that's not the pointer the object was pushed as, which the
+         // registry knows it by, that one is kept too (see get_registered_ptr).
+         // Stack: ... [object]  ->  ... [object]
+         template<typename Cls>
+         static void put_object_ptr(duk_context* ctx, void* stored_ptr, Cls* obj)
+         {
+            duk_push_pointer(ctx, stored_ptr);
+            put_hidden_prop(ctx, -2, KEY_OBJ_PTR);
+
+            void* pushed_ptr = const_cast<void*>(static_cast<const volatile void*>(obj));
+            if (stored_ptr != pushed_ptr) {
+               duk_push_pointer(ctx, pushed_ptr);
+               put_hidden_prop(ctx, -2, KEY_PUSHED_PTR);
+            }
+         }
+
+         // Pushes the prototype for a script object for obj, and returns the pointer the script object
+         // should hold: obj as the class of the prototype, which is obj's run-time class (see
+         // dynamic_class_id). That can be a class derived from Cls, at another address if it has several
+         // base classes. Without RTTI, the address is found through the run-time class' base classes,
+         // and the prototype for Cls is used if that can't be done.
+         // proto_id is set to the ID of the class whose prototype was pushed.
+         // Stack: ... -> ... [proto]
+         template<typename Cls>
+         static void* push_object_prototype(duk_context* ctx, Cls* obj, class_id_t& proto_id)
+         {
+            void* obj_ptr = const_cast<void*>(static_cast<const volatile void*>(obj));
+            const class_id_t static_id = class_id<Cls>();
+            const class_id_t dynamic_id = dynamic_class_id(obj);
+
+            proto_id = static_id;
+            if (dynamic_id == static_id) {
+               push_prototype(ctx, static_id);
+               return obj_ptr;
+            }
 
-            // push the appropriate prototype
 #ifdef DUKGLUE_INFER_BASE_CLASS
             // In the "infer base class" case, we push the prototype
             // corresponding to the compile-time class if no prototype
@@ -82,130 +221,229 @@ namespace dukglue {
             // dukglue_set_base_class() to be called, so it is opt-in via an ifdef.
 
             // does a prototype exist for the run-time type? if so, push it
-            if (!find_and_push_prototype(ctx, TypeInfo(typeid(*obj)))) {
+            if (!find_and_push_prototype(ctx, dynamic_id)) {
                // nope, find or create the prototype for the compile-time type
                // and push that
-               push_prototype<Cls>(ctx);
+               push_prototype(ctx, static_id);
+               return obj_ptr;
             }
 #else
             // always use the prototype for the run-time type
-            push_prototype(ctx, TypeInfo(typeid(*obj)));
+            push_prototype(ctx, dynamic_id);
 #endif
+            proto_id = dynamic_id;
+
+#ifndef DUKGLUE_NO_RTTI
+            if (std::is_polymorphic<Cls>::value)
+               return most_derived_ptr(obj);
+#endif
+
+            get_hidden_prop(ctx, -1, KEY_TYPE_INFO);
+            const TypeInfo* info = static_cast<const TypeInfo*>(duk_get_pointer(ctx, -1));
+            duk_pop(ctx);
+
+            void* derived_ptr = info != nullptr ? info->from_ancestor(obj_ptr, static_id) : nullptr;
+            if (derived_ptr == nullptr) {
+               duk_pop(ctx);
+               push_prototype(ctx, static_id);
+               return obj_ptr;
+            }
+
+            return derived_ptr;
+         }
+
+         // Copies the member with the key on top of the stack from the prototype at proto_idx (which has it
+         // as an own property) into the prototype at derived_idx, unless that (or a class prototype it
+         // inherits from) already has a member with the key. Returns true if it was copied.
+         // Getters and setters are copied as they are. This only uses the C API, since scripts may have
+         // changed anything they can reach (Object.defineProperty, Object.prototype, ...).
+         // Stack: ... [key]  ->  ... [key]
+         static bool copy_member(duk_context* ctx, duk_idx_t derived_idx, duk_idx_t proto_idx)
+         {
+            derived_idx = duk_normalize_index(ctx, derived_idx);
+            proto_idx = duk_normalize_index(ctx, proto_idx);
+
+            if (has_class_member(ctx, derived_idx))
+               return false;
+
+            duk_dup(ctx, -1);
+            duk_get_prop_desc(ctx, proto_idx, 0);  // ... [key] [desc]
+            if (!duk_is_object(ctx, -1)) {
+               duk_pop(ctx);
+               return false;
+            }
 
+            // read the descriptor's own properties only (undefined means no prototype here)
+            duk_push_undefined(ctx);
             duk_set_prototype(ctx, -2);
+            const duk_idx_t desc_idx = duk_get_top_index(ctx);
+
+            duk_uint_t flags = DUK_DEFPROP_HAVE_ENUMERABLE | DUK_DEFPROP_HAVE_CONFIGURABLE;
+            duk_get_prop_string(ctx, desc_idx, "enumerable");
+            if (duk_to_boolean(ctx, -1))
+               flags |= DUK_DEFPROP_ENUMERABLE;
+            duk_get_prop_string(ctx, desc_idx, "configurable");
+            if (duk_to_boolean(ctx, -1))
+               flags |= DUK_DEFPROP_CONFIGURABLE;
+            duk_pop_2(ctx);
+
+            duk_dup(ctx, desc_idx - 1);  // ... [key] [desc] [key]
+            if (duk_has_prop_string(ctx, desc_idx, "get") || duk_has_prop_string(ctx, desc_idx, "set")) {
+               flags |= DUK_DEFPROP_HAVE_GETTER | DUK_DEFPROP_HAVE_SETTER;
+               duk_get_prop_string(ctx, desc_idx, "get");
+               duk_get_prop_string(ctx, desc_idx, "set");
+            }
+            else {
+               flags |= DUK_DEFPROP_HAVE_VALUE | DUK_DEFPROP_HAVE_WRITABLE;
+               duk_get_prop_string(ctx, desc_idx, "writable");
+               if (duk_to_boolean(ctx, -1))
+                  flags |= DUK_DEFPROP_WRITABLE;
+               duk_pop(ctx);
+               duk_get_prop_string(ctx, desc_idx, "value");
+            }
+
+            duk_def_prop(ctx, derived_idx, flags);  // ... [key] [desc]
+            duk_pop(ctx);  // pop desc
+            return true;
+         }
+
+         // True if the class prototype at idx, or one it inherits from, has an own member with the key on
+         // top of the stack (Object.prototype and the like aren't asked).
+         // Stack: ... [key]  ->  ... [key]
+         static bool has_class_member(duk_context* ctx, duk_idx_t idx)
+         {
+            duk_dup(ctx, idx);  // ... [key] [proto]
+            bool found = false;
+            while (!found && is_class_prototype(ctx, -1)) {
+               duk_dup(ctx, -2);
+               duk_get_prop_desc(ctx, -2, 0);
+               found = !duk_is_undefined(ctx, -1);
+               duk_pop(ctx);  // pop desc
+
+               duk_get_prototype(ctx, -1);
+               duk_remove(ctx, -2);
+            }
+            duk_pop(ctx);
+            return found;
+         }
+
+         // The ID of the class of the class prototype at idx.
+         static class_id_t prototype_class(duk_context* ctx, duk_idx_t idx)
+         {
+            get_hidden_prop(ctx, idx, KEY_TYPE_INFO);
+            const TypeInfo* info = static_cast<const TypeInfo*>(duk_require_pointer(ctx, -1));
+            duk_pop(ctx);
+            return info->id();
+         }
+
+         // True if the value at idx is a class prototype (or inherits from one).
+         static bool is_class_prototype(duk_context* ctx, duk_idx_t idx)
+         {
+            if (!duk_is_object(ctx, idx))
+               return false;
+
+            get_hidden_prop(ctx, idx, KEY_TYPE_INFO);
+            const bool found = duk_is_pointer(ctx, -1) != 0;
+            duk_pop(ctx);
+            return found;
          }
 
-      private:
          static duk_ret_t type_info_finalizer(duk_context* ctx)
          {
-            duk_get_prop_string(ctx, 0, "\xFF" "type_info");
+            get_hidden_prop(ctx, 0, KEY_TYPE_INFO);
             dukglue::detail::TypeInfo* info = static_cast<dukglue::detail::TypeInfo*>(duk_require_pointer(ctx, -1));
             delete info;
 
             // set pointer to NULL in case this finalizer runs again
             duk_push_pointer(ctx, nullptr);
-            duk_put_prop_string(ctx, 0, "\xFF" "type_info");
+            put_hidden_prop(ctx, 0, KEY_TYPE_INFO);
 
             return 0;
          }
 
-         // puts heap_stash["dukglue_prototypes"] on the stack,
-         // or creates it if it doesn't exist
-         static void push_prototypes_array(duk_context* ctx)
-         {
-            static const char* DUKGLUE_PROTOTYPES = "dukglue_prototypes";
+         // Stack: ... [proto]  ->  ... [proto]
+         static void register_prototype(duk_context* ctx, const TypeInfo* info) {
+            DukglueHeapState* state = DukglueHeapState::require(ctx);
 
-            duk_push_heap_stash(ctx);
+            // append it to the prototypes array (keeping it alive), then index it
+            duk_push_heapptr(ctx, state->prototypes_array);
+            duk_dup(ctx, -2);
+            duk_put_prop_index(ctx, -2, static_cast<duk_uarridx_t>(duk_get_length(ctx, -2)));
+            duk_pop(ctx);  // pop prototypes_array
 
-            // does the prototype array already exist?
-            if (!duk_has_prop_string(ctx, -1, DUKGLUE_PROTOTYPES)) {
-               // nope, we need to create it
-               duk_push_array(ctx);
-               duk_put_prop_string(ctx, -2, DUKGLUE_PROTOTYPES);
+            if (info->id() >= state->prototypes.size()) {
+               state->prototypes.resize(info->id() + 1, nullptr);
+               state->type_infos.resize(info->id() + 1, nullptr);
             }
+            state->prototypes[info->id()] = duk_get_heapptr(ctx, -1);
+            state->type_infos[info->id()] = info;
+         }
 
-            duk_get_prop_string(ctx, -1, DUKGLUE_PROTOTYPES);
+         // A prototype a BindingSet left empty gets its members when it is first pushed (see BindingSet::apply_lazy).
+         static bool find_and_push_prototype(duk_context* ctx, class_id_t id) {
+            const DukglueHeapState* state = DukglueHeapState::require(ctx);
 
-            // remove the heap stash from the stack
-            duk_remove(ctx, -2);
-         }
+            if (id >= state->prototypes.size() || state->prototypes[id] == nullptr)
+               return false;
 
-         // Stack: ... [proto]  ->  ... [proto]
-         static void register_prototype(duk_context* ctx, const TypeInfo* info) {
-            // 1. We assume info is not in the prototype array already
-            // 2. Duktape has no efficient "shift array indices" operation (at least publicly)
-            // 3. This method doesn't need to be fast, it's only called during registration
-
-            // Work from high to low in the prototypes array, shifting as we go,
-            // until we find the spot for info.
-
-            push_prototypes_array(ctx);
-            duk_size_t i = duk_get_length(ctx, -1);
-            assert(i >= 0);
-            while (i > 0) {
-               duk_uarridx_t arr_idx = static_cast<duk_uarridx_t>(i) - 1;
-               duk_get_prop_index(ctx, -1, arr_idx);
-
-               duk_get_prop_string(ctx, -1, "\xFF" "type_info");
-               const TypeInfo* chk_info = static_cast<TypeInfo*>(duk_require_pointer(ctx, -1));
-               duk_pop(ctx);  // pop type_info
-
-               if (*chk_info > *info) {
-                  duk_put_prop_index(ctx, -2, static_cast<duk_uarridx_t>(i));
-                  i--;
-               }
-               else {
-                  duk_pop(ctx);  // pop prototypes_array[i]
-                  break;
-               }
-            }
+            duk_push_heapptr(ctx, state->prototypes[id]);
 
-            //std::cout << "Registering prototype for " << typeid(Cls).name() << " at " << i << std::endl;
+            if (state->num_lazy_prototypes != 0 && id < state->lazy_prototypes.size() && state->lazy_prototypes[id])
+               state->materialize_prototype(ctx, id);
 
-            duk_dup(ctx, -2);  // copy proto to top
-            duk_put_prop_index(ctx, -2, static_cast<duk_uarridx_t>(i));
-            duk_pop(ctx);  // pop prototypes_array
+            return true;
          }
 
-         static bool find_and_push_prototype(duk_context* ctx, const TypeInfo& search_info) {
-            push_prototypes_array(ctx);
+      };
 
-            /*
-                   These are ints and not duk_size_t to deal with negative indices
-                */
-            int min = 0;
-            duk_size_t len = duk_get_length(ctx, -1);
-            int max = static_cast<int>(len) - 1;
+      // For the finalizer of a script object that owns its native object: clears the script object's
+      // pointer and invalidates any other script object for it, then returns the object so the caller
+      // can free it. Returns null if ownership was taken back by native code (see
+      // DukType<std::unique_ptr<T>>), or if the finalizer has already run.
+      // Owned objects are deleted as pushed (for std::unique_ptr<T>, as a T).
+      template <typename Cls>
+      static Cls* take_owned_object(duk_context* ctx, duk_idx_t idx)
+      {
+         Cls* obj = static_cast<Cls*>(get_registered_ptr(ctx, idx));
 
-            while (min <= max) {
-               int mid = (max - min) / 2 + min;
+         if (obj != nullptr) {
+            // for safety, set the pointer to undefined
+            duk_push_undefined(ctx);
+            put_hidden_prop(ctx, idx, KEY_OBJ_PTR);
 
-               duk_get_prop_index(ctx, -1, mid);
+            // the object may also have been pushed as a raw pointer, registering another script
+            // object for it, which would be left dangling
+            RefManager::find_and_invalidate_native_object(ctx, obj);
+         }
 
-               duk_get_prop_string(ctx, -1, "\xFF" "type_info");
-               TypeInfo* mid_info = static_cast<TypeInfo*>(duk_require_pointer(ctx, -1));
-               duk_pop(ctx);  // pop type_info pointer
+         return obj;
+      }
 
-               if (*mid_info == search_info) {
-                  // found it
-                  duk_remove(ctx, -2);  // pop prototypes_array
-                  return true;
-               }
-               else if (*mid_info < search_info) {
-                  min = mid + 1;
-               }
-               else {
-                  max = mid - 1;
-               }
+      // Converts obj_ptr, the native object pointer of the script object at idx, into a Cls*.
+      // The pointer is to the class of the object's prototype, so it needs adjusting if Cls is a base
+      // class at another address (see TypeInfo::cast); until a heap has such a base class, it never does.
+      // The object isn't checked to be a Cls.
+      template <typename Cls>
+      static Cls* object_ptr_as(duk_context* ctx, duk_idx_t idx, void* obj_ptr)
+      {
+         const DukglueHeapState* state = DukglueHeapState::get(ctx);
+         if (state == nullptr || !state->adjusted_casts)
+            return static_cast<Cls*>(obj_ptr);
 
-               duk_pop(ctx);  // pop prototypes_array[mid]
-            }
+         get_hidden_prop(ctx, idx, KEY_TYPE_INFO);
+         const TypeInfo* info = static_cast<const TypeInfo*>(duk_get_pointer(ctx, -1));
+         duk_pop(ctx);
 
-            duk_pop(ctx);  // pop prototypes_array
-            return false;
-         }
+         return info != nullptr ? info->cast<Cls>(obj_ptr) : static_cast<Cls*>(obj_ptr);
+      }
 
-      };
+      // Finalizer for script objects that own a native object pushed as a std::unique_ptr: deletes the object.
+      template <typename Cls>
+      static duk_ret_t managed_finalizer(duk_context* ctx)
+      {
+         delete take_owned_object<Cls>(ctx, 0);
+         return 0;
+      }
    }
 }
 
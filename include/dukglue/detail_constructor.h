@@ -2,6 +2,7 @@
 #ifndef _DETAIL_CONSTRUCTOR_20240506_H
 #define _DETAIL_CONSTRUCTOR_20240506_H 1
 
+#include "class_allocator.h"
 #include "detail_stack.h"
 #include "detail_traits.h"
 
@@ -17,18 +18,27 @@ namespace dukglue {
          }
 
          // construct the new instance
+         // (script-owned instances come from the class's allocator, see dukglue_class_allocator)
          auto constructor_args = dukglue::detail::get_stack_values<Ts...>(ctx);
-         Cls* obj = dukglue::detail::apply_constructor<Cls>(std::move(constructor_args));
+         Cls* obj;
+         if (managed) {
+            obj = ClassAllocation<Cls>::create([&constructor_args](void* memory) {
+               return dukglue::detail::apply_placement_constructor<Cls>(memory, std::move(constructor_args));
+            });
+         }
+         else {
+            obj = dukglue::detail::apply_constructor<Cls>(std::move(constructor_args));
+         }
 
          duk_push_this(ctx);
 
          // make the new script object keep the pointer to the new object instance
          duk_push_pointer(ctx, obj);
-         duk_put_prop_string(ctx, -2, "\xFF" "obj_ptr");
+         put_hidden_prop(ctx, -2, KEY_OBJ_PTR);
 
          // register it
          if (!managed) {
-            dukglue::detail::RefManager::register_native_object(ctx, obj);
+            dukglue::detail::RefManager::register_native_object(ctx, obj, class_id<Cls>());
          }
 
          duk_pop(ctx); // pop this
@@ -45,17 +55,25 @@ namespace dukglue {
          }
 
          // construct the new instance
-         Cls* obj = new Cls(ctx);
+         Cls* obj;
+         if (managed) {
+            obj = ClassAllocation<Cls>::create([ctx](void* memory) {
+               return new (memory) Cls(ctx);
+            });
+         }
+         else {
+            obj = new Cls(ctx);
+         }
 
          duk_push_this(ctx);
 
          // make the new script object keep the pointer to the new object instance
          duk_push_pointer(ctx, obj);
-         duk_put_prop_string(ctx, -2, "\xFF" "obj_ptr");
+         put_hidden_prop(ctx, -2, KEY_OBJ_PTR);
 
          // register it
          if (!managed) {
-            dukglue::detail::RefManager::register_native_object(ctx, obj);
+            dukglue::detail::RefManager::register_native_object(ctx, obj, class_id<Cls>());
          }
 
          duk_pop(ctx); // pop this
@@ -63,37 +81,76 @@ namespace dukglue {
          return 0;
       }
 
+      // Finalizer for script objects constructed by a managed constructor: destroys the object
+      // and gives its memory back to the class's allocator.
       template <typename Cls>
-      static duk_ret_t managed_finalizer(duk_context* ctx)
+      static duk_ret_t allocated_finalizer(duk_context* ctx)
       {
-         duk_get_prop_string(ctx, 0, "\xFF" "obj_ptr");
-         Cls* obj = (Cls*)duk_require_pointer(ctx, -1);
-         duk_pop(ctx);  // pop obj_ptr
+         Cls* obj = take_owned_object<Cls>(ctx, 0);
+         if (obj != nullptr)
+            ClassAllocation<Cls>::destroy(obj);
 
-         if (obj != nullptr) {
-            delete obj;
+         return 0;
+      }
 
-            // for safety, set the pointer to undefined
-            duk_push_undefined(ctx);
-            duk_put_prop_string(ctx, 0, "\xFF" "obj_ptr");
+      // Pushes a new prototype for script objects constructed by a managed constructor:
+      // it inherits from Cls's prototype, and marks objects as owned by their script object
+      // (with a finalizer that destroys them, see allocated_finalizer).
+      // Stack: ... -> ... [prototype]
+      template <typename Cls>
+      static void push_managed_prototype(duk_context* ctx)
+      {
+         duk_push_object(ctx);
+
+         // set the finalizer
+         duk_push_c_function(ctx, allocated_finalizer<Cls>, 1);
+         duk_set_finalizer(ctx, -2);
+
+         duk_push_true(ctx);
+         put_hidden_prop(ctx, -2, KEY_OWNED);
+
+         // objects not allocated with new can't be given up as a std::unique_ptr
+         if (!dukglue_class_allocator<Cls>::uses_new) {
+            duk_push_true(ctx);
+            put_hidden_prop(ctx, -2, KEY_ALLOCATED);
          }
 
-         return 0;
+         // hook prototype with finalizer up to real class prototype
+         // must use duk_set_prototype, not set the .prototype property
+         ProtoManager::push_prototype<Cls>(ctx);
+         duk_set_prototype(ctx, -2);
       }
 
+      // Objects owned by their script object (constructed by a managed constructor, or pushed as a
+      // std::unique_ptr) are freed by running the script object's finalizer, which frees them the way
+      // they were allocated, as the class they were created as (which can be derived from Cls),
+      // and clears the object pointer so it does nothing when the script object is collected.
+      // Other objects are deleted as a Cls.
       template<typename Cls>
       static duk_ret_t call_native_deleter(duk_context* ctx)
       {
          duk_push_this(ctx);
-         duk_get_prop_string(ctx, -1, "\xFF" "obj_ptr");
+         get_hidden_prop(ctx, -1, KEY_OBJ_PTR);
 
          if (!duk_is_pointer(ctx, -1)) {
             duk_error(ctx, DUK_RET_REFERENCE_ERROR, "Object has already been invalidated; cannot delete.");
             return DUK_RET_REFERENCE_ERROR;
          }
 
-         Cls* obj = static_cast<Cls*>(duk_require_pointer(ctx, -1));
-         dukglue_invalidate_object(ctx, obj);
+         get_hidden_prop(ctx, -2, KEY_OWNED);
+         const bool owned = duk_get_boolean(ctx, -1) != 0;
+         duk_pop(ctx);  // pop owned
+
+         if (owned) {
+            duk_get_finalizer(ctx, -2);
+            duk_dup(ctx, -3);
+            duk_call(ctx, 1);
+            duk_pop_3(ctx);  // pop result, pointer and this
+            return 0;
+         }
+
+         Cls* obj = object_ptr_as<Cls>(ctx, -2, duk_require_pointer(ctx, -1));
+         RefManager::find_and_invalidate_native_object(ctx, get_registered_ptr(ctx, -2));
          delete obj;
 
          duk_pop_2(ctx);
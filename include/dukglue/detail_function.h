@@ -4,6 +4,8 @@
 
 #include "detail_stack.h"
 
+#include <mutex>
+
 namespace dukglue
 {
    namespace detail
@@ -26,8 +28,7 @@ namespace dukglue
             // this is not recommended due to the ugly syntax it requires.
             static duk_ret_t call_native_function(duk_context* ctx)
             {
-               auto bakedArgs = dukglue::detail::get_stack_values<Ts...>(ctx);
-               actually_call(ctx, bakedArgs);
+               actually_call(ctx, dukglue::detail::get_stack_values<Ts...>(ctx));
                return std::is_void<RetType>::value ? 0 : 1;
             }
 
@@ -35,70 +36,191 @@ namespace dukglue
             // this mess is to support functions with void return values
 
             template<typename Dummy = RetType, typename... BakedTs>
-            static typename std::enable_if<!std::is_void<Dummy>::value>::type actually_call(duk_context* ctx, const std::tuple<BakedTs...>& args)
+            static typename std::enable_if<!std::is_void<Dummy>::value>::type actually_call(duk_context* ctx, std::tuple<BakedTs...>&& args)
             {
                // ArgStorage has some static_asserts in it that validate value types,
                // so we typedef it to force ArgStorage<RetType> to compile and run the asserts
                typedef typename dukglue::types::ArgStorage<RetType>::type ValidateReturnType;
 
-               RetType return_val = dukglue::detail::apply_fp(funcToCall, args);
+               RetType return_val = dukglue::detail::apply_fp(funcToCall, std::move(args));
 
                using namespace dukglue::types;
                DukType<typename Bare<RetType>::type>::template push<RetType>(ctx, std::move(return_val));
             }
 
             template<typename Dummy = RetType, typename... BakedTs>
-            static typename std::enable_if<std::is_void<Dummy>::value>::type actually_call(duk_context* ctx, const std::tuple<BakedTs...>& args)
+            static typename std::enable_if<std::is_void<Dummy>::value>::type actually_call(duk_context* ctx, std::tuple<BakedTs...>&& args)
             {
-               dukglue::detail::apply_fp(funcToCall, args);
+               dukglue::detail::apply_fp(funcToCall, std::move(args));
             }
          };
 
          struct FuncRuntime
          {
-            // Pull the address of the function to call from the
-            // Duktape function object at run time.
+            // Pull the address of the function to call from the heap's
+            // binding table at run time (found through the function's magic value).
             static duk_ret_t call_native_function(duk_context* ctx)
             {
-               duk_push_current_function(ctx);
-               duk_get_prop_string(ctx, -1, "\xFF" "func_ptr");
-               void* fp_void = duk_require_pointer(ctx, -1);
-               if (fp_void == nullptr) {
-                  duk_error(ctx, DUK_RET_TYPE_ERROR, "what even");
-                  return DUK_RET_TYPE_ERROR;
-               }
-
-               duk_pop_2(ctx);
-
-               static_assert(sizeof(RetType(*)(Ts...)) == sizeof(void*), "Function pointer and data pointer are different sizes");
-
-               RetType(*funcToCall)(Ts...) = reinterpret_cast<RetType(*)(Ts...)>(fp_void);
+               return call(ctx, DukglueHeapState::current_binding<FuncType>(ctx));
+            }
 
+            // Read the arguments off the stack and call funcToCall with them.
+            static duk_ret_t call(duk_context* ctx, FuncType funcToCall)
+            {
                actually_call(ctx, funcToCall, dukglue::detail::get_stack_values<Ts...>(ctx));
                return std::is_void<RetType>::value ? 0 : 1;
             }
 
+            // Same as call_native_function, without argument type checks (see dukglue_set_trusted).
+            static duk_ret_t call_native_function_trusted(duk_context* ctx)
+            {
+               FuncType funcToCall = DukglueHeapState::current_binding<FuncType>(ctx);
+               actually_call(ctx, funcToCall, dukglue::detail::get_stack_values_trusted<Ts...>(ctx));
+               return std::is_void<RetType>::value ? 0 : 1;
+            }
+
+            // The Duktape function to register in ctx's heap.
+            static duk_c_function native_function(duk_context* ctx)
+            {
+               return DukglueHeapState::require(ctx)->trusted ? call_native_function_trusted : call_native_function;
+            }
+
             // this mess is to support functions with void return values
             template<typename Dummy = RetType, typename... BakedTs>
-            static typename std::enable_if<!std::is_void<Dummy>::value>::type actually_call(duk_context* ctx, RetType(*funcToCall)(Ts...), const std::tuple<BakedTs...>& args)
+            static typename std::enable_if<!std::is_void<Dummy>::value>::type actually_call(duk_context* ctx, RetType(*funcToCall)(Ts...), std::tuple<BakedTs...>&& args)
             {
                // ArgStorage has some static_asserts in it that validate value types,
                // so we typedef it to force ArgStorage<RetType> to compile and run the asserts
                typedef typename dukglue::types::ArgStorage<RetType>::type ValidateReturnType;
 
-               RetType return_val = dukglue::detail::apply_fp(funcToCall, args);
+               RetType return_val = dukglue::detail::apply_fp(funcToCall, std::move(args));
 
                using namespace dukglue::types;
                DukType<typename Bare<RetType>::type>::template push<RetType>(ctx, std::move(return_val));
             }
 
             template<typename Dummy = RetType, typename... BakedTs>
-            static typename std::enable_if<std::is_void<Dummy>::value>::type actually_call(duk_context* ctx, RetType(*funcToCall)(Ts...), const std::tuple<BakedTs...>& args)
+            static typename std::enable_if<std::is_void<Dummy>::value>::type actually_call(duk_context* ctx, RetType(*funcToCall)(Ts...), std::tuple<BakedTs...>&& args)
+            {
+               dukglue::detail::apply_fp(funcToCall, std::move(args));
+            }
+         };
+
+         // Registers funcToCall as a Duktape lightfunc (duk_push_c_lightfunc).
+         // Lightfuncs are plain tagged values with no object or property table behind them,
+         // so they're almost free to create. They only have 8 bits of magic and no properties,
+         // so the function is found in a table of function pointers shared by all lightfuncs
+         // with this signature, in every heap.
+         struct FuncLightfunc
+         {
+            // limits of a lightfunc's nargs and magic
+            static const duk_idx_t MAX_NARGS = 14;
+            static const int MAX_FUNCS = 256;
+
+            static duk_ret_t call_native_function(duk_context* ctx)
+            {
+               FuncRuntime::actually_call(ctx, current(ctx), dukglue::detail::get_stack_values<Ts...>(ctx));
+               return std::is_void<RetType>::value ? 0 : 1;
+            }
+
+            static duk_ret_t call_native_function_trusted(duk_context* ctx)
+            {
+               FuncRuntime::actually_call(ctx, current(ctx), dukglue::detail::get_stack_values_trusted<Ts...>(ctx));
+               return std::is_void<RetType>::value ? 0 : 1;
+            }
+
+            // Pushes a lightfunc that calls funcToCall.
+            // Returns false (without pushing anything) if funcToCall can't be a lightfunc,
+            // because it takes too many arguments or the table for this signature is full.
+            // Stack: ... -> ... [func]
+            static bool push(duk_context* ctx, FuncType funcToCall)
+            {
+               if (sizeof...(Ts) > MAX_NARGS)
+                  return false;
+
+               const int idx = find_or_add(funcToCall);
+               if (idx < 0)
+                  return false;
+
+               duk_c_function evalFunc = DukglueHeapState::require(ctx)->trusted ? call_native_function_trusted : call_native_function;
+               const duk_int_t magic = (idx > 0x7F ? idx - 0x100 : idx);  // magic is a signed 8-bit value
+               duk_push_c_lightfunc(ctx, evalFunc, sizeof...(Ts), sizeof...(Ts), magic);
+               return true;
+            }
+
+         private:
+            static FuncType funcs[MAX_FUNCS];
+
+            static FuncType current(duk_context* ctx)
+            {
+               return funcs[static_cast<duk_uint8_t>(duk_get_current_magic(ctx))];
+            }
+
+            // Returns the index of funcToCall in funcs (adding it if it isn't there yet),
+            // or -1 if funcs is full.
+            static int find_or_add(FuncType funcToCall)
             {
-               dukglue::detail::apply_fp(funcToCall, args);
+               static std::mutex mutex;
+               static int count = 0;
+               std::lock_guard<std::mutex> lock(mutex);
+
+               for (int i = 0; i < count; i++) {
+                  if (funcs[i] == funcToCall)
+                     return i;
+               }
+
+               if (count == MAX_FUNCS)
+                  return -1;
+
+               funcs[count] = funcToCall;
+               return count++;
+            }
+         };
+
+         // Same as FuncRuntime, but trailing arguments the script leaves undefined
+         // are replaced by default values (stored along with the function pointer).
+         template<typename... Ds>
+         struct FuncDefaultsRuntime
+         {
+            struct Binding
+            {
+               FuncType func;
+               std::tuple<Ds...> defaults;
+            };
+
+            static duk_ret_t call_native_function(duk_context* ctx)
+            {
+               const Binding* binding = DukglueHeapState::current_binding<Binding*>(ctx);
+
+               FuncRuntime::actually_call(ctx, binding->func, dukglue::detail::get_stack_values<Ts...>(ctx, binding->defaults));
+               return std::is_void<RetType>::value ? 0 : 1;
+            }
+
+            // Stack: ... -> ... [func]
+            static void push(duk_context* ctx, FuncType funcToCall, Defaults<Ds...>&& defaults)
+            {
+               DukglueHeapState* state = DukglueHeapState::require(ctx);
+               Binding binding = { funcToCall, std::move(defaults.values) };
+
+               duk_push_c_function(ctx, call_native_function, sizeof...(Ts));
+               DukglueHeapState::set_binding(ctx, -1, state->arena.create(std::move(binding)));
             }
          };
       };
+
+      template<typename RetType, typename... Ts>
+      typename FuncInfoHolder<RetType, Ts...>::FuncType FuncInfoHolder<RetType, Ts...>::FuncLightfunc::funcs[FuncInfoHolder<RetType, Ts...>::FuncLightfunc::MAX_FUNCS];
+
+#ifdef DUKGLUE_HAS_CPP17
+      // Pushes a Duktape function that calls funcToCall, embedded at compile time.
+      // funcToCall is passed again as an argument to deduce its signature.
+      template<auto funcToCall, typename RetType, typename... Ts>
+      void push_function_compiletime(duk_context* ctx, RetType(*)(Ts...))
+      {
+         duk_c_function evalFunc = FuncInfoHolder<RetType, Ts...>::template FuncCompiletime<funcToCall>::call_native_function;
+         duk_push_c_function(ctx, evalFunc, sizeof...(Ts));
+      }
+#endif
    }
 }
 
@@ -0,0 +1,325 @@
+#ifndef _DETAIL_HEAP_ALLOCATOR_20240506_H
+#define _DETAIL_HEAP_ALLOCATOR_20240506_H 1
+
+#include <duktape.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace dukglue
+{
+   namespace detail
+   {
+      // Counters for a heap created with dukglue_create_heap (see dukglue_get_heap_alloc_stats).
+      struct HeapAllocStats
+      {
+         std::size_t bytes;  // bytes Duktape has allocated now
+         std::size_t peak_bytes;  // most bytes Duktape has had allocated at once
+         std::size_t allocations;  // allocations so far (reallocations that moved a block included)
+         std::size_t reserved;  // bytes taken from the system (pool chunks and large blocks)
+      };
+
+      // Memory functions for a Duktape heap (see dukglue_create_heap).
+      //
+      // Small blocks (strings, objects, property tables of a few entries...) come from size-class pools:
+      // each size class has a free list of blocks, refilled a chunk at a time. A heap is only used by one
+      // thread at a time, so the pools need no locking. Blocks start with a header holding their size,
+      // so realloc and free know their size class (Duktape doesn't pass the old size).
+      //
+      // In arena mode, large blocks are also tracked, and everything is released in one shot when the heap
+      // is destroyed: the frees Duktape does while tearing the heap down are skipped.
+      class HeapAllocator
+      {
+      public:
+         static const std::size_t GRANULE = 16;
+         static const std::size_t MAX_SMALL_BLOCK = 512;  // header included
+         static const std::size_t CHUNK_SIZE = 64 * 1024;
+
+         HeapAllocator(bool pools, bool arena) : pools_(pools), arena_(arena), tearing_down_(false), large_(nullptr)
+         {
+            stats_.bytes = stats_.peak_bytes = stats_.allocations = stats_.reserved = 0;
+            for (std::size_t i = 0; i < NUM_SIZE_CLASSES; i++)
+               free_lists_[i] = nullptr;
+         }
+
+         ~HeapAllocator()
+         {
+            // whatever Duktape didn't free (in arena mode, everything)
+            while (large_ != nullptr) {
+               LargeLinks* next = large_->next;
+               std::free(large_);
+               large_ = next;
+            }
+
+            for (std::size_t i = 0; i < chunks_.size(); i++)
+               std::free(chunks_[i]);
+         }
+
+         // Called before the heap is destroyed: in arena mode, frees are skipped from now on.
+         void begin_teardown()
+         {
+            tearing_down_ = arena_;
+         }
+
+         HeapAllocStats stats() const
+         {
+            return stats_;
+         }
+
+         // The allocator of ctx's heap, or nullptr if the heap wasn't created with one.
+         static HeapAllocator* of(duk_context* ctx)
+         {
+            duk_memory_functions funcs;
+            duk_get_memory_functions(ctx, &funcs);
+            return funcs.alloc_func == &alloc_func ? static_cast<HeapAllocator*>(funcs.udata) : nullptr;
+         }
+
+         // duk_alloc_function, duk_realloc_function and duk_free_function (udata is the allocator)
+         static void* alloc_func(void* udata, duk_size_t size)
+         {
+            return static_cast<HeapAllocator*>(udata)->allocate(size);
+         }
+
+         static void* realloc_func(void* udata, void* ptr, duk_size_t size)
+         {
+            return static_cast<HeapAllocator*>(udata)->reallocate(ptr, size);
+         }
+
+         static void free_func(void* udata, void* ptr)
+         {
+            static_cast<HeapAllocator*>(udata)->deallocate(ptr);
+         }
+
+      private:
+         static const std::size_t NUM_SIZE_CLASSES = MAX_SMALL_BLOCK / GRANULE;
+
+         // Duktape stores doubles in its blocks.
+         static const std::size_t PAYLOAD_ALIGN = 8;
+
+         // In front of every block. Padded to 8 bytes even where std::size_t is smaller, so the payload
+         // stays 8-byte aligned (blocks start at multiples of GRANULE from malloc'd memory).
+         union Header
+         {
+            std::size_t size;  // requested size
+            std::uint64_t align;
+         };
+
+         // In front of large blocks in arena mode (doubly linked, so they can be unlinked when freed)
+         struct LargeLinks
+         {
+            LargeLinks* prev;
+            LargeLinks* next;
+         };
+
+         struct FreeBlock
+         {
+            FreeBlock* next;
+         };
+
+         static_assert(sizeof(Header) % PAYLOAD_ALIGN == 0 && GRANULE % PAYLOAD_ALIGN == 0,
+            "Small block payloads must be 8-byte aligned");
+         static_assert((sizeof(LargeLinks) + sizeof(Header)) % PAYLOAD_ALIGN == 0,
+            "Large block payloads must be 8-byte aligned");
+
+         // Blocks of size class cls are (cls + 1) * GRANULE bytes, header included.
+         static std::size_t size_class(std::size_t size)
+         {
+            return (size + sizeof(Header) - 1) / GRANULE;
+         }
+
+         bool is_small(std::size_t size) const
+         {
+            return pools_ && size + sizeof(Header) <= MAX_SMALL_BLOCK;
+         }
+
+         std::size_t large_prefix() const
+         {
+            return arena_ ? sizeof(LargeLinks) + sizeof(Header) : sizeof(Header);
+         }
+
+         static Header* header_of(void* ptr)
+         {
+            return static_cast<Header*>(ptr) - 1;
+         }
+
+         void* allocate(std::size_t size)
+         {
+            if (size == 0)
+               return nullptr;
+
+            Header* header;
+            if (is_small(size)) {
+               FreeBlock*& head = free_lists_[size_class(size)];
+               if (head == nullptr && !refill(head, size_class(size)))
+                  return nullptr;
+
+               header = reinterpret_cast<Header*>(head);
+               head = head->next;
+            }
+            else {
+               char* raw = static_cast<char*>(std::malloc(large_prefix() + size));
+               if (raw == nullptr)
+                  return nullptr;
+
+               if (arena_) {
+                  LargeLinks* links = reinterpret_cast<LargeLinks*>(raw);
+                  link(links);
+               }
+
+               header = reinterpret_cast<Header*>(raw + large_prefix() - sizeof(Header));
+               stats_.reserved += large_prefix() + size;
+            }
+
+            header->size = size;
+            stats_.allocations++;
+            stats_.bytes += size;
+            if (stats_.bytes > stats_.peak_bytes)
+               stats_.peak_bytes = stats_.bytes;
+
+            return header + 1;
+         }
+
+         void deallocate(void* ptr)
+         {
+            if (ptr == nullptr || tearing_down_)
+               return;
+
+            Header* header = header_of(ptr);
+            const std::size_t size = header->size;
+            stats_.bytes -= size;
+
+            if (is_small(size)) {
+               FreeBlock* block = reinterpret_cast<FreeBlock*>(header);
+               FreeBlock*& head = free_lists_[size_class(size)];
+               block->next = head;
+               head = block;
+            }
+            else {
+               char* raw = reinterpret_cast<char*>(header) + sizeof(Header) - large_prefix();
+               if (arena_)
+                  unlink(reinterpret_cast<LargeLinks*>(raw));
+
+               stats_.reserved -= large_prefix() + size;
+               std::free(raw);
+            }
+         }
+
+         void* reallocate(void* ptr, std::size_t size)
+         {
+            if (ptr == nullptr)
+               return allocate(size);
+
+            if (size == 0) {
+               deallocate(ptr);
+               return nullptr;
+            }
+
+            Header* header = header_of(ptr);
+            const std::size_t old_size = header->size;
+
+            // small -> small in the same size class: nothing to move
+            if (is_small(old_size) && is_small(size) && size_class(old_size) == size_class(size)) {
+               header->size = size;
+               resize_stats(old_size, size);
+               return ptr;
+            }
+
+            // large -> large: let the system allocator grow it in place if it can
+            if (!is_small(old_size) && !is_small(size)) {
+               char* raw = reinterpret_cast<char*>(header) + sizeof(Header) - large_prefix();
+               LargeLinks* links = reinterpret_cast<LargeLinks*>(raw);
+               if (arena_)
+                  unlink(links);
+
+               char* new_raw = static_cast<char*>(std::realloc(raw, large_prefix() + size));
+               if (new_raw == nullptr) {
+                  if (arena_)
+                     link(links);
+                  return nullptr;
+               }
+
+               if (arena_)
+                  link(reinterpret_cast<LargeLinks*>(new_raw));
+
+               header = reinterpret_cast<Header*>(new_raw + large_prefix() - sizeof(Header));
+               header->size = size;
+               stats_.reserved += size - old_size;
+               resize_stats(old_size, size);
+               return header + 1;
+            }
+
+            void* new_ptr = allocate(size);
+            if (new_ptr == nullptr)
+               return nullptr;
+
+            std::memcpy(new_ptr, ptr, old_size < size ? old_size : size);
+            deallocate(ptr);
+            return new_ptr;
+         }
+
+         void resize_stats(std::size_t old_size, std::size_t size)
+         {
+            stats_.bytes = stats_.bytes - old_size + size;
+            if (stats_.bytes > stats_.peak_bytes)
+               stats_.peak_bytes = stats_.bytes;
+         }
+
+         // Splits a new chunk into blocks for size class cls. Returns false if out of memory.
+         bool refill(FreeBlock*& head, std::size_t cls)
+         {
+            char* chunk = static_cast<char*>(std::malloc(CHUNK_SIZE));
+            if (chunk == nullptr)
+               return false;
+
+            chunks_.push_back(chunk);
+            stats_.reserved += CHUNK_SIZE;
+
+            // (malloc's alignment is good for any block, blocks are multiples of GRANULE)
+            const std::size_t block_size = (cls + 1) * GRANULE;
+            for (std::size_t offset = CHUNK_SIZE / block_size * block_size; offset != 0; ) {
+               offset -= block_size;
+               FreeBlock* block = reinterpret_cast<FreeBlock*>(chunk + offset);
+               block->next = head;
+               head = block;
+            }
+
+            return true;
+         }
+
+         void link(LargeLinks* links)
+         {
+            links->prev = nullptr;
+            links->next = large_;
+            if (large_ != nullptr)
+               large_->prev = links;
+            large_ = links;
+         }
+
+         void unlink(LargeLinks* links)
+         {
+            if (links->prev != nullptr)
+               links->prev->next = links->next;
+            else
+               large_ = links->next;
+
+            if (links->next != nullptr)
+               links->next->prev = links->prev;
+         }
+
+         const bool pools_;
+         const bool arena_;
+         bool tearing_down_;
+
+         FreeBlock* free_lists_[NUM_SIZE_CLASSES];
+         std::vector<char*> chunks_;
+         LargeLinks* large_;  // large blocks (arena mode only)
+
+         HeapAllocStats stats_;
+      };
+   }
+}
+
+#endif
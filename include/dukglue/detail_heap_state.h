@@ -0,0 +1,552 @@
+#ifndef _DETAIL_HEAP_STATE_20240506_H
+#define _DETAIL_HEAP_STATE_20240506_H 1
+
+#include <duktape.h>
+
+#include "dukexception.h"
+#include "detail_binding_arena.h"
+#include "detail_ptr_map.h"
+#include "detail_ref_array.h"
+#include "detail_shared_ptrs.h"
+#include "detail_typeinfo.h"
+
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+namespace dukglue
+{
+   namespace detail
+   {
+      // Hidden ("\xFF"-prefixed) property keys used by dukglue.
+      enum HiddenKey {
+         KEY_OBJ_PTR,
+         KEY_TYPE_INFO,
+         KEY_SHARED_PTR,
+         KEY_OWNED,
+         KEY_INTRUSIVE_PTR,
+         KEY_ALLOCATED,
+         KEY_PUSHED_PTR,
+         KEY_BINDING,
+
+         NUM_HIDDEN_KEYS
+      };
+
+      inline const char* hidden_key_name(HiddenKey key)
+      {
+         static const char* names[NUM_HIDDEN_KEYS] = {
+            "\xFF" "obj_ptr",
+            "\xFF" "type_info",
+            "\xFF" "shared_ptr",
+            "\xFF" "owned",
+            "\xFF" "intrusive_ptr",
+            "\xFF" "allocated",
+            "\xFF" "pushed_ptr",
+            "\xFF" "binding"
+         };
+
+         return names[key];
+      }
+
+      // The script object registered for a native object (see detail_refs.h).
+      struct RefEntry
+      {
+         void* heapptr;  // the script object (duk_get_heapptr)
+         duk_uarridx_t ref_idx;  // index in the ref array keeping it alive, or 0 for a weak ref
+         duk_uint_t scope;  // invalidation scope the object was registered in, or 0 (see dukglue_open_scope)
+         class_id_t cls;  // class of the script object's prototype (see dukglue_invalidate_all)
+      };
+
+      // Maps native object pointer -> registered script object.
+      typedef PtrMap<RefEntry> RefMap;
+
+      // Native data for one bound function (a function pointer, a method pointer, a member offset...).
+      // Stored inline, so registering a binding doesn't need its own allocation or finalizer.
+      struct BindingSlot
+      {
+         static const std::size_t SIZE = 32;
+
+         union {
+            void* align_ptr;
+            double align_double;
+            unsigned char bytes[SIZE];
+         };
+
+         template<typename T>
+         static BindingSlot make(const T& value)
+         {
+            static_assert(sizeof(T) <= SIZE, "Binding is too big to fit in a BindingSlot");
+            static_assert(std::is_trivially_copyable<T>::value, "Binding must be trivially copyable");
+
+            BindingSlot slot;
+            std::memset(slot.bytes, 0, SIZE);  // (so equal bindings have equal slots)
+            std::memcpy(slot.bytes, &value, sizeof(T));
+            return slot;
+         }
+
+         // T must be the type the slot was made with.
+         template<typename T>
+         T load() const
+         {
+            T value;
+            std::memcpy(&value, bytes, sizeof(T));
+            return value;
+         }
+      };
+
+      // A binding along with the function that reads it, to find bindings that can share a slot.
+      struct BindingKey
+      {
+         duk_c_function func;
+         BindingSlot slot;
+
+         bool operator==(const BindingKey& rhs) const
+         {
+            return func == rhs.func && std::memcmp(slot.bytes, rhs.slot.bytes, BindingSlot::SIZE) == 0;
+         }
+      };
+
+      struct BindingKeyHash
+      {
+         std::size_t operator()(const BindingKey& key) const
+         {
+            // FNV-1a
+            std::size_t hash = static_cast<std::size_t>(14695981039346656037ULL);
+            const unsigned char* func = reinterpret_cast<const unsigned char*>(&key.func);
+            for (std::size_t i = 0; i < sizeof(key.func); i++)
+               hash = (hash ^ func[i]) * static_cast<std::size_t>(1099511628211ULL);
+            for (std::size_t i = 0; i < BindingSlot::SIZE; i++)
+               hash = (hash ^ key.slot.bytes[i]) * static_cast<std::size_t>(1099511628211ULL);
+            return hash;
+         }
+      };
+
+      // A base class whose members were copied into a derived class' prototype, which has another
+      // class prototype in its prototype chain (see ProtoManager::inherit_prototype).
+      struct CopiedBase
+      {
+         class_id_t base;
+         class_id_t derived;
+      };
+
+      // Native per-heap state, created the first time dukglue touches a heap.
+      // Everything dukglue needs to find on a hot path lives here, so finding it
+      // costs a pointer dereference instead of heap stash property lookups.
+
+      // The state lives in a native struct owned by a holder object in the heap stash
+      // (and is deleted by that object's finalizer when the heap is destroyed).
+      // Going through the heap stash is expensive (duk_push_heap_stash alone costs
+      // about as much as a string-keyed property lookup), so the most recently used
+      // context -> state pair is cached per thread.
+
+      // The cache is keyed on duk_context*, which is only unique while the Duktape
+      // thread is alive. The state keeps the last few threads it was looked up for alive
+      // (see pin_thread), and the cache is invalidated (by bumping a global epoch) whenever
+      // a state is destroyed or one of those threads is let go.
+
+      // Script values owned by the state (interned keys, the ref arrays, the prototypes array)
+      // are pinned by the holder object and kept as heap pointers, so they can be pushed with
+      // duk_push_heapptr(). Hidden keys in particular are interned once per heap, so hot paths can
+      // use duk_push_heapptr() + duk_get_prop() instead of hashing and interning the key string
+      // on every access.
+      struct DukglueHeapState
+      {
+      public:
+         void* keys[NUM_HIDDEN_KEYS];
+
+         // native object -> script object (see RefManager)
+         RefMap ref_map;
+
+         // script objects for registered native objects (see RefManager)
+         RefArray ref_array;
+
+         // script values held by DukValues (see DukValue)
+         PinnedRefs dukvalue_refs;
+
+         // script objects for native objects pushed as std::shared_ptr (see SharedPtrRefs)
+         SharedPtrRefs shared_ptrs;
+
+         // class prototypes, in registration order; keeps them alive (see ProtoManager)
+         void* prototypes_array;
+
+         // class id -> class prototype (a heap pointer, pinned by prototypes_array; null if the class has none yet)
+         std::vector<void*> prototypes;
+
+         // class id -> type info of the class prototype (owned by the prototype; null if the class has none yet)
+         std::vector<const TypeInfo*> type_infos;
+
+         // Base classes copied into derived prototypes, in the order they were (see ProtoManager::member_added).
+         std::vector<CopiedBase> copied_bases;
+
+         // Native data for bound functions, indexed by the function's magic value.
+         // Slot 0 is never used, so a function without magic can't find a binding by accident.
+         // Slots live as long as the heap does, and are shared by functions with the same binding
+         // (so registering a function again doesn't take another one). Once magic values run out,
+         // bindings go into a property of their function instead (see set_binding_slot).
+         std::vector<BindingSlot> bindings;
+
+         // binding -> its index in bindings
+         std::unordered_map<BindingKey, std::size_t, BindingKeyHash> binding_indices;
+
+         // Storage for bindings that don't fit in a BindingSlot (lambda captures, ...).
+         // Slots hold pointers into the arena.
+         BindingArena arena;
+
+         // Binding slots shared with other heaps, those of the BindingSet applied to this heap (if any).
+         // They take the binding indices from shared_bindings_begin up, counting down from the last one
+         // (so their magic values are -1, -2, ...); bindings registered in this heap can't reach them.
+         const BindingSlot* shared_bindings;
+         std::size_t shared_bindings_begin;
+
+         // Keeps the native data of the applied BindingSet (shared_bindings, type infos) alive.
+         std::shared_ptr<const void> binding_set;
+
+         // Prototypes of the applied BindingSet's classes that are still empty, by class id (see
+         // BindingSet::apply_lazy). materialize_prototype puts their members in the first time they are pushed.
+         std::vector<bool> lazy_prototypes;
+         std::size_t num_lazy_prototypes;
+         void(*materialize_prototype)(duk_context* ctx, class_id_t id);
+
+         // If set, functions and methods registered from now on skip argument type checks
+         // (see dukglue_set_trusted).
+         bool trusted;
+
+         // If set, native objects pushed from now on are registered with weak refs
+         // (see dukglue_set_weak_refs).
+         bool weak_refs;
+
+         // Set once a base class at another address than its derived class (or a virtual base class)
+         // has been set up (see dukglue_set_base_class). Until then, native object pointers never
+         // need adjusting for methods of a base class.
+         bool adjusted_casts;
+
+         // Finalizer shared by weakly registered script objects (created on first use, see RefManager).
+         void* weak_ref_finalizer;
+
+         // Invalidation scopes that are open, innermost last (see dukglue_open_scope).
+         // Native objects registered while a scope is open are tagged with the innermost one.
+         std::vector<duk_uint_t> open_scopes;
+
+         // Id for the next scope (ids are never reused).
+         duk_uint_t next_scope;
+
+         // Duktape threads (contexts) of this heap the state may be cached for, most recent last (see get()).
+         // They are kept alive by pinned_threads_array, so their memory can't be reused for a thread in
+         // another heap while a cache may still hold them. Only the last few are kept.
+         static const std::size_t NUM_PINNED_THREADS = 4;
+         void* pinned_threads_array;
+         duk_context* pinned_threads[NUM_PINNED_THREADS];
+         std::size_t next_pinned_thread;
+
+         // Magic values are signed 16-bit values, which we treat as unsigned binding indices.
+         static const std::size_t MAX_BINDINGS = 0x10000;
+
+         DukglueHeapState() : bindings(1), shared_bindings(nullptr), shared_bindings_begin(MAX_BINDINGS),
+            num_lazy_prototypes(0), materialize_prototype(nullptr), trusted(false), weak_refs(false), adjusted_casts(false), weak_ref_finalizer(nullptr), next_scope(1),
+            pinned_threads_array(nullptr), pinned_threads(), next_pinned_thread(0) {}
+
+         duk_uint_t current_scope() const
+         {
+            return open_scopes.empty() ? 0 : open_scopes.back();
+         }
+
+         // Stores value in a binding slot and sets the magic of the Duktape/C function at func_idx to
+         // point at it (see bindings).
+         // Stack: ... [func] ...  ->  ... [func] ...
+         template<typename T>
+         static void set_binding(duk_context* ctx, duk_idx_t func_idx, const T& value)
+         {
+            set_binding_slot(ctx, func_idx, BindingSlot::make(value));
+         }
+
+         static void set_binding_slot(duk_context* ctx, duk_idx_t func_idx, const BindingSlot& slot)
+         {
+            DukglueHeapState* state = require(ctx);
+            func_idx = duk_normalize_index(ctx, func_idx);
+
+            BindingKey key;
+            key.func = duk_get_c_function(ctx, func_idx);
+            key.slot = slot;
+
+            std::size_t idx;
+            auto found = state->binding_indices.find(key);
+            if (found != state->binding_indices.end()) {
+               idx = found->second;
+            }
+            else if (state->bindings.size() < state->shared_bindings_begin) {
+               idx = state->bindings.size();
+               state->bindings.push_back(slot);
+               state->binding_indices.emplace(key, idx);
+            }
+            else {
+               // out of magic values: magic 0 says the binding is in the function's KEY_BINDING property
+               state->push_key(ctx, KEY_BINDING);
+               void* bytes = duk_push_fixed_buffer(ctx, BindingSlot::SIZE);
+               std::memcpy(bytes, slot.bytes, BindingSlot::SIZE);
+               duk_put_prop(ctx, func_idx);
+               idx = 0;
+            }
+
+            duk_int_t magic = static_cast<duk_int_t>(idx);
+            if (magic > 0x7FFF)
+               magic -= 0x10000;
+
+            duk_set_magic(ctx, func_idx, magic);
+         }
+
+         // Returns the value stored (with set_binding) for the currently running Duktape/C function.
+         // T must be the type set_binding was called with.
+         template<typename T>
+         static T current_binding(duk_context* ctx)
+         {
+            DukglueHeapState* state = require(ctx);
+            const duk_uint16_t idx = static_cast<duk_uint16_t>(duk_get_current_magic(ctx));
+            if (idx >= state->shared_bindings_begin)
+               return state->shared_bindings[MAX_BINDINGS - 1 - idx].template load<T>();
+
+            if (idx == 0)
+               return state->property_binding(ctx).template load<T>();
+
+            if (idx >= state->bindings.size())
+               duk_error(ctx, DUK_RET_TYPE_ERROR, "Native binding missing?!");
+
+            return state->bindings[idx].template load<T>();
+         }
+
+         // Makes the count slots at slots the heap's shared bindings, kept alive by owner (see BindingSet).
+         // The Duktape/C function for slot i gets the magic value shared_binding_magic(i).
+         // Throws a DukException if the heap already has shared bindings, or too many bindings of its own.
+         void share_bindings(const std::shared_ptr<const void>& owner, const BindingSlot* slots, std::size_t count)
+         {
+            if (binding_set)
+               throw DukException() << "A heap can only have one BindingSet applied";
+            if (bindings.size() > MAX_BINDINGS - count)
+               throw DukException() << "Too many bindings registered (the limit is " << (MAX_BINDINGS - 1) << " per heap, "
+                  << "BindingSet bindings included)";
+
+            binding_set = owner;
+            shared_bindings = slots;
+            shared_bindings_begin = MAX_BINDINGS - count;
+         }
+
+         // The binding of the currently running Duktape/C function, if it's in a property (see set_binding_slot).
+         BindingSlot property_binding(duk_context* ctx) const
+         {
+            duk_push_current_function(ctx);
+            push_key(ctx, KEY_BINDING);
+            duk_get_prop(ctx, -2);
+
+            duk_size_t size = 0;
+            const void* bytes = duk_get_buffer(ctx, -1, &size);
+            if (bytes == nullptr || size != BindingSlot::SIZE)
+               duk_error(ctx, DUK_RET_TYPE_ERROR, "Native binding missing?!");
+
+            BindingSlot slot;
+            std::memcpy(slot.bytes, bytes, BindingSlot::SIZE);
+            duk_pop_2(ctx);  // pop binding and function
+            return slot;
+         }
+
+         static duk_int_t shared_binding_magic(std::size_t i)
+         {
+            return -1 - static_cast<duk_int_t>(i);
+         }
+
+         // Returns the state for ctx's heap, creating it if necessary.
+         // Returns NULL while the heap is being destroyed (after the state's finalizer has run).
+         static DukglueHeapState* get(duk_context* ctx)
+         {
+            const LookupCache& cache = lookup_cache();
+            if (cache.ctx == ctx && cache.epoch == epoch().load(std::memory_order_acquire))
+               return cache.state;
+
+            return lookup(ctx);
+         }
+
+         // Same as get(), but throws a Duktape error if the heap is being destroyed.
+         static DukglueHeapState* require(duk_context* ctx)
+         {
+            DukglueHeapState* state = get(ctx);
+            if (state == nullptr)
+               duk_error(ctx, DUK_ERR_ERROR, "dukglue state is not available (heap is being destroyed)");
+
+            return state;
+         }
+
+         inline void push_key(duk_context* ctx, HiddenKey key) const
+         {
+            duk_push_heapptr(ctx, keys[key]);
+         }
+
+      private:
+         struct LookupCache
+         {
+            duk_context* ctx;
+            DukglueHeapState* state;
+            unsigned int epoch;
+         };
+
+         static LookupCache& lookup_cache()
+         {
+            static thread_local LookupCache cache = { nullptr, nullptr, 0 };
+            return cache;
+         }
+
+         static std::atomic<unsigned int>& epoch()
+         {
+            static std::atomic<unsigned int> value(1);
+            return value;
+         }
+
+         static void invalidate_caches()
+         {
+            epoch().fetch_add(1, std::memory_order_acq_rel);
+         }
+
+         static DukglueHeapState* lookup(duk_context* ctx)
+         {
+            static const char* DUKGLUE_STATE = "dukglue_state";
+            static const char* PTR = "ptr";
+
+            duk_push_heap_stash(ctx);
+
+            if (!duk_get_prop_string(ctx, -1, DUKGLUE_STATE)) {
+               duk_pop(ctx);  // pop undefined
+
+               DukglueHeapState* state = new DukglueHeapState();
+
+               duk_push_object(ctx);
+
+               // intern the hidden keys and keep them reachable through the holder
+               for (int i = 0; i < NUM_HIDDEN_KEYS; i++) {
+                  duk_push_string(ctx, hidden_key_name(static_cast<HiddenKey>(i)));
+                  state->keys[i] = duk_get_heapptr(ctx, -1);
+                  duk_put_prop_index(ctx, -2, static_cast<duk_uarridx_t>(i));
+               }
+
+               state->ref_array.create(ctx);
+               duk_put_prop_string(ctx, -2, "ref_array");
+
+               state->dukvalue_refs.create(ctx);
+               duk_put_prop_string(ctx, -2, "dukvalue_ref_array");
+
+               duk_push_array(ctx);
+               state->prototypes_array = duk_get_heapptr(ctx, -1);
+               duk_put_prop_string(ctx, -2, "prototypes_array");
+
+               duk_push_array(ctx);
+               state->pinned_threads_array = duk_get_heapptr(ctx, -1);
+               duk_put_prop_string(ctx, -2, "pinned_threads_array");
+
+               duk_push_pointer(ctx, state);
+               duk_put_prop_string(ctx, -2, PTR);
+
+               duk_push_c_function(ctx, state_finalizer, 2);
+               duk_set_finalizer(ctx, -2);
+
+               duk_dup_top(ctx);
+               duk_put_prop_string(ctx, -3, DUKGLUE_STATE);
+            }
+
+            duk_get_prop_string(ctx, -1, PTR);
+            DukglueHeapState* state = static_cast<DukglueHeapState*>(duk_get_pointer(ctx, -1));
+            duk_pop_3(ctx);  // pop ptr, holder and heap stash
+
+            if (state != nullptr) {
+               state->pin_thread(ctx);
+
+               // (after pinning, which can move to a new epoch)
+               LookupCache& cache = lookup_cache();
+               cache.ctx = ctx;
+               cache.state = state;
+               cache.epoch = epoch().load(std::memory_order_acquire);
+            }
+
+            return state;
+         }
+
+         // Keeps the Duktape thread behind ctx alive while the state may be cached for it, since its memory
+         // could otherwise be reused for a thread in another heap (nothing a script can do to the thread,
+         // like replacing its finalizer, changes that). Unpinning the oldest thread to make room moves
+         // every cache to a new epoch.
+         void pin_thread(duk_context* ctx)
+         {
+            for (duk_context* pinned : pinned_threads) {
+               if (pinned == ctx)
+                  return;
+            }
+
+            if (pinned_threads[next_pinned_thread] != nullptr)
+               invalidate_caches();
+
+            // a duk_context* is the thread's heap pointer
+            duk_push_heapptr(ctx, pinned_threads_array);
+            duk_push_heapptr(ctx, ctx);
+            duk_put_prop_index(ctx, -2, static_cast<duk_uarridx_t>(next_pinned_thread));
+            duk_pop(ctx);  // pop pinned_threads_array
+
+            pinned_threads[next_pinned_thread] = ctx;
+            next_pinned_thread = (next_pinned_thread + 1) % NUM_PINNED_THREADS;
+         }
+
+         static duk_ret_t state_finalizer(duk_context* ctx)
+         {
+            duk_get_prop_string(ctx, 0, "ptr");
+            DukglueHeapState* state = static_cast<DukglueHeapState*>(duk_get_pointer(ctx, -1));
+            duk_pop(ctx);
+
+            if (state != nullptr) {
+               // set pointer to NULL first, in case this finalizer runs again
+               // or someone asks for the state while (or after) it is deleted
+               // (objects in the arena, like DukValues captured by lambdas, can do that)
+               duk_push_pointer(ctx, nullptr);
+               duk_put_prop_string(ctx, 0, "ptr");
+
+               invalidate_caches();
+               delete state;
+            }
+
+            return 0;
+         }
+      };
+
+      // Stack: ... -> ... [value]
+      // Same as duk_get_prop_string(ctx, obj_idx, hidden_key_name(key)),
+      // but uses the heap's interned key.
+      inline duk_bool_t get_hidden_prop(duk_context* ctx, duk_idx_t obj_idx, HiddenKey key)
+      {
+         DukglueHeapState* state = DukglueHeapState::get(ctx);
+         if (state == nullptr)  // heap is being destroyed
+            return duk_get_prop_string(ctx, obj_idx, hidden_key_name(key));
+
+         // if obj_idx is relative, we need to adjust it to deal with the key we are pushing
+         if (obj_idx < 0)
+            obj_idx--;
+
+         state->push_key(ctx, key);
+         return duk_get_prop(ctx, obj_idx);
+      }
+
+      // Stack: ... [value] -> ...
+      // Same as duk_put_prop_string(ctx, obj_idx, hidden_key_name(key)),
+      // but uses the heap's interned key.
+      inline duk_bool_t put_hidden_prop(duk_context* ctx, duk_idx_t obj_idx, HiddenKey key)
+      {
+         DukglueHeapState* state = DukglueHeapState::get(ctx);
+         if (state == nullptr)  // heap is being destroyed
+            return duk_put_prop_string(ctx, obj_idx, hidden_key_name(key));
+
+         if (obj_idx < 0)
+            obj_idx--;
+
+         state->push_key(ctx, key);  // ... [value] [key]
+         duk_swap_top(ctx, -2);  // ... [key] [value]
+         return duk_put_prop(ctx, obj_idx);
+      }
+   }
+}
+
+#endif
@@ -20,18 +20,6 @@ namespace dukglue
          // set get member via offset
          struct MemberAccess {
 
-            static duk_ret_t finalize_method(duk_context* ctx)
-            {
-               // clean up the MethodHolder reference
-               duk_get_prop_string(ctx, 0, "\xFF" "method_holder");
-
-               void* method_holder_void = duk_require_pointer(ctx, -1);
-               MemberOffset* method_holder = static_cast<MemberOffset*>(method_holder_void);
-               delete method_holder;
-
-               return 0;
-            }
-
             static duk_ret_t call_native_access(duk_context* ctx)
             {
                duk_ret_t rc = 0;
@@ -39,7 +27,7 @@ namespace dukglue
                // get this.obj_ptr
                duk_push_this(ctx);
 
-               duk_get_prop_string(ctx, -1, "\xFF" "obj_ptr");
+               get_hidden_prop(ctx, -1, KEY_OBJ_PTR);
 
                void* obj_void = duk_get_pointer(ctx, -1);
 
@@ -48,36 +36,28 @@ namespace dukglue
                   return DUK_RET_REFERENCE_ERROR;
                }
 
-               duk_pop_2(ctx);  // pop this.obj_ptr and this
-
-               // get current_function.method_info
-               duk_push_current_function(ctx);
-
-               duk_get_prop_string(ctx, -1, "\xFF" "method_holder");
-
-               void* method_holder_void = duk_require_pointer(ctx, -1);
+               // (should always be valid unless someone is intentionally messing with this.obj_ptr...)
+               Cls* obj = object_ptr_as<Cls>(ctx, -2, obj_void);
 
-               if (method_holder_void == nullptr) {
-                  duk_error(ctx, DUK_RET_TYPE_ERROR, "Method pointer missing?!");
-                  return DUK_RET_TYPE_ERROR;
-               }
+               duk_pop_2(ctx);  // pop this.obj_ptr and this
 
-               duk_pop_2(ctx);
+               // get the member offset for the current function
+               const MemberOffset memberOffset = DukglueHeapState::current_binding<MemberOffset>(ctx);
 
-               // (should always be valid unless someone is intentionally messing with this.obj_ptr...)
-               Cls* obj = static_cast<Cls*>(obj_void);
+               if (memberOffset.get) {
 
-               MemberOffset* memberOffset = static_cast<MemberOffset*>(method_holder_void);
-               if (memberOffset->get) {
+                  U* p_member = reinterpret_cast<U*>((char*)obj + memberOffset.offset);
 
-                  U* p_member = reinterpret_cast<U*>((char*)obj + memberOffset->offset);
-                  dukglue_push(ctx, *p_member);
+                  using namespace dukglue::types;
+                  DukType<typename Bare<U>::type>::template push<U>(ctx, *p_member);
                   rc = 1;
                }
                else {
 
-                  U* p_member = reinterpret_cast<U*>(((char*)obj + memberOffset->offset));
-                  dukglue_read<U>(ctx, 0, p_member);
+                  U* p_member = reinterpret_cast<U*>(((char*)obj + memberOffset.offset));
+
+                  using namespace dukglue::types;
+                  *p_member = DukType<typename Bare<U>::type>::template read<U>(ctx, 0);
 
                   // remove from stack
                   duk_pop(ctx);
@@ -94,12 +74,8 @@ namespace dukglue
 
          // The size of a method pointer is not guaranteed to be the same size as a function pointer.
          // This means we can't just use duk_push_pointer(ctx, &MyClass::method) to store the method at run time.
-         // To get around this, we wrap the method pointer in a MethodHolder (on the heap), and push a pointer to
-         // that. The MethodHolder is cleaned up by the finalizer.
-         struct MethodHolder
-         {
-            MethodType method;
-         };
+         // Instead, the method pointer is copied into the heap's binding table, and the Duktape function
+         // finds it through its magic value (see DukglueHeapState::set_binding).
 
          template<MethodType methodToCall>
          struct MethodCompiletime
@@ -108,112 +84,151 @@ namespace dukglue
             {
                // get this.obj_ptr
                duk_push_this(ctx);
-               duk_get_prop_string(ctx, -1, "\xFF" "obj_ptr");
+               get_hidden_prop(ctx, -1, KEY_OBJ_PTR);
                void* obj_void = duk_require_pointer(ctx, -1);
                if (obj_void == nullptr) {
                   duk_error(ctx, DUK_RET_REFERENCE_ERROR, "Native object missing.");
                   return DUK_RET_REFERENCE_ERROR;
                }
 
-               duk_pop_2(ctx);
-
                // (should always be valid unless someone is intentionally messing with this.obj_ptr...)
-               Cls* obj = static_cast<Cls*>(obj_void);
+               Cls* obj = object_ptr_as<Cls>(ctx, -2, obj_void);
+
+               duk_pop_2(ctx);
 
                // read arguments and call function
                auto bakedArgs = dukglue::detail::get_stack_values<Ts...>(ctx);
-               actually_call(ctx, obj, bakedArgs);
+               actually_call(ctx, obj, std::move(bakedArgs));
                return std::is_void<RetType>::value ? 0 : 1;
             }
 
             // this mess is to support functions with void return values
             template<typename Dummy = RetType, typename... BakedTs>
-            static typename std::enable_if<!std::is_void<Dummy>::value>::type actually_call(duk_context* ctx, Cls* obj, const std::tuple<BakedTs...>& args)
+            static typename std::enable_if<!std::is_void<Dummy>::value>::type actually_call(duk_context* ctx, Cls* obj, std::tuple<BakedTs...>&& args)
             {
                // ArgStorage has some static_asserts in it that validate value types,
                // so we typedef it to force ArgStorage<RetType> to compile and run the asserts
                typedef typename dukglue::types::ArgStorage<RetType>::type ValidateReturnType;
 
-               RetType return_val = dukglue::detail::apply_method<Cls, RetType, Ts...>(methodToCall, obj, args);
+               RetType return_val = dukglue::detail::apply_method<Cls, RetType, Ts...>(methodToCall, obj, std::move(args));
 
                using namespace dukglue::types;
                DukType<typename Bare<RetType>::type>::template push<RetType>(ctx, std::move(return_val));
             }
 
             template<typename Dummy = RetType, typename... BakedTs>
-            static typename std::enable_if<std::is_void<Dummy>::value>::type actually_call(duk_context* ctx, Cls* obj, const std::tuple<BakedTs...>& args)
+            static typename std::enable_if<std::is_void<Dummy>::value>::type actually_call(duk_context* ctx, Cls* obj, std::tuple<BakedTs...>&& args)
             {
-               dukglue::detail::apply_method(methodToCall, obj, args);
+               dukglue::detail::apply_method(methodToCall, obj, std::move(args));
             }
          };
 
 
          struct MethodRuntime
          {
-            static duk_ret_t finalize_method(duk_context* ctx)
+            static duk_ret_t call_native_method(duk_context* ctx)
             {
-               // clean up the MethodHolder reference
-               duk_get_prop_string(ctx, 0, "\xFF" "method_holder");
+               return call(ctx, DukglueHeapState::current_binding<MethodType>(ctx));
+            }
 
-               void* method_holder_void = duk_require_pointer(ctx, -1);
-               MethodHolder* method_holder = static_cast<MethodHolder*>(method_holder_void);
-               delete method_holder;
+            // Call method on this, with arguments read off the stack.
+            static duk_ret_t call(duk_context* ctx, MethodType method)
+            {
+               Cls* obj = get_this(ctx);
 
-               return 0;
+               // read arguments and call method
+               auto bakedArgs = dukglue::detail::get_stack_values<Ts...>(ctx);
+               actually_call(ctx, method, obj, std::move(bakedArgs));
+               return std::is_void<RetType>::value ? 0 : 1;
             }
 
-            static duk_ret_t call_native_method(duk_context* ctx)
+            // Same as call_native_method, without argument type checks (see dukglue_set_trusted).
+            static duk_ret_t call_native_method_trusted(duk_context* ctx)
+            {
+               MethodType method = DukglueHeapState::current_binding<MethodType>(ctx);
+               Cls* obj = get_this(ctx);
+
+               auto bakedArgs = dukglue::detail::get_stack_values_trusted<Ts...>(ctx);
+               actually_call(ctx, method, obj, std::move(bakedArgs));
+               return std::is_void<RetType>::value ? 0 : 1;
+            }
+
+            // The Duktape function to register in ctx's heap.
+            static duk_c_function native_method(duk_context* ctx)
+            {
+               return DukglueHeapState::require(ctx)->trusted ? call_native_method_trusted : call_native_method;
+            }
+
+            // Returns this.obj_ptr (throws a script error if this is not a valid native object).
+            static Cls* get_this(duk_context* ctx)
             {
                // get this.obj_ptr
                duk_push_this(ctx);
-               duk_get_prop_string(ctx, -1, "\xFF" "obj_ptr");
+               get_hidden_prop(ctx, -1, KEY_OBJ_PTR);
                void* obj_void = duk_get_pointer(ctx, -1);
                if (obj_void == nullptr) {
                   duk_error(ctx, DUK_RET_REFERENCE_ERROR, "Invalid native object for 'this'");
-                  return DUK_RET_REFERENCE_ERROR;
+                  return nullptr;
                }
 
-               duk_pop_2(ctx); // pop this.obj_ptr and this
-
-               // get current_function.method_info
-               duk_push_current_function(ctx);
-               duk_get_prop_string(ctx, -1, "\xFF" "method_holder");
-               void* method_holder_void = duk_require_pointer(ctx, -1);
-               if (method_holder_void == nullptr) {
-                  duk_error(ctx, DUK_RET_TYPE_ERROR, "Method pointer missing?!");
-                  return DUK_RET_TYPE_ERROR;
-               }
-
-               duk_pop_2(ctx);
-
                // (should always be valid unless someone is intentionally messing with this.obj_ptr...)
-               Cls* obj = static_cast<Cls*>(obj_void);
-               MethodHolder* method_holder = static_cast<MethodHolder*>(method_holder_void);
+               Cls* obj = object_ptr_as<Cls>(ctx, -2, obj_void);
 
-               // read arguments and call method
-               auto bakedArgs = dukglue::detail::get_stack_values<Ts...>(ctx);
-               actually_call(ctx, method_holder->method, obj, bakedArgs);
-               return std::is_void<RetType>::value ? 0 : 1;
+               duk_pop_2(ctx); // pop this.obj_ptr and this
+
+               return obj;
             }
 
             // this mess is to support functions with void return values
             template<typename Dummy = RetType, typename... BakedTs>
-            static typename std::enable_if<!std::is_void<Dummy>::value>::type actually_call(duk_context* ctx, MethodType method, Cls* obj, const std::tuple<BakedTs...>& args)
+            static typename std::enable_if<!std::is_void<Dummy>::value>::type actually_call(duk_context* ctx, MethodType method, Cls* obj, std::tuple<BakedTs...>&& args)
             {
                // ArgStorage has some static_asserts in it that validate value types,
                // so we typedef it to force ArgStorage<RetType> to compile and run the asserts
                typedef typename dukglue::types::ArgStorage<RetType>::type ValidateReturnType;
 
-               RetType return_val = dukglue::detail::apply_method<Cls, RetType, Ts...>(method, obj, args);
+               RetType return_val = dukglue::detail::apply_method<Cls, RetType, Ts...>(method, obj, std::move(args));
 
                using namespace dukglue::types;
                DukType<typename Bare<RetType>::type>::template push<RetType>(ctx, std::move(return_val));
             }
 
             template<typename Dummy = RetType, typename... BakedTs>
-            static typename std::enable_if<std::is_void<Dummy>::value>::type actually_call(duk_context* ctx, MethodType method, Cls* obj, const std::tuple<BakedTs...>& args)
+            static typename std::enable_if<std::is_void<Dummy>::value>::type actually_call(duk_context* ctx, MethodType method, Cls* obj, std::tuple<BakedTs...>&& args)
             {
-               dukglue::detail::apply_method(method, obj, args);
+               dukglue::detail::apply_method(method, obj, std::move(args));
+            }
+         };
+
+         // Same as MethodRuntime, but trailing arguments the script leaves undefined
+         // are replaced by default values (stored along with the method pointer).
+         template<typename... Ds>
+         struct MethodDefaultsRuntime
+         {
+            struct Binding
+            {
+               MethodType method;
+               std::tuple<Ds...> defaults;
+            };
+
+            static duk_ret_t call_native_method(duk_context* ctx)
+            {
+               const Binding* binding = DukglueHeapState::current_binding<Binding*>(ctx);
+               Cls* obj = MethodRuntime::get_this(ctx);
+
+               auto bakedArgs = dukglue::detail::get_stack_values<Ts...>(ctx, binding->defaults);
+               MethodRuntime::actually_call(ctx, binding->method, obj, std::move(bakedArgs));
+               return std::is_void<RetType>::value ? 0 : 1;
+            }
+
+            // Stack: ... -> ... [func]
+            static void push(duk_context* ctx, MethodType method, Defaults<Ds...>&& defaults)
+            {
+               DukglueHeapState* state = DukglueHeapState::require(ctx);
+               Binding binding = { method, std::move(defaults.values) };
+
+               duk_push_c_function(ctx, call_native_method, sizeof...(Ts));
+               DukglueHeapState::set_binding(ctx, -1, state->arena.create(std::move(binding)));
             }
          };
       };
@@ -222,44 +237,67 @@ namespace dukglue
       struct MethodVariadicRuntime
       {
          typedef MethodInfo<isConst, Cls, duk_ret_t, duk_context*> MethodInfoVariadic;
-         typedef typename MethodInfoVariadic::MethodHolder MethodHolderVariadic;
-
-         static duk_ret_t finalize_method(duk_context* ctx)
-         {
-            return MethodInfoVariadic::MethodRuntime::finalize_method(ctx);
-         }
+         typedef typename MethodInfoVariadic::MethodType MethodTypeVariadic;
 
          static duk_ret_t call_native_method(duk_context* ctx)
          {
             // get this.obj_ptr
             duk_push_this(ctx);
-            duk_get_prop_string(ctx, -1, "\xFF" "obj_ptr");
+            get_hidden_prop(ctx, -1, KEY_OBJ_PTR);
             void* obj_void = duk_get_pointer(ctx, -1);
             if (obj_void == nullptr) {
                duk_error(ctx, DUK_RET_REFERENCE_ERROR, "Invalid native object for 'this'");
                return DUK_RET_REFERENCE_ERROR;
             }
 
+            // (should always be valid unless someone is intentionally messing with this.obj_ptr...)
+            Cls* obj = object_ptr_as<Cls>(ctx, -2, obj_void);
+
             duk_pop_2(ctx);  // pop this.obj_ptr and this
 
-            // get current_function.method_info
-            duk_push_current_function(ctx);
-            duk_get_prop_string(ctx, -1, "\xFF" "method_holder");
-            void* method_holder_void = duk_require_pointer(ctx, -1);
-            if (method_holder_void == nullptr) {
-               duk_error(ctx, DUK_RET_TYPE_ERROR, "Method pointer missing?!");
-               return DUK_RET_TYPE_ERROR;
-            }
+            // get the method for the current function
+            const MethodTypeVariadic method = DukglueHeapState::current_binding<MethodTypeVariadic>(ctx);
 
-            duk_pop_2(ctx);
+            return (*obj.*method)(ctx);
+         }
+      };
 
-            // (should always be valid unless someone is intentionally messing with this.obj_ptr...)
-            Cls* obj = static_cast<Cls*>(obj_void);
-            MethodHolderVariadic* method_holder = static_cast<MethodHolderVariadic*>(method_holder_void);
+      // Class a method (or nullptr) belongs to, for deducing the class from a method pointer.
+      template<typename T>
+      struct MethodClass
+      {
+         typedef void type;
+      };
 
-            return (*obj.*method_holder->method)(ctx);
-         }
+      template<class Cls, typename RetType, typename... Ts>
+      struct MethodClass<RetType(Cls::*)(Ts...)>
+      {
+         typedef Cls type;
+      };
+
+      template<class Cls, typename RetType, typename... Ts>
+      struct MethodClass<RetType(Cls::*)(Ts...) const>
+      {
+         typedef Cls type;
       };
+
+#ifdef DUKGLUE_HAS_CPP17
+      // Pushes a Duktape function that calls methodToCall, embedded at compile time.
+      // methodToCall is passed again as an argument to deduce its signature.
+      template<auto methodToCall, class Cls, typename RetType, typename... Ts>
+      void push_method_compiletime(duk_context* ctx, RetType(Cls::*)(Ts...))
+      {
+         duk_c_function method_func = MethodInfo<false, Cls, RetType, Ts...>::template MethodCompiletime<methodToCall>::call_native_method;
+         duk_push_c_function(ctx, method_func, sizeof...(Ts));
+      }
+
+      template<auto methodToCall, class Cls, typename RetType, typename... Ts>
+      void push_method_compiletime(duk_context* ctx, RetType(Cls::*)(Ts...) const)
+      {
+         duk_c_function method_func = MethodInfo<true, Cls, RetType, Ts...>::template MethodCompiletime<methodToCall>::call_native_method;
+         duk_push_c_function(ctx, method_func, sizeof...(Ts));
+      }
+#endif
    }
 }
 
@@ -0,0 +1,268 @@
+#ifndef _DETAIL_OVERLOADS_20240506_H
+#define _DETAIL_OVERLOADS_20240506_H 1
+
+#include "detail_function.h"
+#include "detail_method.h"
+
+#include <string>
+#include <vector>
+
+namespace dukglue
+{
+   namespace detail
+   {
+      // Set of Duktape types (DUK_TYPE_MASK_*) a script value can have to be read as FullT
+      // (a full argument type, like const Dog* or int).
+      template<typename FullT>
+      duk_uint_t arg_type_mask()
+      {
+         using namespace dukglue::types;
+         typedef typename Bare<FullT>::type BareType;
+
+         duk_uint_t mask = DukTypeMask<BareType>::mask();
+
+         // native object pointers can be null
+         if (std::is_pointer<FullT>::value && !DukType<BareType>::IsValueType::value)
+            mask |= DUK_TYPE_MASK_NULL;
+
+         return mask;
+      }
+
+      // True if the value at arg_idx can be read as FullT.
+      // Unlike DukType::read, this never throws. For value types only the type mask is checked,
+      // for native objects the object's type is checked too.
+      template<typename FullT>
+      bool arg_matches(duk_context* ctx, duk_idx_t arg_idx)
+      {
+         using namespace dukglue::types;
+         typedef typename Bare<FullT>::type BareType;
+
+         if (!duk_check_type_mask(ctx, arg_idx, arg_type_mask<FullT>()))
+            return false;
+
+         if (DukType<BareType>::IsValueType::value || !duk_is_object(ctx, arg_idx))
+            return true;
+
+         get_hidden_prop(ctx, arg_idx, KEY_TYPE_INFO);
+         TypeInfo* info = static_cast<TypeInfo*>(duk_get_pointer(ctx, -1));
+         duk_pop(ctx);
+         if (info == nullptr || !info->can_cast<BareType>())
+            return false;
+
+         // must still be valid
+         get_hidden_prop(ctx, arg_idx, KEY_OBJ_PTR);
+         const bool valid = (duk_get_pointer(ctx, -1) != nullptr);
+         duk_pop(ctx);
+         return valid;
+      }
+
+      template<typename... Ts, size_t... Indexes>
+      bool args_match_helper(duk_context* ctx, index_tuple<Indexes...>)
+      {
+         (void) ctx;  // unused if there are no arguments
+         const bool matches[] = { true, arg_matches<Ts>(ctx, static_cast<duk_idx_t>(Indexes))... };
+         for (bool match : matches) {
+            if (!match)
+               return false;
+         }
+         return true;
+      }
+
+      template<typename... Ts>
+      bool args_match(duk_context* ctx)
+      {
+         return args_match_helper<Ts...>(ctx, typename make_indexes<Ts...>::type());
+      }
+
+      // Several native functions (or methods) bound to one script function.
+      // The candidate to call is picked by:
+      //   1. the number of arguments (using a table built at registration time),
+      //   2. the Duktape type of each argument (a bit test per argument),
+      //   3. if several candidates are left, a full (non-throwing) type check of each,
+      //      in the order they were registered.
+      // Once a single candidate is left it is called directly, and its own argument checks
+      // report any type errors.
+      struct OverloadSet
+      {
+         struct Candidate
+         {
+            duk_ret_t(*invoke)(duk_context* ctx, const BindingSlot& binding);
+            bool(*matches)(duk_context* ctx);
+            BindingSlot binding;
+            std::vector<duk_uint_t> masks;  // one per argument
+         };
+
+         std::string name;
+         std::vector<Candidate> candidates;
+
+         // by_arity[n] lists the candidates to consider when called with n arguments:
+         // the candidates taking exactly n arguments or, if there are none, those taking the most
+         // arguments below n (extra arguments are ignored, as with any other bound function).
+         // Calls with more arguments than any candidate takes use the last entry.
+         std::vector<std::vector<std::size_t> > by_arity;
+
+         void build_table()
+         {
+            std::size_t max_nargs = 0;
+            for (const auto& candidate : candidates) {
+               if (candidate.masks.size() > max_nargs)
+                  max_nargs = candidate.masks.size();
+            }
+
+            by_arity.assign(max_nargs + 1, std::vector<std::size_t>());
+            for (std::size_t nargs = 0; nargs <= max_nargs; nargs++) {
+               for (std::size_t below = nargs + 1; below > 0 && by_arity[nargs].empty(); below--) {
+                  for (std::size_t i = 0; i < candidates.size(); i++) {
+                     if (candidates[i].masks.size() == below - 1)
+                        by_arity[nargs].push_back(i);
+                  }
+               }
+            }
+         }
+
+         static bool masks_match(duk_context* ctx, const Candidate& candidate)
+         {
+            for (std::size_t i = 0; i < candidate.masks.size(); i++) {
+               if ((duk_get_type_mask(ctx, static_cast<duk_idx_t>(i)) & candidate.masks[i]) == 0)
+                  return false;
+            }
+            return true;
+         }
+
+         static duk_ret_t dispatch(duk_context* ctx)
+         {
+            const OverloadSet* set = DukglueHeapState::current_binding<OverloadSet*>(ctx);
+
+            duk_idx_t nargs = duk_get_top(ctx);
+            std::size_t arity = static_cast<std::size_t>(nargs);
+            if (arity >= set->by_arity.size())
+               arity = set->by_arity.size() - 1;
+
+            const std::vector<std::size_t>& bucket = set->by_arity[arity];
+            if (bucket.empty())
+               duk_error(ctx, DUK_RET_TYPE_ERROR, "%s: no overload takes %d arguments", set->name.c_str(), nargs);
+
+            if (bucket.size() == 1)
+               return call(ctx, set->candidates[bucket[0]]);
+
+            // filter by type masks
+            const Candidate* first_match = nullptr;
+            std::size_t mask_matches = 0;
+            for (std::size_t idx : bucket) {
+               const Candidate& candidate = set->candidates[idx];
+               if (masks_match(ctx, candidate)) {
+                  if (first_match == nullptr)
+                     first_match = &candidate;
+                  mask_matches++;
+               }
+            }
+
+            if (mask_matches == 1)
+               return call(ctx, *first_match);
+
+            // still ambiguous, do a full check
+            if (mask_matches > 1) {
+               for (std::size_t idx : bucket) {
+                  const Candidate& candidate = set->candidates[idx];
+                  if (masks_match(ctx, candidate) && candidate.matches(ctx))
+                     return call(ctx, candidate);
+               }
+            }
+
+            duk_error(ctx, DUK_RET_TYPE_ERROR, "%s: no overload matches the arguments", set->name.c_str());
+            return DUK_RET_TYPE_ERROR;
+         }
+
+         static duk_ret_t call(duk_context* ctx, const Candidate& candidate)
+         {
+            // copy the binding, the candidate may not outlive the call
+            // (if the overload set is re-registered from within the call)
+            const BindingSlot binding = candidate.binding;
+            return candidate.invoke(ctx, binding);
+         }
+      };
+
+      template<typename RetType, typename... Ts>
+      duk_ret_t invoke_function(duk_context* ctx, const BindingSlot& binding)
+      {
+         typedef FuncInfoHolder<RetType, Ts...> FuncInfo;
+         return FuncInfo::FuncRuntime::call(ctx, binding.load<typename FuncInfo::FuncType>());
+      }
+
+      template<bool isConst, class Cls, typename RetType, typename... Ts>
+      duk_ret_t invoke_method(duk_context* ctx, const BindingSlot& binding)
+      {
+         typedef MethodInfo<isConst, Cls, RetType, Ts...> Info;
+         return Info::MethodRuntime::call(ctx, binding.load<typename Info::MethodType>());
+      }
+
+      template<typename... Ts>
+      OverloadSet::Candidate make_candidate(duk_ret_t(*invoke)(duk_context*, const BindingSlot&), const BindingSlot& binding)
+      {
+         OverloadSet::Candidate candidate;
+         candidate.invoke = invoke;
+         candidate.matches = &args_match<Ts...>;
+         candidate.binding = binding;
+         candidate.masks = std::vector<duk_uint_t>{ arg_type_mask<Ts>()... };
+         return candidate;
+      }
+
+      template<typename RetType, typename... Ts>
+      void add_overload(OverloadSet& set, RetType(*func)(Ts...))
+      {
+         set.candidates.push_back(make_candidate<Ts...>(&invoke_function<RetType, Ts...>, BindingSlot::make(func)));
+      }
+
+      template<class Cls, typename RetType, typename... Ts>
+      void add_overload(OverloadSet& set, RetType(Cls::*method)(Ts...))
+      {
+         set.candidates.push_back(make_candidate<Ts...>(&invoke_method<false, Cls, RetType, Ts...>, BindingSlot::make(method)));
+      }
+
+      template<class Cls, typename RetType, typename... Ts>
+      void add_overload(OverloadSet& set, RetType(Cls::*method)(Ts...) const)
+      {
+         set.candidates.push_back(make_candidate<Ts...>(&invoke_method<true, Cls, RetType, Ts...>, BindingSlot::make(method)));
+      }
+
+      // OverloadsClass<Methods...>::type is the class all of Methods belong to,
+      // or void if they don't all belong to the same class.
+      template<typename... Methods>
+      struct OverloadsClass;
+
+      template<typename Method>
+      struct OverloadsClass<Method>
+      {
+         typedef typename MethodClass<Method>::type type;
+      };
+
+      template<typename Method, typename... Rest>
+      struct OverloadsClass<Method, Rest...>
+      {
+         typedef typename MethodClass<Method>::type First;
+         typedef typename std::conditional<std::is_same<First, typename OverloadsClass<Rest...>::type>::value, First, void>::type type;
+      };
+
+      // Pushes a script function that dispatches to one of overloads.
+      // Stack: ... -> ... [func]
+      template<typename... Overloads>
+      void push_overloads(duk_context* ctx, const char* name, Overloads... overloads)
+      {
+         static_assert(sizeof...(Overloads) > 0, "Need at least one overload");
+
+         OverloadSet set;
+         set.name = name;
+
+         const int expand[] = { 0, (add_overload(set, overloads), 0)... };
+         (void) expand;
+
+         set.build_table();
+
+         DukglueHeapState* state = DukglueHeapState::require(ctx);
+         duk_push_c_function(ctx, OverloadSet::dispatch, DUK_VARARGS);
+         DukglueHeapState::set_binding(ctx, -1, state->arena.create(std::move(set)));
+      }
+   }
+}
+
+#endif
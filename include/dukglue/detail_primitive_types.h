@@ -2,6 +2,7 @@
 #ifndef _DETAIL_PRIMITIVE_TYPES_20240506_H
 #define _DETAIL_PRIMITIVE_TYPES_20240506_H 1
 
+#include "detail_traits.h"  // for DUKGLUE_HAS_CPP17
 #include "detail_types.h"
 #include "detail_typeinfo.h"
 #include "dukvalue.h"
@@ -9,12 +10,51 @@
 #include <vector>
 #include <map>
 #include <stdint.h>
-#include <memory>  // for std::shared_ptr
+#include <memory>  // for std::shared_ptr, std::unique_ptr
+#ifdef DUKGLUE_HAS_CPP17
+#include <optional>
+#endif
 
 namespace dukglue {
+   namespace detail {
+      // duk_get_string, but never null (std::string can't be constructed from null)
+      inline const char* get_string_or_empty(duk_context* ctx, duk_idx_t idx) {
+         return duk_get_string_default(ctx, idx, "");
+      }
+
+      // Releases a shared_ptr wrapper's reference to its object (see SharedPtrRefs).
+      inline duk_ret_t shared_ptr_finalizer(duk_context* ctx)
+      {
+         DukglueHeapState* state = DukglueHeapState::get(ctx);
+         if (state == nullptr)  // heap is being destroyed, the state has released everything
+            return 0;
+
+         get_hidden_prop(ctx, 0, KEY_SHARED_PTR);
+         if (!duk_is_number(ctx, -1)) {  // already released (finalizers can run multiple times)
+            duk_pop(ctx);
+            return 0;
+         }
+         duk_uarridx_t slot = duk_get_uint(ctx, -1);
+         duk_pop(ctx);
+
+         // for safety, set the slot to undefined (the slot will be reused)
+         duk_push_undefined(ctx);
+         put_hidden_prop(ctx, 0, KEY_SHARED_PTR);
+
+         // released (which may run the object's destructor) once the registry is consistent
+         std::shared_ptr<void> owner = state->shared_ptrs.remove(slot, duk_get_heapptr(ctx, 0));
+         return 0;
+      }
+   }
+
    namespace types {
 
-#define DUKGLUE_SIMPLE_VALUE_TYPE(TYPE, DUK_IS_FUNC, DUK_GET_FUNC, DUK_PUSH_FUNC, PUSH_VALUE) \
+#define DUKGLUE_SIMPLE_VALUE_TYPE(TYPE, DUK_IS_FUNC, DUK_GET_FUNC, DUK_PUSH_FUNC, PUSH_VALUE, TYPE_MASK) \
+      template<> \
+      struct DukTypeMask<TYPE> { \
+         static duk_uint_t mask() { return TYPE_MASK; } \
+      }; \
+      \
       template<> \
       struct DukType<TYPE> { \
          typedef std::true_type IsValueType; \
@@ -31,30 +71,35 @@ namespace dukglue {
          } \
          \
          template<typename FullT> \
+         static TYPE read_trusted(duk_context* ctx, duk_idx_t arg_idx) { \
+            return static_cast<TYPE>(DUK_GET_FUNC(ctx, arg_idx)); \
+         } \
+         \
+         template<typename FullT> \
          static void push(duk_context* ctx, TYPE value) { \
             DUK_PUSH_FUNC(ctx, PUSH_VALUE); \
          } \
       };
 
-      DUKGLUE_SIMPLE_VALUE_TYPE(bool, duk_is_boolean, 0 != duk_get_boolean, duk_push_boolean, value)
+      DUKGLUE_SIMPLE_VALUE_TYPE(bool, duk_is_boolean, 0 != duk_get_boolean, duk_push_boolean, value, DUK_TYPE_MASK_BOOLEAN)
 
-         DUKGLUE_SIMPLE_VALUE_TYPE(uint8_t, duk_is_number, duk_get_uint, duk_push_uint, value)
-         DUKGLUE_SIMPLE_VALUE_TYPE(uint16_t, duk_is_number, duk_get_uint, duk_push_uint, value)
-         DUKGLUE_SIMPLE_VALUE_TYPE(uint32_t, duk_is_number, duk_get_uint, duk_push_uint, value)
-         DUKGLUE_SIMPLE_VALUE_TYPE(uint64_t, duk_is_number, duk_get_number, duk_push_number, value) // have to cast to double
+         DUKGLUE_SIMPLE_VALUE_TYPE(uint8_t, duk_is_number, duk_get_uint, duk_push_uint, value, DUK_TYPE_MASK_NUMBER)
+         DUKGLUE_SIMPLE_VALUE_TYPE(uint16_t, duk_is_number, duk_get_uint, duk_push_uint, value, DUK_TYPE_MASK_NUMBER)
+         DUKGLUE_SIMPLE_VALUE_TYPE(uint32_t, duk_is_number, duk_get_uint, duk_push_uint, value, DUK_TYPE_MASK_NUMBER)
+         DUKGLUE_SIMPLE_VALUE_TYPE(uint64_t, duk_is_number, duk_get_number, duk_push_number, value, DUK_TYPE_MASK_NUMBER) // have to cast to double
 
-         DUKGLUE_SIMPLE_VALUE_TYPE(int8_t, duk_is_number, duk_get_int, duk_push_int, value)
-         DUKGLUE_SIMPLE_VALUE_TYPE(int16_t, duk_is_number, duk_get_int, duk_push_int, value)
-         DUKGLUE_SIMPLE_VALUE_TYPE(int32_t, duk_is_number, duk_get_int, duk_push_int, value)
-         DUKGLUE_SIMPLE_VALUE_TYPE(int64_t, duk_is_number, duk_get_number, duk_push_number, value) // have to cast to double
+         DUKGLUE_SIMPLE_VALUE_TYPE(int8_t, duk_is_number, duk_get_int, duk_push_int, value, DUK_TYPE_MASK_NUMBER)
+         DUKGLUE_SIMPLE_VALUE_TYPE(int16_t, duk_is_number, duk_get_int, duk_push_int, value, DUK_TYPE_MASK_NUMBER)
+         DUKGLUE_SIMPLE_VALUE_TYPE(int32_t, duk_is_number, duk_get_int, duk_push_int, value, DUK_TYPE_MASK_NUMBER)
+         DUKGLUE_SIMPLE_VALUE_TYPE(int64_t, duk_is_number, duk_get_number, duk_push_number, value, DUK_TYPE_MASK_NUMBER) // have to cast to double
 
          // signed char and unsigned char are surprisingly *both* different from char, at least in MSVC
-         DUKGLUE_SIMPLE_VALUE_TYPE(char, duk_is_number, duk_get_int, duk_push_int, value)
+         DUKGLUE_SIMPLE_VALUE_TYPE(char, duk_is_number, duk_get_int, duk_push_int, value, DUK_TYPE_MASK_NUMBER)
 
-         DUKGLUE_SIMPLE_VALUE_TYPE(float, duk_is_number, duk_get_number, duk_push_number, value)
-         DUKGLUE_SIMPLE_VALUE_TYPE(double, duk_is_number, duk_get_number, duk_push_number, value)
+         DUKGLUE_SIMPLE_VALUE_TYPE(float, duk_is_number, duk_get_number, duk_push_number, value, DUK_TYPE_MASK_NUMBER)
+         DUKGLUE_SIMPLE_VALUE_TYPE(double, duk_is_number, duk_get_number, duk_push_number, value, DUK_TYPE_MASK_NUMBER)
 
-         DUKGLUE_SIMPLE_VALUE_TYPE(std::string, duk_is_string, duk_get_string, duk_push_string, value.c_str())
+         DUKGLUE_SIMPLE_VALUE_TYPE(std::string, duk_is_string, detail::get_string_or_empty, duk_push_string, value.c_str(), DUK_TYPE_MASK_STRING)
 
          // We have to do some magic for const char* to work correctly.
          // We override the "bare type" and "storage type" to both be const char*.
@@ -74,6 +119,11 @@ namespace dukglue {
          typedef const char* type;
       };
 
+      template<>
+      struct DukTypeMask<const char*> {
+         static duk_uint_t mask() { return DUK_TYPE_MASK_STRING; }
+      };
+
       template<>
       struct DukType<const char*> {
          typedef std::true_type IsValueType;
@@ -89,6 +139,11 @@ namespace dukglue {
             }
          }
 
+         template<typename FullT>
+         static const char* read_trusted(duk_context* ctx, duk_idx_t arg_idx) {
+            return duk_get_string(ctx, arg_idx);
+         }
+
          template<typename FullT>
          static void push(duk_context* ctx, const char* value) {
             duk_push_string(ctx, value);
@@ -133,8 +188,15 @@ namespace dukglue {
          }
       };
 
+      // DukValue can hold anything (uses the default DukTypeMask)
+
       // std::vector (as value)
       // TODO - probably leaks memory if duktape is using longjmp and an error is encountered while reading an element
+      template<typename T>
+      struct DukTypeMask< std::vector<T> > {
+         static duk_uint_t mask() { return DUK_TYPE_MASK_OBJECT; }
+      };
+
       template<typename T>
       struct DukType< std::vector<T> > {
          typedef std::true_type IsValueType;
@@ -171,6 +233,12 @@ namespace dukglue {
       };
 
       // std::shared_ptr (as value)
+      // Each object gets one wrapper at a time (see SharedPtrRefs).
+      template<typename T>
+      struct DukTypeMask< std::shared_ptr<T> > {
+         static duk_uint_t mask() { return DUK_TYPE_MASK_OBJECT | DUK_TYPE_MASK_NULL; }
+      };
+
       template<typename T>
       struct DukType< std::shared_ptr<T> > {
          typedef std::true_type IsValueType;
@@ -187,7 +255,7 @@ namespace dukglue {
                duk_error(ctx, DUK_RET_TYPE_ERROR, "Argument %d: expected shared_ptr object, got ", arg_idx, detail::get_type_name(type_idx));
             }
 
-            duk_get_prop_string(ctx, arg_idx, "\xFF" "type_info");
+            detail::get_hidden_prop(ctx, arg_idx, detail::KEY_TYPE_INFO);
             if (!duk_is_pointer(ctx, -1))  // missing type_info, must not be a native object
                duk_error(ctx, DUK_RET_TYPE_ERROR, "Argument %d: expected shared_ptr object (missing type_info)", arg_idx);
 
@@ -197,49 +265,187 @@ namespace dukglue {
                duk_error(ctx, DUK_RET_TYPE_ERROR, "Argument %d: wrong type of shared_ptr object", arg_idx);
             duk_pop(ctx);  // pop type_info
 
-            duk_get_prop_string(ctx, arg_idx, "\xFF" "shared_ptr");
-            if (!duk_is_pointer(ctx, -1))
+            detail::get_hidden_prop(ctx, arg_idx, detail::KEY_OBJ_PTR);
+            void* obj_ptr = duk_get_pointer(ctx, -1);
+            duk_pop(ctx);  // pop obj_ptr
+
+            detail::get_hidden_prop(ctx, arg_idx, detail::KEY_SHARED_PTR);
+            if (!duk_is_number(ctx, -1))
                duk_error(ctx, DUK_RET_TYPE_ERROR, "Argument %d: not a shared_ptr object (missing shared_ptr)", arg_idx);
-            void* ptr = duk_get_pointer(ctx, -1);
-            duk_pop(ctx);  // pop pointer to shared_ptr
+            duk_uarridx_t slot = duk_get_uint(ctx, -1);
+            duk_pop(ctx);  // pop slot
+
+            const std::shared_ptr<void>& owner = detail::DukglueHeapState::require(ctx)->shared_ptrs.get(slot, duk_get_heapptr(ctx, arg_idx));
+            if (!owner)
+               duk_error(ctx, DUK_RET_TYPE_ERROR, "Argument %d: not a shared_ptr object (released)", arg_idx);
+
+            // the owner points at the object as pushed, the wrapper at the object as the class of its
+            // prototype, which is cast to T (an invalidated wrapper still shares ownership, and has
+            // only the owner's pointer left)
+            T* obj = obj_ptr != nullptr ? info->cast<T>(obj_ptr) : static_cast<T*>(owner.get());
+            return std::shared_ptr<T>(owner, obj);
+         }
+
+         // Pushes the wrapper for value, creating it if value's object has no live wrapper.
+         template <typename FullT>
+         static void push(duk_context* ctx, const std::shared_ptr<T>& value) {
+            if (!value) {
+               duk_push_null(ctx);
+               return;
+            }
+
+            detail::DukglueHeapState* state = detail::DukglueHeapState::require(ctx);
+            detail::SharedPtrRefs& refs = state->shared_ptrs;
+
+            void* obj_ptr = const_cast<void*>(static_cast<const void*>(value.get()));
+            void* existing = refs.find(obj_ptr);
+            if (existing != nullptr) {
+               // pushing a wrapper waiting for its finalizer is allowed, and cancels the finalizer
+               duk_push_heapptr(ctx, existing);
+               return;
+            }
 
-            return *((std::shared_ptr<T>*) ptr);
+            dukglue::detail::ProtoManager::make_script_object(ctx, value.get());
+
+            duk_uarridx_t slot = refs.add(duk_get_heapptr(ctx, -1), std::static_pointer_cast<void>(std::const_pointer_cast<typename std::remove_const<T>::type>(value)));
+            duk_push_uint(ctx, slot);
+            detail::put_hidden_prop(ctx, -2, detail::KEY_SHARED_PTR);
+
+            push_finalizer(ctx, state);
+            duk_set_finalizer(ctx, -2);
          }
 
-         static duk_ret_t shared_ptr_finalizer(duk_context* ctx)
+      private:
+         // Stack: ... -> ... [finalizer]
+         static void push_finalizer(duk_context* ctx, detail::DukglueHeapState* state)
          {
-            duk_get_prop_string(ctx, 0, "\xFF" "shared_ptr");
-            std::shared_ptr<T>* ptr = (std::shared_ptr<T>*) duk_require_pointer(ctx, -1);
-            duk_pop(ctx);  // pop shared_ptr ptr
+            detail::SharedPtrRefs& refs = state->shared_ptrs;
+            if (refs.finalizer == nullptr) {
+               // one function shared by all wrappers (of any type), kept alive by the ref array
+               state->ref_array.push_array(ctx);
+               duk_push_c_function(ctx, &detail::shared_ptr_finalizer, 1);
+               refs.finalizer = duk_get_heapptr(ctx, -1);
+               duk_put_prop_string(ctx, -2, "\xFF" "shared_ptr_finalizer");
+               duk_pop(ctx);  // pop ref_array
+            }
+
+            duk_push_heapptr(ctx, refs.finalizer);
+         }
+      };
 
-            if (ptr != nullptr) {
-               delete ptr;
+      // std::unique_ptr (ownership transfer)
+      // A native object pushed as a unique_ptr is owned by its script object, and deleted by the
+      // script object's finalizer (like objects constructed by a managed constructor).
+      // Reading a script-owned object as a unique_ptr (by value or rvalue reference) takes the
+      // ownership back, and invalidates the script object, once every argument of the call has
+      // been read (see ScriptOwnedPtr). Objects constructed by a managed
+      // constructor can only be taken if their class is allocated with new (see dukglue_class_allocator).
+      // Script-owned objects aren't registered (see RefManager), so pushing the object again as
+      // a raw pointer gives another script object.
+
+      // Argument storage for a std::unique_ptr<T> read from a script object. The script object
+      // keeps owning the native object until take() is called, once every argument has been read:
+      // if reading a later argument fails, the native object is left to the script object.
+      template<typename T>
+      class ScriptOwnedPtr : public std::unique_ptr<T> {
+      public:
+         ScriptOwnedPtr() : idx_(0), taken_(false) {}
+         ScriptOwnedPtr(T* obj, duk_idx_t idx) : std::unique_ptr<T>(obj), idx_(idx), taken_(false) {}
+         ScriptOwnedPtr(ScriptOwnedPtr&&) = default;
+
+         ~ScriptOwnedPtr() {
+            if (!taken_)
+               this->release();  // still the script object's
+         }
 
-               // for safety, set the pointer to undefined
-               // (finalizers can run multiple times)
+         // Invalidates the script object, so its finalizer won't delete the native object.
+         void take(duk_context* ctx) {
+            if (this->get() != nullptr && !taken_) {
                duk_push_undefined(ctx);
-               duk_put_prop_string(ctx, 0, "\xFF" "shared_ptr");
+               detail::put_hidden_prop(ctx, idx_, detail::KEY_OBJ_PTR);
             }
+            taken_ = true;
+         }
 
-            return 0;
+      private:
+         duk_idx_t idx_;  // of the script object
+         bool taken_;
+      };
+
+      template<typename T>
+      struct ValueStorage< std::unique_ptr<T> > {
+         typedef ScriptOwnedPtr<T> type;
+      };
+
+      template<typename T>
+      struct ArgOwnership< ScriptOwnedPtr<T> > {
+         static const void* owned_object(const ScriptOwnedPtr<T>& ptr) { return ptr.get(); }
+         static void take(duk_context* ctx, ScriptOwnedPtr<T>& ptr) { ptr.take(ctx); }
+      };
+
+      template<typename T>
+      struct DukTypeMask< std::unique_ptr<T> > {
+         static duk_uint_t mask() { return DUK_TYPE_MASK_OBJECT | DUK_TYPE_MASK_NULL; }
+      };
+
+      template<typename T>
+      struct DukType< std::unique_ptr<T> > {
+         typedef std::true_type IsValueType;
+
+         template<typename FullT>
+         static ScriptOwnedPtr<T> read(duk_context* ctx, duk_idx_t arg_idx) {
+            if (duk_is_null(ctx, arg_idx))
+               return ScriptOwnedPtr<T>();
+
+            // checks the object can be read as a T*
+            T* obj = DukType<T>::template read<T*>(ctx, arg_idx);
+
+            detail::get_hidden_prop(ctx, arg_idx, detail::KEY_OWNED);
+            const bool owned = duk_get_boolean(ctx, -1) != 0;
+            duk_pop(ctx);  // pop owned
+
+            if (!owned)
+               duk_error(ctx, DUK_RET_TYPE_ERROR, "Argument %d: native object is not owned by script", arg_idx);
+
+            // constructed in memory from a dukglue_class_allocator that delete can't free
+            detail::get_hidden_prop(ctx, arg_idx, detail::KEY_ALLOCATED);
+            const bool allocated = duk_get_boolean(ctx, -1) != 0;
+            duk_pop(ctx);  // pop allocated
+
+            if (allocated)
+               duk_error(ctx, DUK_RET_TYPE_ERROR, "Argument %d: native object was not allocated with new", arg_idx);
+
+            return ScriptOwnedPtr<T>(obj, duk_normalize_index(ctx, arg_idx));
          }
 
-         template <typename FullT>
-         static void push(duk_context* ctx, const std::shared_ptr<T>& value) {
+         template<typename FullT>
+         static void push(duk_context* ctx, std::unique_ptr<T> value) {
+            if (!value) {
+               duk_push_null(ctx);
+               return;
+            }
+
             dukglue::detail::ProtoManager::make_script_object(ctx, value.get());
 
-            // create + set shared_ptr
-            duk_push_pointer(ctx, new std::shared_ptr<T>(value));
-            duk_put_prop_string(ctx, -2, "\xFF" "shared_ptr");
+            duk_push_true(ctx);
+            detail::put_hidden_prop(ctx, -2, detail::KEY_OWNED);
 
-            // set shared_ptr finalizer
-            duk_push_c_function(ctx, &shared_ptr_finalizer, 1);
+            // a lightfunc, so the finalizer doesn't cost a function object per script object
+            duk_push_c_lightfunc(ctx, &detail::managed_finalizer<T>, 1, 1, 0);
             duk_set_finalizer(ctx, -2);
+
+            // owned by the script object from here on
+            value.release();
          }
       };
 
       // std::map (as value)
       // TODO - probably leaks memory if duktape is using longjmp and an error is encountered while reading values
+      template<typename T>
+      struct DukTypeMask< std::map<std::string, T> > {
+         static duk_uint_t mask() { return DUK_TYPE_MASK_OBJECT; }
+      };
+
       template<typename T>
       struct DukType< std::map<std::string, T> > {
          typedef std::true_type IsValueType;
@@ -270,6 +476,36 @@ namespace dukglue {
          }
       };
 
+#ifdef DUKGLUE_HAS_CPP17
+      // std::optional (as value)
+      // undefined (or an omitted argument) reads as std::nullopt, and std::nullopt is pushed as undefined.
+      template<typename T>
+      struct DukTypeMask< std::optional<T> > {
+         static duk_uint_t mask() { return DukTypeMask<typename Bare<T>::type>::mask() | DUK_TYPE_MASK_NONE | DUK_TYPE_MASK_UNDEFINED; }
+      };
+
+      template<typename T>
+      struct DukType< std::optional<T> > {
+         typedef std::true_type IsValueType;
+
+         template <typename FullT>
+         static std::optional<T> read(duk_context* ctx, duk_idx_t arg_idx) {
+            if (duk_check_type_mask(ctx, arg_idx, DUK_TYPE_MASK_NONE | DUK_TYPE_MASK_UNDEFINED))
+               return std::nullopt;
+
+            return DukType<typename Bare<T>::type>::template read<typename ArgStorage<T>::type>(ctx, arg_idx);
+         }
+
+         template <typename FullT>
+         static void push(duk_context* ctx, const std::optional<T>& value) {
+            if (value)
+               DukType<typename Bare<T>::type>::template push<T>(ctx, *value);
+            else
+               duk_push_undefined(ctx);
+         }
+      };
+#endif
+
       // std::function
       /*template <typename RetT, typename... ArgTs>
       struct DukType< std::function<RetT(ArgTs...)> > {
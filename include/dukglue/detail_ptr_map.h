@@ -0,0 +1,188 @@
+#ifndef _DETAIL_PTR_MAP_20240506_H
+#define _DETAIL_PTR_MAP_20240506_H 1
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+namespace dukglue
+{
+   namespace detail
+   {
+      // Hash map from (non-null) pointers to Value, used to find the script object
+      // registered for a native object (see RefManager).
+      //
+      // Entries live in one flat array (no allocation per entry), found by linear probing:
+      // a lookup hashes the pointer to a slot, then walks forward until it finds the pointer
+      // or an empty slot, usually within the same cache line.
+      // Erasing shifts the following entries of the probe sequence back (instead of leaving
+      // a tombstone), so lookups never slow down as objects come and go.
+      //
+      // Value must be trivially copyable (it is moved around with plain assignment).
+      // The table is kept at most 3/4 full, so an entry costs 1.3-2.7 times sizeof(Entry).
+      template<typename Value>
+      class PtrMap
+      {
+      public:
+         struct Entry
+         {
+            void* key;  // nullptr if the slot is empty
+            Value value;
+         };
+
+         PtrMap() : entries_(nullptr), mask_(0), shift_(63), size_(0) {}
+
+         ~PtrMap()
+         {
+            std::free(entries_);
+         }
+
+         PtrMap(const PtrMap&) = delete;
+         PtrMap& operator=(const PtrMap&) = delete;
+
+         std::size_t size() const
+         {
+            return size_;
+         }
+
+         // Returns the value for key, or nullptr if key isn't in the map.
+         // The pointer is valid until the map is modified.
+         Value* find(void* key)
+         {
+            if (size_ == 0)
+               return nullptr;
+
+            for (std::size_t idx = slot(key); ; idx = (idx + 1) & mask_) {
+               Entry& entry = entries_[idx];
+               if (entry.key == key)
+                  return &entry.value;
+               if (entry.key == nullptr)
+                  return nullptr;
+            }
+         }
+
+         // Sets the value for key (which must not be null), adding it if needed.
+         void set(void* key, Value value)
+         {
+            if ((size_ + 1) * 4 > capacity() * 3)
+               grow();
+
+            for (std::size_t idx = slot(key); ; idx = (idx + 1) & mask_) {
+               Entry& entry = entries_[idx];
+               if (entry.key == key) {
+                  entry.value = value;
+                  return;
+               }
+               if (entry.key == nullptr) {
+                  entry.key = key;
+                  entry.value = value;
+                  size_++;
+                  return;
+               }
+            }
+         }
+
+         // Removes key from the map. Returns false if it wasn't there.
+         bool erase(void* key)
+         {
+            if (size_ == 0)
+               return false;
+
+            std::size_t hole = slot(key);
+            while (entries_[hole].key != key) {
+               if (entries_[hole].key == nullptr)
+                  return false;
+               hole = (hole + 1) & mask_;
+            }
+
+            // Backward shift deletion: move later entries of the same probe run into the hole
+            // if the hole is between their home slot and their current slot.
+            for (std::size_t idx = (hole + 1) & mask_; entries_[idx].key != nullptr; idx = (idx + 1) & mask_) {
+               const std::size_t home = slot(entries_[idx].key);
+               if (((idx - home) & mask_) >= ((idx - hole) & mask_)) {
+                  entries_[hole] = entries_[idx];
+                  hole = idx;
+               }
+            }
+
+            entries_[hole].key = nullptr;
+            size_--;
+            return true;
+         }
+
+         // Calls func(key, value) for each entry, in no particular order.
+         // func can change the value, but must not add or remove entries.
+         template<typename Func>
+         void for_each(Func func)
+         {
+            for (std::size_t i = 0; i < capacity(); i++) {
+               if (entries_[i].key != nullptr)
+                  func(entries_[i].key, entries_[i].value);
+            }
+         }
+
+         template<typename Func>
+         void for_each(Func func) const
+         {
+            for (std::size_t i = 0; i < capacity(); i++) {
+               if (entries_[i].key != nullptr)
+                  func(entries_[i].key, static_cast<const Value&>(entries_[i].value));
+            }
+         }
+
+      private:
+         static const std::size_t MIN_CAPACITY = 16;
+
+         Entry* entries_;
+         std::size_t mask_;  // capacity - 1 (capacity is a power of two), or 0 before the first insert
+         unsigned shift_;  // 64 - log2(capacity)
+         std::size_t size_;
+
+         std::size_t capacity() const
+         {
+            return entries_ == nullptr ? 0 : mask_ + 1;
+         }
+
+         // Fibonacci hashing: multiplying by 2^64 / golden ratio mixes all the pointer's bits
+         // into the top bits of the product, which are used as the slot.
+         // The low bits of a pointer are mostly zero because of alignment, so they are shifted out first.
+         std::size_t slot(void* key) const
+         {
+            const std::uint64_t bits = static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(key)) >> 3;
+            return static_cast<std::size_t>((bits * 0x9E3779B97F4A7C15ull) >> shift_);
+         }
+
+         void grow()
+         {
+            const std::size_t old_capacity = capacity();
+            Entry* old_entries = entries_;
+
+            const std::size_t new_capacity = (old_capacity == 0 ? MIN_CAPACITY : old_capacity * 2);
+            entries_ = static_cast<Entry*>(std::calloc(new_capacity, sizeof(Entry)));
+            if (entries_ == nullptr) {
+               entries_ = old_entries;
+               throw std::bad_alloc();
+            }
+            mask_ = new_capacity - 1;
+            shift_ = 64;
+            for (std::size_t c = new_capacity; c > 1; c >>= 1)
+               shift_--;
+
+            for (std::size_t i = 0; i < old_capacity; i++) {
+               if (old_entries[i].key == nullptr)
+                  continue;
+
+               std::size_t idx = slot(old_entries[i].key);
+               while (entries_[idx].key != nullptr)
+                  idx = (idx + 1) & mask_;
+               entries_[idx] = old_entries[i];
+            }
+
+            std::free(old_entries);
+         }
+      };
+   }
+}
+
+#endif
@@ -0,0 +1,266 @@
+#ifndef _DETAIL_REF_ARRAY_20240506_H
+#define _DETAIL_REF_ARRAY_20240506_H 1
+
+#include <duktape.h>
+
+#include <cstddef>
+#include <vector>
+
+namespace dukglue
+{
+   namespace detail
+   {
+      // Sizes of a ref array (see dukglue_get_ref_stats).
+      struct RefArrayStats
+      {
+         std::size_t live;  // slots holding a reference
+         std::size_t free;  // released slots, waiting to be reused (or compacted away)
+
+         // Fraction of the array's slots that are free.
+         double fragmentation() const
+         {
+            return (live + free == 0) ? 0.0 : static_cast<double>(free) / static_cast<double>(live + free);
+         }
+      };
+
+      // A script array holding references to script values, to keep them from being garbage collected
+      // (see RefManager and DukValue). Each value is stored in a slot, and slots are reused once released.
+      // Slot 0 is never used, so 0 can mean "no slot".
+      //
+      // Free slots are kept in a native list, so storing or releasing a value is a single array write.
+      // The array doesn't shrink when values are released; compact() moves the values in the last slots
+      // into free ones and truncates it, so a heap that once held many references doesn't keep a huge,
+      // mostly empty array around (which mark-and-sweep would scan on every GC).
+      //
+      // Writes to the array can run finalizers (by allocating, or by dropping the last reference to a
+      // value), which can store and release other values. Every operation keeps the free list consistent
+      // across those writes, and compaction never runs while a store or release is in progress.
+      class RefArray
+      {
+      public:
+         RefArray() : array_(nullptr), length_(1), busy_(0) {}
+
+         // Creates the script array. The caller needs to keep it reachable.
+         // Stack: ... -> ... [array]
+         void create(duk_context* ctx)
+         {
+            duk_push_array(ctx);
+            array_ = duk_get_heapptr(ctx, -1);
+
+            // array[0] = 0 (slot 0 is never used)
+            duk_push_int(ctx, 0);
+            duk_put_prop_index(ctx, -2, 0);
+         }
+
+         // Stack: ... -> ... [array]
+         void push_array(duk_context* ctx) const
+         {
+            duk_push_heapptr(ctx, array_);
+         }
+
+         // Stores (a reference to) the value at idx and returns its slot.
+         // Stack: ... [value] ... -> ... [value] ...
+         duk_uarridx_t store(duk_context* ctx, duk_idx_t idx)
+         {
+            idx = duk_normalize_index(ctx, idx);
+
+            duk_uarridx_t slot;
+            if (free_slots_.empty()) {
+               slot = length_++;
+            }
+            else {
+               slot = free_slots_.back();
+               free_slots_.pop_back();
+            }
+
+            busy_++;
+            duk_push_heapptr(ctx, array_);
+            duk_dup(ctx, idx);
+            duk_put_prop_index(ctx, -2, slot);
+            duk_pop(ctx);
+            busy_--;
+
+            return slot;
+         }
+
+         // Pushes the value stored in slot.
+         // Stack: ... -> ... [value]
+         void push(duk_context* ctx, duk_uarridx_t slot) const
+         {
+            duk_push_heapptr(ctx, array_);
+            duk_get_prop_index(ctx, -1, slot);
+            duk_remove(ctx, -2);
+         }
+
+         // Gives up the reference in slot (the value may be freed right away).
+         // Does not affect the stack.
+         void release(duk_context* ctx, duk_uarridx_t slot)
+         {
+            busy_++;
+            duk_push_heapptr(ctx, array_);
+            duk_push_undefined(ctx);
+            duk_put_prop_index(ctx, -2, slot);
+            duk_pop(ctx);
+            busy_--;
+
+            // only reusable once it is empty
+            free_slots_.push_back(slot);
+         }
+
+         RefArrayStats stats() const
+         {
+            RefArrayStats stats;
+            stats.free = free_slots_.size();
+            stats.live = (length_ - 1) - stats.free;
+            return stats;
+         }
+
+         // True if at least 3/4 of the array is free, and there's enough of it to be worth compacting.
+         // Compacting moves at most a third as many values as it frees slots, and (when everything
+         // is being released) rarely moves values that are about to be released anyway.
+         bool wants_compaction() const
+         {
+            static const std::size_t MIN_FREE_SLOTS = 1024;
+            return busy_ == 0 && free_slots_.size() >= MIN_FREE_SLOTS && free_slots_.size() * 4 >= length_ * 3;
+         }
+
+         // Moves the values in the last slots into the free slots below them, and truncates the array
+         // so it has no free slots left.
+         // Before the array's storage is shrunk, relocate(moved_to, new_length) is called to update slot
+         // numbers kept elsewhere: the value in slot s (for s >= new_length) is now in moved_to[s - new_length].
+         // Does nothing if a store or release is in progress (when called from a finalizer).
+         // Does not affect the stack.
+         template<typename Relocate>
+         void compact(duk_context* ctx, Relocate relocate)
+         {
+            if (busy_ != 0 || free_slots_.empty())
+               return;
+
+            busy_++;
+
+            const duk_uarridx_t new_length = length_ - static_cast<duk_uarridx_t>(free_slots_.size());
+
+            // free slots below new_length will take the values above it (there are as many of each)
+            std::vector<bool> tail_free(length_ - new_length, false);
+            std::vector<duk_uarridx_t> holes;
+            for (duk_uarridx_t slot : free_slots_) {
+               if (slot >= new_length)
+                  tail_free[slot - new_length] = true;
+               else
+                  holes.push_back(slot);
+            }
+
+            std::vector<duk_uarridx_t> moved_to(length_ - new_length, 0);
+            std::size_t next_hole = 0;
+
+            duk_push_heapptr(ctx, array_);
+            for (duk_uarridx_t slot = new_length; slot < length_; slot++) {
+               if (tail_free[slot - new_length])
+                  continue;
+
+               // array[hole] = array[slot]
+               // (the slot is cut off below, the value stays referenced by the hole meanwhile)
+               const duk_uarridx_t hole = holes[next_hole++];
+               duk_get_prop_index(ctx, -1, slot);
+               duk_put_prop_index(ctx, -2, hole);
+               moved_to[slot - new_length] = hole;
+            }
+
+            duk_set_length(ctx, -1, new_length);
+            free_slots_.clear();
+            length_ = new_length;
+
+            relocate(moved_to, new_length);
+
+            // release the array's unused storage (this allocates, so it can run finalizers,
+            // but everything is consistent again by now)
+            duk_compact(ctx, -1);
+            duk_pop(ctx);  // pop array
+
+            busy_--;
+         }
+
+      private:
+         void* array_;
+         std::vector<duk_uarridx_t> free_slots_;
+         duk_uarridx_t length_;  // the array's length (slot 0 included)
+         int busy_;  // stores, releases and compactions in progress
+      };
+
+      // A RefArray whose values are referred to by pins: handles that stay the same when the array is
+      // compacted (see DukValue). The pin -> slot table is native, so it's cheap to keep and doesn't
+      // add to what mark-and-sweep scans. Pins are reused once unpinned.
+      class PinnedRefs
+      {
+      public:
+         // Stack: ... -> ... [array]
+         void create(duk_context* ctx)
+         {
+            refs_.create(ctx);
+         }
+
+         // Stores (a reference to) the value at idx and returns its pin.
+         // Stack: ... [value] ... -> ... [value] ...
+         duk_uarridx_t pin(duk_context* ctx, duk_idx_t idx)
+         {
+            const duk_uarridx_t slot = refs_.store(ctx, idx);
+
+            duk_uarridx_t pin;
+            if (free_pins_.empty()) {
+               pin = static_cast<duk_uarridx_t>(slots_.size());
+               slots_.push_back(slot);
+            }
+            else {
+               pin = free_pins_.back();
+               free_pins_.pop_back();
+               slots_[pin] = slot;
+            }
+
+            return pin;
+         }
+
+         // Pushes the value for pin.
+         // Stack: ... -> ... [value]
+         void push(duk_context* ctx, duk_uarridx_t pin) const
+         {
+            refs_.push(ctx, slots_[pin]);
+         }
+
+         // Gives up the reference for pin, compacting the array if it has become mostly empty.
+         // Does not affect the stack.
+         void unpin(duk_context* ctx, duk_uarridx_t pin)
+         {
+            const duk_uarridx_t slot = slots_[pin];
+            slots_[pin] = 0;
+            free_pins_.push_back(pin);
+
+            refs_.release(ctx, slot);
+
+            if (refs_.wants_compaction())
+               compact(ctx);
+         }
+
+         void compact(duk_context* ctx)
+         {
+            refs_.compact(ctx, [this](const std::vector<duk_uarridx_t>& moved_to, duk_uarridx_t new_length) {
+               for (duk_uarridx_t& slot : slots_) {
+                  if (slot >= new_length)
+                     slot = moved_to[slot - new_length];
+               }
+            });
+         }
+
+         RefArrayStats stats() const
+         {
+            return refs_.stats();
+         }
+
+      private:
+         RefArray refs_;
+         std::vector<duk_uarridx_t> slots_;  // pin -> slot (0 for free pins)
+         std::vector<duk_uarridx_t> free_pins_;
+      };
+   }
+}
+
+#endif
@@ -1,11 +1,14 @@
-
 #ifndef _DETAIL_REFS_20240506_H
 #define _DETAIL_REFS_20240506_H 1
 
 #include <duktape.h>
 
-#include <cassert>
-#include <unordered_map>
+#include "detail_heap_state.h"
+#include "intrusive_ptr_traits.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
 
 namespace dukglue
 {
@@ -15,23 +18,41 @@ namespace dukglue
       // It also prevents script objects from being GC'd until someone
       // explicitly frees the underlying native object.
 
-      // Implemented by keeping an array of script objects in the heap stash.
-      // An std::unordered_map maps pointer -> array index.
-      // Thanks to std::unordered_map, lookup time is O(1) on average.
-
-      // Using std::unordered_map has some memory overhead (~32 bytes per object),
-      // which could be removed by using a different data structure:
+      // Implemented by keeping an array of script objects in the per-heap state
+      // (a RefArray, see DukglueHeapState). A flat hash map (PtrMap) maps pointer -> script object
+      // (its heap pointer, and its index in the array).
+      // The array is compacted (and the indexes in the map updated) once most of it is free.
+      // Lookup time is O(1) on average, and registering an object doesn't allocate
+      // (other than when the map grows). Each object costs 32-64 bytes in the map.
+
+      // Objects can also be registered with a weak ref (see dukglue_set_weak_refs).
+      // Those aren't put in the array, so the script object is garbage collected
+      // once scripts stop using it. A finalizer then removes it from the map, and the
+      // next push of the native object creates a new script object.
+      // Objects with an intrusive reference count (see intrusive_ptr_traits) are always registered
+      // that way, and their script object holds a reference to them until it is collected.
+
+      // Objects can be invalidated one at a time (find_and_invalidate_native_object), or in bulk
+      // (invalidate_where): by the invalidation scope they were registered in, or by type.
+
+      // The pointer the registry knows the script object at idx by: its native object as pushed, which
+      // is kept apart if it differs from the object's pointer (see ProtoManager::put_object_ptr).
+      // Null if the object has been invalidated.
+      inline void* get_registered_ptr(duk_context* ctx, duk_idx_t idx)
+      {
+         get_hidden_prop(ctx, idx, KEY_OBJ_PTR);
+         void* obj_ptr = duk_get_pointer(ctx, -1);
+         duk_pop(ctx);
 
-      // 1. Use no data structure. Blindly scan through the reference registry,
-      //    checking \xFFobj_ptr on every object until you find yours.
-      //    Performance when returning native objects from functions when a lot
-      //    of native objects are registered will suffer.
+         if (obj_ptr == nullptr)
+            return nullptr;
 
-      // 2. Implement a self-balancing binary tree on top of a Duktape array
-      //    for the registry. Still fast - O(log(N)) - and no memory overhead.
+         get_hidden_prop(ctx, idx, KEY_PUSHED_PTR);
+         void* pushed_ptr = duk_get_pointer(ctx, -1);
+         duk_pop(ctx);
 
-      // 3. A sorted list would work too, though insertion speed might be worse
-      //    than a binary tree.
+         return pushed_ptr != nullptr ? pushed_ptr : obj_ptr;
+      }
 
       struct RefManager
       {
@@ -43,65 +64,85 @@ namespace dukglue
          //        ... -> ... [object]     (if object has not been registered)
          static bool find_and_push_native_object(duk_context* ctx, void* obj_ptr)
          {
-            RefMap* ref_map = get_ref_map(ctx);
+            DukglueHeapState* state = DukglueHeapState::get(ctx);
+            if (state == nullptr)  // heap is being destroyed, nothing is registered anymore
+               return false;
 
-            const auto it = ref_map->find(obj_ptr);
+            const RefEntry* entry = state->ref_map.find(obj_ptr);
 
-            if (it == ref_map->end()) {
+            if (entry == nullptr) {
                return false;
             }
             else {
-               push_ref_array(ctx);
-               duk_get_prop_index(ctx, -1, it->second);
-               duk_remove(ctx, -2);
+               // objects in the ref array are always reachable, and weak refs are removed
+               // by the object's finalizer before it is freed
+               // (pushing an object waiting for its finalizer is allowed, and cancels the finalizer)
+               duk_push_heapptr(ctx, entry->heapptr);
                return true;
             }
          }
 
          // Takes a script object and adds it to the registry, associating
-         // it with obj_ptr. unregistered_object is not modified.
+         // it with obj_ptr. unregistered_object is not modified
+         // (other than getting a finalizer, if it is registered with a weak ref).
+         // If allow_weak is true and the heap uses weak refs, the registry doesn't keep the
+         // object alive. Objects constructed by scripts are always registered normally, since
+         // the native object would be leaked if its script object was collected.
+         // cls is the class of the object's prototype.
          // If obj_ptr has already been registered with another object,
          // the old registry entry will be overidden.
          // Does nothing if obj_ptr is NULL.
          // Stack: ... [object]  ->  ... [object]
-         static void register_native_object(duk_context* ctx, void* obj_ptr)
+         static void register_native_object(duk_context* ctx, void* obj_ptr, class_id_t cls, bool allow_weak = false)
          {
             if (obj_ptr == nullptr) {
                return;
             }
 
-            RefMap* ref_map = get_ref_map(ctx);
+            DukglueHeapState* state = DukglueHeapState::get(ctx);
+            if (state == nullptr)  // heap is being destroyed
+               return;
 
-            push_ref_array(ctx);
+            RefEntry entry = { duk_get_heapptr(ctx, -1), 0, state->current_scope(), cls };
 
-            // find next free index
-            // free indices are kept in a linked list, starting at ref_array[0]
-            duk_get_prop_index(ctx, -1, 0);
-            duk_uarridx_t next_free_idx = duk_get_uint(ctx, -1);  // returns duk_uint_t
-            duk_pop(ctx);
+            if (allow_weak && state->weak_refs) {
+               push_weak_ref_finalizer(ctx, state);
+               duk_set_finalizer(ctx, -2);
 
-            if (next_free_idx == 0) {
-               // no free spots in the array, make a new one at arr.length
-               duk_size_t len = duk_get_length(ctx, -1);
-               assert(len < DUK_UINT_MAX);
-               next_free_idx = static_cast<duk_uint_t>(len);
-            }
-            else {
-               // free spot found, need to remove it from the free list
-               // ref_array[0] = ref_array[next_free_idx]
-               duk_get_prop_index(ctx, -1, next_free_idx);
-               duk_put_prop_index(ctx, -2, 0);
+               state->ref_map.set(obj_ptr, entry);
+               return;
             }
 
-            // std::cout << "putting reference at ref_array[" << next_free_idx << "]" << std::endl;
-            (*ref_map)[obj_ptr] = next_free_idx;
+            entry.ref_idx = state->ref_array.store(ctx, -1);
+            state->ref_map.set(obj_ptr, entry);
+         }
+
+         // Takes a script object for obj, whose class has an intrusive reference count
+         // (see intrusive_ptr_traits), and adds it to the registry with a weak ref (whatever the
+         // heap's weak refs setting). The script object holds a reference to obj, which its
+         // finalizer releases. cls is the class of the object's prototype.
+         // Stack: ... [object]  ->  ... [object]
+         template<typename T>
+         static void register_intrusive_object(duk_context* ctx, T* obj, class_id_t cls)
+         {
+            DukglueHeapState* state = DukglueHeapState::get(ctx);
+            if (state == nullptr)  // heap is being destroyed
+               return;
+
+            // The pointer to release is kept apart from the object pointer, so invalidating the
+            // script object doesn't leak the reference.
+            // The reference is taken last, once nothing that can fail is left.
+            duk_push_pointer(ctx, obj);
+            put_hidden_prop(ctx, -2, KEY_INTRUSIVE_PTR);
 
-            duk_dup(ctx, -2);  // put object on top
+            // a lightfunc, so the finalizer doesn't cost a function object per script object
+            duk_push_c_lightfunc(ctx, intrusive_finalizer<T>, 1, 1, 0);
+            duk_set_finalizer(ctx, -2);
 
-            // ... [object] [ref_array] [object]
-            duk_put_prop_index(ctx, -2, next_free_idx);
+            intrusive_ptr_traits<T>::add_ref(obj);
 
-            duk_pop(ctx);  // pop ref_array
+            RefEntry entry = { duk_get_heapptr(ctx, -1), 0, state->current_scope(), cls };
+            state->ref_map.set(obj, entry);
          }
 
          // Remove the object associated with obj_ptr from the registry
@@ -113,94 +154,226 @@ namespace dukglue
             if (obj_ptr == nullptr)
                return;
 
-            RefMap* ref_map = get_ref_map(ctx);
-            auto it = ref_map->find(obj_ptr);
-            if (it == ref_map->end())  // was never registered
+            DukglueHeapState* state = DukglueHeapState::get(ctx);
+            if (state == nullptr)  // heap is being destroyed
                return;
 
-            push_ref_array(ctx);
-            duk_get_prop_index(ctx, -1, it->second);
+            const RefEntry* found = state->ref_map.find(obj_ptr);
+            if (found == nullptr)  // was never registered
+               return;
 
-            // invalidate internal pointer
-            duk_push_undefined(ctx);
-            duk_put_prop_string(ctx, -2, "\xFF" "obj_ptr");
-            duk_pop(ctx);  // pop object
+            const RefEntry entry = *found;
 
-            // remove from references array and add the space it was in to free list
-            // (refs[0] -> tail) -> (refs[0] -> old_obj_idx -> tail)
+            duk_push_heapptr(ctx, entry.heapptr);
+            invalidate_entry(ctx, state, obj_ptr, entry);
+            duk_pop(ctx);  // pop object
 
-            // refs[old_obj_idx] = refs[0]
-            duk_get_prop_index(ctx, -1, 0);
-            duk_put_prop_index(ctx, -2, it->second);
+            compact_if_sparse(ctx, state);
+         }
 
-            // refs[0] = old_obj_idx
-            duk_push_uint(ctx, it->second);
-            duk_put_prop_index(ctx, -2, 0);
+         // Invalidates every registered object whose entry passes select(const RefEntry&),
+         // and (with the object pushed) accept(duk_context*). select must not touch the Duktape heap.
+         // Done in one pass over the registry.
+         // Returns the number of objects invalidated.
+         // Does not affect the stack.
+         template<typename Select, typename Accept>
+         static std::size_t invalidate_where(duk_context* ctx, Select select, Accept accept)
+         {
+            DukglueHeapState* state = DukglueHeapState::get(ctx);
+            if (state == nullptr)  // heap is being destroyed
+               return 0;
+
+            // Finalizers that run while we invalidate (when an object is dropped from the ref array)
+            // can change the map, so take a copy of the entries first and check each one is still
+            // current before touching it.
+            typedef std::pair<void*, RefEntry> Selected;
+            std::vector<Selected> selected;
+            state->ref_map.for_each([&](void* obj_ptr, const RefEntry& entry) {
+               if (select(entry))
+                  selected.push_back(std::make_pair(obj_ptr, entry));
+            });
+
+            if (selected.empty())
+               return 0;
+
+            // go through the objects in the order they were registered (mostly the order they were
+            // allocated in), rather than in the map's order, which is random
+            const RefArrayStats stats = state->ref_array.stats();
+            sort_by_ref_idx(selected, stats.live + stats.free + 1);
+
+            // objects are kept on the stack and dropped a chunk at a time, which is a bit faster than one at a time
+            static const std::size_t CHUNK_SIZE = 256;
+            const duk_idx_t top = duk_get_top(ctx);
+            std::size_t count = 0;
+
+            for (std::size_t i = 0; i < selected.size(); i++) {
+               if (i % CHUNK_SIZE == 0) {
+                  duk_set_top(ctx, top);
+                  duk_require_stack(ctx, CHUNK_SIZE + 8);
+               }
+
+               const Selected& item = selected[i];
+               const RefEntry* current = state->ref_map.find(item.first);
+               if (current == nullptr || current->heapptr != item.second.heapptr)
+                  continue;
+
+               const RefEntry entry = *current;
+               duk_push_heapptr(ctx, entry.heapptr);
+               if (accept(ctx)) {
+                  invalidate_entry(ctx, state, item.first, entry);
+                  count++;
+               }
+               else {
+                  duk_pop(ctx);
+               }
+            }
 
-            duk_pop(ctx);  // pop ref_array
+            duk_set_top(ctx, top);
 
-            // also remove from map
-            // std::cout << "Freeing ref_array[" << it->second << "]" << std::endl;
-            ref_map->erase(it);
+            compact_if_sparse(ctx, state);
+            return count;
          }
 
-      private:
-         typedef std::unordered_map<void*, duk_uarridx_t> RefMap;
+         // Compacts the ref array (see RefArray::compact), and updates the indexes in the map.
+         // Does not affect the stack.
+         static void compact(duk_context* ctx)
+         {
+            DukglueHeapState* state = DukglueHeapState::get(ctx);
+            if (state == nullptr)  // heap is being destroyed
+               return;
+
+            state->ref_array.compact(ctx, [state](const std::vector<duk_uarridx_t>& moved_to, duk_uarridx_t new_length) {
+               state->ref_map.for_each([&](void*, RefEntry& entry) {
+                  if (entry.ref_idx >= new_length)
+                     entry.ref_idx = moved_to[entry.ref_idx - new_length];
+               });
+            });
+         }
 
-         static RefMap* get_ref_map(duk_context* ctx)
+         // Pushes the finalizer for weakly registered script objects.
+         // Stack: ... -> ... [weak_ref_finalizer]
+         static void push_weak_ref_finalizer(duk_context* ctx, DukglueHeapState* state)
          {
-            static const char* DUKGLUE_REF_MAP = "dukglue_ref_map";
-            static const char* PTR = "ptr";
+            if (state->weak_ref_finalizer == nullptr) {
+               // one function shared by all weak refs, kept alive by the ref array
+               state->ref_array.push_array(ctx);
+               duk_push_c_function(ctx, weak_ref_finalizer, 1);
+               state->weak_ref_finalizer = duk_get_heapptr(ctx, -1);
+               duk_put_prop_string(ctx, -2, "\xFF" "weak_ref_finalizer");
+               duk_pop(ctx);  // pop ref_array
+            }
 
-            duk_push_heap_stash(ctx);
+            duk_push_heapptr(ctx, state->weak_ref_finalizer);
+         }
 
-            if (!duk_has_prop_string(ctx, -1, DUKGLUE_REF_MAP)) {
-               // doesn't exist yet, need to create it
-               duk_push_object(ctx);
+      private:
+         // Sorts entries by ref_idx (weak refs, with no index, go first).
+         // ref_array_length is an upper bound for the indexes.
+         static void sort_by_ref_idx(std::vector<std::pair<void*, RefEntry> >& entries, std::size_t ref_array_length)
+         {
+            typedef std::pair<void*, RefEntry> Entry;
 
-               duk_push_pointer(ctx, new RefMap());
-               duk_put_prop_string(ctx, -2, PTR);
+            if (ref_array_length > entries.size() * 4) {
+               // a few objects out of many, not worth a pass over every slot
+               std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+                  return a.second.ref_idx < b.second.ref_idx;
+               });
+               return;
+            }
 
-               duk_push_c_function(ctx, ref_map_finalizer, 1);
-               duk_set_finalizer(ctx, -2);
+            // each strong ref has its own slot, so the entries can be put straight in place
+            std::vector<Entry> by_slot(ref_array_length, Entry(nullptr, RefEntry()));
+            std::size_t weak = 0;
+            for (const Entry& entry : entries) {
+               if (entry.second.ref_idx == 0)
+                  entries[weak++] = entry;
+               else
+                  by_slot[entry.second.ref_idx] = entry;
+            }
 
-               duk_put_prop_string(ctx, -2, DUKGLUE_REF_MAP);
+            std::size_t out = weak;
+            for (const Entry& entry : by_slot) {
+               if (entry.first != nullptr)
+                  entries[out++] = entry;
             }
+         }
 
-            duk_get_prop_string(ctx, -1, DUKGLUE_REF_MAP);
-            duk_get_prop_string(ctx, -1, PTR);
-            RefMap* map = static_cast<RefMap*>(duk_require_pointer(ctx, -1));
-            duk_pop_3(ctx);
+         // Invalidates the object's internal native pointer (by setting it to undefined),
+         // and removes it from the map and ref array.
+         // The object stays on the stack, so it can't be freed (and run finalizers) before we're done.
+         // Stack: ... [object]  ->  ... [object]
+         static void invalidate_entry(duk_context* ctx, DukglueHeapState* state, void* obj_ptr, const RefEntry& entry)
+         {
+            state->ref_map.erase(obj_ptr);
+
+            if (entry.ref_idx != 0)
+               state->ref_array.release(ctx, entry.ref_idx);
+
+            duk_push_undefined(ctx);
+            put_hidden_prop(ctx, -2, KEY_OBJ_PTR);
+         }
 
-            return map;
+         static void compact_if_sparse(duk_context* ctx, DukglueHeapState* state)
+         {
+            if (state->ref_array.wants_compaction())
+               compact(ctx);
          }
 
-         static duk_ret_t ref_map_finalizer(duk_context* ctx)
+         // Runs when a weakly registered script object is about to be freed.
+         static duk_ret_t weak_ref_finalizer(duk_context* ctx)
          {
-            duk_get_prop_string(ctx, 0, "ptr");
-            RefMap* map = static_cast<RefMap*>(duk_require_pointer(ctx, -1));
-            delete map;
+            DukglueHeapState* state = DukglueHeapState::get(ctx);
+            if (state == nullptr)  // heap is being destroyed
+               return 0;
+
+            get_hidden_prop(ctx, 0, KEY_OBJ_PTR);
+            void* obj_ptr = duk_get_pointer(ctx, -1);
+            duk_pop(ctx);
 
+            get_hidden_prop(ctx, 0, KEY_PUSHED_PTR);
+            void* pushed_ptr = duk_get_pointer(ctx, -1);
+            duk_pop(ctx);
+
+            if (obj_ptr == nullptr)  // invalidated
+               return 0;
+
+            erase_weak_ref(state, pushed_ptr != nullptr ? pushed_ptr : obj_ptr, duk_get_heapptr(ctx, 0));
             return 0;
          }
 
-         static void push_ref_array(duk_context* ctx)
+         // Runs when the script object of an intrusively refcounted object is about to be freed
+         // (or when the heap is destroyed).
+         template<typename T>
+         static duk_ret_t intrusive_finalizer(duk_context* ctx)
          {
-            static const char* DUKGLUE_REF_ARRAY = "dukglue_ref_array";
-            duk_push_heap_stash(ctx);
+            get_hidden_prop(ctx, 0, KEY_INTRUSIVE_PTR);
+            T* obj = static_cast<T*>(duk_get_pointer(ctx, -1));
+            duk_pop(ctx);
 
-            if (!duk_has_prop_string(ctx, -1, DUKGLUE_REF_ARRAY)) {
-               duk_push_array(ctx);
+            if (obj == nullptr)  // already released (finalizers can run multiple times)
+               return 0;
 
-               // ref_array[0] = 0 (initialize free list as empty)
-               duk_push_int(ctx, 0);
-               duk_put_prop_index(ctx, -2, 0);
+            duk_push_undefined(ctx);
+            put_hidden_prop(ctx, 0, KEY_INTRUSIVE_PTR);
+            duk_push_undefined(ctx);
+            put_hidden_prop(ctx, 0, KEY_OBJ_PTR);
 
-               duk_put_prop_string(ctx, -2, DUKGLUE_REF_ARRAY);
-            }
+            DukglueHeapState* state = DukglueHeapState::get(ctx);
+            if (state != nullptr)
+               erase_weak_ref(state, obj, duk_get_heapptr(ctx, 0));
 
-            duk_get_prop_string(ctx, -1, DUKGLUE_REF_ARRAY);
-            duk_remove(ctx, -2); // pop heap stash
+            // may delete obj, running any destructor, so the registry must be consistent by now
+            intrusive_ptr_traits<T>::release(obj);
+            return 0;
+         }
+
+         // Removes obj_ptr from the map if it's registered with a weak ref to the script object
+         // at heapptr (the native object may have been registered again with another script object since).
+         static void erase_weak_ref(DukglueHeapState* state, void* obj_ptr, void* heapptr)
+         {
+            const RefEntry* entry = state->ref_map.find(obj_ptr);
+            if (entry != nullptr && entry->ref_idx == 0 && entry->heapptr == heapptr)
+               state->ref_map.erase(obj_ptr);
          }
       };
    }
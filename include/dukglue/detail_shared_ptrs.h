@@ -0,0 +1,119 @@
+#ifndef _DETAIL_SHARED_PTRS_20240506_H
+#define _DETAIL_SHARED_PTRS_20240506_H 1
+
+#include <duktape.h>
+
+#include "detail_ptr_map.h"
+
+#include <memory>
+#include <vector>
+
+namespace dukglue
+{
+   namespace detail
+   {
+      // Script objects (wrappers) for native objects pushed as std::shared_ptr.
+      //
+      // A wrapper owns a reference to its object until the wrapper is garbage collected.
+      // While it is alive, pushing the same object again (by raw pointer) gives the same wrapper,
+      // so identity (a === b) and dynamic properties hold. The registry doesn't keep wrappers alive.
+      //
+      // The owning shared_ptrs are kept in a native slab (indexed by the slot number stored in the
+      // wrapper), so creating a wrapper doesn't need its own allocation, and pushing an existing
+      // one doesn't touch the control block at all.
+      class SharedPtrRefs
+      {
+      public:
+         struct Entry
+         {
+            void* heapptr;  // the wrapper
+            duk_uarridx_t slot;
+         };
+
+         SharedPtrRefs() : finalizer(nullptr) {}
+
+         // Returns the live wrapper for obj_ptr, or nullptr if there is none.
+         void* find(void* obj_ptr)
+         {
+            const Entry* entry = wrappers_.find(obj_ptr);
+            return entry == nullptr ? nullptr : entry->heapptr;
+         }
+
+         // Registers heapptr as the wrapper for owner.get(), and returns the slot holding owner.
+         duk_uarridx_t add(void* heapptr, std::shared_ptr<void> owner)
+         {
+            duk_uarridx_t slot;
+            if (free_slots_.empty()) {
+               slot = static_cast<duk_uarridx_t>(slots_.size());
+               slots_.push_back(Slot());
+            }
+            else {
+               slot = free_slots_.back();
+               free_slots_.pop_back();
+            }
+
+            void* obj_ptr = owner.get();
+            slots_[slot].heapptr = heapptr;
+            slots_[slot].owner = std::move(owner);
+
+            Entry entry = { heapptr, slot };
+            wrappers_.set(obj_ptr, entry);
+            return slot;
+         }
+
+         // The owning pointer in slot, if slot belongs to the wrapper at heapptr (or an empty pointer).
+         const std::shared_ptr<void>& get(duk_uarridx_t slot, void* heapptr) const
+         {
+            static const std::shared_ptr<void> empty;
+            if (slot >= slots_.size() || slots_[slot].heapptr != heapptr)
+               return empty;
+
+            return slots_[slot].owner;
+         }
+
+         // Unregisters the wrapper at heapptr (which is being finalized) and returns its owning pointer,
+         // so the caller can release it once the registry is consistent again (releasing it can run any
+         // destructor, which may push objects).
+         std::shared_ptr<void> remove(duk_uarridx_t slot, void* heapptr)
+         {
+            if (slot >= slots_.size() || slots_[slot].heapptr != heapptr)
+               return std::shared_ptr<void>();
+
+            std::shared_ptr<void> owner = std::move(slots_[slot].owner);
+            slots_[slot].heapptr = nullptr;
+            slots_[slot].owner.reset();
+            free_slots_.push_back(slot);
+
+            const Entry* entry = wrappers_.find(owner.get());
+            if (entry != nullptr && entry->heapptr == heapptr)
+               wrappers_.erase(owner.get());
+
+            return owner;
+         }
+
+         // Number of live wrappers.
+         std::size_t size() const
+         {
+            return slots_.size() - free_slots_.size();
+         }
+
+         // Finalizer shared by all wrappers (created on first use, see DukType<std::shared_ptr<T>>).
+         void* finalizer;
+
+      private:
+         struct Slot
+         {
+            Slot() : heapptr(nullptr) {}
+
+            void* heapptr;
+            std::shared_ptr<void> owner;
+         };
+
+         PtrMap<Entry> wrappers_;  // raw pointer -> wrapper
+         std::vector<Slot> slots_;
+         std::vector<duk_uarridx_t> free_slots_;
+      };
+   }
+}
+
+#endif
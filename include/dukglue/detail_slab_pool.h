@@ -0,0 +1,254 @@
+#ifndef _DETAIL_SLAB_POOL_20240506_H
+#define _DETAIL_SLAB_POOL_20240506_H 1
+
+#include <cstddef>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace dukglue
+{
+   namespace detail
+   {
+      // A size-class allocator for small objects (see dukglue::slab_allocator).
+      //
+      // Sizes are rounded up to a multiple of GRANULE, and each size class has its own free list
+      // of blocks. Free lists are per thread, so allocating and freeing are a few pointer moves with
+      // no locking. A block may be freed on another thread than the one that allocated it (it then goes
+      // to that thread's free list).
+      //
+      // Behind the threads' lists is a global one per size class, under a lock. A thread's list holds
+      // at most a chunk's worth of blocks: past that, half of them are moved to the global list (so a
+      // thread that only frees blocks other threads allocated doesn't hoard them), and a thread whose
+      // list is empty takes up to half that many from the global list, or a new chunk if that's empty.
+      // A thread's lists are given to the global ones when it exits (blocks freed by a thread after
+      // that go straight to the global lists).
+      //
+      // Chunks are owned by the pool, and kept for reuse for the life of the process (blocks can be
+      // freed at any time, even during static destruction, so they are never returned to the system).
+      // Sizes over MAX_SIZE go to operator new.
+      class SlabPool
+      {
+      public:
+         static const std::size_t GRANULE = 16;
+         static const std::size_t MAX_SIZE = 256;
+         static const std::size_t CHUNK_SIZE = 16 * 1024;
+
+         static void* allocate(std::size_t size)
+         {
+            if (size > MAX_SIZE)
+               return ::operator new(size);
+
+            FreeLists& lists = thread_free_lists();
+            if (!lists.attached)
+               attach(lists);
+
+            if (lists.exited)
+               return allocate_global(size_class(size));
+
+            const std::size_t cls = size_class(size);
+            if (lists.heads[cls] == nullptr)
+               refill(lists, cls);
+
+            FreeBlock* block = lists.heads[cls];
+            lists.heads[cls] = block->next;
+            lists.counts[cls]--;
+            return block;
+         }
+
+         // size must be the size the block was allocated with.
+         static void deallocate(void* ptr, std::size_t size)
+         {
+            if (size > MAX_SIZE) {
+               ::operator delete(ptr);
+               return;
+            }
+
+            FreeLists& lists = thread_free_lists();
+            if (!lists.attached)
+               attach(lists);
+
+            FreeBlock* block = static_cast<FreeBlock*>(ptr);
+            if (lists.exited) {
+               deallocate_global(block, size_class(size));
+               return;
+            }
+
+            const std::size_t cls = size_class(size);
+            block->next = lists.heads[cls];
+            lists.heads[cls] = block;
+            if (++lists.counts[cls] > max_cached(cls))
+               spill(lists, cls);
+         }
+
+         // Bytes in chunks the pool has allocated (on all threads).
+         static std::size_t chunk_bytes()
+         {
+            Global& global = global_state();
+            std::lock_guard<std::mutex> lock(global.mutex);
+            return global.chunks.size() * CHUNK_SIZE;
+         }
+
+      private:
+         static const std::size_t NUM_SIZE_CLASSES = MAX_SIZE / GRANULE;
+
+         struct FreeBlock
+         {
+            FreeBlock* next;
+         };
+
+         // trivially destructible, so it can be used at any time during thread exit
+         struct FreeLists
+         {
+            FreeBlock* heads[NUM_SIZE_CLASSES];
+            std::size_t counts[NUM_SIZE_CLASSES];  // blocks in each list
+            bool attached;  // ThreadExit is set up
+            bool exited;  // the lists have been given to the global ones
+         };
+
+         // Gives the thread's lists to the global ones when the thread exits.
+         struct ThreadExit
+         {
+            ~ThreadExit()
+            {
+               FreeLists& lists = thread_free_lists();
+               Global& global = global_state();
+               std::lock_guard<std::mutex> lock(global.mutex);
+               for (std::size_t cls = 0; cls < NUM_SIZE_CLASSES; cls++) {
+                  while (lists.heads[cls] != nullptr) {
+                     FreeBlock* block = lists.heads[cls];
+                     lists.heads[cls] = block->next;
+                     block->next = global.heads[cls];
+                     global.heads[cls] = block;
+                  }
+                  lists.counts[cls] = 0;
+               }
+               lists.exited = true;
+            }
+         };
+
+         struct Global
+         {
+            std::mutex mutex;
+            FreeBlock* heads[NUM_SIZE_CLASSES];
+            std::vector<char*> chunks;
+         };
+
+         static FreeLists& thread_free_lists()
+         {
+            static thread_local FreeLists lists = {};
+            return lists;
+         }
+
+         static void attach(FreeLists& lists)
+         {
+            static thread_local ThreadExit exit_hook;
+            (void) exit_hook;
+            lists.attached = true;
+         }
+
+         // never destroyed, since blocks can be freed during static destruction
+         static Global& global_state()
+         {
+            static Global* global = new Global();
+            return *global;
+         }
+
+         static std::size_t size_class(std::size_t size)
+         {
+            return size == 0 ? 0 : (size - 1) / GRANULE;
+         }
+
+         // Most blocks of size class cls a thread's list keeps (a chunk's worth).
+         static std::size_t max_cached(std::size_t cls)
+         {
+            return CHUNK_SIZE / ((cls + 1) * GRANULE);
+         }
+
+         // Fills the thread's empty list for size class cls with up to half of max_cached(cls) blocks:
+         // from the global list, or a new chunk.
+         static void refill(FreeLists& lists, std::size_t cls)
+         {
+            Global& global = global_state();
+            std::lock_guard<std::mutex> lock(global.mutex);
+            if (global.heads[cls] == nullptr)
+               add_chunk(global, cls);
+
+            FreeBlock* first = global.heads[cls];
+            FreeBlock* last = first;
+            std::size_t count = 1;
+            for (const std::size_t wanted = max_cached(cls) / 2; count < wanted && last->next != nullptr; count++)
+               last = last->next;
+
+            global.heads[cls] = last->next;
+            last->next = nullptr;
+            lists.heads[cls] = first;
+            lists.counts[cls] = count;
+         }
+
+         // Moves half of the thread's list for size class cls to the global list.
+         static void spill(FreeLists& lists, std::size_t cls)
+         {
+            const std::size_t moved = lists.counts[cls] / 2;
+            FreeBlock* first = lists.heads[cls];
+            FreeBlock* last = first;
+            for (std::size_t i = 1; i < moved; i++)
+               last = last->next;
+
+            lists.heads[cls] = last->next;
+            lists.counts[cls] -= moved;
+
+            Global& global = global_state();
+            std::lock_guard<std::mutex> lock(global.mutex);
+            last->next = global.heads[cls];
+            global.heads[cls] = first;
+         }
+
+         static void* allocate_global(std::size_t cls)
+         {
+            Global& global = global_state();
+            std::lock_guard<std::mutex> lock(global.mutex);
+            if (global.heads[cls] == nullptr)
+               add_chunk(global, cls);
+
+            FreeBlock* block = global.heads[cls];
+            global.heads[cls] = block->next;
+            return block;
+         }
+
+         static void deallocate_global(FreeBlock* block, std::size_t cls)
+         {
+            Global& global = global_state();
+            std::lock_guard<std::mutex> lock(global.mutex);
+            block->next = global.heads[cls];
+            global.heads[cls] = block;
+         }
+
+         // Splits a new chunk into blocks for size class cls, on the global list (which must be locked).
+         static void add_chunk(Global& global, std::size_t cls)
+         {
+            global.chunks.push_back(nullptr);  // first, so a failure here can't leak the chunk
+
+            // malloc's alignment is good for any block (blocks are multiples of GRANULE)
+            char* chunk = static_cast<char*>(std::malloc(CHUNK_SIZE));
+            if (chunk == nullptr) {
+               global.chunks.pop_back();
+               throw std::bad_alloc();
+            }
+            global.chunks.back() = chunk;
+
+            const std::size_t block_size = (cls + 1) * GRANULE;
+            FreeBlock*& head = global.heads[cls];
+            for (std::size_t offset = CHUNK_SIZE / block_size * block_size; offset != 0; ) {
+               offset -= block_size;
+               FreeBlock* block = reinterpret_cast<FreeBlock*>(chunk + offset);
+               block->next = head;
+               head = block;
+            }
+         }
+      };
+   }
+}
+
+#endif
@@ -17,18 +17,39 @@ namespace dukglue
          typedef std::tuple<typename dukglue::types::ArgStorage<Args>::type...> type;
       };
 
+      // Arguments that take a native object from its script object (see ScriptOwnedPtr) only do so
+      // here, once every argument has been read. An object can't be taken by two arguments.
+      template<typename... Stored, size_t... Indexes>
+      void take_ownership(duk_context* ctx, std::tuple<Stored...>& values, dukglue::detail::index_tuple<Indexes...>)
+      {
+         using namespace dukglue::types;
+         const void* owned[] = { nullptr, ArgOwnership<Stored>::owned_object(std::get<Indexes>(values))... };
+         for (size_t i = 1; i < sizeof(owned) / sizeof(owned[0]); i++) {
+            for (size_t j = 1; j < i && owned[i] != nullptr; j++) {
+               if (owned[j] == owned[i])
+                  duk_error(ctx, DUK_RET_TYPE_ERROR, "Argument %d: native object is already taken by argument %d", static_cast<int>(i - 1), static_cast<int>(j - 1));
+            }
+         }
+
+         const int taken[] = { 0, (ArgOwnership<Stored>::take(ctx, std::get<Indexes>(values)), 0)... };
+         (void) taken;
+      }
+
       // Helper to get argument indices.
       // Call read for every Ts[i], for matching argument index Index[i].
       // The traits::index_tuple is used for type inference.
       // A concrete example:
       //   get_values<int, bool>(duktape_context)
       //     get_values_helper<{int, bool}, {0, 1}>(ctx, ignored)
-      //       std::make_tuple<int, bool>(read<int>(ctx, 0), read<bool>(ctx, 1))
+      //       std::tuple<int, bool>(read<int>(ctx, 0), read<bool>(ctx, 1))
+      // The values read are moved straight into the tuple.
       template<typename... Args, size_t... Indexes>
-      typename ArgsTuple<Args...>::type get_stack_values_helper(duk_context* ctx, dukglue::detail::index_tuple<Indexes...>)
+      typename ArgsTuple<Args...>::type get_stack_values_helper(duk_context* ctx, dukglue::detail::index_tuple<Indexes...> indexes)
       {
          using namespace dukglue::types;
-         return std::forward_as_tuple(DukType<typename Bare<Args>::type>::template read<typename ArgStorage<Args>::type>(ctx, Indexes)...);
+         typename ArgsTuple<Args...>::type values(DukType<typename Bare<Args>::type>::template read<typename ArgStorage<Args>::type>(ctx, Indexes)...);
+         take_ownership(ctx, values, indexes);
+         return values;
       }
 
       // Returns an std::tuple of the values asked for in the template parameters.
@@ -47,7 +68,113 @@ namespace dukglue
          auto indices = typename dukglue::detail::make_indexes<Args...>::type();
          return get_stack_values_helper<Args...>(ctx, indices);
       }
+
+      // Reads a value with DukType<T>::read_trusted if T has one (skipping type checks),
+      // or with DukType<T>::read otherwise.
+      template<typename Arg>
+      auto read_trusted_value(duk_context* ctx, duk_idx_t arg_idx, int)
+         -> decltype(dukglue::types::DukType<typename dukglue::types::Bare<Arg>::type>::template read_trusted<typename dukglue::types::ArgStorage<Arg>::type>(ctx, arg_idx))
+      {
+         using namespace dukglue::types;
+         return DukType<typename Bare<Arg>::type>::template read_trusted<typename ArgStorage<Arg>::type>(ctx, arg_idx);
+      }
+
+      template<typename Arg>
+      typename dukglue::types::ArgStorage<Arg>::type read_trusted_value(duk_context* ctx, duk_idx_t arg_idx, long)
+      {
+         using namespace dukglue::types;
+         return DukType<typename Bare<Arg>::type>::template read<typename ArgStorage<Arg>::type>(ctx, arg_idx);
+      }
+
+      template<typename... Args, size_t... Indexes>
+      typename ArgsTuple<Args...>::type get_stack_values_trusted_helper(duk_context* ctx, dukglue::detail::index_tuple<Indexes...> indexes)
+      {
+         typename ArgsTuple<Args...>::type values(read_trusted_value<Args>(ctx, Indexes, 0)...);
+         take_ownership(ctx, values, indexes);
+         return values;
+      }
+
+      // Same as get_stack_values(ctx), but for trusted bindings: arguments are not type checked
+      // (unless DUKGLUE_CHECK_TRUSTED is set). Passing a value of the wrong type, or a native
+      // object of the wrong class, is undefined behavior.
+      template<typename... Args>
+      typename ArgsTuple<Args...>::type get_stack_values_trusted(duk_context* ctx)
+      {
+#if DUKGLUE_CHECK_TRUSTED
+         return get_stack_values<Args...>(ctx);
+#else
+         auto indices = typename dukglue::detail::make_indexes<Args...>::type();
+         return get_stack_values_trusted_helper<Args...>(ctx, indices);
+#endif
+      }
+
+      // Default values for the last sizeof...(Ds) arguments of a bound function (see dukglue_defaults).
+      template<typename... Ds>
+      struct Defaults
+      {
+         std::tuple<Ds...> values;
+      };
+
+      // Reads argument Index, or uses its default value if the argument is undefined
+      // (omitted by the script). Only arguments from FirstDefault on have a default.
+      template<typename Arg, size_t Index, size_t FirstDefault, bool HasDefault = (Index >= FirstDefault)>
+      struct StackValue
+      {
+         template<typename DefaultsTuple>
+         static typename dukglue::types::ArgStorage<Arg>::type read(duk_context* ctx, const DefaultsTuple&)
+         {
+            using namespace dukglue::types;
+            return DukType<typename Bare<Arg>::type>::template read<typename ArgStorage<Arg>::type>(ctx, Index);
+         }
+      };
+
+      template<typename Arg, size_t Index, size_t FirstDefault>
+      struct StackValue<Arg, Index, FirstDefault, true>
+      {
+         template<typename DefaultsTuple>
+         static typename dukglue::types::ArgStorage<Arg>::type read(duk_context* ctx, const DefaultsTuple& defaults)
+         {
+            using namespace dukglue::types;
+            if (duk_is_undefined(ctx, Index))
+               return typename ArgStorage<Arg>::type(std::get<Index - FirstDefault>(defaults));
+
+            return DukType<typename Bare<Arg>::type>::template read<typename ArgStorage<Arg>::type>(ctx, Index);
+         }
+      };
+
+      template<typename... Args, typename... Ds, size_t... Indexes>
+      typename ArgsTuple<Args...>::type get_stack_values_helper(duk_context* ctx, const std::tuple<Ds...>& defaults, dukglue::detail::index_tuple<Indexes...> indexes)
+      {
+         typename ArgsTuple<Args...>::type values(
+            StackValue<Args, Indexes, sizeof...(Args) - sizeof...(Ds)>::read(ctx, defaults)...);
+         take_ownership(ctx, values, indexes);
+         return values;
+      }
+
+      // Same as get_stack_values(ctx), but the last sizeof...(Ds) arguments are
+      // replaced by their default value when they are undefined.
+      template<typename... Args, typename... Ds>
+      typename ArgsTuple<Args...>::type get_stack_values(duk_context* ctx, const std::tuple<Ds...>& defaults)
+      {
+         static_assert(sizeof...(Ds) <= sizeof...(Args), "More default values than arguments");
+
+         auto indices = typename dukglue::detail::make_indexes<Args...>::type();
+         return get_stack_values_helper<Args...>(ctx, defaults, indices);
+      }
    }
 }
 
+// Default values for the trailing arguments of a function, method or callable, used
+// when the script omits them (or passes undefined):
+//   int greet(std::string name, int times);
+//   dukglue_register_function(ctx, &greet, "greet", dukglue_defaults(1));
+//   greet("Bob");  // greet("Bob", 1)
+// The values are copied when the function is registered.
+template<typename... Ds>
+dukglue::detail::Defaults<typename std::decay<Ds>::type...> dukglue_defaults(Ds&&... values)
+{
+   dukglue::detail::Defaults<typename std::decay<Ds>::type...> defaults = { std::tuple<typename std::decay<Ds>::type...>(std::forward<Ds>(values)...) };
+   return defaults;
+}
+
 #endif
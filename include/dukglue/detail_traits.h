@@ -3,6 +3,23 @@
 #define _DETAIL_TRAITS_20240506_H 1
 
 #include <functional>
+#include <new>
+
+// C++17 features (template<auto> registration, ...) are only available when compiling as C++17 or later.
+// MSVC reports __cplusplus as 199711L unless /Zc:__cplusplus is used, so check _MSVC_LANG too.
+#if !defined(DUKGLUE_HAS_CPP17)
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#define DUKGLUE_HAS_CPP17 1
+#endif
+#endif
+
+// Without RTTI (-fno-rtti), the run-time class of a polymorphic object is only known if its class
+// reports it (see TypeInfo). Defined automatically when the compiler says RTTI is off.
+#if !defined(DUKGLUE_NO_RTTI)
+#if !defined(__GXX_RTTI) && !defined(_CPPRTTI)
+#define DUKGLUE_NO_RTTI 1
+#endif
+#endif
 
 namespace dukglue
 {
@@ -51,6 +68,8 @@ namespace dukglue
         
         // This mess is used to use function arguments stored in an std::tuple to an
         // std::function, function pointer, or method.
+        // The tuple is taken by rvalue reference and its elements are forwarded to the callee,
+        // so arguments taken by value (std::string, std::vector, ...) are moved, not copied.
         
         // std::function
         template<class Ret, class... Args, size_t... Indexes >
@@ -60,9 +79,9 @@ namespace dukglue
         }
         
         template<class Ret, class ... Args>
-        Ret apply(std::function<Ret(Args...)> pf, const std::tuple<Args...>&  tup)
+        Ret apply(std::function<Ret(Args...)> pf, std::tuple<Args...>&& tup)
         {
-            return apply_helper(pf, typename make_indexes<Args...>::type(), std::tuple<Args...>(tup));
+            return apply_helper(pf, typename make_indexes<Args...>::type(), std::move(tup));
         }
         
         // function pointer
@@ -73,9 +92,9 @@ namespace dukglue
         }
         
         template<class Ret, class ... Args, class ... BakedArgs>
-        Ret apply_fp(Ret(*pf)(Args...), const std::tuple<BakedArgs...>&  tup)
+        Ret apply_fp(Ret(*pf)(Args...), std::tuple<BakedArgs...>&& tup)
         {
-            return apply_fp_helper(pf, typename make_indexes<BakedArgs...>::type(), std::tuple<BakedArgs...>(tup));
+            return apply_fp_helper(pf, typename make_indexes<BakedArgs...>::type(), std::move(tup));
         }
         
         // method pointer
@@ -86,9 +105,9 @@ namespace dukglue
         }
         
         template<class Cls, class Ret, class ... Args, class... BakedArgs>
-        Ret apply_method(Ret(Cls::*pf)(Args...), Cls* obj, const std::tuple<BakedArgs...>& tup)
+        Ret apply_method(Ret(Cls::*pf)(Args...), Cls* obj, std::tuple<BakedArgs...>&& tup)
         {
-            return apply_method_helper(pf, typename make_indexes<Args...>::type(), obj, std::tuple<BakedArgs...>(tup));
+            return apply_method_helper(pf, typename make_indexes<Args...>::type(), obj, std::move(tup));
         }
         
         // const method pointer
@@ -99,9 +118,22 @@ namespace dukglue
         }
         
         template<class Cls, class Ret, class ... Args, class... BakedArgs>
-        Ret apply_method(Ret(Cls::*pf)(Args...) const, Cls* obj, const std::tuple<BakedArgs...>& tup)
+        Ret apply_method(Ret(Cls::*pf)(Args...) const, Cls* obj, std::tuple<BakedArgs...>&& tup)
+        {
+            return apply_method_helper(pf, typename make_indexes<Args...>::type(), obj, std::move(tup));
+        }
+        
+        // callable object (lambda, functor, std::function...)
+        template<class Ret, class... Args, class Callable, class... BakedArgs, size_t... Indexes >
+        Ret apply_callable_helper(Callable& callable, index_tuple< Indexes... >, std::tuple<BakedArgs...>&& tup)
+        {
+            return callable(std::forward<Args>(std::get<Indexes>(tup))...);
+        }
+        
+        template<class Ret, class... Args, class Callable, class... BakedArgs>
+        Ret apply_callable(Callable& callable, std::tuple<BakedArgs...>&& tup)
         {
-            return apply_method_helper(pf, typename make_indexes<Args...>::type(), obj, std::tuple<BakedArgs...>(tup));
+            return apply_callable_helper<Ret, Args...>(callable, typename make_indexes<BakedArgs...>::type(), std::move(tup));
         }
         
         // constructor
@@ -112,9 +144,22 @@ namespace dukglue
         }
         
         template<class Cls, typename... Args>
-        Cls* apply_constructor(const std::tuple<Args...>& tup)
+        Cls* apply_constructor(std::tuple<Args...>&& tup)
+        {
+            return apply_constructor_helper<Cls>(typename make_indexes<Args...>::type(), std::move(tup));
+        }
+        
+        // constructor, in memory already allocated (placement new)
+        template<class Cls, typename... Args, size_t... Indexes >
+        Cls* apply_placement_constructor_helper(void* memory, index_tuple< Indexes... >, std::tuple<Args...>&& tup)
+        {
+            return new (memory) Cls(std::forward<Args>(std::get<Indexes>(tup))...);
+        }
+        
+        template<class Cls, typename... Args>
+        Cls* apply_placement_constructor(void* memory, std::tuple<Args...>&& tup)
         {
-            return apply_constructor_helper<Cls>(typename make_indexes<Args...>::type(), std::tuple<Args...>(tup));
+            return apply_placement_constructor_helper<Cls>(memory, typename make_indexes<Args...>::type(), std::move(tup));
         }
         
         //////////////////////////////////////////////////////////////////////////////////////////////
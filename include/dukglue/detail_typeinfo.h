@@ -2,11 +2,26 @@
 #ifndef _DETAIL_TYPEINFO_20240506_H
 #define _DETAIL_TYPEINFO_20240506_H 1
 
+#include "detail_traits.h"  // for DUKGLUE_NO_RTTI
 
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#ifndef DUKGLUE_NO_RTTI
+#include <mutex>
 #include <typeindex>
+#include <unordered_map>
+#endif
 
 namespace dukglue
 {
+	// Dense integer ID of a class (see dukglue_class_id).
+	typedef unsigned int class_id_t;
+
 	namespace detail
 	{
 		// same as duk_get_type_name, which is private for some reason *shakes fist*
@@ -30,37 +45,348 @@ namespace dukglue
 				return "unknown";
 		}
 
+		// Dense IDs for classes, for indexing prototypes and TypeInfo's ancestor sets. IDs are process-wide
+		// (a class has the same ID in every heap), and handed out in order of first use.
+		inline class_id_t next_class_id() {
+			static std::atomic<class_id_t> next(0);
+			return next++;
+		}
+
+#ifndef DUKGLUE_NO_RTTI
+		// The ID of the class with RTTI type index (for the run-time class of polymorphic objects).
+		inline class_id_t class_id(const std::type_index& index) {
+			static std::mutex mutex;
+			static std::unordered_map<std::type_index, class_id_t> ids;
+
+			std::lock_guard<std::mutex> lock(mutex);
+			auto found = ids.find(index);
+			if (found == ids.end())
+				found = ids.emplace(index, next_class_id()).first;
+			return found->second;
+		}
+
+		// The same, looked up in a small per-thread cache first (keyed on the type_info's address), so
+		// finding the run-time class of an object only takes the lock and hashes the type's name the
+		// first time a thread sees that class (or when two classes share a cache entry).
+		inline class_id_t cached_class_id(const std::type_info& type) {
+			struct CacheEntry {
+				const std::type_info* type;
+				class_id_t id;
+			};
+
+			static const std::size_t CACHE_SIZE = 64;
+			static thread_local CacheEntry cache[CACHE_SIZE] = {};
+
+			// (type_infos are at least pointer-aligned, so the low bits say nothing)
+			CacheEntry& entry = cache[reinterpret_cast<std::uintptr_t>(&type) / sizeof(void*) % CACHE_SIZE];
+			if (entry.type != &type) {
+				entry.id = class_id(std::type_index(type));
+				entry.type = &type;
+			}
+			return entry.id;
+		}
+
+		template<typename T>
+		struct ClassId {
+			static class_id_t get() {
+				static const class_id_t id = class_id(std::type_index(typeid(T)));
+				return id;
+			}
+		};
+#else
+		template<typename T>
+		struct ClassId {
+			static class_id_t get() {
+				static const class_id_t id = next_class_id();
+				return id;
+			}
+		};
+#endif
+
+		// The ID of class T (const or not).
+		template<typename T>
+		class_id_t class_id() {
+			return ClassId<typename std::remove_cv<T>::type>::get();
+		}
+
+		// Classes can report the run-time class of their objects with a virtual method
+		//    dukglue::class_id_t dukglue_dynamic_class() const
+		// returning dukglue_class_id<Cls>() for the object's class Cls. It's the only way to find it without RTTI,
+		// and saves a look-up by RTTI type index with it.
+		template<typename T, typename = void>
+		struct HasDynamicClass : std::false_type {};
+
+		template<typename T>
+		struct HasDynamicClass<T, decltype(void(std::declval<const T&>().dukglue_dynamic_class()))> : std::true_type {};
+
+		template<typename T>
+		class_id_t dynamic_class_id(T* obj, std::true_type /* has dukglue_dynamic_class */) {
+			return obj->dukglue_dynamic_class();
+		}
+
+		template<typename T>
+		class_id_t dynamic_class_id(T* obj, std::false_type /* has dukglue_dynamic_class */) {
+#ifndef DUKGLUE_NO_RTTI
+			// (typeid of a non-polymorphic class is known at compile time)
+			const std::type_info& type = typeid(*obj);
+			return type == typeid(T) ? class_id<T>() : cached_class_id(type);
+#else
+			(void) obj;
+			return class_id<T>();
+#endif
+		}
+
+		// The ID of the run-time class of obj.
+		template<typename T>
+		class_id_t dynamic_class_id(T* obj) {
+			return dynamic_class_id(obj, HasDynamicClass<T>());
+		}
+
+#ifndef DUKGLUE_NO_RTTI
+		// Pointer to the most derived object obj is part of (for polymorphic classes; for
+		// other classes, the static type is all there is to go by).
+		template<typename T>
+		typename std::enable_if<std::is_polymorphic<T>::value, void*>::type most_derived_ptr(T* obj) {
+			return const_cast<void*>(dynamic_cast<const volatile void*>(obj));
+		}
+
+		template<typename T>
+		typename std::enable_if<!std::is_polymorphic<T>::value, void*>::type most_derived_ptr(T* obj) {
+			return const_cast<void*>(static_cast<const volatile void*>(obj));
+		}
+#endif
+
+		// Converts a pointer to a class into a pointer to one of its direct base classes.
+		struct BaseCast
+		{
+			std::ptrdiff_t offset;  // added to the pointer (if upcast is null)
+			void* (*upcast)(void*);  // for virtual base classes, whose offset depends on the object
+
+			inline bool is_identity() const {
+				return upcast == nullptr && offset == 0;
+			}
+
+			inline void* apply(void* obj) const {
+				return upcast != nullptr ? upcast(obj) : static_cast<char*>(obj) + offset;
+			}
+		};
+
+		// True if Base is a virtual base class of Derived (which rules out downcasts with static_cast).
+		template<typename Base, typename Derived, typename = void>
+		struct IsVirtualBase : std::true_type {};
+
+		template<typename Base, typename Derived>
+		struct IsVirtualBase<Base, Derived, decltype(void(static_cast<Derived*>(std::declval<Base*>())))> : std::false_type {};
+
+		template<typename Base, typename Derived>
+		void* upcast(void* obj) {
+			return static_cast<Base*>(static_cast<Derived*>(obj));
+		}
+
+		template<typename Base, typename Derived>
+		BaseCast make_base_cast(std::true_type /* virtual */) {
+			BaseCast cast = { 0, &upcast<Base, Derived> };
+			return cast;
+		}
+
+		template<typename Base, typename Derived>
+		BaseCast make_base_cast(std::false_type /* virtual */) {
+			// a non-virtual base class is at the same offset in every object, so any (suitably aligned) address will do
+			typename std::aligned_storage<sizeof(Derived), alignof(Derived)>::type storage;
+			Derived* derived = reinterpret_cast<Derived*>(&storage);
+			Base* base = derived;
+
+			BaseCast cast = { reinterpret_cast<char*>(base) - reinterpret_cast<char*>(derived), nullptr };
+			return cast;
+		}
+
+		// The cast from Derived to Base, its direct or indirect base class.
+		template<typename Base, typename Derived>
+		BaseCast make_base_cast() {
+			return make_base_cast<Base, Derived>(IsVirtualBase<Base, Derived>());
+		}
+
+		// Type information for a class prototype: the class, and the base classes its objects can be used as
+		// (see dukglue_set_base_class). Ancestors are flattened when base classes are set, so checking whether
+		// an object can be used as some class costs the same however deep the hierarchy is.
 		class TypeInfo
 		{
 		public:
-			TypeInfo(std::type_index&& idx) : index_(idx), base_(nullptr) {}
-			TypeInfo(const TypeInfo& rhs) : index_(rhs.index_), base_(rhs.base_) {}
+			explicit TypeInfo(class_id_t id) : id_(id), adjusts_(false), frozen_(false) {
+				update_ancestors();
+			}
+
+			inline class_id_t id() const {
+				return id_;
+			}
+
+			// True if any ancestor is at another address than the object (or a virtual base class).
+			inline bool adjusts() const {
+				return adjusts_;
+			}
+
+			// True once the type info is shared between heaps (see BindingSet); it can't get base classes then.
+			inline bool frozen() const {
+				return frozen_;
+			}
+
+			inline void freeze() {
+				frozen_ = true;
+			}
 
-			inline void set_base(TypeInfo* base) {
-				base_ = base;
+			// Adds a direct base class. cast converts a pointer to this class into a pointer to base.
+			// Classes that already have this one as an ancestor are updated too (unless base is frozen,
+			// since a frozen class never gets new ancestors).
+			void add_base(TypeInfo* base, const BaseCast& cast) {
+				if (base == this || frozen_)
+					return;
+
+				for (const Edge& edge : bases_) {
+					if (edge.base == base)
+						return;
+				}
+
+				Edge edge = { base, cast };
+				bases_.push_back(edge);
+				if (!base->frozen_)
+					base->derived_.push_back(this);
+				update_ancestors();
 			}
 
 			template<typename T>
 			bool can_cast() const {
-				if (index_ == typeid(T))
-					return true;
+				return is_a(class_id<T>());
+			}
 
-				if (base_)
-					return base_->can_cast<T>();
+			// True if the class with ID id is this class or one of its ancestors.
+			inline bool is_a(class_id_t id) const {
+				return id / 64 < ancestor_bits_.size() && (ancestor_bits_[id / 64] >> (id % 64) & 1) != 0;
+			}
+
+			// Converts obj, a pointer to this class, into a pointer to T (this class or one of its ancestors).
+			// If T isn't one, obj is returned as is.
+			template<typename T>
+			T* cast(void* obj) const {
+				if (!adjusts_ || obj == nullptr)
+					return static_cast<T*>(obj);
 
-				return false;
+				const Ancestor* ancestor = find_ancestor(class_id<T>());
+				return static_cast<T*>(ancestor != nullptr ? ancestor->apply(obj) : obj);
 			}
 
-			inline bool operator<(const TypeInfo& rhs) const { return index_ < rhs.index_; }
-			inline bool operator<=(const TypeInfo& rhs) const { return index_ <= rhs.index_; }
-			inline bool operator>(const TypeInfo& rhs) const { return index_ > rhs.index_; }
-			inline bool operator>=(const TypeInfo& rhs) const { return index_ >= rhs.index_; }
-			inline bool operator==(const TypeInfo& rhs) const { return index_ == rhs.index_; }
-			inline bool operator!=(const TypeInfo& rhs) const { return index_ != rhs.index_; }
+			// Converts obj, a pointer to the ancestor with ID id, back into a pointer to this class.
+			// Returns null if id isn't an ancestor at a fixed offset (not set up as a base class, or virtual).
+			void* from_ancestor(void* obj, class_id_t id) const {
+				if (id == id_)
+					return obj;
+
+				const Ancestor* ancestor = find_ancestor(id);
+				if (ancestor == nullptr || !ancestor->path.empty() || ancestor->total.upcast != nullptr)
+					return nullptr;
+
+				return static_cast<char*>(obj) - ancestor->total.offset;
+			}
+
+			inline bool operator<(const TypeInfo& rhs) const { return id_ < rhs.id_; }
+			inline bool operator<=(const TypeInfo& rhs) const { return id_ <= rhs.id_; }
+			inline bool operator>(const TypeInfo& rhs) const { return id_ > rhs.id_; }
+			inline bool operator>=(const TypeInfo& rhs) const { return id_ >= rhs.id_; }
+			inline bool operator==(const TypeInfo& rhs) const { return id_ == rhs.id_; }
+			inline bool operator!=(const TypeInfo& rhs) const { return id_ != rhs.id_; }
 
 		private:
-			std::type_index index_;
-			TypeInfo* base_;
+			struct Edge
+			{
+				TypeInfo* base;
+				BaseCast cast;
+			};
+
+			// An ancestor, and the casts that lead to it (offsets are summed up, unless a virtual base is on the way).
+			struct Ancestor
+			{
+				class_id_t id;
+				BaseCast total;  // if path is empty
+				std::vector<BaseCast> path;
+
+				void* apply(void* obj) const {
+					if (path.empty())
+						return total.apply(obj);
+
+					for (const BaseCast& cast : path)
+						obj = cast.apply(obj);
+					return obj;
+				}
+
+				bool operator<(const Ancestor& rhs) const { return id < rhs.id; }
+			};
+
+			const Ancestor* find_ancestor(class_id_t id) const {
+				Ancestor key;
+				key.id = id;
+				auto found = std::lower_bound(ancestors_.begin(), ancestors_.end(), key);
+				return found != ancestors_.end() && found->id == id ? &*found : nullptr;
+			}
+
+			// Rebuilds the ancestor set from the bases' (and then the derived classes', which include this one's).
+			void update_ancestors() {
+				ancestors_.clear();
+				ancestor_bits_.assign(id_ / 64 + 1, 0);
+				ancestor_bits_[id_ / 64] |= std::uint64_t(1) << (id_ % 64);
+				adjusts_ = false;
+
+				for (const Edge& edge : bases_) {
+					add_ancestor(edge.base->id_, edge.cast, nullptr);
+					for (const Ancestor& further : edge.base->ancestors_)
+						add_ancestor(further.id, edge.cast, &further);
+				}
+
+				std::sort(ancestors_.begin(), ancestors_.end());
+
+				for (TypeInfo* derived : derived_)
+					derived->update_ancestors();
+			}
+
+			// Adds the ancestor reached by cast, then (if further isn't null) further's casts.
+			// If an ancestor can be reached in several ways, the first base class set wins.
+			void add_ancestor(class_id_t id, const BaseCast& cast, const Ancestor* further) {
+				if (id / 64 < ancestor_bits_.size() && (ancestor_bits_[id / 64] >> (id % 64) & 1) != 0)
+					return;
+
+				if (id / 64 >= ancestor_bits_.size())
+					ancestor_bits_.resize(id / 64 + 1, 0);
+				ancestor_bits_[id / 64] |= std::uint64_t(1) << (id % 64);
+
+				Ancestor ancestor;
+				ancestor.id = id;
+				ancestor.total = cast;
+
+				if (further != nullptr) {
+					if (further->path.empty() && cast.upcast == nullptr && further->total.upcast == nullptr) {
+						ancestor.total.offset += further->total.offset;
+					}
+					else {
+						ancestor.path.push_back(cast);
+						if (further->path.empty())
+							ancestor.path.push_back(further->total);
+						else
+							ancestor.path.insert(ancestor.path.end(), further->path.begin(), further->path.end());
+					}
+				}
+
+				if (!ancestor.total.is_identity() || !ancestor.path.empty())
+					adjusts_ = true;
+
+				ancestors_.push_back(ancestor);
+			}
+
+			class_id_t id_;  // (see class_id)
+			bool adjusts_;
+			bool frozen_;
+
+			std::vector<std::uint64_t> ancestor_bits_;  // by class id, this class included
+			std::vector<Ancestor> ancestors_;  // sorted by class id
+			std::vector<Edge> bases_;  // direct base classes
+			std::vector<TypeInfo*> derived_;  // direct derived classes
 		};
 	}
 }
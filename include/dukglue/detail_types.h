@@ -10,6 +10,22 @@
 
 // TODO try adding a using namespace std in here if I can scope it to just this file
 
+// Trusted bindings (see dukglue_set_trusted) read arguments without checking their types.
+// Debug builds keep the checks, so mistakes in trusted scripts still raise script errors.
+// Define DUKGLUE_CHECK_TRUSTED to 0 or 1 to override this.
+#ifndef DUKGLUE_CHECK_TRUSTED
+#ifdef NDEBUG
+#define DUKGLUE_CHECK_TRUSTED 0
+#else
+#define DUKGLUE_CHECK_TRUSTED 1
+#endif
+#endif
+
+// every Duktape type
+#define DUKGLUE_TYPE_MASK_ANY (DUK_TYPE_MASK_NONE | DUK_TYPE_MASK_UNDEFINED | DUK_TYPE_MASK_NULL | \
+   DUK_TYPE_MASK_BOOLEAN | DUK_TYPE_MASK_NUMBER | DUK_TYPE_MASK_STRING | DUK_TYPE_MASK_OBJECT | \
+   DUK_TYPE_MASK_BUFFER | DUK_TYPE_MASK_POINTER | DUK_TYPE_MASK_LIGHTFUNC)
+
 namespace dukglue {
    namespace types {
 
@@ -63,7 +79,7 @@ namespace dukglue {
                duk_error(ctx, DUK_RET_TYPE_ERROR, "Argument %d: expected native object, got %s", arg_idx, get_type_name(type_idx));
             }
 
-            duk_get_prop_string(ctx, arg_idx, "\xFF" "type_info");
+            get_hidden_prop(ctx, arg_idx, KEY_TYPE_INFO);
             if (!duk_is_pointer(ctx, -1)) { // missing type_info, must not be a native object
                duk_error(ctx, DUK_RET_TYPE_ERROR, "Argument %d: expected native object (missing type_info)", arg_idx);
             }
@@ -76,12 +92,13 @@ namespace dukglue {
 
             duk_pop(ctx);  // pop type_info
 
-            duk_get_prop_string(ctx, arg_idx, "\xFF" "obj_ptr");
+            get_hidden_prop(ctx, arg_idx, KEY_OBJ_PTR);
             if (!duk_is_pointer(ctx, -1)) {
                duk_error(ctx, DUK_RET_TYPE_ERROR, "Argument %d: invalid native object.", arg_idx);
             }
 
-            T* obj = static_cast<T*>(duk_get_pointer(ctx, -1));
+            // (the object is held as the class of its prototype)
+            T* obj = info->cast<T>(duk_get_pointer(ctx, -1));
 
             duk_pop(ctx);  // pop obj_ptr
 
@@ -98,6 +115,33 @@ namespace dukglue {
             return *obj;
          }
 
+         // read pointer, without checking that the value is a native object of the right type
+         // (for trusted bindings)
+         template<typename FullT, typename = typename std::enable_if< std::is_pointer<FullT>::value>::type >
+         static T* read_trusted(duk_context* ctx, duk_idx_t arg_idx) {
+            using namespace dukglue::detail;
+
+            if (duk_is_null_or_undefined(ctx, arg_idx)) {
+               return nullptr;
+            }
+
+            get_hidden_prop(ctx, arg_idx, KEY_OBJ_PTR);
+            T* obj = object_ptr_as<T>(ctx, arg_idx, duk_get_pointer(ctx, -1));
+            duk_pop(ctx);  // pop obj_ptr
+
+            return obj;
+         }
+
+         // read reference, without checking the native object's type (for trusted bindings)
+         template<typename FullT, typename = typename std::enable_if< std::is_reference<FullT>::value>::type >
+         static T& read_trusted(duk_context* ctx, duk_idx_t arg_idx) {
+            T* obj = read_trusted<T*>(ctx, arg_idx);
+            if (obj == nullptr)
+               duk_error(ctx, DUK_RET_TYPE_ERROR, "Argument %d: cannot be null (native function expects reference)", arg_idx);
+
+            return *obj;
+         }
+
          // read value
          // commented out because it breaks for abstract classes
          /*template<typename FullT, typename = typename std::enable_if< std::is_same<T, typename std::remove_const<FullT>::type >::value>::type >
@@ -117,8 +161,7 @@ namespace dukglue {
 
             if (!RefManager::find_and_push_native_object(ctx, &value)) {
                // need to create new script object
-               ProtoManager::make_script_object<T>(ctx, &value);
-               RefManager::register_native_object(ctx, &value);
+               push_new_script_object(ctx, &value, HasIntrusivePtrTraits<T>());
             }
          }
 
@@ -138,6 +181,34 @@ namespace dukglue {
             static_assert(std::is_copy_constructible<T>::value, "Cannot push value for non-copy-constructable type.");
             return push<T*>(ctx, new T(value));
          }*/
+
+      private:
+         static void push_new_script_object(duk_context* ctx, T* value, std::false_type) {
+            const dukglue::class_id_t cls = dukglue::detail::ProtoManager::make_script_object<T>(ctx, value);
+            dukglue::detail::RefManager::register_native_object(ctx, value, cls, true);
+         }
+
+         // the class has an intrusive reference count (see intrusive_ptr_traits)
+         static void push_new_script_object(duk_context* ctx, T* value, std::true_type) {
+            const dukglue::class_id_t cls = dukglue::detail::ProtoManager::make_script_object<T>(ctx, value);
+            dukglue::detail::RefManager::register_intrusive_object(ctx, value, cls);
+         }
+      };
+
+      // How a value type read from a script is stored in the argument tuple (see ArgStorage).
+      // Usually the type itself; see ScriptOwnedPtr for std::unique_ptr.
+      template<typename T>
+      struct ValueStorage {
+         typedef T type;
+      };
+
+      // For a storage type that takes something from the script object it was read from
+      // (see ScriptOwnedPtr): owned_object returns what it takes, and take takes it.
+      // Both are called once every argument of a call has been read (see detail::take_ownership).
+      template<typename Stored>
+      struct ArgOwnership {
+         static const void* owned_object(const Stored&) { return nullptr; }
+         static void take(duk_context*, Stored&) {}
       };
 
       // Figure out what the type for an argument should be inside the tuple.
@@ -154,11 +225,22 @@ namespace dukglue {
 
          static_assert(!IsValueType::value || !std::is_pointer<T>::value, "Cannot return pointer to value type.");
          static_assert(!IsValueType::value ||
-            (!std::is_reference<T>::value || std::is_const<typename std::remove_reference<T>::type>::value),
-            "Value types can only be returned as const references.");
+            (!std::is_lvalue_reference<T>::value || std::is_const<typename std::remove_reference<T>::type>::value),
+            "Value types can only be returned as const references (or rvalue references).");
 
       public:
-         typedef typename std::conditional<IsValueType::value, BareType, T>::type type;
+         typedef typename std::conditional<IsValueType::value, typename ValueStorage<BareType>::type, T>::type type;
+      };
+
+      // DukTypeMask<T>::mask() is the set of Duktape types (DUK_TYPE_MASK_*) DukType<T> can read,
+      // where T is a bare type. It is used to cheaply pick between overloads.
+      // Native objects must be objects (pointers may also be null, see detail::arg_type_mask).
+      // Value types that don't specialize this are assumed to accept anything.
+      template<typename T>
+      struct DukTypeMask {
+         static duk_uint_t mask() {
+            return DukType<T>::IsValueType::value ? DUKGLUE_TYPE_MASK_ANY : DUK_TYPE_MASK_OBJECT;
+         }
       };
    }
 }
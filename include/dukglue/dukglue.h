@@ -7,6 +7,7 @@
 #include "register_property.h"
 #include "public_util.h"
 #include "dukvalue.h"
+#include "binding_set.h"
 
 #endif
 
@@ -11,11 +11,15 @@
 #include <map>
 
 #include "dukexception.h"
+#include "detail_heap_state.h"
+#include "detail_class_proto.h"
 
 // A variant class for Duktape values.
 // This class is not really dependant on the rest of dukglue, but the rest of dukglue is integrated to support it.
 // Script objects are persisted by copying a reference to the object into an array in the heap stash.
 // When we need to push a reference to the object, we just look up that reference in the stash.
+// DukValues refer to their entry in the array with a pin (see PinnedRefs), so the array can be compacted
+// without having to find every DukValue.
 
 // DukValues can be copied freely. We use reference counting behind the scenes to keep track of when we need
 // to remove our reference from the heap stash. Memory for reference counting is only allocated once a DukValue
@@ -122,7 +126,6 @@ public:
 
       case OBJECT:
       {
-         // this could be optimized to only push ref_array once...
          this->push();
          rhs.push();
          bool equal = duk_equals(mContext, -1, -2) ? true : false;
@@ -174,7 +177,7 @@ public:
       }
 
       case OBJECT:
-         value.mPOD.ref_array_idx = stash_ref(ctx, idx);
+         value.mPOD.pin = stash_ref(ctx, idx);
          break;
 
       case POINTER:
@@ -260,7 +263,7 @@ public:
             throw DukErrorException(ctx, rc) << "Could not decode JSON";
          }
          else {
-            v.mPOD.ref_array_idx = stash_ref(ctx, -1);
+            v.mPOD.pin = stash_ref(ctx, -1);
             duk_pop(ctx);
          }
          break;
@@ -305,9 +308,7 @@ public:
          break;
 
       case OBJECT:
-         push_ref_array(ctx);
-         duk_get_prop_index(ctx, -1, mPOD.ref_array_idx);
-         duk_remove(ctx, -2);
+         dukglue::detail::DukglueHeapState::require(ctx)->dukvalue_refs.push(ctx, mPOD.pin);
          break;
 
       case POINTER:
@@ -327,10 +328,10 @@ public:
          return false;
 
       push(); // [ obj ]
-      duk_get_prop_literal(mContext, -1, "\xFF" "class_id"); // [ obj this.typeid ]
-      duk_push_string(mContext, typeid(T).name()); // [ obj this.typeid T.typeid ]
-      bool equal = duk_strict_equals(mContext, -1, -2);
-      duk_pop_3(mContext);
+      dukglue::detail::get_hidden_prop(mContext, -1, dukglue::detail::KEY_TYPE_INFO); // [ obj type_info ]
+      const dukglue::detail::TypeInfo* info = static_cast<const dukglue::detail::TypeInfo*>(duk_get_pointer(mContext, -1));
+      bool equal = (info != nullptr && info->id() == dukglue::detail::class_id<T>());
+      duk_pop_2(mContext);
       return equal;
    }
 
@@ -417,11 +418,12 @@ public:
          throw DukException() << "Expected object, got " << type_name();
 
       push(); // [ object ]
-      duk_get_prop_string(mContext, -1, "\xFF" "obj_ptr"); // [ object ptr ]
+      dukglue::detail::get_hidden_prop(mContext, -1, dukglue::detail::KEY_OBJ_PTR); // [ object ptr ]
 
       void* ptr = duk_require_pointer(mContext, -1);
+      T* obj = dukglue::detail::object_ptr_as<T>(mContext, -2, ptr);
       duk_pop_2(mContext);
-      return static_cast<T*>(ptr);
+      return obj;
    }
 
    std::string as_json_string() const {
@@ -612,77 +614,22 @@ private:
    // THIS IS COMPLETELY UNRELATED TO DETAIL_REFS.H.
    // detail_refs.h stores a mapping of native object -> script object.
    // This just stores arbitrary script objects (which likely have no native object backing them).
-   // If I was smarter I might merge the two implementations, but this one is simpler
-   // (since we don't need the std::map here).
-   static void push_ref_array(duk_context* ctx)
-   {
-      static const char* DUKVALUE_REF_ARRAY = "dukglue_dukvalue_refs";
-      duk_push_heap_stash(ctx);
-
-      if (!duk_has_prop_string(ctx, -1, DUKVALUE_REF_ARRAY)) {
-         duk_push_array(ctx);
+   // The array itself lives in the per-heap state (see DukglueHeapState and PinnedRefs).
 
-         // ref_array[0] = 0 (initialize free list as empty)
-         duk_push_int(ctx, 0);
-         duk_put_prop_index(ctx, -2, 0);
-
-         duk_put_prop_string(ctx, -2, DUKVALUE_REF_ARRAY);
-      }
-
-      duk_get_prop_string(ctx, -1, DUKVALUE_REF_ARRAY);
-      duk_remove(ctx, -2); // pop heap stash
-   }
-
-   // put a new reference into the ref array and return its index in the array
+   // put a new reference into the ref array and return its pin
    static duk_uint_t stash_ref(duk_context* ctx, duk_idx_t idx)
    {
-      push_ref_array(ctx);
-
-      // if idx is relative, we need to adjust it to deal with the array we just pushed
-      if (idx < 0)
-         idx--;
-
-      // find next free index
-      // free indices are kept in a linked list, starting at ref_array[0]
-      duk_get_prop_index(ctx, -1, 0);
-      duk_uarridx_t next_free_idx = duk_get_uint(ctx, -1);
-      duk_pop(ctx);
-
-      if (next_free_idx == 0) {
-         // no free spots in the array, make a new one at arr.length
-         duk_size_t len = duk_get_length(ctx, -1);
-         assert(len < DUK_UINT_MAX);
-         next_free_idx = static_cast<duk_uarridx_t>(len);
-      }
-      else {
-         // free spot found, need to remove it from the free list
-         // ref_array[0] = ref_array[next_free_idx]
-         duk_get_prop_index(ctx, -1, next_free_idx);
-         duk_put_prop_index(ctx, -2, 0);
-      }
-
-      duk_dup(ctx, idx);  // copy value we are storing (since store consumes it)
-      duk_put_prop_index(ctx, -2, next_free_idx);  // store it (consumes duplicated value)
-      duk_pop(ctx);  // pop ref array
-
-      return next_free_idx;
+      return dukglue::detail::DukglueHeapState::require(ctx)->dukvalue_refs.pin(ctx, idx);
    }
 
-   // remove ref_array_idx from the ref array and add its spot to the free list (at refs[0])
-   static void free_ref(duk_context* ctx, duk_uarridx_t ref_array_idx)
+   // remove the reference for pin from the ref array (compacting it if it has become mostly empty)
+   static void free_ref(duk_context* ctx, duk_uarridx_t pin)
    {
-      push_ref_array(ctx);
-
-      // add this spot to the free list
-      // refs[old_obj_idx] = refs[0] (implicitly gives up our reference)
-      duk_get_prop_index(ctx, -1, 0);
-      duk_put_prop_index(ctx, -2, ref_array_idx);
-
-      // refs[0] = old_obj_idx
-      duk_push_uint(ctx, ref_array_idx);
-      duk_put_prop_index(ctx, -2, 0);
+      dukglue::detail::DukglueHeapState* state = dukglue::detail::DukglueHeapState::get(ctx);
+      if (state == nullptr)  // heap is being destroyed, the ref array is going away anyway
+         return;
 
-      duk_pop(ctx);  // pop ref array
+      state->dukvalue_refs.unpin(ctx, pin);
    }
 
    // this is for reference counting - used to release our reference based on the state
@@ -702,7 +649,7 @@ private:
             }
             else {
                // not sharing anymore, we can free it
-               free_ref(mContext, mPOD.ref_array_idx);
+               free_ref(mContext, mPOD.pin);
                delete mRefCount;
             }
 
@@ -710,7 +657,7 @@ private:
          }
          else {
             // not sharing with any other DukValue, free it
-            free_ref(mContext, mPOD.ref_array_idx);
+            free_ref(mContext, mPOD.pin);
          }
 
          mType = UNDEFINED;
@@ -727,7 +674,7 @@ private:
       bool boolean;
       double number;
       void* pointer;  // if mType == NULLREF, this is 0 (otherwise holds pointer value when mType == POINTER)
-      duk_uarridx_t ref_array_idx;
+      duk_uarridx_t pin;  // if mType == OBJECT (see stash_ref)
    } mPOD;
 
    std::string mString;  // if it's a string, we store it with std::string
@@ -0,0 +1,42 @@
+#ifndef _INTRUSIVE_PTR_TRAITS_20240506_H
+#define _INTRUSIVE_PTR_TRAITS_20240506_H 1
+
+#include <type_traits>
+
+namespace dukglue
+{
+   // Specialize this for classes that carry their own reference count (AddRef/Release style),
+   // so their script objects hold a reference to them:
+   //
+   //   namespace dukglue {
+   //      template<>
+   //      struct intrusive_ptr_traits<Mesh> {
+   //         static void add_ref(Mesh* obj) { obj->AddRef(); }
+   //         static void release(Mesh* obj) { obj->Release(); }
+   //      };
+   //   }
+   //
+   // (Enable is there so a whole class hierarchy can be covered at once, with a partial
+   // specialization on std::enable_if<std::is_base_of<RefCounted, T>::value>.)
+   // The specialization must be visible wherever the class is pushed.
+   //
+   // Pushing an object of such a class takes one reference, which is released once its script
+   // object is garbage collected. While the script object is alive, pushing the object again gives
+   // the same script object (as with dukglue_set_weak_refs). Like any native object, it can be
+   // invalidated early (dukglue_invalidate_object); the reference is still only released on collection.
+   template<typename T, typename Enable = void>
+   struct intrusive_ptr_traits;
+
+   namespace detail
+   {
+      // HasIntrusivePtrTraits<T>::value is true if intrusive_ptr_traits is specialized for T.
+      template<typename T, typename = void>
+      struct HasIntrusivePtrTraits : std::false_type {};
+
+      template<typename T>
+      struct HasIntrusivePtrTraits<T, decltype((void) intrusive_ptr_traits<T>::release(static_cast<T*>(nullptr)))>
+         : std::true_type {};
+   }
+}
+
+#endif
@@ -4,6 +4,10 @@
 
 #include "dukexception.h"
 #include "detail_traits.h"  // for index_tuple/make_indexes
+#include "detail_heap_state.h"
+#include "detail_refs.h"
+#include "class_allocator.h"
+#include "detail_heap_allocator.h"
 
 // This file has some useful utility functions for users.
 // Hopefully this saves you from wading through the implementation.
@@ -22,6 +26,7 @@ void dukglue_push(duk_context* ctx, const FullT& val) {
    // ArgStorage has some static_asserts in it that validate value types,
    // so we typedef it to force ArgStorage<RetType> to compile and run the asserts
    typedef typename dukglue::types::ArgStorage<FullT>::type ValidateReturnType;
+   (void) sizeof(ValidateReturnType);
 
    using namespace dukglue::types;
    DukType<typename Bare<FullT>::type>::template push<FullT>(ctx, std::move(val));
@@ -34,7 +39,7 @@ void dukglue_push(duk_context* ctx, const T& arg, ArgTs... args)
    dukglue_push(ctx, args...);
 }
 
-inline void dukglue_push(duk_context* ctx)
+inline void dukglue_push(duk_context*)
 {
    // no-op
 }
@@ -48,12 +53,12 @@ inline void dukglue_push(duk_context* ctx)
 template <typename RetT>
 void dukglue_read(duk_context* ctx, duk_idx_t arg_idx, RetT* out)
 {
-   // ArgStorage has some static_asserts in it that validate value types,
-   // so we typedef it to force ArgStorage<RetType> to compile and run the asserts
-   typedef typename dukglue::types::ArgStorage<RetT>::type ValidateReturnType;
-
+   // (ArgStorage also has some static_asserts in it that validate value types)
    using namespace dukglue::types;
-   *out = DukType<typename Bare<RetT>::type>::template read<RetT>(ctx, arg_idx);
+   typedef typename ArgStorage<RetT>::type Stored;
+   Stored value = DukType<typename Bare<RetT>::type>::template read<RetT>(ctx, arg_idx);
+   ArgOwnership<Stored>::take(ctx, value);
+   *out = std::move(value);
 }
 
 
@@ -320,6 +325,131 @@ inline void dukglue_register_global(duk_context* ctx, const T& obj, const char*
    duk_put_global_string(ctx, name);
 }
 
+// Functions and methods registered after this is set (until it is cleared) are "trusted":
+// they read their arguments without type checks, which makes calls cheaper, especially
+// for native object arguments (no type_info lookup or base class check).
+// Only use this for scripts you control - calling a trusted binding with arguments of the
+// wrong type is undefined behavior. Debug builds keep the checks (see DUKGLUE_CHECK_TRUSTED).
+// Set it around individual registrations to only trust some bindings:
+//   dukglue_set_trusted(ctx, true);
+//   dukglue_register_method(ctx, &Vec3::add, "add");
+//   dukglue_set_trusted(ctx, false);
+inline void dukglue_set_trusted(duk_context* ctx, bool trusted)
+{
+   dukglue::detail::DukglueHeapState::require(ctx)->trusted = trusted;
+}
+
+// Native objects pushed to scripts after this is set (until it is cleared) are registered
+// with weak refs: their script object is garbage collected once scripts stop using it,
+// instead of being kept until dukglue_invalidate_object is called.
+// While the script object is alive, pushing the native object again gives the same script object.
+// After it has been collected, pushing the native object creates a new one
+// (so properties scripts added to the old one are lost).
+// The native object itself is never deleted. Objects created by scripts with a registered
+// constructor are always kept alive, since nothing else refers to them.
+inline void dukglue_set_weak_refs(duk_context* ctx, bool weak_refs)
+{
+   dukglue::detail::DukglueHeapState::require(ctx)->weak_refs = weak_refs;
+}
+
+// Counts of Cls objects constructed and destroyed by managed constructors on all threads
+// (through dukglue_class_allocator<Cls>).
+template<typename Cls>
+inline dukglue::detail::ClassAllocStats dukglue_get_class_alloc_stats()
+{
+   return dukglue::detail::ClassAllocation<Cls>::stats();
+}
+
+// Options for dukglue_create_heap.
+struct DukglueHeapOptions
+{
+   DukglueHeapOptions() : size_class_pools(true), arena(false), fatal_handler(nullptr) {}
+
+   // Allocate small blocks (up to 504 bytes) from per-heap size-class pools instead of malloc.
+   bool size_class_pools;
+
+   // Release all of the heap's memory in one shot when it is destroyed, instead of block by block.
+   bool arena;
+
+   // Passed to duk_create_heap.
+   duk_fatal_function fatal_handler;
+};
+
+// Creates a heap whose memory functions are dukglue's allocator (see HeapAllocator), which keeps
+// byte counts (see dukglue_get_heap_alloc_stats). Returns nullptr if the heap can't be created.
+// Destroy it with dukglue_destroy_heap (duk_destroy_heap would leak the allocator).
+inline duk_context* dukglue_create_heap(const DukglueHeapOptions& options = DukglueHeapOptions())
+{
+   dukglue::detail::HeapAllocator* allocator = new dukglue::detail::HeapAllocator(options.size_class_pools, options.arena);
+
+   duk_context* ctx = duk_create_heap(&dukglue::detail::HeapAllocator::alloc_func,
+      &dukglue::detail::HeapAllocator::realloc_func, &dukglue::detail::HeapAllocator::free_func,
+      allocator, options.fatal_handler);
+
+   if (ctx == nullptr)
+      delete allocator;
+
+   return ctx;
+}
+
+// Destroys a heap created with dukglue_create_heap (or any other heap, like duk_destroy_heap).
+inline void dukglue_destroy_heap(duk_context* ctx)
+{
+   if (ctx == nullptr)
+      return;
+
+   dukglue::detail::HeapAllocator* allocator = dukglue::detail::HeapAllocator::of(ctx);
+   if (allocator != nullptr)
+      allocator->begin_teardown();
+
+   duk_destroy_heap(ctx);
+   delete allocator;
+}
+
+// Memory counters for a heap created with dukglue_create_heap (all 0 for other heaps).
+inline dukglue::detail::HeapAllocStats dukglue_get_heap_alloc_stats(duk_context* ctx)
+{
+   const dukglue::detail::HeapAllocator* allocator = dukglue::detail::HeapAllocator::of(ctx);
+   if (allocator == nullptr) {
+      dukglue::detail::HeapAllocStats none = { 0, 0, 0, 0 };
+      return none;
+   }
+
+   return allocator->stats();
+}
+
+// Sizes of the arrays dukglue keeps references to script objects in:
+// one for the script objects of native objects, one for the values held by DukValues.
+// Released slots are reused, and an array is compacted automatically once 3/4 of it
+// is free (and it has at least 1024 free slots).
+struct DukglueRefStats
+{
+   dukglue::detail::RefArrayStats native_objects;
+   dukglue::detail::RefArrayStats dukvalues;
+};
+
+inline DukglueRefStats dukglue_get_ref_stats(duk_context* ctx)
+{
+   const dukglue::detail::DukglueHeapState* state = dukglue::detail::DukglueHeapState::require(ctx);
+
+   DukglueRefStats stats;
+   stats.native_objects = state->ref_array.stats();
+   stats.dukvalues = state->dukvalue_refs.stats();
+   return stats;
+}
+
+// Compacts both ref arrays now, moving live references into free slots and truncating the arrays,
+// so they take no memory (or mark-and-sweep time) for released references.
+// Useful after a spike of references (a level load, a big batch of DukValues) went away.
+inline void dukglue_compact_refs(duk_context* ctx)
+{
+   dukglue::detail::RefManager::compact(ctx);
+
+   dukglue::detail::DukglueHeapState* state = dukglue::detail::DukglueHeapState::get(ctx);
+   if (state != nullptr)
+      state->dukvalue_refs.compact(ctx);
+}
+
 
 
 //
@@ -6,6 +6,7 @@
 #include "detail_class_proto.h"
 #include "detail_constructor.h"
 #include "detail_method.h"
+#include "detail_overloads.h"
 
 
 // Set the constructor for the given type.
@@ -55,21 +56,11 @@ template<class Cls, typename... Ts>
 void dukglue_register_constructor_managed(duk_context* ctx, const char* name)
 {
     duk_c_function constructor_func = dukglue::detail::call_native_constructor<true, Cls, Ts...>;
-    duk_c_function finalizer_func = dukglue::detail::managed_finalizer<Cls>;
 
     duk_push_c_function(ctx, constructor_func, sizeof...(Ts));
 
-    // create new prototype with finalizer
-    duk_push_object(ctx);
-
-    // set the finalizer
-    duk_push_c_function(ctx, finalizer_func, 1);
-    duk_set_finalizer(ctx, -2);
-
-    // hook prototype with finalizer up to real class prototype
-    // must use duk_set_prototype, not set the .prototype property
-    dukglue::detail::ProtoManager::push_prototype<Cls>(ctx);
-    duk_set_prototype(ctx, -2);
+    // create new prototype with finalizer (see push_managed_prototype)
+    dukglue::detail::push_managed_prototype<Cls>(ctx);
 
     // set constructor_func.prototype to the prototype with the finalizer
     duk_put_prop_string(ctx, -2, "prototype");
@@ -86,22 +77,12 @@ void dukglue_register_constructor_managed_obj_varargs(duk_context* ctx, const ch
     duk_push_string(ctx, name);
     
     duk_c_function constructor_func = dukglue::detail::call_native_constructor_varargs<true, Cls>;
-    duk_c_function finalizer_func = dukglue::detail::managed_finalizer<Cls>;
     
     duk_push_c_function(ctx, constructor_func, DUK_VARARGS);
     
-    // create new prototype with finalizer
-    duk_push_object(ctx);
-    
-    // set the finalizer
-    duk_push_c_function(ctx, finalizer_func, 1);
-    duk_set_finalizer(ctx, -2);
-    
-    // hook prototype with finalizer up to real class prototype
-    // must use duk_set_prototype, not set the .prototype property
-    dukglue::detail::ProtoManager::push_prototype<Cls>(ctx);
-    duk_set_prototype(ctx, -2);
-    
+    // create new prototype with finalizer (see push_managed_prototype)
+    dukglue::detail::push_managed_prototype<Cls>(ctx);
+
     // set constructor_func.prototype to the prototype with the finalizer
     duk_put_prop_string(ctx, -2, "prototype");
     
@@ -117,22 +98,12 @@ void dukglue_register_constructor_managed_obj(duk_context* ctx, const char* name
     duk_push_string(ctx, name);
     
     duk_c_function constructor_func = dukglue::detail::call_native_constructor<true, Cls, Ts...>;
-    duk_c_function finalizer_func = dukglue::detail::managed_finalizer<Cls>;
     
     duk_push_c_function(ctx, constructor_func, sizeof...(Ts));
     
-    // create new prototype with finalizer
-    duk_push_object(ctx);
-    
-    // set the finalizer
-    duk_push_c_function(ctx, finalizer_func, 1);
-    duk_set_finalizer(ctx, -2);
-    
-    // hook prototype with finalizer up to real class prototype
-    // must use duk_set_prototype, not set the .prototype property
-    dukglue::detail::ProtoManager::push_prototype<Cls>(ctx);
-    duk_set_prototype(ctx, -2);
-    
+    // create new prototype with finalizer (see push_managed_prototype)
+    dukglue::detail::push_managed_prototype<Cls>(ctx);
+
     // set constructor_func.prototype to the prototype with the finalizer
     duk_put_prop_string(ctx, -2, "prototype");
     
@@ -150,21 +121,11 @@ void dukglue_register_constructor_managed_ns(duk_context* ctx, const char* ns, c
      }
 
     duk_c_function constructor_func = dukglue::detail::call_native_constructor<true, Cls, Ts...>;
-    duk_c_function finalizer_func = dukglue::detail::managed_finalizer<Cls>;
     
     duk_push_c_function(ctx, constructor_func, sizeof...(Ts));
 
-    // create new prototype with finalizer
-    duk_push_object(ctx);
-    
-    // set the finalizer
-    duk_push_c_function(ctx, finalizer_func, 1);
-    duk_set_finalizer(ctx, -2);
-    
-    // hook prototype with finalizer up to real class prototype
-    // must use duk_set_prototype, not set the .prototype property
-    dukglue::detail::ProtoManager::push_prototype<Cls>(ctx);
-    duk_set_prototype(ctx, -2);
+    // create new prototype with finalizer (see push_managed_prototype)
+    dukglue::detail::push_managed_prototype<Cls>(ctx);
 
     // set constructor_func.prototype to the prototype with the finalizer
     duk_put_prop_string(ctx, -2, "prototype");
@@ -175,6 +136,18 @@ void dukglue_register_constructor_managed_ns(duk_context* ctx, const char* ns, c
     duk_pop(ctx);
 }
 
+// The dense integer ID dukglue knows class Cls by (the same in every heap; const or not).
+// Polymorphic classes can report the run-time class of their objects with it, by overriding
+//   virtual dukglue::class_id_t dukglue_dynamic_class() const { return dukglue_class_id<MyClass>(); }
+// in every class pushed as a base class pointer. dukglue then picks the prototype of an object's
+// run-time class without RTTI (so this is needed in -fno-rtti builds, see DUKGLUE_NO_RTTI),
+// and without looking up its RTTI type index (so it's faster with RTTI too).
+template<class Cls>
+inline dukglue::class_id_t dukglue_class_id()
+{
+    return dukglue::detail::class_id<Cls>();
+}
+
 template<class Base, class Derived>
 void dukglue_set_base_class(duk_context* ctx)
 {
@@ -184,36 +157,42 @@ void dukglue_set_base_class(duk_context* ctx)
 
     using namespace dukglue::detail;
 
-    // Derived.type_info->set_base(Base.type_info)
+    // objects of Derived can be used as a Base (and as Base's base classes), at Base's address
     ProtoManager::push_prototype<Derived>(ctx);
-    duk_get_prop_string(ctx, -1, "\xFF" "type_info");
+    dukglue::detail::get_hidden_prop(ctx, -1, dukglue::detail::KEY_TYPE_INFO);
     TypeInfo* derived_type_info = static_cast<TypeInfo*>(duk_require_pointer(ctx, -1));
-    duk_pop_2(ctx);
+    duk_pop(ctx);
+
+    if (derived_type_info->frozen()) {
+        duk_pop(ctx);  // pop prototype
+        throw DukException() << "Base classes of a class from a BindingSet can only be set in the BindingSet";
+    }
 
     ProtoManager::push_prototype<Base>(ctx);
-    duk_get_prop_string(ctx, -1, "\xFF" "type_info");
+    dukglue::detail::get_hidden_prop(ctx, -1, dukglue::detail::KEY_TYPE_INFO);
     TypeInfo* base_type_info = static_cast<TypeInfo*>(duk_require_pointer(ctx, -1));
-    duk_pop_2(ctx);
+    duk_pop(ctx);
 
-    derived_type_info->set_base(base_type_info);
+    const BaseCast cast = make_base_cast<Base, Derived>();
+    derived_type_info->add_base(base_type_info, cast);
+    if (!cast.is_identity())
+        DukglueHeapState::require(ctx)->adjusted_casts = true;
 
-    // also set up the prototype chain
-    ProtoManager::push_prototype<Derived>(ctx);
-    ProtoManager::push_prototype<Base>(ctx);
-    duk_set_prototype(ctx, -2);
-    duk_pop(ctx);
+    // also give scripts Base's members (see ProtoManager::inherit_prototype)
+    ProtoManager::inherit_prototype(ctx, -2, -1);
+    duk_pop_2(ctx);
 }
 
 // methods
 template<typename T, T Value, class Cls, typename RetType, typename... Ts>
-void dukglue_register_method_compiletime(duk_context* ctx, RetType(Cls::*method)(Ts...), const char* name)
+void dukglue_register_method_compiletime(duk_context* ctx, RetType(Cls::*)(Ts...), const char* name)
 {
     static_assert(std::is_same<T, RetType(Cls::*)(Ts...)>::value, "Mismatching method types.");
     dukglue_register_method_compiletime<false, T, Value, Cls, RetType, Ts...>(ctx, name);
 }
 
 template<typename T, T Value, class Cls, typename RetType, typename... Ts>
-void dukglue_register_method_compiletime(duk_context* ctx, RetType(Cls::*method)(Ts...) const, const char* name)
+void dukglue_register_method_compiletime(duk_context* ctx, RetType(Cls::*)(Ts...) const, const char* name)
 {
     static_assert(std::is_same<T, RetType(Cls::*)(Ts...) const>::value, "Mismatching method types.");
     dukglue_register_method_compiletime<true, T, Value, Cls, RetType, Ts...>(ctx, name);
@@ -231,9 +210,30 @@ void dukglue_register_method_compiletime(duk_context* ctx, const char* name)
 
     duk_push_c_function(ctx, method_func, sizeof...(Ts));
     duk_put_prop_string(ctx, -2, name); // consumes func above
+    ProtoManager::member_added(ctx, -1, class_id<Cls>(), name);
+
+    duk_pop(ctx); // pop prototype
+}
+
+#ifdef DUKGLUE_HAS_CPP17
+// Register a method, embedding the method at compile time (requires C++17):
+//   dukglue_register_method<&MyClass::method>(ctx, "method");
+template<auto method>
+void dukglue_register_method(duk_context* ctx, const char* name)
+{
+    using namespace dukglue::detail;
+    typedef typename MethodClass<decltype(method)>::type Cls;
+    static_assert(!std::is_void<Cls>::value, "dukglue_register_method<method> requires a method pointer");
+
+    ProtoManager::push_prototype<Cls>(ctx);
+
+    push_method_compiletime<method>(ctx, method);
+    duk_put_prop_string(ctx, -2, name); // consumes method function
+    ProtoManager::member_added(ctx, -1, class_id<Cls>(), name);
 
     duk_pop(ctx); // pop prototype
 }
+#endif
 
 template<class Cls, typename RetType, typename... Ts>
 void dukglue_register_method(duk_context* ctx, RetType(Cls::*method)(Ts...), const char* name)
@@ -247,6 +247,35 @@ void dukglue_register_method(duk_context* ctx, RetType(Cls::*method)(Ts...) cons
     dukglue_register_method<true, Cls, RetType, Ts...>(ctx, method, name);
 }
 
+// Register a method with default values for its trailing arguments (see dukglue_defaults):
+//   dukglue_register_method(ctx, &Dog::bark, "bark", dukglue_defaults(3));
+template<class Cls, typename RetType, typename... Ts, typename... Ds>
+void dukglue_register_method(duk_context* ctx, RetType(Cls::*method)(Ts...), const char* name, dukglue::detail::Defaults<Ds...> defaults)
+{
+    dukglue_register_method<false, Cls, RetType, Ts...>(ctx, method, name, std::move(defaults));
+}
+
+template<class Cls, typename RetType, typename... Ts, typename... Ds>
+void dukglue_register_method(duk_context* ctx, RetType(Cls::*method)(Ts...) const, const char* name, dukglue::detail::Defaults<Ds...> defaults)
+{
+    dukglue_register_method<true, Cls, RetType, Ts...>(ctx, method, name, std::move(defaults));
+}
+
+template<bool isConst, typename Cls, typename RetType, typename... Ts, typename... Ds>
+void dukglue_register_method(duk_context* ctx, typename std::conditional<isConst, RetType(Cls::*)(Ts...) const, RetType(Cls::*)(Ts...)>::type method, const char* name, dukglue::detail::Defaults<Ds...> defaults)
+{
+    using namespace dukglue::detail;
+    typedef MethodInfo<isConst, Cls, RetType, Ts...> MethodInfo;
+
+    ProtoManager::push_prototype<Cls>(ctx);
+
+    MethodInfo::template MethodDefaultsRuntime<Ds...>::push(ctx, method, std::move(defaults));
+    duk_put_prop_string(ctx, -2, name); // consumes method function
+    ProtoManager::member_added(ctx, -1, class_id<Cls>(), name);
+
+    duk_pop(ctx); // pop prototype
+}
+
 // I'm sorry this signature is so long, but I figured it was better than duplicating the method,
 // once for const methods and once for non-const methods.
 template<bool isConst, typename Cls, typename RetType, typename... Ts>
@@ -255,20 +284,16 @@ void dukglue_register_method(duk_context* ctx, typename std::conditional<isConst
     using namespace dukglue::detail;
     typedef MethodInfo<isConst, Cls, RetType, Ts...> MethodInfo;
 
-    duk_c_function method_func = MethodInfo::MethodRuntime::call_native_method;
+    duk_c_function method_func = MethodInfo::MethodRuntime::native_method(ctx);
 
     ProtoManager::push_prototype<Cls>(ctx);
 
     duk_push_c_function(ctx, method_func, sizeof...(Ts));
 
-    duk_push_pointer(ctx, new typename MethodInfo::MethodHolder{ method });
-    duk_put_prop_string(ctx, -2, "\xFF" "method_holder"); // consumes raw method pointer
-
-    // make sure we free the method_holder when this function is removed
-    duk_push_c_function(ctx, MethodInfo::MethodRuntime::finalize_method, 1);
-    duk_set_finalizer(ctx, -2);
+    DukglueHeapState::set_binding(ctx, -1, method);
 
     duk_put_prop_string(ctx, -2, name); // consumes method function
+    ProtoManager::member_added(ctx, -1, class_id<Cls>(), name);
 
     duk_pop(ctx); // pop prototype
 }
@@ -301,14 +326,31 @@ void dukglue_register_method_varargs(duk_context* ctx,
 
     duk_push_c_function(ctx, method_func, DUK_VARARGS);
 
-    duk_push_pointer(ctx, new typename MethodVariadicInfo::MethodHolderVariadic{ method });
-    duk_put_prop_string(ctx, -2, "\xFF" "method_holder");  // consumes raw method pointer
-
-    // make sure we free the method_holder when this function is removed
-    duk_push_c_function(ctx, MethodVariadicInfo::finalize_method, 1);
-    duk_set_finalizer(ctx, -2);
+    DukglueHeapState::set_binding(ctx, -1, method);
 
     duk_put_prop_string(ctx, -2, name); // consumes method function
+    ProtoManager::member_added(ctx, -1, class_id<Cls>(), name);
+
+    duk_pop(ctx); // pop prototype
+}
+
+// Register several overloads of a method under one name:
+//   dukglue_register_method_overloads(ctx, "resize", &Image::resizeTo, &Image::resizeBy);
+// Overloaded methods must be cast to the signature to register, e.g.
+//   static_cast<void(Image::*)(int, int)>(&Image::resize)
+// The overload to call is picked the same way as in dukglue_register_function_overloads.
+template<typename... Methods>
+void dukglue_register_method_overloads(duk_context* ctx, const char* name, Methods... methods)
+{
+    using namespace dukglue::detail;
+    typedef typename OverloadsClass<Methods...>::type Cls;
+    static_assert(!std::is_void<Cls>::value, "dukglue_register_method_overloads requires methods of the same class");
+
+    ProtoManager::push_prototype<Cls>(ctx);
+
+    push_overloads(ctx, name, methods...);
+    duk_put_prop_string(ctx, -2, name); // consumes dispatch function
+    ProtoManager::member_added(ctx, -1, class_id<Cls>(), name);
 
     duk_pop(ctx); // pop prototype
 }
@@ -318,6 +360,73 @@ inline void dukglue_invalidate_object(duk_context* ctx, void* obj_ptr)
     dukglue::detail::RefManager::find_and_invalidate_native_object(ctx, obj_ptr);
 }
 
+// Invalidation scopes, for freeing many native objects at once (a level, a document, ...).
+// Native objects registered while a scope is open (pushed to a script for the first time,
+// or constructed by a script) are tagged with it, and dukglue_invalidate_scope invalidates
+// all of them in one pass over the registry.
+// If scopes are nested, objects are tagged with the innermost one only.
+// Objects registered before the scope was opened keep their tag (or lack of one).
+inline duk_uint_t dukglue_open_scope(duk_context* ctx)
+{
+    dukglue::detail::DukglueHeapState* state = dukglue::detail::DukglueHeapState::require(ctx);
+    const duk_uint_t scope = state->next_scope++;
+    state->open_scopes.push_back(scope);
+    return scope;
+}
+
+// Stops tagging objects with scope. Objects already tagged can still be invalidated
+// with dukglue_invalidate_scope.
+inline void dukglue_close_scope(duk_context* ctx, duk_uint_t scope)
+{
+    std::vector<duk_uint_t>& open_scopes = dukglue::detail::DukglueHeapState::require(ctx)->open_scopes;
+    for (std::size_t i = open_scopes.size(); i > 0; i--) {
+        if (open_scopes[i - 1] == scope) {
+            open_scopes.erase(open_scopes.begin() + (i - 1));
+            break;
+        }
+    }
+}
+
+// Invalidates every object tagged with scope (as if dukglue_invalidate_object was called for each).
+// The scope stays open if it was. Returns the number of objects invalidated.
+inline std::size_t dukglue_invalidate_scope(duk_context* ctx, duk_uint_t scope)
+{
+    using namespace dukglue::detail;
+    return RefManager::invalidate_where(ctx,
+        [scope](const RefEntry& entry) { return entry.scope == scope; },
+        [](duk_context*) { return true; });
+}
+
+// Invalidates every registered object of type Cls, or of a type derived from it
+// (see dukglue_set_base_class). Returns the number of objects invalidated.
+template<typename Cls>
+std::size_t dukglue_invalidate_all(duk_context* ctx)
+{
+    using namespace dukglue::detail;
+    DukglueHeapState* state = DukglueHeapState::get(ctx);
+    if (state == nullptr)  // heap is being destroyed
+        return 0;
+
+    // registry entries know the class of their object's prototype, so the classes to invalidate
+    // are worked out once, and the objects picked without touching the Duktape heap
+    std::vector<bool> selected(state->type_infos.size(), false);
+    bool any = false;
+    for (std::size_t id = 0; id < selected.size(); id++) {
+        const TypeInfo* info = state->type_infos[id];
+        if (info != nullptr && info->can_cast<Cls>()) {
+            selected[id] = true;
+            any = true;
+        }
+    }
+
+    if (!any)
+        return 0;
+
+    return RefManager::invalidate_where(ctx,
+        [&selected](const RefEntry& entry) { return entry.cls < selected.size() && selected[entry.cls]; },
+        [](duk_context*) { return true; });
+}
+
 // register a deleter
 template<typename Cls>
 void dukglue_register_delete(duk_context* ctx)
@@ -327,6 +436,7 @@ void dukglue_register_delete(duk_context* ctx)
     dukglue::detail::ProtoManager::push_prototype<Cls>(ctx);
     duk_push_c_function(ctx, delete_func, 0);
     duk_put_prop_string(ctx, -2, "delete");
+    dukglue::detail::ProtoManager::member_added(ctx, -1, dukglue::detail::class_id<Cls>(), "delete");
     duk_pop(ctx);  // pop prototype
 }
 
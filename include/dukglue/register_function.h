@@ -3,6 +3,8 @@
 #define _REGISTER_FUNCTION_20240506_H 1
 
 #include "detail_function.h"
+#include "detail_callable.h"
+#include "detail_overloads.h"
 
 // Register a function, embedding the function address at compile time.
 // According to benchmarks, there's really not much reason to do this
@@ -15,24 +17,90 @@ void dukglue_register_function_compiletime(duk_context* ctx, RetType(*)(Ts...),
       "Mismatching function pointer template parameter and function pointer argument types. "
       "Try: dukglue_register_function<decltype(func), func>(ctx, \"funcName\", func)");
 
-   duk_c_function evalFunc = dukglue::detail::FuncInfoHolder<RetType, Ts...>::template FuncActual<Value>::call_native_function;
+   duk_c_function evalFunc = dukglue::detail::FuncInfoHolder<RetType, Ts...>::template FuncCompiletime<Value>::call_native_function;
 
    duk_push_c_function(ctx, evalFunc, sizeof...(Ts));
    duk_put_global_string(ctx, name);
 }
 
+#ifdef DUKGLUE_HAS_CPP17
+// Register a function, embedding the function address at compile time (requires C++17).
+// The function is called directly from the generated Duktape function, without looking up a
+// function pointer at run time:
+//   dukglue_register_function<&myFunc>(ctx, "myFunc");
+template<auto funcToCall>
+void dukglue_register_function(duk_context* ctx, const char* name)
+{
+   dukglue::detail::push_function_compiletime<funcToCall>(ctx, funcToCall);
+   duk_put_global_string(ctx, name);
+}
+#endif
+
 // Register a function.
 template<typename RetType, typename... Ts>
 void dukglue_register_function(duk_context* ctx, RetType(*funcToCall)(Ts...), const char* name)
 {
-   duk_c_function evalFunc = dukglue::detail::FuncInfoHolder<RetType, Ts...>::FuncRuntime::call_native_function;
+   duk_c_function evalFunc = dukglue::detail::FuncInfoHolder<RetType, Ts...>::FuncRuntime::native_function(ctx);
 
    duk_push_c_function(ctx, evalFunc, sizeof...(Ts));
 
-   static_assert(sizeof(RetType(*)(Ts...)) == sizeof(void*), "Function pointer and data pointer are different sizes");
-   duk_push_pointer(ctx, reinterpret_cast<void*>(funcToCall));
-   duk_put_prop_string(ctx, -2, "\xFF" "func_ptr");
+   dukglue::detail::DukglueHeapState::set_binding(ctx, -1, funcToCall);
+
+   duk_put_global_string(ctx, name);
+}
+
+// Register a function as a Duktape lightfunc.
+// Lightfuncs take almost no memory (no function object or property table), which helps
+// when registering many stateless helpers. In exchange, they can't have properties of their own
+// (fn.prototype, fn.name, ...), and up to 256 different functions per signature can be lightfuncs.
+// Functions that can't be lightfuncs (past that limit, or with more than 14 arguments)
+// are registered as normal functions.
+template<typename RetType, typename... Ts>
+void dukglue_register_lightfunc(duk_context* ctx, RetType(*funcToCall)(Ts...), const char* name)
+{
+   if (!dukglue::detail::FuncInfoHolder<RetType, Ts...>::FuncLightfunc::push(ctx, funcToCall)) {
+      dukglue_register_function(ctx, funcToCall, name);
+      return;
+   }
+
+   duk_put_global_string(ctx, name);
+}
+
+// Register a function with default values for its trailing arguments (see dukglue_defaults):
+//   dukglue_register_function(ctx, &greet, "greet", dukglue_defaults(1));
+template<typename RetType, typename... Ts, typename... Ds>
+void dukglue_register_function(duk_context* ctx, RetType(*funcToCall)(Ts...), const char* name, dukglue::detail::Defaults<Ds...> defaults)
+{
+   dukglue::detail::FuncInfoHolder<RetType, Ts...>::template FuncDefaultsRuntime<Ds...>::push(ctx, funcToCall, std::move(defaults));
+   duk_put_global_string(ctx, name);
+}
+
+// Register a lambda, functor or std::function.
+// The callable is moved into storage owned by the heap (no allocation per binding),
+// and lives until the heap is destroyed.
+// Its signature is taken from its operator(), so generic lambdas can't be registered.
+template<typename Callable, typename = typename std::enable_if<dukglue::detail::IsCallableObject<Callable>::value>::type>
+void dukglue_register_function(duk_context* ctx, Callable&& callable, const char* name)
+{
+   dukglue::detail::push_callable(ctx, std::forward<Callable>(callable));
+   duk_put_global_string(ctx, name);
+}
+
+template<typename Callable, typename... Ds, typename = typename std::enable_if<dukglue::detail::IsCallableObject<Callable>::value>::type>
+void dukglue_register_function(duk_context* ctx, Callable&& callable, const char* name, dukglue::detail::Defaults<Ds...> defaults)
+{
+   dukglue::detail::push_callable(ctx, std::forward<Callable>(callable), std::move(defaults));
+   duk_put_global_string(ctx, name);
+}
 
+// Register several overloads of a function under one name:
+//   dukglue_register_function_overloads(ctx, "area", &circleArea, &rectArea);
+// The overload to call is picked by the number of arguments, then by their types.
+// If several overloads take the same argument types, the first one registered wins.
+template<typename... Funcs>
+void dukglue_register_function_overloads(duk_context* ctx, const char* name, Funcs... funcs)
+{
+   dukglue::detail::push_overloads(ctx, name, funcs...);
    duk_put_global_string(ctx, name);
 }
 
@@ -46,13 +114,11 @@ void dukglue_register_function_ns(duk_context* ctx, RetType(*funcToCall)(Ts...),
       throw DukException() << ns << " is not an object";
    }
 
-   duk_c_function evalFunc = dukglue::detail::FuncInfoHolder<RetType, Ts...>::FuncRuntime::call_native_function;
+   duk_c_function evalFunc = dukglue::detail::FuncInfoHolder<RetType, Ts...>::FuncRuntime::native_function(ctx);
 
    duk_push_c_function(ctx, evalFunc, sizeof...(Ts));
 
-   static_assert(sizeof(RetType(*)(Ts...)) == sizeof(void*), "Function pointer and data pointer are different sizes");
-   duk_push_pointer(ctx, reinterpret_cast<void*>(funcToCall));
-   duk_put_prop_string(ctx, -2, "\xFF" "func_ptr");
+   dukglue::detail::DukglueHeapState::set_binding(ctx, -1, funcToCall);
 
    duk_put_prop_string(ctx, -2, name);
 
@@ -64,7 +130,7 @@ void dukglue_register_function_ns(duk_context* ctx, RetType(*funcToCall)(Ts...),
 template<typename RetType, typename... Ts>
 void dukglue_register_member_function(duk_context* ctx, RetType(*funcToCall)(Ts...), const char* ns, const char* functionName)
 {
-   duk_c_function evalFunc = dukglue::detail::FuncInfoHolder<RetType, Ts...>::FuncRuntime::call_native_function;
+   duk_c_function evalFunc = dukglue::detail::FuncInfoHolder<RetType, Ts...>::FuncRuntime::native_function(ctx);
 
    duk_get_global_string(ctx, ns); // [ object ]
    if (!duk_is_object(ctx, -1)) {
@@ -73,9 +139,7 @@ void dukglue_register_member_function(duk_context* ctx, RetType(*funcToCall)(Ts.
 
    duk_push_c_function(ctx, evalFunc, sizeof...(Ts)); // [ object func ]
 
-   static_assert(sizeof(RetType(*)(Ts...)) == sizeof(void*), "Function pointer and data pointer are different sizes");
-   duk_push_pointer(ctx, reinterpret_cast<void*>(funcToCall)); // [ object func void* ]
-   duk_put_prop_string(ctx, -2, "\xFF" "func_ptr"); // [ object func ]
+   dukglue::detail::DukglueHeapState::set_binding(ctx, -1, funcToCall); // [ object func ]
 
    duk_put_prop_string(ctx, -2, functionName);  // [ object ]
    duk_pop(ctx);
@@ -113,12 +113,7 @@ void dukglue_register_property(duk_context* ctx,
 
       duk_push_c_function(ctx, method_func, 0);
 
-      duk_push_pointer(ctx, new typename GetterMethodInfo::MethodHolder{ getter });
-      duk_put_prop_string(ctx, -2, "\xFF" "method_holder"); // consumes raw method pointer
-
-      // make sure we free the method_holder when this function is removed
-      duk_push_c_function(ctx, GetterMethodInfo::MethodRuntime::finalize_method, 1);
-      duk_set_finalizer(ctx, -2);
+      DukglueHeapState::set_binding(ctx, -1, getter);
    }
    else {
       duk_push_c_function(ctx, dukglue_throw_error, 1);
@@ -129,12 +124,7 @@ void dukglue_register_property(duk_context* ctx,
 
       duk_push_c_function(ctx, method_func, 1);
 
-      duk_push_pointer(ctx, new typename SetterMethodInfo::MethodHolder{ setter });
-      duk_put_prop_string(ctx, -2, "\xFF" "method_holder"); // consumes raw method pointer
-
-      // make sure we free the method_holder when this function is removed
-      duk_push_c_function(ctx, SetterMethodInfo::MethodRuntime::finalize_method, 1);
-      duk_set_finalizer(ctx, -2);
+      DukglueHeapState::set_binding(ctx, -1, setter);
    }
    else {
       duk_push_c_function(ctx, dukglue_throw_error, 1);
@@ -146,9 +136,60 @@ void dukglue_register_property(duk_context* ctx,
       | DUK_DEFPROP_FORCE /* allow overriding built-ins and previously defined properties */;
 
    duk_def_prop(ctx, -4, flags);
+   ProtoManager::member_added(ctx, -1, class_id<Cls>(), name);
    duk_pop(ctx);  // pop prototype
 }
 
+#ifdef DUKGLUE_HAS_CPP17
+namespace dukglue
+{
+   namespace detail
+   {
+      template<auto method>
+      void push_accessor_compiletime(duk_context* ctx)
+      {
+         if constexpr (std::is_same<decltype(method), std::nullptr_t>::value)
+            duk_push_c_function(ctx, dukglue_throw_error, 1);
+         else
+            push_method_compiletime<method>(ctx, method);
+      }
+   }
+}
+
+// Register a property, embedding the getter and setter at compile time (requires C++17).
+// Either may be nullptr:
+//   dukglue_register_property<&MyClass::getValue, &MyClass::setValue>(ctx, "value");
+//   dukglue_register_property<&MyClass::getValue, nullptr>(ctx, "readOnlyValue");
+template <auto getter, auto setter>
+void dukglue_register_property(duk_context* ctx, const char* name)
+{
+   using namespace dukglue::detail;
+   typedef typename MethodClass<decltype(getter)>::type GetterCls;
+   typedef typename MethodClass<decltype(setter)>::type SetterCls;
+   typedef typename std::conditional<std::is_void<GetterCls>::value, SetterCls, GetterCls>::type Cls;
+
+   static_assert(!std::is_void<Cls>::value, "Must have getter or setter");
+   static_assert(std::is_void<GetterCls>::value || std::is_void<SetterCls>::value || std::is_same<GetterCls, SetterCls>::value,
+      "Getter and setter must be methods of the same class");
+
+   ProtoManager::push_prototype<Cls>(ctx);
+
+   // push key
+   duk_push_string(ctx, name);
+
+   push_accessor_compiletime<getter>(ctx);
+   push_accessor_compiletime<setter>(ctx);
+
+   duk_uint_t flags = DUK_DEFPROP_HAVE_GETTER
+      | DUK_DEFPROP_HAVE_SETTER
+      | DUK_DEFPROP_HAVE_CONFIGURABLE /* set not configurable (from JS) */
+      | DUK_DEFPROP_FORCE /* allow overriding built-ins and previously defined properties */;
+
+   duk_def_prop(ctx, -4, flags);
+   ProtoManager::member_added(ctx, -1, class_id<Cls>(), name);
+   duk_pop(ctx);  // pop prototype
+}
+#endif
 
 template <typename Cls, typename U>
 void dukglue_register_property(duk_context* ctx, U Cls::* get_member, U Cls::* set_member, const char* name) {
@@ -169,12 +210,8 @@ void dukglue_register_property(duk_context* ctx, U Cls::* get_member, U Cls::* s
       duk_c_function method_func = GetSetInfo::MemberAccess::call_native_access; // get and set by offset
       duk_push_c_function(ctx, method_func, 0);
 
-      duk_push_pointer(ctx, new typename GetSetInfo::MemberOffset{ true, offset });
-      duk_put_prop_string(ctx, -2, "\xFF" "method_holder"); // consumes raw method pointer
-
-      // make sure we free the method_holder when this function is removed
-      duk_push_c_function(ctx, GetSetInfo::MemberAccess::finalize_method, 1);
-      duk_set_finalizer(ctx, -2);
+      const typename GetSetInfo::MemberOffset member_offset = { true, offset };
+      DukglueHeapState::set_binding(ctx, -1, member_offset);
    }
    else {
       duk_push_c_function(ctx, dukglue_throw_error, 1);
@@ -187,12 +224,8 @@ void dukglue_register_property(duk_context* ctx, U Cls::* get_member, U Cls::* s
 
       duk_push_c_function(ctx, method_func, 1);
 
-      duk_push_pointer(ctx, new typename GetSetInfo::MemberOffset{ false, offset });
-      duk_put_prop_string(ctx, -2, "\xFF" "method_holder"); // consumes raw method pointer
-
-      // make sure we free the method_holder when this function is removed
-      duk_push_c_function(ctx, GetSetInfo::MemberAccess::finalize_method, 1);
-      duk_set_finalizer(ctx, -2);
+      const typename GetSetInfo::MemberOffset member_offset = { false, offset };
+      DukglueHeapState::set_binding(ctx, -1, member_offset);
    }
    else {
       duk_push_c_function(ctx, dukglue_throw_error, 1);
@@ -204,6 +237,7 @@ void dukglue_register_property(duk_context* ctx, U Cls::* get_member, U Cls::* s
       | DUK_DEFPROP_FORCE /* allow overriding built-ins and previously defined properties */;
 
    duk_def_prop(ctx, -4, flags);
+   ProtoManager::member_added(ctx, -1, class_id<Cls>(), name);
    duk_pop(ctx);  // pop prototype
 }
 
@@ -7,6 +7,26 @@ void test_inheritance();
 void test_multiple_contexts();
 void test_properties();
 void test_dukvalue();
+void test_compiletime();
+void test_argument_copies();
+void test_callables();
+void test_overloads();
+void test_defaults();
+void test_trusted();
+void test_lightfunc();
+void test_ptr_map();
+void test_weak_refs();
+void test_bulk_invalidate();
+void test_ref_compaction();
+void test_shared_identity();
+void test_unique_ptr();
+void test_intrusive_ptr();
+void test_class_allocator();
+void test_heap_allocator();
+void test_prototypes();
+void test_multiple_inheritance();
+void test_class_ids();
+void test_binding_set();
 
 int main() {
 	test_framework();
@@ -16,6 +36,26 @@ int main() {
 	test_multiple_contexts();
 	test_properties();
 	test_dukvalue();
+	test_compiletime();
+	test_argument_copies();
+	test_callables();
+	test_overloads();
+	test_defaults();
+	test_trusted();
+	test_lightfunc();
+	test_ptr_map();
+	test_weak_refs();
+	test_bulk_invalidate();
+	test_ref_compaction();
+	test_shared_identity();
+	test_unique_ptr();
+	test_intrusive_ptr();
+	test_class_allocator();
+	test_heap_allocator();
+	test_prototypes();
+	test_multiple_inheritance();
+	test_class_ids();
+	test_binding_set();
 
 	std::cout << "All tests passed!" << std::endl;
 
@@ -0,0 +1,123 @@
+#include "test_assert.h"
+#include <dukglue/dukglue.h>
+
+#include <iostream>
+#include <string>
+
+// A value type that counts how often it is copied, to check that arguments
+// are moved through the call pipeline instead of being copied.
+struct Heavy {
+	static int copies;
+
+	Heavy() {}
+	explicit Heavy(const char* str) : value(str) {}
+	Heavy(const Heavy& other) : value(other.value) { copies++; }
+	Heavy(Heavy&& other) : value(std::move(other.value)) {}
+
+	Heavy& operator=(const Heavy& other) { value = other.value; copies++; return *this; }
+	Heavy& operator=(Heavy&& other) { value = std::move(other.value); return *this; }
+
+	std::string value;
+};
+
+int Heavy::copies = 0;
+
+namespace dukglue {
+	namespace types {
+		template<>
+		struct DukType<Heavy> {
+			typedef std::true_type IsValueType;
+
+			template<typename FullT>
+			static Heavy read(duk_context* ctx, duk_idx_t arg_idx) {
+				return Heavy(duk_require_string(ctx, arg_idx));
+			}
+
+			template<typename FullT>
+			static void push(duk_context* ctx, const Heavy& value) {
+				duk_push_string(ctx, value.value.c_str());
+			}
+		};
+	}
+}
+
+namespace {
+	std::string lastValue;
+
+	void takeByValue(Heavy h) {
+		lastValue = h.value;
+	}
+
+	void takeByConstRef(const Heavy& h) {
+		lastValue = h.value;
+	}
+
+	Heavy concat(Heavy a, const Heavy& b) {
+		Heavy result(std::move(a));
+		result.value += b.value;
+		return result;
+	}
+
+	class HeavyHolder {
+	public:
+		HeavyHolder(Heavy h) : mHeavy(std::move(h)) {}
+
+		void set(Heavy h) {
+			mHeavy = std::move(h);
+		}
+
+		std::string get() const {
+			return mHeavy.value;
+		}
+
+	private:
+		Heavy mHeavy;
+	};
+}
+
+void test_argument_copies()
+{
+	duk_context* ctx = duk_create_heap_default();
+
+	dukglue_register_function(ctx, &takeByValue, "takeByValue");
+	dukglue_register_function(ctx, &takeByConstRef, "takeByConstRef");
+	dukglue_register_function(ctx, &concat, "concat");
+
+	dukglue_register_constructor<HeavyHolder, Heavy>(ctx, "HeavyHolder");
+	dukglue_register_method(ctx, &HeavyHolder::set, "set");
+	dukglue_register_method(ctx, &HeavyHolder::get, "get");
+
+	Heavy::copies = 0;
+
+	test_eval(ctx, "takeByValue('by value')");
+	duk_pop(ctx);
+	test_assert(lastValue == "by value");
+
+	test_eval(ctx, "takeByConstRef('by const ref')");
+	duk_pop(ctx);
+	test_assert(lastValue == "by const ref");
+
+	test_eval_expect(ctx, "concat('con', 'cat')", "concat");
+
+	test_eval(ctx, "var holder = new HeavyHolder('constructed'); holder.set('set');");
+	duk_pop(ctx);
+	test_eval_expect(ctx, "holder.get()", "set");
+
+#ifdef DUKGLUE_HAS_CPP17
+	dukglue_register_function<&takeByValue>(ctx, "takeByValueCompiletime");
+	dukglue_register_method<&HeavyHolder::set>(ctx, "setCompiletime");
+
+	test_eval(ctx, "takeByValueCompiletime('compile time'); holder.setCompiletime('set at compile time');");
+	duk_pop(ctx);
+	test_assert(lastValue == "compile time");
+	test_eval_expect(ctx, "holder.get()", "set at compile time");
+#endif
+
+	// no argument (or return value) was copied along the way
+	test_assert(Heavy::copies == 0);
+
+	test_assert(duk_get_top(ctx) == 0);
+	duk_destroy_heap(ctx);
+
+	std::cout << "Argument copies tested OK" << std::endl;
+}
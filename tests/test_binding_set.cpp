@@ -0,0 +1,199 @@
+#include "test_assert.h"
+#include <dukglue/dukglue.h>
+
+#include <iostream>
+#include <string>
+
+namespace {
+	class Shape {
+	public:
+		Shape() : scale_(1) {}
+		virtual ~Shape() {}
+
+		virtual double area() const {
+			return 0;
+		}
+
+		int getScale() const {
+			return scale_;
+		}
+
+		void setScale(int scale) {
+			scale_ = scale;
+		}
+
+	private:
+		int scale_;
+	};
+
+	class Labeled {
+	public:
+		Labeled() : label_("square") {}
+		virtual ~Labeled() {}
+
+		std::string label() const {
+			return label_;
+		}
+
+	private:
+		std::string label_;
+	};
+
+	int squaresDeleted = 0;
+
+	// Labeled is at another address than the Square it is part of
+	class Square : public Shape, public Labeled {
+	public:
+		Square(double side) : side_(side) {}
+		~Square() {
+			squaresDeleted++;
+		}
+
+		virtual double area() const override {
+			return side_ * side_;
+		}
+
+	private:
+		double side_;
+	};
+
+	int twice(int x) {
+		return x * 2;
+	}
+
+	std::string readLabel(Labeled* labeled) {
+		return labeled->label();
+	}
+
+	int perHeap() {
+		return 7;
+	}
+
+	Square square(2);
+
+	Square* getSquare() {
+		return &square;
+	}
+
+	void record(dukglue::BindingSet& bindings) {
+		bindings.register_function(&twice, "twice");
+		bindings.register_function(&readLabel, "readLabel");
+
+		bindings.register_method(&Shape::area, "area");
+		bindings.register_property(&Shape::getScale, &Shape::setScale, "scale");
+		bindings.register_method(&Shape::getScale, "getScale");
+		bindings.register_method(&Labeled::label, "label");
+
+		bindings.register_constructor_managed<Square, double>("Square");
+		bindings.register_constructor<Shape>("Shape");
+		bindings.register_delete<Shape>();
+		bindings.register_delete<Square>();
+		bindings.set_base_class<Shape, Square>();
+		bindings.set_base_class<Labeled, Square>();
+		bindings.register_method(&Labeled::label, "tag");
+	}
+
+	template<typename Func>
+	bool throwsDukException(Func func) {
+		try {
+			func();
+		} catch (DukException&) {
+			return true;
+		}
+		return false;
+	}
+
+	void check(duk_context* ctx) {
+		test_eval_expect(ctx, "twice(21)", 42);
+		test_eval_expect(ctx, "var s = new Square(3); s.area()", 9);
+		test_eval_expect(ctx, "s.scale = 4; s.scale", 4);
+		test_eval_expect(ctx, "s.label() + ' ' + readLabel(s)", "square square");
+		test_eval_expect(ctx, "s.tag()", "square");
+		test_eval_expect_error(ctx, "readLabel(new Shape())");
+		test_eval_expect(ctx, "var p = new Shape(); p.delete(); 1", 1);
+		test_eval_expect_error(ctx, "p.area()");
+
+		// a script-owned (managed) object is freed once, by delete() instead of its finalizer
+		const int deleted = squaresDeleted;
+		test_eval_expect(ctx, "var q = new Square(2); q.delete(); 1", 1);
+		test_assert(squaresDeleted == deleted + 1);
+		test_eval_expect_error(ctx, "q.area()");
+		test_eval(ctx, "q = undefined");
+		duk_pop(ctx);
+		duk_gc(ctx, 0);
+		test_assert(squaresDeleted == deleted + 1);
+	}
+}
+
+void test_binding_set()
+{
+	duk_context* ctx1 = duk_create_heap_default();
+	duk_context* ctx2 = duk_create_heap_default();
+	duk_context* lazy1 = duk_create_heap_default();
+	duk_context* lazy2 = duk_create_heap_default();
+
+	{
+		dukglue::BindingSet bindings;
+		record(bindings);
+
+		// registrations can be mixed with the heap's own, before and after
+		dukglue_register_function(ctx1, &perHeap, "perHeap");
+		bindings.apply(ctx1);
+		bindings.apply(ctx2);
+		dukglue_register_function(ctx2, &perHeap, "perHeap");
+
+		// lazily applied, globals are stubs until read
+		bindings.apply_lazy(lazy1);
+		bindings.apply_lazy(lazy2);
+		test_eval_expect(lazy1, "typeof Object.getOwnPropertyDescriptor(this, 'twice').get", "function");
+		test_eval_expect(lazy1, "twice(4)", 8);
+		test_eval_expect(lazy1, "typeof Object.getOwnPropertyDescriptor(this, 'twice').value", "function");
+
+		// or assigned to
+		test_eval_expect(lazy1, "Shape = 5; Shape", 5);
+		test_eval_expect(lazy1, "Object.getOwnPropertyDescriptor(this, 'Shape').writable ? 1 : 0", 1);
+
+		// prototypes get their members (and their base classes') when first needed: by native objects,
+		dukglue_register_function(lazy2, &getSquare, "getSquare");
+		test_eval_expect(lazy2, "var q = getSquare(); q.area() + ' ' + q.label()", "4 square");
+
+		// and by the heap's own registrations, which go on top
+		dukglue_register_method(lazy2, &Shape::area, "getScale");
+		test_eval_expect(lazy2, "new Square(3).getScale()", 9);
+		test_assert(duk_get_top(lazy2) == 0);
+
+		// the set is fixed once applied, and a heap only takes one
+		test_assert(throwsDukException([&]() { bindings.register_function(&twice, "again"); }));
+		test_assert(throwsDukException([&]() { bindings.apply(ctx1); }));
+
+		// and its classes get base classes from it only
+		test_assert(throwsDukException([&]() { dukglue_set_base_class<Shape, Square>(ctx1); }));
+		test_assert(duk_get_top(ctx1) == 0);
+
+		// a heap that already has a prototype for one of its classes is left alone
+		duk_context* ctx3 = duk_create_heap_default();
+		dukglue_register_method(ctx3, &Labeled::label, "label");
+		test_assert(throwsDukException([&]() { bindings.apply(ctx3); }));
+		test_eval_expect_error(ctx3, "twice(1)");
+		duk_destroy_heap(ctx3);
+	}
+
+	// heaps keep working after the set is gone
+	check(ctx1);
+	check(ctx2);
+	test_eval_expect(ctx1, "perHeap()", 7);
+	test_eval_expect(ctx2, "perHeap()", 7);
+	test_eval_expect(lazy1, "twice(21) + new Square(1).area()", 43);
+
+	// lazy heaps behave the same otherwise
+	check(lazy2);
+
+	test_assert(duk_get_top(ctx1) == 0);
+	test_assert(duk_get_top(ctx2) == 0);
+	duk_destroy_heap(ctx1);
+	duk_destroy_heap(ctx2);
+	duk_destroy_heap(lazy1);
+	duk_destroy_heap(lazy2);
+
+	std::cout << "Binding sets tested OK" << std::endl;
+}
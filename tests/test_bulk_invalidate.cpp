@@ -0,0 +1,169 @@
+#include "test_assert.h"
+#include <dukglue/dukglue.h>
+
+#include <iostream>
+#include <vector>
+
+namespace {
+	class Tile {
+	public:
+		Tile(int id) : mId(id) {}
+		virtual ~Tile() {}
+
+		int id() const {
+			return mId;
+		}
+
+	private:
+		int mId;
+	};
+
+	class Door : public Tile {
+	public:
+		Door(int id) : Tile(id) {}
+	};
+
+	class Window : public Tile {
+	public:
+		Window(int id) : Tile(id) {}
+	};
+
+	class Sound {
+	public:
+		int volume() const {
+			return 11;
+		}
+	};
+
+	std::vector<Tile*> tiles;
+	Door door(100);
+	Window window(101);
+	Sound sound;
+
+	Tile* getTile(int i) {
+		return tiles[i];
+	}
+
+	Door* getDoor() {
+		return &door;
+	}
+
+	Window* getWindow() {
+		return &window;
+	}
+
+	Sound* getSound() {
+		return &sound;
+	}
+
+	std::size_t registered(duk_context* ctx) {
+		return dukglue::detail::DukglueHeapState::get(ctx)->ref_map.size();
+	}
+}
+
+void test_bulk_invalidate()
+{
+	for (int i = 0; i < 100; i++)
+		tiles.push_back(new Tile(i));
+
+	duk_context* ctx = duk_create_heap_default();
+
+	dukglue_register_constructor<Tile, int>(ctx, "Tile");
+	dukglue_register_method(ctx, &Tile::id, "id");
+	dukglue_set_base_class<Tile, Door>(ctx);
+	dukglue_register_method(ctx, &Sound::volume, "volume");
+	dukglue_register_function(ctx, &getTile, "getTile");
+	dukglue_register_function(ctx, &getDoor, "getDoor");
+	dukglue_register_function(ctx, &getSound, "getSound");
+	dukglue_register_function(ctx, &getWindow, "getWindow");
+
+	// objects registered before the scope are not tagged
+	test_eval(ctx, "var before = getTile(0);");
+	duk_pop(ctx);
+
+	duk_uint_t level = dukglue_open_scope(ctx);
+	test_eval(ctx, "var inLevel = []; for (var i = 1; i < 50; i++) inLevel.push(getTile(i));"
+		"var before2 = getTile(0); var made = new Tile(-1);");
+	duk_pop(ctx);
+
+	// nested scopes tag objects with the innermost scope
+	duk_uint_t room = dukglue_open_scope(ctx);
+	test_assert(room != level);
+	test_eval(ctx, "var inRoom = getTile(50);");
+	duk_pop(ctx);
+	dukglue_close_scope(ctx, room);
+
+	test_eval(ctx, "var afterRoom = getTile(51);");
+	duk_pop(ctx);
+	dukglue_close_scope(ctx, level);
+
+	test_eval(ctx, "var after = getTile(52);");
+	duk_pop(ctx);
+	test_assert(registered(ctx) == 54);
+
+	test_assert(dukglue_invalidate_scope(ctx, level) == 51);
+	test_assert(registered(ctx) == 3);
+	test_eval_expect_error(ctx, "inLevel[0].id()");
+	test_eval_expect_error(ctx, "inLevel[48].id()");
+	test_eval_expect_error(ctx, "made.id()");
+	test_eval_expect_error(ctx, "afterRoom.id()");
+	test_eval_expect(ctx, "before.id()", 0);
+	test_eval_expect(ctx, "inRoom.id()", 50);
+	test_eval_expect(ctx, "after.id()", 52);
+
+	// pushing again makes a new script object
+	test_eval_expect(ctx, "getTile(1) !== inLevel[0] ? 1 : 0", 1);
+	test_eval_expect(ctx, "getTile(1).id()", 1);
+
+	// invalidating again does nothing
+	test_assert(dukglue_invalidate_scope(ctx, level) == 0);
+	test_assert(dukglue_invalidate_scope(ctx, room) == 1);
+	test_eval_expect_error(ctx, "inRoom.id()");
+
+	// freed slots in the ref array are reused
+	test_eval(ctx, "for (var i = 2; i < 100; i++) getTile(i);");
+	duk_pop(ctx);
+	test_eval_expect(ctx, "getTile(99).id()", 99);
+
+	// by type (including derived types)
+	test_eval(ctx, "var d = getDoor(); var s = getSound();");
+	duk_pop(ctx);
+	test_assert(registered(ctx) == 102);
+	test_assert(dukglue_invalidate_all<Door>(ctx) == 1);
+	test_eval_expect_error(ctx, "d.id()");
+	test_eval(ctx, "d = getDoor();");
+	duk_pop(ctx);
+	test_assert(dukglue_invalidate_all<Tile>(ctx) == 101);
+	test_assert(registered(ctx) == 1);
+	test_eval_expect_error(ctx, "d.id()");
+	test_eval_expect_error(ctx, "before.id()");
+	test_eval_expect(ctx, "s.volume()", 11);
+
+	// and base classes set after the objects were pushed
+	test_eval(ctx, "var win = getWindow();");
+	duk_pop(ctx);
+	dukglue_set_base_class<Tile, Window>(ctx);
+	test_eval_expect(ctx, "win.id()", 101);
+	test_assert(dukglue_invalidate_all<Tile>(ctx) == 1);
+	test_eval_expect_error(ctx, "win.id()");
+
+	// weak refs are invalidated too
+	dukglue_set_weak_refs(ctx, true);
+	duk_uint_t weak = dukglue_open_scope(ctx);
+	test_eval(ctx, "var w = getTile(5), w2 = getTile(6);");
+	duk_pop(ctx);
+	dukglue_close_scope(ctx, weak);
+	test_assert(dukglue_invalidate_scope(ctx, weak) == 2);
+	test_eval_expect_error(ctx, "w.id()");
+	duk_gc(ctx, 0);
+	test_assert(registered(ctx) == 1);
+
+	test_assert(duk_get_top(ctx) == 0);
+	duk_destroy_heap(ctx);
+
+	for (Tile* tile : tiles)
+		delete tile;
+	tiles.clear();
+
+	std::cout << "Bulk invalidation tested OK" << std::endl;
+}
@@ -0,0 +1,99 @@
+#include "test_assert.h"
+#include <dukglue/dukglue.h>
+
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+
+namespace {
+	class Service {
+	public:
+		Service() : mCalls(0) {}
+
+		int lookup(int id) {
+			mCalls++;
+			return id * 100;
+		}
+
+		int calls() const {
+			return mCalls;
+		}
+
+	private:
+		int mCalls;
+	};
+
+	struct Multiplier {
+		int factor;
+
+		int operator()(int v) const {
+			return v * factor;
+		}
+	};
+}
+
+void test_callables()
+{
+	duk_context* ctx = duk_create_heap_default();
+
+	// lambda with a capture
+	Service service;
+	dukglue_register_function(ctx, [&service](int id) { return service.lookup(id); }, "lookup");
+	test_eval_expect(ctx, "lookup(3)", 300);
+	test_eval_expect_error(ctx, "lookup('three')");
+	test_assert(service.calls() == 1);
+
+	// many closures that only differ by what they capture
+	for (int i = 0; i < 200; i++) {
+		std::string name = "getId" + std::to_string(i);
+		dukglue_register_function(ctx, [i]() { return i; }, name.c_str());
+	}
+	test_eval_expect(ctx, "getId0() + getId7() + getId199()", 206);
+
+	// void return
+	int sideEffect = 0;
+	dukglue_register_function(ctx, [&sideEffect](int v, int w) { sideEffect = v + w; }, "setSideEffect");
+	test_eval(ctx, "setSideEffect(20, 22)");
+	duk_pop(ctx);
+	test_assert(sideEffect == 42);
+
+	// mutable lambda keeps its state between calls
+	int count = 0;
+	dukglue_register_function(ctx, [count]() mutable { return ++count; }, "nextCount");
+	test_eval_expect(ctx, "nextCount(); nextCount(); nextCount()", 3);
+	test_assert(count == 0);
+
+	// functor
+	Multiplier triple = { 3 };
+	dukglue_register_function(ctx, triple, "triple");
+	test_eval_expect(ctx, "triple(5)", 15);
+
+	// std::function
+	std::function<std::string(std::string)> shout = [](std::string s) { return s + "!"; };
+	dukglue_register_function(ctx, shout, "shout");
+	test_eval_expect(ctx, "shout('hey')", "hey!");
+
+	// captures are destroyed with the heap
+	std::shared_ptr<int> captured = std::make_shared<int>(7);
+	dukglue_register_function(ctx, [captured]() { return *captured; }, "getCaptured");
+	test_eval_expect(ctx, "getCaptured()", 7);
+	test_assert(captured.use_count() == 2);
+
+	// same lambda type, registered in two heaps
+	duk_context* ctx2 = duk_create_heap_default();
+	for (int i = 0; i < 2; i++) {
+		duk_context* heap = (i == 0 ? ctx : ctx2);
+		dukglue_register_function(heap, [i]() { return i; }, "heapIndex");
+	}
+	test_eval_expect(ctx, "heapIndex()", 0);
+	test_eval_expect(ctx2, "heapIndex()", 1);
+	duk_destroy_heap(ctx2);
+
+	test_assert(duk_get_top(ctx) == 0);
+	duk_destroy_heap(ctx);
+
+	test_assert(captured.use_count() == 1);
+
+	std::cout << "Callables tested OK" << std::endl;
+}
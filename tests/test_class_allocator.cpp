@@ -0,0 +1,264 @@
+#include "test_assert.h"
+#include <dukglue/dukglue.h>
+
+#include <condition_variable>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace {
+	class Vec2 {
+	public:
+		Vec2(double x, double y) : mX(x), mY(y) {
+			sAlive++;
+		}
+
+		~Vec2() {
+			sAlive--;
+		}
+
+		double x() const {
+			return mX;
+		}
+
+		double y() const {
+			return mY;
+		}
+
+		static int alive() {
+			return sAlive;
+		}
+
+	private:
+		double mX, mY;
+		static int sAlive;
+	};
+
+	int Vec2::sAlive = 0;
+
+	// too large for the slab pool
+	class Matrix {
+	public:
+		Matrix(int n) {
+			mCells[0] = n;
+		}
+
+		int first() const {
+			return static_cast<int>(mCells[0]);
+		}
+
+	private:
+		double mCells[64];
+	};
+
+	class Color {
+	public:
+		Color(int rgb) : mRgb(rgb) {}
+
+		int rgb() const {
+			return mRgb;
+		}
+
+	private:
+		int mRgb;
+	};
+
+	// counts what goes through it
+	struct CountingAllocator {
+		static const bool uses_new = false;
+
+		static void* allocate() {
+			allocated++;
+			return ::operator new(sizeof(Color));
+		}
+
+		static void deallocate(void* ptr) {
+			freed++;
+			::operator delete(ptr);
+		}
+
+		static int allocated;
+		static int freed;
+	};
+
+	int CountingAllocator::allocated = 0;
+	int CountingAllocator::freed = 0;
+
+	void take(std::unique_ptr<Vec2>) {
+	}
+}
+
+template<>
+struct dukglue_class_allocator<Color> : CountingAllocator {};
+
+void test_class_allocator()
+{
+	using namespace dukglue::detail;
+
+	// slab pool: freed blocks are reused, per size class
+	{
+		void* a = SlabPool::allocate(24);
+		void* b = SlabPool::allocate(24);
+		test_assert(a != b);
+		SlabPool::deallocate(a, 24);
+		test_assert(SlabPool::allocate(32) == a);  // same size class (17..32 bytes)
+		void* c = SlabPool::allocate(48);
+		test_assert(c != a && c != b);
+		SlabPool::deallocate(a, 32);
+		SlabPool::deallocate(b, 24);
+		SlabPool::deallocate(c, 48);
+
+		void* large = SlabPool::allocate(SlabPool::MAX_SIZE + 1);
+		SlabPool::deallocate(large, SlabPool::MAX_SIZE + 1);
+	}
+
+	// threads give their free blocks back when they exit, so other threads reuse them
+	{
+		auto work = []() {
+			void* blocks[64];
+			for (void*& block : blocks)
+				block = SlabPool::allocate(200);
+			for (void* block : blocks)
+				SlabPool::deallocate(block, 200);
+		};
+		std::thread(work).join();
+		const std::size_t bytes = SlabPool::chunk_bytes();
+		for (int i = 0; i < 4; i++)
+			std::thread(work).join();
+		test_assert(SlabPool::chunk_bytes() == bytes);
+	}
+
+	// a thread that frees blocks another thread keeps allocating hands them back while both run
+	{
+		std::mutex mutex;
+		std::condition_variable changed;
+		std::vector<void*> batch;
+		bool done = false;
+
+		std::thread consumer([&]() {
+			std::unique_lock<std::mutex> lock(mutex);
+			while (!done) {
+				changed.wait(lock, [&]() { return !batch.empty() || done; });
+				for (void* block : batch)
+					SlabPool::deallocate(block, 200);
+				batch.clear();
+				changed.notify_all();
+			}
+		});
+
+		std::size_t bytes = 0;
+		for (int round = 0; round < 200; round++) {
+			if (round == 20)
+				bytes = SlabPool::chunk_bytes();
+
+			std::vector<void*> blocks;
+			for (int i = 0; i < 64; i++)
+				blocks.push_back(SlabPool::allocate(200));
+
+			std::unique_lock<std::mutex> lock(mutex);
+			batch.swap(blocks);
+			changed.notify_all();
+			changed.wait(lock, [&]() { return batch.empty(); });
+		}
+		test_assert(SlabPool::chunk_bytes() == bytes);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			done = true;
+		}
+		changed.notify_all();
+		consumer.join();
+	}
+
+	// objects can be destroyed on another thread than the one that created them
+	{
+		const ClassAllocStats before = dukglue_get_class_alloc_stats<Vec2>();
+		Vec2* made = nullptr;
+		std::thread([&made]() {
+			made = ClassAllocation<Vec2>::create([](void* memory) { return new (memory) Vec2(1, 2); });
+		}).join();
+		test_assert(dukglue_get_class_alloc_stats<Vec2>().live() == before.live() + 1);
+		ClassAllocation<Vec2>::destroy(made);
+		test_assert(dukglue_get_class_alloc_stats<Vec2>().live() == before.live());
+	}
+
+	// default allocators
+	test_assert(!dukglue_class_allocator<Vec2>::uses_new);
+	test_assert(dukglue_class_allocator<Matrix>::uses_new);
+
+	duk_context* ctx = duk_create_heap_default();
+
+	dukglue_register_constructor_managed<Vec2, double, double>(ctx, "Vec2");
+	dukglue_register_method(ctx, &Vec2::x, "x");
+	dukglue_register_method(ctx, &Vec2::y, "y");
+	dukglue_register_constructor_managed<Matrix, int>(ctx, "Matrix");
+	dukglue_register_method(ctx, &Matrix::first, "first");
+	dukglue_register_constructor_managed<Color, int>(ctx, "Color");
+	dukglue_register_method(ctx, &Color::rgb, "rgb");
+	dukglue_register_delete<Color>(ctx);
+	dukglue_register_function(ctx, &take, "take");
+
+	// managed objects are constructed in allocator memory, and destroyed by their finalizer
+	const ClassAllocStats before = dukglue_get_class_alloc_stats<Vec2>();
+	test_eval_expect(ctx, "var sum = 0; for (var i = 0; i < 100; i++) { var v = new Vec2(i, 1); sum += v.y(); } sum", 100);
+	test_eval(ctx, "v = null;");
+	duk_pop(ctx);
+	duk_gc(ctx, 0);
+
+	const ClassAllocStats after = dukglue_get_class_alloc_stats<Vec2>();
+	test_assert(after.allocations - before.allocations == 100);
+	test_assert(after.live() == before.live());
+	test_assert(Vec2::alive() == 0);
+
+	// objects from an allocator that doesn't use new can't be given up as unique_ptrs
+	test_eval_expect_error(ctx, "take(new Vec2(1, 2))");
+
+	// large classes fall back to new
+	test_eval_expect(ctx, "new Matrix(3).first()", 3);
+
+	// custom allocators
+	test_eval_expect(ctx, "var c = new Color(255); c.rgb()", 255);
+	test_assert(CountingAllocator::allocated == 1 && CountingAllocator::freed == 0);
+	test_eval(ctx, "c = null;");
+	duk_pop(ctx);
+	test_assert(CountingAllocator::freed == 1);
+	test_assert(dukglue_get_class_alloc_stats<Color>().live() == 0);
+
+	// a throwing constructor gives its memory back
+	test_assert(CountingAllocator::allocated == 1);
+	try {
+		ClassAllocation<Color>::create([](void*) -> Color* { throw std::runtime_error("nope"); });
+		test_assert(false);
+	}
+	catch (const std::runtime_error&) {
+	}
+	test_assert(CountingAllocator::allocated == 2 && CountingAllocator::freed == 2);
+	test_assert(dukglue_get_class_alloc_stats<Color>().allocations == 1);
+
+	// deleting a managed object gives its memory back to the allocator, once
+	test_eval(ctx, "var d = new Color(1); d.delete();");
+	duk_pop(ctx);
+	test_assert(CountingAllocator::allocated == 3 && CountingAllocator::freed == 3);
+	test_assert(dukglue_get_class_alloc_stats<Color>().live() == 0);
+	test_eval_expect_error(ctx, "d.rgb()");
+	test_eval_expect_error(ctx, "d.delete()");
+	test_eval(ctx, "d = null;");
+	duk_pop(ctx);
+	duk_gc(ctx, 0);
+	test_assert(CountingAllocator::freed == 3);
+
+	// objects still alive are destroyed with the heap
+	test_eval(ctx, "var kept = new Vec2(1, 2);");
+	duk_pop(ctx);
+	test_assert(Vec2::alive() == 1);
+
+	test_assert(duk_get_top(ctx) == 0);
+	duk_destroy_heap(ctx);
+	test_assert(Vec2::alive() == 0);
+	test_assert(dukglue_get_class_alloc_stats<Vec2>().live() == 0);
+
+	std::cout << "Class allocator tested OK" << std::endl;
+}
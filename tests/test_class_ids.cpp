@@ -0,0 +1,110 @@
+#include "test_assert.h"
+#include <dukglue/dukglue.h>
+
+#include <iostream>
+#include <string>
+
+namespace {
+	// classes that report their run-time class (see dukglue_class_id), so RTTI isn't needed
+	class Animal {
+	public:
+		virtual ~Animal() {}
+
+		virtual dukglue::class_id_t dukglue_dynamic_class() const {
+			return dukglue_class_id<Animal>();
+		}
+
+		std::string name() const {
+			return "animal";
+		}
+	};
+
+	class Dog : public Animal {
+	public:
+		virtual dukglue::class_id_t dukglue_dynamic_class() const override {
+			return dukglue_class_id<Dog>();
+		}
+
+		std::string bark() const {
+			return "woof";
+		}
+	};
+
+	class Tagged {
+	public:
+		Tagged() : tag_(5) {}
+		virtual ~Tagged() {}
+
+		virtual dukglue::class_id_t dukglue_dynamic_class() const = 0;
+
+		int tag() const {
+			return tag_;
+		}
+
+	private:
+		int tag_;
+	};
+
+	// Tagged is at another address than the Puppy it is part of
+	class Puppy : public Dog, public Tagged {
+	public:
+		virtual dukglue::class_id_t dukglue_dynamic_class() const override {
+			return dukglue_class_id<Puppy>();
+		}
+	};
+
+	Dog dog;
+	Puppy puppy;
+
+	Animal* getDogAsAnimal() {
+		return &dog;
+	}
+
+	Tagged* getPuppyAsTagged() {
+		return &puppy;
+	}
+
+	int readTag(Tagged* tagged) {
+		return tagged->tag();
+	}
+}
+
+void test_class_ids()
+{
+	// IDs are dense, fixed, and the same for const classes
+	test_assert(dukglue_class_id<Animal>() != dukglue_class_id<Dog>());
+	test_assert(dukglue_class_id<Dog>() == dukglue_class_id<Dog>());
+	test_assert(dukglue_class_id<const Dog>() == dukglue_class_id<Dog>());
+
+	duk_context* ctx = duk_create_heap_default();
+
+	dukglue_register_method(ctx, &Animal::name, "name");
+	dukglue_register_method(ctx, &Dog::bark, "bark");
+	dukglue_register_method(ctx, &Tagged::tag, "tag");
+	dukglue_set_base_class<Animal, Dog>(ctx);
+	dukglue_set_base_class<Dog, Puppy>(ctx);
+	dukglue_set_base_class<Tagged, Puppy>(ctx);
+
+	dukglue_register_function(ctx, &getDogAsAnimal, "getDogAsAnimal");
+	dukglue_register_function(ctx, &getPuppyAsTagged, "getPuppyAsTagged");
+	dukglue_register_function(ctx, &readTag, "readTag");
+
+	// pushed as a base class, objects get the prototype of their run-time class
+	test_eval_expect(ctx, "var d = getDogAsAnimal(); d.bark() + ' ' + d.name()", "woof animal");
+
+	// also when the base class is at another address
+	test_eval_expect(ctx, "var p = getPuppyAsTagged(); p.bark() + ' ' + p.tag()", "woof 5");
+	test_eval_expect(ctx, "readTag(p)", 5);
+
+	{
+		test_eval(ctx, "d");
+		DukValue value = DukValue::take_from_stack(ctx);
+		test_assert(value.is_class<Dog>());
+		test_assert(!value.is_class<Animal>());
+	}
+
+	test_assert(duk_get_top(ctx) == 0);
+	duk_destroy_heap(ctx);
+
+	std::cout << "Class ids tested OK" << std::endl;
+}
@@ -0,0 +1,92 @@
+#include "test_assert.h"
+#include <dukglue/dukglue.h>
+
+#include <iostream>
+
+namespace {
+	int square(int v) {
+		return v * v;
+	}
+
+	int record_value = 0;
+
+	void record(int v) {
+		record_value = v;
+	}
+
+	class Accumulator {
+	public:
+		Accumulator() : mTotal(0) {}
+
+		void add(int v) {
+			mTotal += v;
+		}
+
+		int getTotal() const {
+			return mTotal;
+		}
+
+		void setTotal(int v) {
+			mTotal = v;
+		}
+
+		int getTotalNonConst() {
+			return mTotal;
+		}
+
+	private:
+		int mTotal;
+	};
+}
+
+void test_compiletime()
+{
+	duk_context* ctx = duk_create_heap_default();
+
+	// pre-C++17 spelling
+	dukglue_register_function_compiletime<decltype(square), square>(ctx, square, "squareOld");
+	test_eval_expect(ctx, "squareOld(7)", 49);
+
+	dukglue_register_constructor<Accumulator>(ctx, "Accumulator");
+	dukglue_register_method_compiletime<decltype(&Accumulator::add), &Accumulator::add>(ctx, &Accumulator::add, "addOld");
+	test_eval(ctx, "var acc = new Accumulator(); acc.addOld(2);");
+	duk_pop(ctx);
+
+#ifdef DUKGLUE_HAS_CPP17
+	dukglue_register_function<&square>(ctx, "square");
+	test_eval_expect(ctx, "square(5)", 25);
+	test_eval_expect_error(ctx, "square('five')");
+
+	dukglue_register_function<&record>(ctx, "record");
+	test_eval(ctx, "record(12)");
+	duk_pop(ctx);
+	test_assert(record_value == 12);
+
+	dukglue_register_method<&Accumulator::add>(ctx, "add");
+	dukglue_register_method<&Accumulator::getTotal>(ctx, "getTotal");
+	test_eval(ctx, "acc.add(3); acc.add(4);");
+	duk_pop(ctx);
+	test_eval_expect(ctx, "acc.getTotal()", 9);
+	test_eval_expect_error(ctx, "Accumulator.prototype.add.call({}, 1)");
+
+	dukglue_register_property<&Accumulator::getTotal, &Accumulator::setTotal>(ctx, "total");
+	test_eval(ctx, "acc.total = 40");
+	duk_pop(ctx);
+	test_eval_expect(ctx, "acc.total", 40);
+
+	dukglue_register_property<&Accumulator::getTotalNonConst, nullptr>(ctx, "readOnlyTotal");
+	test_eval_expect(ctx, "acc.readOnlyTotal", 40);
+	test_eval_expect_error(ctx, "acc.readOnlyTotal = 1");
+
+	dukglue_register_property<nullptr, &Accumulator::setTotal>(ctx, "writeOnlyTotal");
+	test_eval(ctx, "acc.writeOnlyTotal = 5");
+	duk_pop(ctx);
+	test_eval_expect(ctx, "acc.total", 5);
+	test_eval_expect_error(ctx, "acc.writeOnlyTotal");
+#endif
+
+	test_assert(duk_get_top(ctx) == 0);
+	duk_destroy_heap(ctx);
+
+	std::cout << "Compile-time bindings tested OK" << std::endl;
+}
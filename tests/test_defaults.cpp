@@ -0,0 +1,107 @@
+#include "test_assert.h"
+#include <dukglue/dukglue.h>
+
+#include <iostream>
+#include <string>
+
+namespace {
+	std::string greet(std::string name, int times, std::string punctuation) {
+		std::string result;
+		for (int i = 0; i < times; i++)
+			result += "hi " + name + punctuation;
+		return result;
+	}
+
+	class Dog {
+	public:
+		Dog() : mBarks(0) {}
+
+		int bark(int times, Dog* other) {
+			mBarks += times;
+			if (other != nullptr)
+				other->mBarks += times;
+			return mBarks;
+		}
+
+		int barks() const {
+			return mBarks;
+		}
+
+		int barksTimes(int scale) const {
+			return mBarks * scale;
+		}
+
+	private:
+		int mBarks;
+	};
+
+#ifdef DUKGLUE_HAS_CPP17
+	std::string describe(int id, std::optional<std::string> label, std::optional<int> weight) {
+		std::string result = std::to_string(id);
+		if (label)
+			result += " " + *label;
+		if (weight)
+			result += " " + std::to_string(*weight);
+		return result;
+	}
+
+	std::optional<int> half(int v) {
+		if (v % 2 != 0)
+			return std::nullopt;
+		return v / 2;
+	}
+#endif
+}
+
+void test_defaults()
+{
+	duk_context* ctx = duk_create_heap_default();
+
+	// functions
+	dukglue_register_function(ctx, &greet, "greet", dukglue_defaults(1, "!"));
+	test_eval_expect(ctx, "greet('bob', 2, '?')", "hi bob?hi bob?");
+	test_eval_expect(ctx, "greet('bob', 2)", "hi bob!hi bob!");
+	test_eval_expect(ctx, "greet('bob')", "hi bob!");
+	test_eval_expect(ctx, "greet('bob', undefined, '.')", "hi bob.");
+	test_eval_expect_error(ctx, "greet()");  // no default for name
+	test_eval_expect_error(ctx, "greet('bob', null)");  // null is not omitted
+
+	// defaults for every argument
+	dukglue_register_function(ctx, &greet, "greetAnyone", dukglue_defaults(std::string("you"), 1, std::string(".")));
+	test_eval_expect(ctx, "greetAnyone()", "hi you.");
+
+	// methods
+	dukglue_register_constructor<Dog>(ctx, "Dog");
+	dukglue_register_method(ctx, &Dog::bark, "bark", dukglue_defaults(1, nullptr));
+	dukglue_register_method(ctx, &Dog::barksTimes, "barksTimes", dukglue_defaults(10));
+	test_eval_expect(ctx, "var rex = new Dog(); rex.bark()", 1);
+	test_eval_expect(ctx, "rex.bark(2)", 3);
+	test_eval_expect(ctx, "var fido = new Dog(); rex.bark(1, fido); fido.barksTimes()", 10);
+	test_eval_expect(ctx, "rex.barksTimes(2)", 8);
+	test_eval_expect_error(ctx, "Dog.prototype.bark.call({})");
+
+	// lambdas
+	int base = 100;
+	dukglue_register_function(ctx, [base](int a, int b) { return base + a + b; }, "addToBase", dukglue_defaults(0));
+	test_eval_expect(ctx, "addToBase(1)", 101);
+	test_eval_expect(ctx, "addToBase(1, 2)", 103);
+
+#ifdef DUKGLUE_HAS_CPP17
+	// std::optional
+	dukglue_register_function(ctx, &describe, "describe");
+	test_eval_expect(ctx, "describe(1)", "1");
+	test_eval_expect(ctx, "describe(1, 'big')", "1 big");
+	test_eval_expect(ctx, "describe(1, 'big', 30)", "1 big 30");
+	test_eval_expect(ctx, "describe(1, undefined, 30)", "1 30");
+	test_eval_expect_error(ctx, "describe(1, 5)");
+
+	dukglue_register_function(ctx, &half, "half");
+	test_eval_expect(ctx, "half(4)", 2);
+	test_eval_expect(ctx, "half(3) === undefined ? 1 : 0", 1);
+#endif
+
+	test_assert(duk_get_top(ctx) == 0);
+	duk_destroy_heap(ctx);
+
+	std::cout << "Default arguments tested OK" << std::endl;
+}
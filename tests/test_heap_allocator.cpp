@@ -0,0 +1,82 @@
+#include "test_assert.h"
+#include <dukglue/dukglue.h>
+
+#include <iostream>
+
+namespace {
+	class Counter {
+	public:
+		Counter() : mCount(0) {}
+
+		void add(int n) {
+			mCount += n;
+		}
+
+		int count() const {
+			return mCount;
+		}
+
+	private:
+		int mCount;
+	};
+
+	void run_workload(duk_context* ctx) {
+		dukglue_register_constructor_managed<Counter>(ctx, "Counter");
+		dukglue_register_method(ctx, &Counter::add, "add");
+		dukglue_register_method(ctx, &Counter::count, "count");
+
+		// small objects and strings
+		test_eval_expect(ctx,
+			"var total = 0;"
+			"for (var i = 0; i < 2000; i++) { var c = new Counter(); c.add(i % 3); total += c.count(); }"
+			"total", 1999);
+		test_eval_expect(ctx, "var s = ''; for (var i = 0; i < 500; i++) s += 'ab' + i; s.length", 2390);
+
+		// arrays growing from small to large blocks (reallocs across size classes)
+		test_eval_expect(ctx, "var a = []; for (var i = 0; i < 10000; i++) a.push({ v: i }); a[9999].v", 9999);
+		test_eval_expect(ctx, "a.length = 10; a.length", 10);
+		test_eval_expect(ctx, "JSON.stringify(JSON.parse('[1,2,{\"x\":[3]}]'))", "[1,2,{\"x\":[3]}]");
+	}
+}
+
+void test_heap_allocator()
+{
+	// heaps not created by dukglue have no counters
+	{
+		duk_context* ctx = duk_create_heap_default();
+		test_assert(dukglue_get_heap_alloc_stats(ctx).allocations == 0);
+		dukglue_destroy_heap(ctx);
+	}
+
+	for (int mode = 0; mode < 4; mode++) {
+		DukglueHeapOptions options;
+		options.size_class_pools = (mode & 1) != 0;
+		options.arena = (mode & 2) != 0;
+
+		duk_context* ctx = dukglue_create_heap(options);
+		test_assert(ctx != nullptr);
+
+		const dukglue::detail::HeapAllocStats initial = dukglue_get_heap_alloc_stats(ctx);
+		test_assert(initial.allocations > 0 && initial.bytes > 0);
+
+		run_workload(ctx);
+
+		const dukglue::detail::HeapAllocStats used = dukglue_get_heap_alloc_stats(ctx);
+		test_assert(used.peak_bytes >= used.bytes);
+		test_assert(used.peak_bytes > initial.bytes);
+		test_assert(used.reserved >= used.bytes);
+
+		// freeing the workload's garbage lowers the byte count, not the peak
+		test_eval(ctx, "a = null; s = null;");
+		duk_pop(ctx);
+		duk_gc(ctx, 0);
+		const dukglue::detail::HeapAllocStats collected = dukglue_get_heap_alloc_stats(ctx);
+		test_assert(collected.bytes < used.bytes);
+		test_assert(collected.peak_bytes == used.peak_bytes);
+
+		test_assert(duk_get_top(ctx) == 0);
+		dukglue_destroy_heap(ctx);
+	}
+
+	std::cout << "Heap allocator tested OK" << std::endl;
+}
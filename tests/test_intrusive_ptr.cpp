@@ -0,0 +1,174 @@
+#include "test_assert.h"
+#include <dukglue/dukglue.h>
+
+#include <iostream>
+
+namespace {
+	class RefCounted {
+	public:
+		RefCounted() : mRefs(0) {
+			sAlive++;
+		}
+
+		virtual ~RefCounted() {
+			sAlive--;
+		}
+
+		void AddRef() {
+			mRefs++;
+		}
+
+		void Release() {
+			if (--mRefs == 0)
+				delete this;
+		}
+
+		int refs() const {
+			return mRefs;
+		}
+
+		static int alive() {
+			return sAlive;
+		}
+
+	private:
+		int mRefs;
+		static int sAlive;
+	};
+
+	int RefCounted::sAlive = 0;
+
+	class Mesh : public RefCounted {
+	public:
+		Mesh(int vertices) : mVertices(vertices) {}
+
+		int vertices() const {
+			return mVertices;
+		}
+
+	private:
+		int mVertices;
+	};
+
+	class Plain {
+	public:
+		int value() const {
+			return 1;
+		}
+	};
+}
+
+namespace dukglue {
+	template<typename T>
+	struct intrusive_ptr_traits<T, typename std::enable_if<std::is_base_of<RefCounted, T>::value>::type> {
+		static void add_ref(T* obj) {
+			obj->AddRef();
+		}
+
+		static void release(T* obj) {
+			obj->Release();
+		}
+	};
+}
+
+static_assert(dukglue::detail::HasIntrusivePtrTraits<Mesh>::value, "Mesh is intrusively refcounted");
+static_assert(!dukglue::detail::HasIntrusivePtrTraits<Plain>::value, "Plain is not");
+
+namespace {
+	Mesh* held = nullptr;
+
+	Mesh* getHeld() {
+		return held;
+	}
+
+	// nobody else holds a reference
+	Mesh* createMesh(int vertices) {
+		return new Mesh(vertices);
+	}
+
+	int refsOf(Mesh* mesh) {
+		return mesh->refs();
+	}
+
+	Plain plain;
+
+	Plain* getPlain() {
+		return &plain;
+	}
+
+	void collect(duk_context* ctx) {
+		duk_gc(ctx, 0);
+		duk_gc(ctx, 0);
+	}
+}
+
+void test_intrusive_ptr()
+{
+	duk_context* ctx = duk_create_heap_default();
+
+	dukglue_register_method(ctx, &Mesh::vertices, "vertices");
+	dukglue_register_method(ctx, &Plain::value, "value");
+	dukglue_register_function(ctx, &getHeld, "getHeld");
+	dukglue_register_function(ctx, &createMesh, "createMesh");
+	dukglue_register_function(ctx, &refsOf, "refsOf");
+	dukglue_register_function(ctx, &getPlain, "getPlain");
+
+	held = new Mesh(3);
+	held->AddRef();
+
+	// the script object holds one reference, however often the object is pushed
+	test_eval_expect(ctx, "var m = getHeld(); m.tag = 'x'; getHeld() === m ? 1 : 0", 1);
+	test_eval_expect(ctx, "getHeld().tag", "x");
+	test_assert(held->refs() == 2);
+	test_eval_expect(ctx, "refsOf(m)", 2);
+
+	// released once the script object is collected
+	test_eval(ctx, "m = null;");
+	duk_pop(ctx);
+	collect(ctx);
+	test_assert(held->refs() == 1);
+
+	// and the next push makes a new script object
+	test_eval_expect(ctx, "getHeld().tag === undefined ? 1 : 0", 1);
+	collect(ctx);
+	test_assert(held->refs() == 1);
+
+	// objects nobody else holds are kept alive by their script object
+	const int before = RefCounted::alive();
+	test_eval_expect(ctx, "var c = createMesh(8); c.vertices()", 8);
+	test_assert(RefCounted::alive() == before + 1);
+	test_eval(ctx, "c = null;");
+	duk_pop(ctx);
+	collect(ctx);
+	test_assert(RefCounted::alive() == before);
+
+	// invalidating the script object doesn't leak the reference
+	test_eval(ctx, "var v = getHeld();");
+	duk_pop(ctx);
+	test_assert(held->refs() == 2);
+	dukglue_invalidate_object(ctx, held);
+	test_eval_expect_error(ctx, "v.vertices()");
+	test_eval(ctx, "v = null;");
+	duk_pop(ctx);
+	collect(ctx);
+	test_assert(held->refs() == 1);
+
+	// classes without the traits are pushed as before
+	test_eval_expect(ctx, "getPlain() === getPlain() ? 1 : 0", 1);
+
+	// script objects still alive when the heap is destroyed release their references
+	test_eval(ctx, "var kept = getHeld(); var made = createMesh(1);");
+	duk_pop(ctx);
+	test_assert(held->refs() == 2);
+
+	test_assert(duk_get_top(ctx) == 0);
+	duk_destroy_heap(ctx);
+	test_assert(held->refs() == 1);
+	test_assert(RefCounted::alive() == 1);
+
+	held->Release();
+	held = nullptr;
+	test_assert(RefCounted::alive() == 0);
+
+	std::cout << "intrusive_ptr_traits tested OK" << std::endl;
+}
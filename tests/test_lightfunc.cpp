@@ -0,0 +1,86 @@
+#include "test_assert.h"
+#include <dukglue/dukglue.h>
+
+#include <iostream>
+#include <string>
+
+namespace {
+	int add(int a, int b) {
+		return a + b;
+	}
+
+	std::string shout(std::string s) {
+		return s + "!";
+	}
+
+	int calls = 0;
+
+	void touch() {
+		calls++;
+	}
+
+	template<int N>
+	int constant() {
+		return N;
+	}
+
+	// registers constant<Begin>() ... constant<End - 1>() as lightfuncs named "c<N>"
+	template<int Begin, int End>
+	struct RegisterConstants {
+		static void apply(duk_context* ctx) {
+			std::string name = "c" + std::to_string(Begin);
+			dukglue_register_lightfunc(ctx, &constant<Begin>, name.c_str());
+			RegisterConstants<Begin + 1, End>::apply(ctx);
+		}
+	};
+
+	template<int End>
+	struct RegisterConstants<End, End> {
+		static void apply(duk_context*) {}
+	};
+
+	bool is_lightfunc(duk_context* ctx, const char* name) {
+		duk_get_global_string(ctx, name);
+		bool result = (duk_is_lightfunc(ctx, -1) != 0);
+		duk_pop(ctx);
+		return result;
+	}
+}
+
+void test_lightfunc()
+{
+	duk_context* ctx = duk_create_heap_default();
+
+	dukglue_register_lightfunc(ctx, &add, "add");
+	dukglue_register_lightfunc(ctx, &shout, "shout");
+	dukglue_register_lightfunc(ctx, &touch, "touch");
+	test_assert(is_lightfunc(ctx, "add"));
+
+	test_eval_expect(ctx, "add(40, 2)", 42);
+	test_eval_expect(ctx, "shout('hey')", "hey!");
+	test_eval(ctx, "touch(); touch();");
+	duk_pop(ctx);
+	test_assert(calls == 2);
+	test_eval_expect(ctx, "typeof add", "function");
+	test_eval_expect(ctx, "add.length", 2);
+	test_eval_expect_error(ctx, "add('forty', 2)");
+
+	// past 256 functions with the same signature, functions are registered normally
+	RegisterConstants<0, 300>::apply(ctx);
+	test_assert(is_lightfunc(ctx, "c0"));
+	test_assert(is_lightfunc(ctx, "c255"));
+	test_assert(!is_lightfunc(ctx, "c256"));
+	test_eval_expect(ctx, "c0() + c127() + c128() + c255() + c256() + c299()", 0 + 127 + 128 + 255 + 256 + 299);
+
+	// the table is shared between heaps
+	duk_context* ctx2 = duk_create_heap_default();
+	dukglue_register_lightfunc(ctx2, &constant<200>, "c200");
+	test_assert(is_lightfunc(ctx2, "c200"));
+	test_eval_expect(ctx2, "c200()", 200);
+	duk_destroy_heap(ctx2);
+
+	test_assert(duk_get_top(ctx) == 0);
+	duk_destroy_heap(ctx);
+
+	std::cout << "Lightfuncs tested OK" << std::endl;
+}
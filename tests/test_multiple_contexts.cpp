@@ -7,6 +7,14 @@ const char* getNonsense() {
 	return "desu";
 }
 
+int getOne() {
+	return 1;
+}
+
+int getTwo() {
+	return 2;
+}
+
 class A {
 public:
 	int getMeaningOfLife() {
@@ -55,6 +63,40 @@ void test_multiple_contexts() {
 	test_eval_expect_error(ctx1, "test.getMeaningOfLife()");
 	test_eval_expect_error(ctx2, "test.getMeaningOfLife()");
 
+	// bindings are stored per heap, so the same functions registered in a
+	// different order must still call the right native function in each heap
+	dukglue_register_function(ctx1, getOne, "getOne");
+	dukglue_register_function(ctx1, getTwo, "getTwo");
+	dukglue_register_function(ctx2, getTwo, "getTwo");
+	dukglue_register_function(ctx2, getOne, "getOne");
+	test_eval_expect(ctx1, "getOne() * 10 + getTwo()", 12);
+	test_eval_expect(ctx2, "getOne() * 10 + getTwo()", 12);
+
+	// registering a function again reuses its binding slot, and bindings that don't fit in the slots
+	// (there are 65535 per heap) are kept by their functions instead
+	{
+		duk_context* ctx = duk_create_heap_default();
+		for (int i = 0; i < 70000; i++)
+			dukglue_register_function(ctx, getTwo, "getTwo");
+		for (int i = 0; i < 70000; i++)
+			dukglue_register_function(ctx, [i]() { return i; }, i == 0 ? "first" : "last");
+
+		test_eval_expect(ctx, "getTwo() + ' ' + first() + ' ' + last()", "2 0 69999");
+		duk_destroy_heap(ctx);
+	}
+
+	// the memory of a Duktape thread freed in one heap can be reused for a thread in another, which
+	// mustn't find the first heap's bindings (even if a script replaced the thread's finalizer)
+	for (int i = 0; i < 20; i++) {
+		test_eval(ctx1, "var t = new Duktape.Thread(function() { getOne(); }); Duktape.Thread.resume(t); Duktape.fin(t, function() {}); t = undefined;");
+		duk_pop(ctx1);
+		duk_gc(ctx1, 0);
+
+		duk_push_thread(ctx2);
+		test_eval_expect(duk_get_context(ctx2, -1), "getOne() * 10 + getTwo()", 12);
+		duk_pop(ctx2);
+	}
+
 	test_assert(duk_get_top(ctx1) == 0);
 	test_assert(duk_get_top(ctx2) == 0);
 	duk_destroy_heap(ctx1);
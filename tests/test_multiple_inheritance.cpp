@@ -0,0 +1,247 @@
+#include "test_assert.h"
+#include <dukglue/dukglue.h>
+
+#include <iostream>
+#include <memory>
+#include <string>
+
+namespace {
+	class Named {
+	public:
+		Named(const std::string& name) : name_(name) {}
+		virtual ~Named() {}
+
+		std::string name() const {
+			return name_;
+		}
+
+	private:
+		std::string name_;
+	};
+
+	class Counted {
+	public:
+		Counted(int count) : count_(count) {}
+		virtual ~Counted() {}
+
+		int count() const {
+			return count_;
+		}
+
+		int doubled() const {
+			return count_ * 2;
+		}
+
+	private:
+		int count_;
+	};
+
+	// Counted is at another address than the Widget it is part of
+	class Widget : public Named, public Counted {
+	public:
+		Widget(const std::string& name, int count, int size) : Named(name), Counted(count), size_(size) {}
+
+		int size() const {
+			return size_;
+		}
+
+	private:
+		int size_;
+	};
+
+	int readCount(Counted* counted) {
+		return counted->count();
+	}
+
+	std::string readName(Named* named) {
+		return named->name();
+	}
+
+	Widget widget("w", 7, 3);
+	Named plain("plain");
+
+	Widget* getWidget() {
+		return &widget;
+	}
+
+	Counted* getWidgetAsCounted() {
+		return &widget;
+	}
+
+	Named* getPlain() {
+		return &plain;
+	}
+
+	int sharedCount(std::shared_ptr<Counted> counted) {
+		return counted->count();
+	}
+
+	std::shared_ptr<Widget> makeSharedWidget(int count) {
+		return std::make_shared<Widget>("shared", count, 0);
+	}
+
+	// a diamond with a virtual base class
+	class Root {
+	public:
+		Root() : id_(42) {}
+		virtual ~Root() {}
+
+		int id() const {
+			return id_;
+		}
+
+	private:
+		int id_;
+	};
+
+	class Left : public virtual Root {
+	public:
+		int left() const {
+			return 1;
+		}
+	};
+
+	class Right : public virtual Root {
+	public:
+		int right() const {
+			return 2;
+		}
+	};
+
+	class Diamond : public Left, public Right {
+	};
+
+	Diamond diamond;
+
+	Diamond* getDiamond() {
+		return &diamond;
+	}
+
+	int readId(Root* root) {
+		return root->id();
+	}
+
+	// for setting up base classes in any order
+	struct Top {
+		int top;
+		Top() : top(1) {}
+	};
+
+	struct Pad {
+		double pad;
+		Pad() : pad(0) {}
+	};
+
+	struct Wide {
+		double wide[2];
+		Wide() : wide() {}
+	};
+
+	struct Middle : Pad, Top {};
+
+	struct Bottom : Wide, Middle {};
+
+	Bottom bottom;
+
+	Bottom* getBottom() {
+		return &bottom;
+	}
+
+	int readTop(Top* top) {
+		return top->top;
+	}
+}
+
+void test_multiple_inheritance()
+{
+	duk_context* ctx = duk_create_heap_default();
+
+	dukglue_register_method(ctx, &Named::name, "name");
+	dukglue_register_method(ctx, &Counted::count, "count");
+	dukglue_register_method(ctx, &Widget::size, "size");
+	dukglue_set_base_class<Named, Widget>(ctx);
+	dukglue_set_base_class<Counted, Widget>(ctx);
+
+	dukglue_register_function(ctx, &getWidget, "getWidget");
+	dukglue_register_function(ctx, &getWidgetAsCounted, "getWidgetAsCounted");
+	dukglue_register_function(ctx, &getPlain, "getPlain");
+	dukglue_register_function(ctx, &readCount, "readCount");
+	dukglue_register_function(ctx, &readName, "readName");
+
+	// methods of both base classes, called on the derived class
+	test_eval_expect(ctx, "var w = getWidget(); w.name()", "w");
+	test_eval_expect(ctx, "w.count()", 7);
+	test_eval_expect(ctx, "w.size()", 3);
+
+	// members registered on the second base class afterwards reach the derived class too
+	dukglue_register_method(ctx, &Counted::doubled, "doubled");
+	dukglue_register_property(ctx, &Counted::count, nullptr, "counted");
+	test_eval_expect(ctx, "w.doubled() + w.counted", 21);
+
+	// without going through anything scripts can change
+	test_eval(ctx, "Object.defineProperty = function(o, k) { o[k] = function() { return 'hijacked'; }; };"
+		"Object.prototype.countAgain = function() { return 'hijacked'; };");
+	duk_pop(ctx);
+	dukglue_register_method(ctx, &Counted::count, "countAgain");
+	dukglue_register_property(ctx, &Counted::count, nullptr, "countedAgain");
+	test_eval_expect(ctx, "w.countAgain() + w.countedAgain", 14);
+	test_eval_expect(ctx, "typeof Object.getOwnPropertyDescriptor(Object.getPrototypeOf(w), 'countedAgain').get", "function");
+
+	// arguments are cast to the base class they are read as
+	test_eval_expect(ctx, "readCount(w)", 7);
+	test_eval_expect(ctx, "readName(w)", "w");
+	test_eval_expect_error(ctx, "readCount(getPlain())");
+
+#ifndef DUKGLUE_NO_RTTI
+	// pushed as the second base class, the object still gets the derived class' prototype
+	// (without RTTI, that needs dukglue_dynamic_class, see test_class_ids)
+	test_eval_expect(ctx, "var c = getWidgetAsCounted(); c.size()", 3);
+	test_eval_expect(ctx, "c.name() + c.count() + readCount(c)", "w77");
+
+	// and is invalidated with the pointer it was pushed as
+	dukglue_invalidate_object(ctx, getWidgetAsCounted());
+	test_eval_expect_error(ctx, "c.count()");
+	test_eval_expect(ctx, "w.count()", 7);
+#endif
+
+	// shared_ptrs of the derived class are read as shared_ptrs of a base class
+	dukglue_register_function(ctx, &sharedCount, "sharedCount");
+	dukglue_register_function(ctx, &makeSharedWidget, "makeSharedWidget");
+	test_eval_expect(ctx, "sharedCount(makeSharedWidget(5))", 5);
+
+	// so are DukValues
+	{
+		test_eval(ctx, "w");
+		DukValue value = DukValue::take_from_stack(ctx);
+		test_assert(value.as_object_pointer<Counted>()->count() == 7);
+		test_assert(value.as_object_pointer<Widget>() == &widget);
+	}
+
+	// virtual base classes
+	dukglue_register_method(ctx, &Root::id, "id");
+	dukglue_register_method(ctx, &Left::left, "left");
+	dukglue_register_method(ctx, &Right::right, "right");
+	dukglue_set_base_class<Root, Left>(ctx);
+	dukglue_set_base_class<Root, Right>(ctx);
+	dukglue_set_base_class<Left, Diamond>(ctx);
+	dukglue_set_base_class<Right, Diamond>(ctx);
+
+	dukglue_register_function(ctx, &getDiamond, "getDiamond");
+	dukglue_register_function(ctx, &readId, "readId");
+	test_eval_expect(ctx, "var d = getDiamond(); d.left() + d.right()", 3);
+	test_eval_expect(ctx, "d.id()", 42);
+	test_eval_expect(ctx, "readId(d)", 42);
+
+	// base classes set up from the bottom: ancestors added later still reach derived classes
+	dukglue_register_function(ctx, &getBottom, "getBottom");
+	dukglue_register_function(ctx, &readTop, "readTop");
+	dukglue_set_base_class<Middle, Bottom>(ctx);
+	test_eval_expect_error(ctx, "readTop(getBottom())");
+	dukglue_set_base_class<Top, Middle>(ctx);
+	test_eval_expect(ctx, "readTop(getBottom())", 1);
+
+	test_assert(duk_get_top(ctx) == 0);
+	duk_destroy_heap(ctx);
+
+	std::cout << "Multiple inheritance tested OK" << std::endl;
+}
@@ -0,0 +1,146 @@
+#include "test_assert.h"
+#include <dukglue/dukglue.h>
+
+#include <iostream>
+#include <string>
+
+namespace {
+	class Square {
+	public:
+		Square(int side) : mSide(side) {}
+
+		int side() const {
+			return mSide;
+		}
+
+	private:
+		int mSide;
+	};
+
+	class Circle {
+	public:
+		Circle(int radius) : mRadius(radius) {}
+
+		int radius() const {
+			return mRadius;
+		}
+
+	private:
+		int mRadius;
+	};
+
+	int describe() {
+		return 0;
+	}
+
+	int describeInt(int v) {
+		return v + 1;
+	}
+
+	std::string describeString(std::string s) {
+		return "string " + s;
+	}
+
+	std::string describeBool(bool b) {
+		return b ? "yes" : "no";
+	}
+
+	int describeSum(int a, int b) {
+		return a + b;
+	}
+
+	std::string describeRepeat(std::string s, int times) {
+		std::string result;
+		for (int i = 0; i < times; i++)
+			result += s;
+		return result;
+	}
+
+	std::string describeSquare(Square* square) {
+		return square ? "square " + std::to_string(square->side()) : "null square";
+	}
+
+	std::string describeCircle(Circle* circle) {
+		return "circle " + std::to_string(circle->radius());
+	}
+
+	class Canvas {
+	public:
+		Canvas() : mWidth(0), mHeight(0) {}
+
+		void resizeTo(int width, int height) {
+			mWidth = width;
+			mHeight = height;
+		}
+
+		void resizeSquare(int size) {
+			resizeTo(size, size);
+		}
+
+		void resize(const Canvas* other) {
+			resizeTo(other->mWidth, other->mHeight);
+		}
+
+		int area() const {
+			return mWidth * mHeight;
+		}
+
+		int scaledArea(int scale) const {
+			return area() * scale;
+		}
+
+	private:
+		int mWidth;
+		int mHeight;
+	};
+}
+
+void test_overloads()
+{
+	duk_context* ctx = duk_create_heap_default();
+
+	// picked by number of arguments
+	dukglue_register_function_overloads(ctx, "describe", &describe, &describeInt, &describeSum);
+	test_eval_expect(ctx, "describe()", 0);
+	test_eval_expect(ctx, "describe(41)", 42);
+	test_eval_expect(ctx, "describe(40, 2)", 42);
+	test_eval_expect(ctx, "describe(40, 2, 'ignored')", 42);  // extra arguments are ignored
+
+	// picked by argument type
+	dukglue_register_function_overloads(ctx, "describeValue", &describeInt, &describeString, &describeBool, &describeSum, &describeRepeat);
+	test_eval_expect(ctx, "describeValue(1)", 2);
+	test_eval_expect(ctx, "describeValue('x')", "string x");
+	test_eval_expect(ctx, "describeValue(true)", "yes");
+	test_eval_expect(ctx, "describeValue(1, 2)", 3);
+	test_eval_expect(ctx, "describeValue('ab', 3)", "ababab");
+	test_eval_expect_error(ctx, "describeValue()");
+	test_eval_expect_error(ctx, "describeValue({})");
+	test_eval_expect_error(ctx, "describeValue(1, 'x')");
+
+	// native objects with the same type mask need a full check
+	dukglue_register_constructor<Square, int>(ctx, "Square");
+	dukglue_register_constructor<Circle, int>(ctx, "Circle");
+	dukglue_register_function_overloads(ctx, "describeShape", &describeSquare, &describeCircle, &describeString);
+	test_eval_expect(ctx, "describeShape(new Square(2))", "square 2");
+	test_eval_expect(ctx, "describeShape(new Circle(3))", "circle 3");
+	test_eval_expect(ctx, "describeShape('x')", "string x");
+	test_eval_expect(ctx, "describeShape(null)", "null square");
+	test_eval_expect_error(ctx, "describeShape({})");
+	test_eval_expect_error(ctx, "describeShape(5)");
+
+	// methods
+	dukglue_register_constructor<Canvas>(ctx, "Canvas");
+	dukglue_register_method_overloads(ctx, "resize", &Canvas::resizeSquare, &Canvas::resizeTo, &Canvas::resize);
+	dukglue_register_method_overloads(ctx, "area", &Canvas::area, &Canvas::scaledArea);
+	test_eval_expect(ctx, "var c = new Canvas(); c.resize(3); c.area()", 9);
+	test_eval_expect(ctx, "c.resize(2, 5); c.area(2)", 20);
+	test_eval_expect(ctx, "var d = new Canvas(); d.resize(c); d.area()", 10);
+	test_eval_expect_error(ctx, "c.resize('big')");
+	test_eval_expect_error(ctx, "c.resize(new Square(1))");
+	test_eval_expect_error(ctx, "Canvas.prototype.area.call({})");
+
+	test_assert(duk_get_top(ctx) == 0);
+	duk_destroy_heap(ctx);
+
+	std::cout << "Overloads tested OK" << std::endl;
+}
@@ -0,0 +1,69 @@
+#include "test_assert.h"
+#include <dukglue/dukglue.h>
+
+#include <iostream>
+#include <string>
+
+namespace {
+	template<int N>
+	class Tagged {
+	public:
+		int tag() const {
+			return N;
+		}
+	};
+
+	template<int N>
+	Tagged<N>* getTagged() {
+		static Tagged<N> obj;
+		return &obj;
+	}
+
+	template<int N>
+	int readTag(Tagged<N>* obj) {
+		return obj->tag();
+	}
+
+	// registers Tagged<0..N> with a method, a getter and a reader each
+	template<int N>
+	struct RegisterTagged {
+		static void run(duk_context* ctx) {
+			RegisterTagged<N - 1>::run(ctx);
+
+			const std::string n = std::to_string(N);
+			dukglue_register_method(ctx, &Tagged<N>::tag, "tag");
+			dukglue_register_function(ctx, &getTagged<N>, ("get" + n).c_str());
+			dukglue_register_function(ctx, &readTag<N>, ("read" + n).c_str());
+		}
+	};
+
+	template<>
+	struct RegisterTagged<-1> {
+		static void run(duk_context*) {}
+	};
+}
+
+void test_prototypes()
+{
+	duk_context* ctx = duk_create_heap_default();
+
+	RegisterTagged<63>::run(ctx);
+
+	// every class gets its own prototype, found again on every push
+	test_eval_expect(ctx, "var ok = 0; for (var i = 0; i < 64; i++) ok += (this['get' + i]().tag() === i); ok", 64);
+	test_eval_expect(ctx, "Object.getPrototypeOf(get5()) === Object.getPrototypeOf(get5()) ? 1 : 0", 1);
+	test_eval_expect(ctx, "Object.getPrototypeOf(get5()) !== Object.getPrototypeOf(get6()) ? 1 : 0", 1);
+
+	// and type checks still tell them apart
+	test_eval_expect(ctx, "read42(get42())", 42);
+	test_eval_expect_error(ctx, "read42(get41())");
+
+	// prototypes stay pinned across garbage collections
+	duk_gc(ctx, 0);
+	test_eval_expect(ctx, "get63().tag()", 63);
+
+	test_assert(duk_get_top(ctx) == 0);
+	duk_destroy_heap(ctx);
+
+	std::cout << "Prototype registry tested OK" << std::endl;
+}
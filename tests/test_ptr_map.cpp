@@ -0,0 +1,106 @@
+#include "test_assert.h"
+#include <dukglue/dukglue.h>
+
+#include <iostream>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+	class Node {
+	public:
+		Node(int id) : mId(id) {}
+
+		int id() const {
+			return mId;
+		}
+
+	private:
+		int mId;
+	};
+
+	std::vector<Node*> nodes;
+
+	Node* getNode(int i) {
+		return nodes[i];
+	}
+}
+
+void test_ptr_map()
+{
+	// random inserts/updates/erases, checked against std::unordered_map
+	{
+		dukglue::detail::PtrMap<duk_uarridx_t> map;
+		std::unordered_map<void*, duk_uarridx_t> expected;
+
+		// pointers with a few different alignments, so some of them collide
+		std::vector<char> storage(64 * 1024);
+		std::mt19937 rng(1234);
+		std::uniform_int_distribution<int> pick(1, static_cast<int>(storage.size()) - 1);
+
+		for (int i = 0; i < 200000; i++) {
+			void* key = &storage[pick(rng) & ~(i % 3 == 0 ? 0 : 7)];
+			if (key == &storage[0])
+				continue;
+
+			switch (rng() % 3) {
+			case 0:
+			case 1:
+				map.set(key, static_cast<duk_uarridx_t>(i));
+				expected[key] = static_cast<duk_uarridx_t>(i);
+				break;
+			case 2:
+				test_assert(map.erase(key) == (expected.erase(key) == 1));
+				break;
+			}
+
+			if (i % 1000 == 0) {
+				test_assert(map.size() == expected.size());
+				for (const auto& kv : expected) {
+					const duk_uarridx_t* value = map.find(kv.first);
+					test_assert(value != nullptr && *value == kv.second);
+				}
+			}
+		}
+
+		for (const auto& kv : expected)
+			test_assert(map.erase(kv.first));
+		test_assert(map.size() == 0);
+		test_assert(map.find(&storage[8]) == nullptr);
+	}
+
+	// lots of registered native objects
+	{
+		duk_context* ctx = duk_create_heap_default();
+
+		dukglue_register_method(ctx, &Node::id, "id");
+		dukglue_register_function(ctx, &getNode, "getNode");
+
+		const int count = 5000;
+		for (int i = 0; i < count; i++)
+			nodes.push_back(new Node(i));
+
+		test_eval_expect(ctx, "var all = []; for (var i = 0; i < 5000; i++) all.push(getNode(i)); all[1234].id()", 1234);
+		test_eval_expect(ctx, "getNode(4321) === all[4321] ? 1 : 0", 1);
+
+		// invalidate every other object, then check the rest are still found
+		for (int i = 0; i < count; i += 2)
+			dukglue_invalidate_object(ctx, nodes[i]);
+
+		test_eval_expect(ctx, "var ok = 1; for (var i = 1; i < 5000; i += 2) if (getNode(i) !== all[i]) ok = 0; ok", 1);
+		test_eval_expect_error(ctx, "all[0].id()");
+		test_eval_expect(ctx, "getNode(0) !== all[0] ? 1 : 0", 1);  // re-registered as a new object
+
+		test_eval(ctx, "all = null;");
+		duk_pop(ctx);
+
+		test_assert(duk_get_top(ctx) == 0);
+		duk_destroy_heap(ctx);
+
+		for (Node* node : nodes)
+			delete node;
+		nodes.clear();
+	}
+
+	std::cout << "PtrMap tested OK" << std::endl;
+}
@@ -0,0 +1,136 @@
+#include "test_assert.h"
+#include <dukglue/dukglue.h>
+
+#include <iostream>
+#include <vector>
+
+namespace {
+	class Crate {
+	public:
+		Crate(int id) : mId(id) {}
+
+		int id() const {
+			return mId;
+		}
+
+	private:
+		int mId;
+	};
+
+	std::vector<Crate*> crates;
+
+	Crate* getCrate(int i) {
+		return crates[i];
+	}
+
+	DukValue make_object(duk_context* ctx, int id) {
+		duk_push_object(ctx);
+		duk_push_int(ctx, id);
+		duk_put_prop_string(ctx, -2, "id");
+		return DukValue::take_from_stack(ctx);
+	}
+
+	int object_id(duk_context* ctx, const DukValue& value) {
+		value.push();
+		duk_get_prop_string(ctx, -1, "id");
+		int id = duk_get_int(ctx, -1);
+		duk_pop_2(ctx);
+		return id;
+	}
+}
+
+void test_ref_compaction()
+{
+	const int count = 5000;
+	for (int i = 0; i < count; i++)
+		crates.push_back(new Crate(i));
+
+	duk_context* ctx = duk_create_heap_default();
+
+	dukglue_register_method(ctx, &Crate::id, "id");
+	dukglue_register_function(ctx, &getCrate, "getCrate");
+
+	// native objects
+	test_eval(ctx, "var all = []; for (var i = 0; i < 5000; i++) all.push(getCrate(i));");
+	duk_pop(ctx);
+
+	DukglueRefStats stats = dukglue_get_ref_stats(ctx);
+	test_assert(stats.native_objects.live == count);
+	test_assert(stats.native_objects.free == 0);
+
+	// free most of them, the array is compacted once it's mostly empty
+	for (int i = 0; i < count; i++) {
+		if (i % 10 != 0)
+			dukglue_invalidate_object(ctx, crates[i]);
+	}
+
+	stats = dukglue_get_ref_stats(ctx);
+	test_assert(stats.native_objects.live == count / 10);
+	test_assert(stats.native_objects.free < 1024);
+
+	// identity and validity are kept for the objects that moved
+	test_eval_expect(ctx, "var same = 0; for (var i = 0; i < 5000; i += 10) if (getCrate(i) === all[i] && all[i].id() === i) same++; same", count / 10);
+	test_eval_expect_error(ctx, "all[1].id()");
+	test_eval_expect(ctx, "getCrate(1).id()", 1);
+
+	// explicit compaction
+	test_assert(dukglue_get_ref_stats(ctx).native_objects.free > 0);
+	dukglue_compact_refs(ctx);
+	stats = dukglue_get_ref_stats(ctx);
+	test_assert(stats.native_objects.free == 0);
+	test_assert(stats.native_objects.fragmentation() == 0.0);
+	test_eval_expect(ctx, "var same = 0; for (var i = 0; i < 5000; i += 10) if (getCrate(i) === all[i] && all[i].id() === i) same++; same", count / 10);
+
+	// slots are reused after compaction
+	test_eval(ctx, "getCrate(2); getCrate(3);");
+	duk_pop(ctx);
+	test_assert(dukglue_get_ref_stats(ctx).native_objects.live == count / 10 + 3);
+
+	// DukValues
+	{
+		std::vector<DukValue> values;
+		for (int i = 0; i < count; i++)
+			values.push_back(make_object(ctx, i));
+
+		// a copy shares the reference
+		DukValue copy = values[4990];
+
+		stats = dukglue_get_ref_stats(ctx);
+		test_assert(stats.dukvalues.live == count);
+
+		std::vector<DukValue> kept;
+		for (int i = 0; i < count; i += 10)
+			kept.push_back(values[i]);
+		values.clear();
+
+		stats = dukglue_get_ref_stats(ctx);
+		test_assert(stats.dukvalues.live == count / 10);
+		test_assert(stats.dukvalues.free < 1024);
+
+		for (int i = 0; i < count / 10; i++)
+			test_assert(object_id(ctx, kept[i]) == i * 10);
+		test_assert(object_id(ctx, copy) == 4990);
+		test_assert(copy == kept[499]);
+
+		dukglue_compact_refs(ctx);
+		test_assert(dukglue_get_ref_stats(ctx).dukvalues.free == 0);
+		for (int i = 0; i < count / 10; i++)
+			test_assert(object_id(ctx, kept[i]) == i * 10);
+
+		// the objects are still kept alive by the array
+		duk_gc(ctx, 0);
+		test_assert(object_id(ctx, kept[100]) == 1000);
+	}
+
+	stats = dukglue_get_ref_stats(ctx);
+	test_assert(stats.dukvalues.live == 0);
+
+	test_assert(duk_get_top(ctx) == 0);
+	duk_destroy_heap(ctx);
+
+	for (Crate* crate : crates)
+		delete crate;
+	crates.clear();
+
+	std::cout << "Ref compaction tested OK" << std::endl;
+}
@@ -0,0 +1,123 @@
+#include "test_assert.h"
+#include <dukglue/dukglue.h>
+
+#include <iostream>
+#include <memory>
+
+namespace {
+	class Texture {
+	public:
+		Texture(int id) : mId(id) {
+			sCount++;
+		}
+
+		~Texture() {
+			sCount--;
+		}
+
+		int id() const {
+			return mId;
+		}
+
+		static int count() {
+			return sCount;
+		}
+
+	private:
+		int mId;
+		static int sCount;
+	};
+
+	int Texture::sCount = 0;
+
+	std::shared_ptr<Texture> texture;
+
+	std::shared_ptr<Texture> getTexture() {
+		return texture;
+	}
+
+	std::shared_ptr<Texture> makeTexture(int id) {
+		return std::make_shared<Texture>(id);
+	}
+
+	long useCount(std::shared_ptr<Texture> tex) {
+		return tex.use_count();
+	}
+
+	std::size_t wrappers(duk_context* ctx) {
+		return dukglue::detail::DukglueHeapState::get(ctx)->shared_ptrs.size();
+	}
+}
+
+void test_shared_identity()
+{
+	duk_context* ctx = duk_create_heap_default();
+
+	dukglue_register_method(ctx, &Texture::id, "id");
+	dukglue_register_function(ctx, &getTexture, "getTexture");
+	dukglue_register_function(ctx, &makeTexture, "makeTexture");
+	dukglue_register_function(ctx, &useCount, "useCount");
+
+	texture = std::make_shared<Texture>(1);
+
+	// the same object gives the same wrapper, with its dynamic properties
+	test_eval_expect(ctx, "var t = getTexture(); t.tag = 'x'; getTexture() === t ? 1 : 0", 1);
+	test_eval_expect(ctx, "getTexture().tag", "x");
+	test_eval(ctx, "for (var i = 0; i < 1000; i++) getTexture();");
+	duk_pop(ctx);
+	test_assert(wrappers(ctx) == 1);
+
+	// one reference for the wrapper, no matter how often it was pushed
+	test_assert(texture.use_count() == 2);
+
+	// reading it back shares ownership
+	// (texture, the wrapper, the argument)
+	test_eval_expect(ctx, "useCount(t)", 3);
+
+	// the wrapper keeps the object alive
+	texture.reset();
+	test_assert(Texture::count() == 1);
+	test_eval_expect(ctx, "t.id()", 1);
+	test_eval_expect(ctx, "useCount(t)", 2);
+
+	// once the wrapper is collected, the object is released
+	test_eval(ctx, "t = null;");
+	duk_pop(ctx);
+	duk_gc(ctx, 0);
+	duk_gc(ctx, 0);
+	test_assert(Texture::count() == 0);
+	test_assert(wrappers(ctx) == 0);
+
+	// pushing an object again after its wrapper is gone makes a new wrapper
+	texture = std::make_shared<Texture>(2);
+	test_eval(ctx, "var a = getTexture(); a.tag = 'a';");
+	duk_pop(ctx);
+	test_eval(ctx, "a = null;");
+	duk_pop(ctx);
+	duk_gc(ctx, 0);
+	duk_gc(ctx, 0);
+	test_assert(wrappers(ctx) == 0);
+	test_assert(texture.use_count() == 1);
+	test_eval_expect(ctx, "getTexture().tag === undefined ? 1 : 0", 1);
+
+	// different objects get different wrappers
+	test_eval_expect(ctx, "makeTexture(3) !== makeTexture(3) ? 1 : 0", 1);
+	test_eval_expect(ctx, "makeTexture(4).id()", 4);
+
+	// null shared_ptrs are pushed as null
+	texture.reset();
+	test_eval_expect(ctx, "getTexture() === null ? 1 : 0", 1);
+
+	// wrappers still alive when the heap is destroyed release their objects
+	texture = std::make_shared<Texture>(5);
+	test_eval(ctx, "var kept = getTexture();");
+	duk_pop(ctx);
+	texture.reset();
+	duk_gc(ctx, 0);
+
+	test_assert(duk_get_top(ctx) == 0);
+	duk_destroy_heap(ctx);
+	test_assert(Texture::count() == 0);
+
+	std::cout << "shared_ptr identity tested OK" << std::endl;
+}
@@ -0,0 +1,89 @@
+#include "test_assert.h"
+#include <dukglue/dukglue.h>
+
+#include <iostream>
+#include <string>
+
+namespace {
+	class Vec2 {
+	public:
+		Vec2(int x, int y) : mX(x), mY(y) {}
+
+		int dot(const Vec2& other) const {
+			return mX * other.mX + mY * other.mY;
+		}
+
+		void add(Vec2* other) {
+			if (other == nullptr)
+				return;
+			mX += other->mX;
+			mY += other->mY;
+		}
+
+		int x() const {
+			return mX;
+		}
+
+	private:
+		int mX;
+		int mY;
+	};
+
+	class Vec3 : public Vec2 {
+	public:
+		Vec3(int x, int y, int z) : Vec2(x, y), mZ(z) {}
+
+	private:
+		int mZ;
+	};
+
+	std::string label(std::string name, int id, const char* suffix) {
+		return name + std::to_string(id) + suffix;
+	}
+}
+
+void test_trusted()
+{
+	duk_context* ctx = duk_create_heap_default();
+
+	dukglue_register_constructor<Vec2, int, int>(ctx, "Vec2");
+	dukglue_register_constructor<Vec3, int, int, int>(ctx, "Vec3");
+	dukglue_set_base_class<Vec2, Vec3>(ctx);
+
+	dukglue_set_trusted(ctx, true);
+	dukglue_register_method(ctx, &Vec2::dot, "dot");
+	dukglue_register_method(ctx, &Vec2::add, "add");
+	dukglue_register_function(ctx, &label, "label");
+	dukglue_register_function(ctx, [](int a, int b) { return a * b; }, "multiply");
+	dukglue_set_trusted(ctx, false);
+
+	dukglue_register_method(ctx, &Vec2::x, "x");
+	dukglue_register_function(ctx, &label, "labelChecked");
+
+	// well-typed calls behave the same as checked bindings
+	test_eval_expect(ctx, "var a = new Vec2(1, 2); var b = new Vec2(3, 4); a.dot(b)", 11);
+	test_eval_expect(ctx, "a.add(b); a.x()", 4);
+	test_eval_expect(ctx, "a.add(null); a.x()", 4);
+	test_eval_expect(ctx, "var c = new Vec3(1, 1, 1); a.dot(c)", 10);  // derived class
+	test_eval_expect(ctx, "label('item', 7, '!')", "item7!");
+	test_eval_expect(ctx, "multiply(6, 7)", 42);
+
+	// checks that are kept for trusted bindings
+	test_eval_expect_error(ctx, "a.dot(null)");  // reference can't be null
+	test_eval_expect_error(ctx, "Vec2.prototype.dot.call({}, b)");  // this must be a native object
+
+	// bindings registered after trusted mode was cleared still check
+	test_eval_expect_error(ctx, "labelChecked(7, 'item', '!')");
+
+#if DUKGLUE_CHECK_TRUSTED
+	// debug builds keep the checks for trusted bindings too
+	test_eval_expect_error(ctx, "label(7, 'item', '!')");
+	test_eval_expect_error(ctx, "a.dot({})");
+	test_eval_expect_error(ctx, "multiply('six', 7)");
+#endif
+
+	test_assert(duk_get_top(ctx) == 0);
+	duk_destroy_heap(ctx);
+
+	std::cout << "Trusted bindings tested OK" << std::endl;
+}
@@ -0,0 +1,179 @@
+#include "test_assert.h"
+#include <dukglue/dukglue.h>
+
+#include <iostream>
+#include <memory>
+
+namespace {
+	class Part {
+	public:
+		Part(int id) : mId(id) {
+			sCount++;
+		}
+
+		virtual ~Part() {
+			sCount--;
+		}
+
+		int id() const {
+			return mId;
+		}
+
+		Part* self() {
+			return this;
+		}
+
+		static int count() {
+			return sCount;
+		}
+
+	private:
+		int mId;
+		static int sCount;
+	};
+
+	int Part::sCount = 0;
+
+	class Gear : public Part {
+	public:
+		Gear(int id) : Part(id) {}
+
+		int teeth() const {
+			return 12;
+		}
+	};
+
+	std::unique_ptr<Part> stored;
+
+	std::unique_ptr<Part> makePart(int id) {
+		return std::unique_ptr<Part>(new Part(id));
+	}
+
+	std::unique_ptr<Gear> makeGear(int id) {
+		return std::unique_ptr<Gear>(new Gear(id));
+	}
+
+	std::unique_ptr<Part> makeNothing() {
+		return std::unique_ptr<Part>();
+	}
+
+	void store(std::unique_ptr<Part>&& part) {
+		stored = std::move(part);
+	}
+
+	int consume(std::unique_ptr<Part> part) {
+		return part ? part->id() : -1;
+	}
+
+	int consumeWith(std::unique_ptr<Part> part, int add) {
+		return part->id() + add;
+	}
+
+	int consumeTwo(std::unique_ptr<Part> a, std::unique_ptr<Part> b) {
+		return a->id() + b->id();
+	}
+
+	Part borrowed(7);
+
+	Part* getBorrowed() {
+		return &borrowed;
+	}
+}
+
+// scripts can give up Parts they construct (deleting them needs new)
+template<>
+struct dukglue_class_allocator<Part> : dukglue::new_delete_allocator<Part> {};
+
+void test_unique_ptr()
+{
+	duk_context* ctx = duk_create_heap_default();
+
+	dukglue_register_method(ctx, &Part::id, "id");
+	dukglue_register_method(ctx, &Part::self, "self");
+	dukglue_set_base_class<Part, Gear>(ctx);
+	dukglue_register_method(ctx, &Gear::teeth, "teeth");
+	dukglue_register_constructor_managed<Part, int>(ctx, "Part");
+
+	dukglue_register_function(ctx, &makePart, "makePart");
+	dukglue_register_function(ctx, &makeGear, "makeGear");
+	dukglue_register_function(ctx, &makeNothing, "makeNothing");
+	dukglue_register_function(ctx, &store, "store");
+	dukglue_register_function(ctx, &consume, "consume");
+	dukglue_register_function(ctx, &consumeWith, "consumeWith");
+	dukglue_register_function(ctx, &consumeTwo, "consumeTwo");
+	dukglue_register_function(ctx, &getBorrowed, "getBorrowed");
+
+	const int base = Part::count();  // borrowed
+
+	// returned objects are owned by their script object
+	test_eval_expect(ctx, "var p = makePart(1); p.id()", 1);
+	test_assert(Part::count() == base + 1);
+	test_eval_expect(ctx, "makeGear(2).teeth()", 12);
+	test_eval_expect(ctx, "makeNothing() === null ? 1 : 0", 1);
+
+	// and deleted when it is collected
+	test_eval(ctx, "p = null;");
+	duk_pop(ctx);
+	duk_gc(ctx, 0);
+	duk_gc(ctx, 0);
+	test_assert(Part::count() == base);
+
+	// taking ownership back (rvalue reference)
+	test_eval(ctx, "var q = makePart(3); store(q);");
+	duk_pop(ctx);
+	test_assert(stored && stored->id() == 3);
+	test_eval_expect_error(ctx, "q.id()");  // invalidated
+	test_eval_expect_error(ctx, "store(q)");  // can't take it twice
+	test_eval(ctx, "q = null;");
+	duk_pop(ctx);
+	duk_gc(ctx, 0);
+	duk_gc(ctx, 0);
+	test_assert(Part::count() == base + 1);  // not deleted by the script object
+	stored.reset();
+	test_assert(Part::count() == base);
+
+	// by value, and through a base class
+	test_eval_expect(ctx, "consume(makeGear(4))", 4);
+	test_assert(Part::count() == base);
+	test_eval_expect(ctx, "consume(null)", -1);
+
+	// ownership is only taken once every argument has been read
+	test_eval(ctx, "var t = makePart(9);");
+	duk_pop(ctx);
+	test_eval_expect_error(ctx, "consumeWith(t, 'not a number')");
+	test_eval_expect_error(ctx, "consumeTwo(t, t)");
+	test_eval_expect(ctx, "t.id()", 9);
+	test_assert(Part::count() == base + 1);
+	test_eval_expect(ctx, "consumeWith(t, 1)", 10);
+	test_assert(Part::count() == base);
+	test_eval_expect_error(ctx, "t.id()");
+
+	// objects constructed by scripts with a managed constructor are script-owned too
+	test_eval_expect(ctx, "var r = new Part(5); store(r); r.id === Part.prototype.id ? 1 : 0", 1);
+	test_assert(stored && stored->id() == 5);
+	stored.reset();
+
+	// objects not owned by scripts can't be taken
+	test_eval_expect_error(ctx, "store(getBorrowed())");
+	test_eval_expect(ctx, "getBorrowed().id()", 7);
+	test_eval_expect_error(ctx, "store({})");
+
+	// deleting an owned object invalidates script objects registered for its raw pointer
+	test_eval(ctx, "var s = makePart(6); var raw = s.self(); s = null;");
+	duk_pop(ctx);
+	duk_gc(ctx, 0);
+	duk_gc(ctx, 0);
+	test_assert(Part::count() == base);
+	test_eval_expect_error(ctx, "raw.id()");
+
+	// script-owned objects still alive are deleted with the heap
+	test_eval(ctx, "var kept = makePart(8);");
+	duk_pop(ctx);
+	test_assert(Part::count() == base + 1);
+
+	test_assert(duk_get_top(ctx) == 0);
+	duk_destroy_heap(ctx);
+	test_assert(Part::count() == base);
+
+	std::cout << "unique_ptr tested OK" << std::endl;
+}
@@ -0,0 +1,92 @@
+#include "test_assert.h"
+#include <dukglue/dukglue.h>
+
+#include <iostream>
+#include <vector>
+
+namespace {
+	class Particle {
+	public:
+		Particle(int id) : mId(id) {}
+
+		int id() const {
+			return mId;
+		}
+
+	private:
+		int mId;
+	};
+
+	std::vector<Particle*> particles;
+
+	Particle* getParticle(int i) {
+		return particles[i];
+	}
+
+	std::size_t registered(duk_context* ctx) {
+		return dukglue::detail::DukglueHeapState::get(ctx)->ref_map.size();
+	}
+}
+
+void test_weak_refs()
+{
+	for (int i = 0; i < 1000; i++)
+		particles.push_back(new Particle(i));
+
+	duk_context* ctx = duk_create_heap_default();
+
+	dukglue_register_constructor<Particle, int>(ctx, "Particle");
+	dukglue_register_method(ctx, &Particle::id, "id");
+	dukglue_register_function(ctx, &getParticle, "getParticle");
+
+	dukglue_set_weak_refs(ctx, true);
+
+	// identity is kept while the script object is alive
+	test_eval_expect(ctx, "var p = getParticle(3); p.tag = 'x'; getParticle(3) === p ? 1 : 0", 1);
+	test_eval_expect(ctx, "getParticle(3).tag", "x");
+	test_assert(registered(ctx) == 1);
+
+	// once it's gone, the registry forgets it and a new script object is made
+	test_eval(ctx, "p = null;");
+	duk_pop(ctx);
+	duk_gc(ctx, 0);
+	test_assert(registered(ctx) == 0);
+	test_eval_expect(ctx, "getParticle(3).tag === undefined ? 1 : 0", 1);
+	test_eval_expect(ctx, "getParticle(3).id()", 3);
+
+	// churn doesn't grow the registry
+	test_eval(ctx, "var sum = 0; for (var r = 0; r < 20; r++) for (var i = 0; i < 1000; i++) sum += getParticle(i).id();");
+	duk_pop(ctx);
+	duk_gc(ctx, 0);
+	test_assert(registered(ctx) == 0);
+
+	// invalidating a weakly registered object
+	test_eval(ctx, "var kept = getParticle(7);");
+	duk_pop(ctx);
+	dukglue_invalidate_object(ctx, particles[7]);
+	test_assert(registered(ctx) == 0);
+	test_eval_expect_error(ctx, "kept.id()");
+	test_eval_expect(ctx, "getParticle(7) !== kept ? 1 : 0", 1);
+
+	// objects constructed by scripts are still kept alive
+	test_eval(ctx, "var made = new Particle(42); made = null;");
+	duk_pop(ctx);
+	duk_gc(ctx, 0);
+	test_assert(registered(ctx) == 1);
+
+	// strong refs again
+	dukglue_set_weak_refs(ctx, false);
+	test_eval(ctx, "getParticle(10); getParticle(11);");
+	duk_pop(ctx);
+	duk_gc(ctx, 0);
+	test_assert(registered(ctx) == 3);
+
+	test_assert(duk_get_top(ctx) == 0);
+	duk_destroy_heap(ctx);
+
+	for (Particle* particle : particles)
+		delete particle;
+	particles.clear();
+
+	std::cout << "Weak refs tested OK" << std::endl;
+}